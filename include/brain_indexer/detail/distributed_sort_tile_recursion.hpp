@@ -141,17 +141,33 @@ inline TwoLevelSTRParams two_level_str_heuristic(size_t n_elements,
 template <typename Value, typename GetCoordinate>
 void distributed_sort_tile_recursion(std::vector<Value>& values,
                                      const DistributedSTRParams& str_params,
-                                     MPI_Comm mpi_comm) {
+                                     MPI_Comm mpi_comm,
+                                     size_t n_threads) {
     using STR = DistributedSortTileRecursion<Value, GetCoordinate, 0ul>;
-    return STR::apply(values, str_params, mpi_comm);
+    return STR::apply(values, str_params, mpi_comm, n_threads);
 }
 
 
+namespace detail {
+
+template <class Storage, class = void>
+struct has_collective_flush : std::false_type {};
+
+template <class Storage>
+struct has_collective_flush<
+    Storage,
+    std::void_t<decltype(std::declval<const Storage&>().flush_subtrees(MPI_Comm{}))>>
+    : std::true_type {};
+
+}  // namespace detail
+
+
 template <class GetCenterCoordinate, class Storage, class Value>
 void distributed_partition(const Storage& storage,
                            std::vector<Value>& values,
                            const TwoLevelSTRParams& str_params,
-                           MPI_Comm comm) {
+                           MPI_Comm comm,
+                           size_t n_threads) {
 
     if(values.size() < 10ul * mpi::size(comm)) {
         // If needed we need to carefully check that this will work. A
@@ -163,30 +179,24 @@ void distributed_partition(const Storage& storage,
     distributed_sort_tile_recursion<Value, GetCenterCoordinate>(
         values,
         str_params.distributed,
-        comm
+        comm,
+        n_threads
     );
 
     auto serial_str_params = SerialSTRParams{values.size(), str_params.local.n_parts_per_dim};
-    serial_sort_tile_recursion<Value, GetCenterCoordinate>(values, serial_str_params);
+    parallel_sort_tile_recursion<Value, GetCenterCoordinate>(values, serial_str_params, n_threads);
 
     auto mpi_rank = mpi::rank(comm);
 
     auto n_serial_parts = serial_str_params.n_parts();
     auto local_boundaries = serial_str_params.partition_boundaries();
-    auto local_bounding_boxes = std::vector<IndexedSubtreeBox>();
-    local_bounding_boxes.reserve(n_serial_parts);
-
-    for (size_t k = 0; k < n_serial_parts; ++k) {
-        util::check_signals();
-        auto subtree = typename Storage::subtree_type(
-            values.data() + local_boundaries[k],
-            values.data() + local_boundaries[k+1]
-        );
-
-        auto k_part = size_t(mpi_rank) * n_serial_parts + k;
-        storage.save_subtree(subtree, k_part);
+    auto local_bounding_boxes = detail::save_subtrees(
+        storage, values, local_boundaries, size_t(mpi_rank) * n_serial_parts, n_threads
+    );
 
-        local_bounding_boxes.push_back(IndexedSubtreeBox(k_part, subtree.size(), subtree.bounds()));
+    // Storage which completes its subtrees in a final step, e.g. `PackedStorage`.
+    if constexpr (detail::has_collective_flush<Storage>::value) {
+        storage.flush_subtrees(comm);
     }
 
     util::check_signals();
@@ -207,11 +217,12 @@ template <typename Value, typename GetCoordinate, size_t dim>
 void DistributedSortTileRecursion<Value, GetCoordinate, dim>::apply(
     std::vector<Value>& values,
     const DistributedSTRParams& str_params,
-    MPI_Comm mpi_comm) {
+    MPI_Comm mpi_comm,
+    size_t n_threads) {
 
     if constexpr (dim < 3) {
         util::check_signals();
-        DistributedMemorySorter<Value, Key>::sort_and_balance(values, mpi_comm);
+        DistributedMemorySorter<Value, Key>::sort_and_balance(values, mpi_comm, n_threads);
 
         if(dim == 2) {
             return;
@@ -223,7 +234,7 @@ void DistributedSortTileRecursion<Value, GetCoordinate, dim>::apply(
         auto sub_comm = mpi::comm_split(mpi_comm, color, k_rank_in_slice);
 
         // 2. Let them do STR.
-        STR<dim+1>::apply(values, str_params, *sub_comm);
+        STR<dim+1>::apply(values, str_params, *sub_comm, n_threads);
     }
 }
 
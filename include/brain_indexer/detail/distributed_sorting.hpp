@@ -11,14 +11,6 @@ inline size_t sum_local_counts(size_t local_count, MPI_Comm comm) {
 }
 
 
-template<class BeginIt, class EndIt, class Comparison>
-void node_local_sort(const BeginIt &begin_it,
-                     const EndIt &end_it,
-                     const Comparison &comparison) {
-    std::sort(begin_it, end_it, comparison);
-}
-
-
 template<class BeginIt, class EndIt>
 void node_local_sort(const BeginIt &begin_it, const EndIt &end_it) {
     std::sort(begin_it, end_it);
@@ -40,9 +32,10 @@ DistributedMemorySorter<T, Key>::~DistributedMemorySorter() {
 
 template<class T, class Key>
 void DistributedMemorySorter<T, Key>::sort_and_balance(Values &values,
-                                                       MPI_Comm comm) {
+                                                       MPI_Comm comm,
+                                                       size_t n_threads) {
     DistributedMemorySorter <T, Key> dms;
-    dms.sort(values, comm);
+    dms.sort(values, comm, n_threads);
     values = dms.balance(values, comm);
 }
 
@@ -88,7 +81,8 @@ auto DistributedMemorySorter<T, Key>::balance(const Values &values, MPI_Comm com
 
 template<class T, class Key>
 void DistributedMemorySorter<T, Key>::sort(Values &values,
-                                           MPI_Comm comm) {
+                                           MPI_Comm comm,
+                                           size_t n_threads) {
     size_t count = values.size();
 
     auto mpi_size = mpi::size(comm);
@@ -105,10 +99,7 @@ void DistributedMemorySorter<T, Key>::sort(Values &values,
         throw std::runtime_error("sort failed: value.size == 0.");
     }
 
-    auto cmp = [=](const Value &a, const Value &b) {
-        return Key::compare(a, b);
-    };
-    node_local_sort(values.begin(), values.end(), cmp);
+    sort_by_key<Key>(values.data(), values.data() + values.size(), n_threads);
 
     // For the locally sorted values select equally spaced samples.
     //
@@ -185,10 +176,12 @@ void DistributedMemorySorter<T, Key>::sort(Values &values,
         comm
     );
 
-    // Perform the final local sort.
-    node_local_sort(sorted.begin(), sorted.end(), cmp);
-
+    // The values have been sent; release them before the final local sort.
+    values = Values{};
     values.swap(sorted);
+
+    // Perform the final local sort.
+    sort_by_key<Key>(values.data(), values.data() + values.size(), n_threads);
 }
 
 template <class T>
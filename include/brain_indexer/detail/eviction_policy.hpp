@@ -0,0 +1,567 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief Take `last_victim` of a policy, which must be `subtree_id`.
+template <class Victim>
+inline Victim take_last_victim(std::optional<Victim>& last_victim, size_t subtree_id) {
+    if(!last_victim || last_victim->subtree_id != subtree_id) {
+        throw std::invalid_argument("Only the last victim can be put back.");
+    }
+
+    auto victim = *last_victim;
+    last_victim.reset();
+
+    return victim;
+}
+
+/// \brief The element after `it` in `list`, if any.
+template <class List, class Iterator>
+inline std::optional<size_t> next_subtree_id(const List& list, Iterator it) {
+    auto next = std::next(it);
+    if(next == list.end()) {
+        return std::nullopt;
+    }
+
+    return *next;
+}
+
+}  // namespace detail
+
+
+inline EvictionPolicy eviction_policy_from_string(const std::string& name) {
+    static const std::unordered_map<std::string, EvictionPolicy> policies = {
+        {"usage_rate", EvictionPolicy::usage_rate},
+        {"lru", EvictionPolicy::lru},
+        {"lfu", EvictionPolicy::lfu},
+        {"clock", EvictionPolicy::clock},
+        {"arc", EvictionPolicy::arc},
+    };
+
+    auto it = policies.find(name);
+    if(it == policies.end()) {
+        throw std::invalid_argument("Unknown eviction policy: " + name);
+    }
+
+    return it->second;
+}
+
+
+inline std::unique_ptr<SubtreeEvictionPolicy> make_eviction_policy(EvictionPolicy policy) {
+    switch(policy) {
+        case EvictionPolicy::usage_rate:
+            return std::make_unique<UsageRatePolicy>();
+        case EvictionPolicy::lru:
+            return std::make_unique<LRUPolicy>();
+        case EvictionPolicy::lfu:
+            return std::make_unique<LFUPolicy>();
+        case EvictionPolicy::clock:
+            return std::make_unique<ClockPolicy>();
+        case EvictionPolicy::arc:
+            return std::make_unique<ARCPolicy>();
+    }
+
+    throw std::invalid_argument("Invalid eviction policy.");
+}
+
+
+inline double
+SubtreeUsage::usage_rate(size_t query_count) const {
+    if (query_count == load_generation_) {
+        // These were loaded during this query. Try not to evict these. However,
+        // it's safe to evict these since the subtree that will be queried next
+        // will be loaded after this eviction; and therefore can't be evicted
+        // before it's ever used.
+        return std::numeric_limits<double>::max();
+    }
+
+    return double(access_count()) / double(incache_count(query_count));
+}
+
+inline size_t
+SubtreeUsage::access_count() const {
+    return previous_access_count_ + current_access_count_;
+}
+
+inline size_t
+SubtreeUsage::incache_count(size_t query_count) const {
+    return (query_count - load_generation_ + 1) + previous_age_;
+}
+
+inline size_t
+SubtreeUsage::eviction_count() const {
+    return eviction_count_;
+}
+
+inline void
+SubtreeUsage::on_query() {
+    ++current_access_count_;
+}
+
+inline void
+SubtreeUsage::on_load(size_t query_count) {
+    previous_load_generation_ = load_generation_;
+    load_generation_ = query_count;
+    current_access_count_ = 1;
+}
+
+inline void
+SubtreeUsage::on_load_failed() {
+    // Before loading, the subtree wasn't in cache; hence, had no current accesses.
+    load_generation_ = previous_load_generation_;
+    current_access_count_ = 0;
+}
+
+inline void
+SubtreeUsage::on_evict(size_t query_count) {
+    previous_access_count_ += current_access_count_;
+    previous_age_ = query_count - load_generation_ + 1;
+
+    current_access_count_ = 0;
+    eviction_count_ += 1;
+}
+
+
+inline void
+UsageRatePolicy::on_load(size_t subtree_id, size_t query_count) {
+    auto& state = states_[subtree_id];
+    if(!state.is_cached) {
+        state.is_cached = true;
+        ++n_cached_;
+    }
+
+    state.usage.on_load(query_count);
+}
+
+inline void
+UsageRatePolicy::on_access(size_t subtree_id, size_t /* query_count */) {
+    auto it = states_.find(subtree_id);
+    if(it != states_.end() && it->second.is_cached) {
+        it->second.usage.on_query();
+    }
+}
+
+inline std::optional<size_t>
+UsageRatePolicy::pop_victim(size_t query_count,
+                            const std::function<bool(size_t)>& is_evictable) {
+    last_victim_.reset();
+
+    std::vector<std::pair<double, size_t>> candidates;
+    candidates.reserve(n_cached_);
+    for(const auto& [id, state] : states_) {
+        if(state.is_cached) {
+            candidates.emplace_back(state.usage.usage_rate(query_count), id);
+        }
+    }
+
+    std::stable_sort(candidates.begin(),
+                     candidates.end(),
+                     [](const auto& l, const auto& r) { return l.first < r.first; });
+
+    for(const auto& [_, id] : candidates) {
+        if(is_evictable(id)) {
+            auto& state = states_[id];
+            last_victim_ = Victim{id, state.usage};
+            state.usage.on_evict(query_count);
+            state.is_cached = false;
+            --n_cached_;
+
+            return id;
+        }
+    }
+
+    return std::nullopt;
+}
+
+inline void
+UsageRatePolicy::on_evict_aborted(size_t subtree_id) {
+    auto victim = detail::take_last_victim(last_victim_, subtree_id);
+
+    auto& state = states_[subtree_id];
+    state.usage = victim.usage;
+    if(!state.is_cached) {
+        state.is_cached = true;
+        ++n_cached_;
+    }
+}
+
+
+inline void
+LRUPolicy::on_load(size_t subtree_id, size_t query_count) {
+    auto it = positions_.find(subtree_id);
+    if(it != positions_.end()) {
+        on_access(subtree_id, query_count);
+        return;
+    }
+
+    order_.push_front(subtree_id);
+    positions_[subtree_id] = order_.begin();
+}
+
+inline void
+LRUPolicy::on_access(size_t subtree_id, size_t /* query_count */) {
+    auto it = positions_.find(subtree_id);
+    if(it != positions_.end()) {
+        order_.splice(order_.begin(), order_, it->second);
+    }
+}
+
+inline std::optional<size_t>
+LRUPolicy::pop_victim(size_t /* query_count */,
+                      const std::function<bool(size_t)>& is_evictable) {
+    last_victim_.reset();
+
+    for(auto it = order_.rbegin(); it != order_.rend(); ++it) {
+        auto id = *it;
+        if(is_evictable(id)) {
+            auto position = std::next(it).base();
+            last_victim_ = Victim{id, detail::next_subtree_id(order_, position)};
+
+            order_.erase(position);
+            positions_.erase(id);
+            return id;
+        }
+    }
+
+    return std::nullopt;
+}
+
+inline void
+LRUPolicy::on_evict_aborted(size_t subtree_id) {
+    auto victim = detail::take_last_victim(last_victim_, subtree_id);
+
+    auto position = order_.end();
+    if(victim.next) {
+        auto next = positions_.find(*victim.next);
+        if(next != positions_.end()) {
+            position = next->second;
+        }
+    }
+
+    auto it = order_.insert(position, subtree_id);
+    positions_[subtree_id] = it;
+}
+
+
+inline void
+LFUPolicy::on_load(size_t subtree_id, size_t query_count) {
+    if(positions_.count(subtree_id) != 0) {
+        on_access(subtree_id, query_count);
+        return;
+    }
+
+    if(buckets_.empty() || buckets_.front().frequency != 1) {
+        buckets_.push_front(Bucket{1, {}});
+    }
+
+    auto bucket = buckets_.begin();
+    bucket->subtree_ids.push_front(subtree_id);
+    positions_[subtree_id] = Position{bucket, bucket->subtree_ids.begin()};
+}
+
+inline void
+LFUPolicy::on_access(size_t subtree_id, size_t /* query_count */) {
+    auto it = positions_.find(subtree_id);
+    if(it == positions_.end()) {
+        return;
+    }
+
+    auto& position = it->second;
+    auto bucket = position.bucket;
+    auto next = std::next(bucket);
+    if(next == buckets_.end() || next->frequency != bucket->frequency + 1) {
+        next = buckets_.insert(next, Bucket{bucket->frequency + 1, {}});
+    }
+
+    // Splicing doesn't invalidate `position.it`.
+    next->subtree_ids.splice(next->subtree_ids.begin(), bucket->subtree_ids, position.it);
+    position.bucket = next;
+
+    if(bucket->subtree_ids.empty()) {
+        buckets_.erase(bucket);
+    }
+}
+
+inline std::optional<size_t>
+LFUPolicy::pop_victim(size_t /* query_count */,
+                      const std::function<bool(size_t)>& is_evictable) {
+    last_victim_.reset();
+
+    for(auto& bucket : buckets_) {
+        const auto& ids = bucket.subtree_ids;
+        for(auto it = ids.rbegin(); it != ids.rend(); ++it) {
+            auto id = *it;
+            if(is_evictable(id)) {
+                const auto& position = positions_.at(id);
+                last_victim_ = Victim{id,
+                                      bucket.frequency,
+                                      detail::next_subtree_id(ids, position.it)};
+
+                erase(id, position);
+                return id;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+inline void
+LFUPolicy::on_evict_aborted(size_t subtree_id) {
+    auto victim = detail::take_last_victim(last_victim_, subtree_id);
+
+    auto next = victim.next ? positions_.find(*victim.next) : positions_.end();
+    if(next != positions_.end() && next->second.bucket->frequency == victim.frequency) {
+        auto bucket = next->second.bucket;
+        auto it = bucket->subtree_ids.insert(next->second.it, subtree_id);
+        positions_[subtree_id] = Position{bucket, it};
+        return;
+    }
+
+    // The bucket may have been removed; finding its place isn't constant
+    // time, but aborted evictions are rare.
+    auto bucket = std::find_if(buckets_.begin(), buckets_.end(), [&victim](const Bucket& b) {
+        return b.frequency >= victim.frequency;
+    });
+
+    if(bucket == buckets_.end() || bucket->frequency != victim.frequency) {
+        bucket = buckets_.insert(bucket, Bucket{victim.frequency, {}});
+    }
+
+    auto it = bucket->subtree_ids.insert(bucket->subtree_ids.end(), subtree_id);
+    positions_[subtree_id] = Position{bucket, it};
+}
+
+inline void
+LFUPolicy::erase(size_t subtree_id, const Position& position) {
+    auto bucket = position.bucket;
+    bucket->subtree_ids.erase(position.it);
+    if(bucket->subtree_ids.empty()) {
+        buckets_.erase(bucket);
+    }
+
+    positions_.erase(subtree_id);
+}
+
+
+inline void
+ClockPolicy::on_load(size_t subtree_id, size_t query_count) {
+    if(positions_.count(subtree_id) != 0) {
+        on_access(subtree_id, query_count);
+        return;
+    }
+
+    // Right behind the hand, i.e. it's the last one the hand reaches.
+    positions_[subtree_id] = slots_.insert(hand_, Slot{subtree_id, true});
+}
+
+inline void
+ClockPolicy::on_access(size_t subtree_id, size_t /* query_count */) {
+    auto it = positions_.find(subtree_id);
+    if(it != positions_.end()) {
+        it->second->is_referenced = true;
+    }
+}
+
+inline std::optional<size_t>
+ClockPolicy::pop_victim(size_t /* query_count */,
+                        const std::function<bool(size_t)>& is_evictable) {
+    last_victim_.reset();
+
+    // After one round all reference bits are cleared, after the second every
+    // subtree has been checked.
+    auto n_steps = 2 * slots_.size();
+    for(size_t k = 0; k < n_steps; ++k) {
+        if(hand_ == slots_.end()) {
+            hand_ = slots_.begin();
+        }
+
+        auto& slot = *hand_;
+        if(slot.is_referenced) {
+            slot.is_referenced = false;
+        }
+        else if(is_evictable(slot.subtree_id)) {
+            auto id = slot.subtree_id;
+            hand_ = slots_.erase(hand_);
+            positions_.erase(id);
+            last_victim_ = Victim{id};
+            return id;
+        }
+
+        ++hand_;
+    }
+
+    return std::nullopt;
+}
+
+inline void
+ClockPolicy::on_evict_aborted(size_t subtree_id) {
+    detail::take_last_victim(last_victim_, subtree_id);
+
+    // The hand points at the victim again, as it did when it was chosen.
+    hand_ = slots_.insert(hand_, Slot{subtree_id, false});
+    positions_[subtree_id] = hand_;
+}
+
+
+inline std::list<size_t>&
+ARCPolicy::list(ListId list_id) {
+    switch(list_id) {
+        case ListId::t1:
+            return t1_;
+        case ListId::t2:
+            return t2_;
+        case ListId::b1:
+            return b1_;
+        case ListId::b2:
+            return b2_;
+    }
+
+    throw std::invalid_argument("Invalid list.");
+}
+
+inline void
+ARCPolicy::move_to_front(size_t subtree_id, ListId list_id) {
+    auto& to = list(list_id);
+
+    auto it = positions_.find(subtree_id);
+    if(it == positions_.end()) {
+        to.push_front(subtree_id);
+        positions_[subtree_id] = Position{list_id, to.begin()};
+        return;
+    }
+
+    auto& position = it->second;
+    to.splice(to.begin(), list(position.list_id), position.it);
+    position.list_id = list_id;
+}
+
+inline void
+ARCPolicy::on_load(size_t subtree_id, size_t /* query_count */) {
+    auto it = positions_.find(subtree_id);
+    if(it == positions_.end()) {
+        move_to_front(subtree_id, ListId::t1);
+    }
+    else {
+        auto capacity = double(size() + 1);
+        auto n_b1 = double(b1_.size());
+        auto n_b2 = double(b2_.size());
+
+        switch(it->second.list_id) {
+            case ListId::b1:
+                p_ = std::min(capacity, p_ + std::max(1.0, n_b2 / n_b1));
+                break;
+            case ListId::b2:
+                p_ = std::max(0.0, p_ - std::max(1.0, n_b1 / n_b2));
+                break;
+            default:
+                break;
+        }
+
+        move_to_front(subtree_id, ListId::t2);
+    }
+
+    trim_ghosts();
+}
+
+inline void
+ARCPolicy::on_access(size_t subtree_id, size_t /* query_count */) {
+    auto it = positions_.find(subtree_id);
+    if(it == positions_.end()) {
+        return;
+    }
+
+    auto list_id = it->second.list_id;
+    if(list_id == ListId::t1 || list_id == ListId::t2) {
+        move_to_front(subtree_id, ListId::t2);
+    }
+}
+
+inline std::optional<size_t>
+ARCPolicy::pop_victim(size_t /* query_count */,
+                      const std::function<bool(size_t)>& is_evictable) {
+    last_victim_.reset();
+
+    bool prefer_t1 = !t1_.empty() && (double(t1_.size()) > p_ || t2_.empty());
+
+    auto victim = prefer_t1 ? pop_victim(ListId::t1, ListId::b1, is_evictable)
+                            : pop_victim(ListId::t2, ListId::b2, is_evictable);
+
+    if(!victim) {
+        victim = prefer_t1 ? pop_victim(ListId::t2, ListId::b2, is_evictable)
+                           : pop_victim(ListId::t1, ListId::b1, is_evictable);
+    }
+
+    trim_ghosts();
+    return victim;
+}
+
+inline std::optional<size_t>
+ARCPolicy::pop_victim(ListId from,
+                      ListId ghost,
+                      const std::function<bool(size_t)>& is_evictable) {
+    const auto& ids = list(from);
+    for(auto it = ids.rbegin(); it != ids.rend(); ++it) {
+        auto id = *it;
+        if(is_evictable(id)) {
+            last_victim_ = Victim{id, from, detail::next_subtree_id(ids, positions_.at(id).it)};
+            move_to_front(id, ghost);
+            return id;
+        }
+    }
+
+    return std::nullopt;
+}
+
+inline void
+ARCPolicy::on_evict_aborted(size_t subtree_id) {
+    auto victim = detail::take_last_victim(last_victim_, subtree_id);
+
+    // Unlike `on_load`, this isn't a hit in the ghosts; `p_` is unchanged.
+    auto ghost = positions_.find(subtree_id);
+    if(ghost != positions_.end()) {
+        list(ghost->second.list_id).erase(ghost->second.it);
+        positions_.erase(ghost);
+    }
+
+    auto& to = list(victim.list_id);
+    auto position = to.end();
+    if(victim.next) {
+        auto next = positions_.find(*victim.next);
+        if(next != positions_.end() && next->second.list_id == victim.list_id) {
+            position = next->second.it;
+        }
+    }
+
+    auto it = to.insert(position, subtree_id);
+    positions_[subtree_id] = Position{victim.list_id, it};
+}
+
+inline void
+ARCPolicy::trim_ghosts() {
+    auto capacity = std::max(size(), size_t(1));
+
+    auto forget_oldest = [this](std::list<size_t>& ghosts) {
+        positions_.erase(ghosts.back());
+        ghosts.pop_back();
+    };
+
+    while(!b1_.empty() && t1_.size() + b1_.size() > capacity) {
+        forget_oldest(b1_);
+    }
+
+    while(!b2_.empty() && size() + b1_.size() + b2_.size() > 2 * capacity) {
+        forget_oldest(b2_);
+    }
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+
+template <class Value>
+SpillFile<Value>::SpillFile(std::string filename)
+    : filename_(std::move(filename)),
+      file_(std::make_unique<detail::PosixFile>(filename_, O_RDWR | O_CREAT | O_TRUNC)) {}
+
+
+template <class Value>
+SpillFile<Value>::~SpillFile() {
+    file_.reset();
+    ::unlink(filename_.c_str());
+}
+
+
+template <class Value>
+void SpillFile<Value>::append(const Value* values, size_t n_values) {
+    file_->pwrite_all(reinterpret_cast<const char*>(values),
+                      n_values * sizeof(Value),
+                      n_values_ * sizeof(Value));
+    n_values_ += n_values;
+}
+
+
+template <class Value>
+void SpillFile<Value>::read(Value* values, size_t n_values, size_t offset) const {
+    if(offset + n_values > n_values_) {
+        throw std::out_of_range("Reading past the end of: " + filename_);
+    }
+
+    file_->pread_all(reinterpret_cast<char*>(values),
+                     n_values * sizeof(Value),
+                     offset * sizeof(Value));
+}
+
+
+namespace detail {
+
+/// \brief Reads a run sequentially, one block at a time.
+template <class Value>
+class SpillFileReader {
+  public:
+    inline SpillFileReader(const SpillFile<Value>& file, size_t values_per_block)
+        : file_(&file), values_per_block_(values_per_block) {
+        fill();
+    }
+
+    inline bool empty() const noexcept {
+        return next_ == buffer_.size();
+    }
+
+    inline const Value& front() const noexcept {
+        return buffer_[next_];
+    }
+
+    inline void pop_front() {
+        ++next_;
+        if(empty()) {
+            fill();
+        }
+    }
+
+  private:
+    inline void fill() {
+        auto n_values = std::min(values_per_block_, file_->size() - offset_);
+        buffer_.resize(n_values);
+        file_->read(buffer_.data(), n_values, offset_);
+
+        offset_ += n_values;
+        next_ = 0;
+    }
+
+    const SpillFile<Value>* file_;
+    size_t values_per_block_;
+    size_t offset_ = 0;
+
+    std::vector<Value> buffer_;
+    size_t next_ = 0;
+};
+
+
+/// \brief Calls `f(value)` for every value of the `runs`, in the order defined by `Key`.
+template <class Key, class Value, class F>
+void merge_runs(const std::vector<std::unique_ptr<SpillFile<Value>>>& runs,
+                size_t values_per_block,
+                F&& f) {
+    auto readers = std::vector<SpillFileReader<Value>>();
+    readers.reserve(runs.size());
+    for(const auto& run : runs) {
+        readers.emplace_back(*run, values_per_block);
+    }
+
+    // A min-heap of the runs by their first value. Ties are broken by the
+    // index of the run, such that the merge is stable.
+    auto is_after = [&readers](size_t i, size_t j) {
+        const auto& a = readers[i].front();
+        const auto& b = readers[j].front();
+
+        if(Key::compare(b, a)) {
+            return true;
+        }
+
+        return !Key::compare(a, b) && j < i;
+    };
+
+    auto heap = std::vector<size_t>();
+    heap.reserve(readers.size());
+    for(size_t i = 0; i < readers.size(); ++i) {
+        if(!readers[i].empty()) {
+            heap.push_back(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), is_after);
+
+    size_t n_merged = 0;
+    while(!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), is_after);
+        auto& reader = readers[heap.back()];
+
+        f(reader.front());
+        reader.pop_front();
+
+        if(reader.empty()) {
+            heap.pop_back();
+        } else {
+            std::push_heap(heap.begin(), heap.end(), is_after);
+        }
+
+        if(++n_merged % values_per_block == 0) {
+            util::check_signals();
+        }
+    }
+}
+
+}  // namespace detail
+
+
+template <class Value, class GetCoordinate>
+ExternalSortTileRecursion<Value, GetCoordinate>::ExternalSortTileRecursion(
+    ExternalSTRParams params)
+    : params_(std::move(params)) {
+
+    if(params_.values_per_block == 0
+       || params_.max_values_in_bucket() < params_.values_per_block) {
+        throw std::invalid_argument(
+            "The memory of the out-of-core STR is too small for its block size.");
+    }
+}
+
+
+template <class Value, class GetCoordinate>
+auto ExternalSortTileRecursion<Value, GetCoordinate>::make_run() -> run_type {
+    auto filename = "run-" + std::to_string(next_run_id_++) + ".bin";
+    return std::make_unique<SpillFile<Value>>(
+        (std::filesystem::path(params_.scratch_dir) / filename).string()
+    );
+}
+
+
+template <class Value, class GetCoordinate>
+void ExternalSortTileRecursion<Value, GetCoordinate>::spill(std::vector<Value>& values) {
+    if(values.empty()) {
+        return;
+    }
+
+    using Key = STRKey<GetCoordinate, 0ul>;
+
+    util::check_signals();
+    radix_sort<Key>(values.data(), values.data() + values.size(), params_.n_threads);
+
+    auto run = make_run();
+    run->append(values.data(), values.size());
+    runs_.push_back(std::move(run));
+
+    n_values_ += values.size();
+    values.clear();
+}
+
+
+template <class Value, class GetCoordinate>
+template <class F>
+void ExternalSortTileRecursion<Value, GetCoordinate>::for_each_bucket(
+    const SerialSTRParams& str_params, F&& f) {
+
+    auto runs = std::move(runs_);
+    auto n_values = n_values_;
+
+    runs_.clear();
+    n_values_ = 0;
+
+    size_t next_part = 0;
+    partition_bucket<0ul>(std::move(runs), n_values, str_params, next_part, f);
+}
+
+
+template <class Value, class GetCoordinate>
+template <size_t dim>
+auto ExternalSortTileRecursion<Value, GetCoordinate>::reduce_runs(std::vector<run_type> runs)
+    -> std::vector<run_type> {
+
+    using Key = STRKey<GetCoordinate, dim>;
+
+    auto fan_in = params_.max_fan_in();
+    auto values_per_block = params_.values_per_block;
+
+    while(runs.size() > fan_in) {
+        auto merged_runs = std::vector<run_type>();
+
+        for(size_t i = 0; i < runs.size(); i += fan_in) {
+            auto group = std::vector<run_type>(
+                std::make_move_iterator(runs.begin() + std::ptrdiff_t(i)),
+                std::make_move_iterator(runs.begin() + std::ptrdiff_t(std::min(i + fan_in, runs.size())))
+            );
+
+            if(group.size() == 1) {
+                merged_runs.push_back(std::move(group[0]));
+                continue;
+            }
+
+            auto run = make_run();
+            auto buffer = std::vector<Value>();
+            buffer.reserve(values_per_block);
+
+            detail::merge_runs<Key>(group, values_per_block, [&](const Value& value) {
+                buffer.push_back(value);
+                if(buffer.size() == values_per_block) {
+                    run->append(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            });
+            run->append(buffer.data(), buffer.size());
+
+            // The merged runs are removed here.
+            merged_runs.push_back(std::move(run));
+        }
+
+        runs = std::move(merged_runs);
+    }
+
+    return runs;
+}
+
+
+template <class Value, class GetCoordinate>
+template <size_t dim, class F>
+void ExternalSortTileRecursion<Value, GetCoordinate>::partition_bucket(
+    std::vector<run_type> runs,
+    size_t n_values,
+    const SerialSTRParams& str_params,
+    size_t& next_part,
+    F& f) {
+
+    // A part is always loaded, even if the heuristic made it a little too big.
+    if(dim == 3 || n_values <= params_.max_values_in_bucket()) {
+        auto values = std::vector<Value>(n_values);
+
+        size_t offset = 0;
+        for(const auto& run : runs) {
+            run->read(values.data() + offset, run->size(), 0);
+            offset += run->size();
+        }
+        runs.clear();
+
+        SerialSortTileRecursion<Value, GetCoordinate, dim>::apply(values, 0, n_values, str_params);
+
+        auto boundaries = detail::str_partition_boundaries(n_values, str_params.n_parts_per_dim, dim);
+        f(values, boundaries, next_part);
+        next_part += boundaries.size() - 1;
+
+        return;
+    }
+
+    if constexpr (dim < 3) {
+        using Key = STRKey<GetCoordinate, dim>;
+
+        runs = reduce_runs<dim>(std::move(runs));
+
+        // Merge the runs and split the result into `n_buckets` buckets; each
+        // is written as runs sorted along the next axis.
+        auto n_buckets = str_params.n_parts_per_dim[dim];
+        auto buckets = std::vector<std::vector<run_type>>(n_buckets);
+
+        auto max_buffered = params_.max_values_in_bucket();
+        auto buffer = std::vector<Value>();
+        buffer.reserve(std::min(n_values, max_buffered));
+
+        size_t k_bucket = 0;
+        size_t n_merged = 0;
+        auto bucket_end = util::balanced_chunks(n_values, n_buckets, k_bucket).high;
+
+        auto spill_buffer = [&]() {
+            if(buffer.empty()) {
+                return;
+            }
+
+            if constexpr (dim + 1 < 3) {
+                using NextKey = STRKey<GetCoordinate, dim + 1>;
+
+                util::check_signals();
+                radix_sort<NextKey>(buffer.data(), buffer.data() + buffer.size(), params_.n_threads);
+            }
+
+            auto run = make_run();
+            run->append(buffer.data(), buffer.size());
+            buckets[k_bucket].push_back(std::move(run));
+            buffer.clear();
+        };
+
+        detail::merge_runs<Key>(runs, params_.values_per_block, [&](const Value& value) {
+            while(n_merged == bucket_end && k_bucket + 1 < n_buckets) {
+                spill_buffer();
+                ++k_bucket;
+                bucket_end = util::balanced_chunks(n_values, n_buckets, k_bucket).high;
+            }
+
+            buffer.push_back(value);
+            ++n_merged;
+
+            if(buffer.size() == max_buffered) {
+                spill_buffer();
+            }
+        });
+        spill_buffer();
+
+        runs.clear();
+        buffer = std::vector<Value>();
+
+        for(size_t k = 0; k < n_buckets; ++k) {
+            auto range = util::balanced_chunks(n_values, n_buckets, k);
+            partition_bucket<dim + 1>(
+                std::move(buckets[k]), range.high - range.low, str_params, next_part, f
+            );
+        }
+    }
+}
+
+
+template <class GetCenterCoordinate, class Storage, class Value>
+void external_partition(const Storage& storage,
+                        ExternalSortTileRecursion<Value, GetCenterCoordinate>& str,
+                        const SerialSTRParams& str_params) {
+
+    auto n_threads = str.params().n_threads;
+    auto top_level_boxes = std::vector<IndexedSubtreeBox>();
+
+    str.for_each_bucket(str_params, [&](const std::vector<Value>& values,
+                                        const std::vector<size_t>& boundaries,
+                                        size_t first_part) {
+
+        auto boxes = detail::save_subtrees(storage, values, boundaries, first_part, n_threads);
+        top_level_boxes.insert(top_level_boxes.end(), boxes.begin(), boxes.end());
+    });
+
+    detail::save_top_tree(storage, top_level_boxes);
+}
+
+}  // namespace brain_indexer
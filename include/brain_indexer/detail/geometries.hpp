@@ -84,6 +84,20 @@ inline CoordType distance_segment_segment(Point3D const& s1_0, Point3D const& s1
     return std::sqrt(square_distance_segment_segment(s1_0, s1_1, s2_0, s2_1));
 }
 
+/// \brief The square of the distance from `x` to the segment from `s_0` to `s_1`.
+inline CoordType square_distance_point_segment(Point3D const& x,
+                                               Point3D const& s_0, Point3D const& s_1) {
+    const auto dir = Point3Dx(s_1) - s_0;
+    const auto dir_dot_dir = dir.norm_sq();
+    if (dir_dot_dir == CoordType(0)) {
+        return (Point3Dx(x) - s_0).norm_sq();
+    }
+
+    const auto x_rel = std::clamp((Point3Dx(x) - s_0).dot(dir) / dir_dot_dir,
+                                  CoordType(0), CoordType(1));
+    return (Point3Dx(x) - (Point3Dx(s_0) + x_rel * dir)).norm_sq();
+}
+
 }  // namespace detail
 
 
@@ -326,6 +340,17 @@ inline bool Cylinder::contains(Point3D const& p) const {
 }
 
 
+inline CoordType Cylinder::distance(Point3D const& p) const {
+    // Zero exactly if `p` is inside the capsule, hence the comparison of the squares.
+    const auto dist_sq = detail::square_distance_point_segment(p, p1, p2);
+    if (dist_sq <= radius * radius) {
+        return CoordType(0);
+    }
+
+    return std::max(std::sqrt(dist_sq) - radius, CoordType(0));
+}
+
+
 // String representation
 
 inline std::ostream& operator<<(std::ostream& os, const Sphere& s) {
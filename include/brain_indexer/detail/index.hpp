@@ -2,14 +2,22 @@
 
 #include "../index.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <type_traits>
 
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
+#include <boost/geometry/index/detail/rtree/utilities/view.hpp>
 #include <boost/iterator/function_output_iterator.hpp>
+#include <boost/version.hpp>
 
 #include "output_iterators.hpp"
+#include "../work_stealing.hpp"
 
 namespace brain_indexer {
 
@@ -93,9 +101,11 @@ template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline decltype(auto) 
 IndexTreeMixin<Derived, T>::find_intersecting_np(const ShapeT& shape) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
     using getter_t = iter_entry_getter<T>;
     typename getter_t::result_t result;
-    find_intersecting<GeometryMode>(shape, getter_t(result));
+    derived.template find_intersecting<GeometryMode>(shape, getter_t(result));
     return result;
 }
 
@@ -103,12 +113,14 @@ IndexTreeMixin<Derived, T>::find_intersecting_np(const ShapeT& shape) const {
 template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline size_t IndexTreeMixin<Derived, T>::count_intersecting(const ShapeT& shape) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
     size_t cardinality = 0; // number of matches in set
     auto counter = boost::make_function_output_iterator(
         [&cardinality](const auto&) { ++cardinality; }
     );
 
-    find_intersecting<GeometryMode>(shape, counter);
+    derived.template find_intersecting<GeometryMode>(shape, counter);
     return cardinality;
 }
 
@@ -116,6 +128,8 @@ template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline std::unordered_map<identifier_t, size_t>
 IndexTreeMixin<Derived, T>::count_intersecting_agg_gid(const ShapeT& shape) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
     std::unordered_map<identifier_t, size_t> counts;
     auto counter = boost::make_function_output_iterator(
         [&counts](const auto& elem) {
@@ -123,10 +137,290 @@ IndexTreeMixin<Derived, T>::count_intersecting_agg_gid(const ShapeT& shape) cons
         }
     );
 
-    find_intersecting<GeometryMode>(shape, counter);
+    derived.template find_intersecting<GeometryMode>(shape, counter);
     return counts;
 }
 
+namespace detail {
+
+// Number of chunks into which a batch of `n_queries` is split. Several chunks
+// per thread are needed, since the cost of individual queries varies greatly.
+inline size_t n_batch_chunks(size_t n_queries, size_t n_threads) {
+    return std::min(n_queries, n_threads == 1 ? size_t(1) : 16 * n_threads);
+}
+
+// Concatenates the results of consecutive chunks of a batch of queries. The
+// chunks are moved into the output one after the other, and each field of a
+// chunk is released as soon as it has been appended. Hence, at any time, only
+// one field of one chunk exists twice.
+template <typename Element>
+inline batch_query_result<Element>
+concatenate_batch_results(std::vector<batch_query_result<Element>>& parts) {
+    if(parts.size() == 1) {
+        return std::move(parts[0]);
+    }
+
+    size_t n_matches = 0;
+    size_t n_queries = 0;
+    for(const auto& part : parts) {
+        n_matches += part.values.size();
+        n_queries += part.offsets.size() - 1;
+    }
+
+    batch_query_result<Element> result;
+    result.offsets.reserve(n_queries + 1);
+    result.offsets.push_back(0);
+
+    // Only reserves address space; the pages are touched as the chunks are
+    // appended.
+    query_result<Element>::for_each_field(
+        [n_matches](auto& field) { field.reserve(n_matches); },
+        result.values
+    );
+
+    for(auto& part : parts) {
+        auto part_offset = result.offsets.back();
+        for(size_t i = 1; i < part.offsets.size(); ++i) {
+            result.offsets.push_back(part_offset + part.offsets[i]);
+        }
+
+        query_result<Element>::for_each_field(
+            [](auto& out, auto& in) {
+                out.insert(out.end(),
+                           std::make_move_iterator(in.begin()),
+                           std::make_move_iterator(in.end()));
+                in = std::decay_t<decltype(in)>{};
+            },
+            result.values, part.values
+        );
+
+        part = batch_query_result<Element>{};
+    }
+
+    return result;
+}
+
+// The inverse of the permutation `order`, i.e. `position[order[j]] == j`.
+inline std::vector<size_t> inverse_permutation(const std::vector<size_t>& order) {
+    std::vector<size_t> position(order.size());
+    for(size_t j = 0; j < order.size(); ++j) {
+        position[order[j]] = j;
+    }
+
+    return position;
+}
+
+// The results of a batch of queries performed in the order `order`, i.e. the
+// `j`-th query of `scheduled` is query `order[j]`, rearranged into the
+// original order of the queries.
+template <typename Element>
+inline batch_query_result<Element>
+unpermute_batch_results(const batch_query_result<Element>& scheduled,
+                        const std::vector<size_t>& order,
+                        const WorkStealingExecutor& executor) {
+    auto n_queries = order.size();
+    auto position = inverse_permutation(order);
+
+    batch_query_result<Element> result;
+    result.offsets.resize(n_queries + 1);
+    result.offsets[0] = 0;
+    for(size_t i = 0; i < n_queries; ++i) {
+        auto j = position[i];
+        auto n_matches = scheduled.offsets[j + 1] - scheduled.offsets[j];
+        result.offsets[i + 1] = result.offsets[i] + n_matches;
+    }
+
+    query_result<Element>::for_each_field(
+        [n_matches = result.offsets.back()](auto& field) { field.resize(n_matches); },
+        result.values
+    );
+
+    auto n_chunks = n_batch_chunks(n_queries, executor.n_threads());
+    executor.for_each(n_chunks, [&](size_t k) {
+        auto range = util::balanced_chunks(n_queries, n_chunks, k);
+        for(size_t i = range.low; i < range.high; ++i) {
+            auto j = position[i];
+            query_result<Element>::for_each_field(
+                [&](auto& out, const auto& in) {
+                    std::copy(in.begin() + scheduled.offsets[j],
+                              in.begin() + scheduled.offsets[j + 1],
+                              out.begin() + result.offsets[i]);
+                },
+                result.values, scheduled.values
+            );
+        }
+    });
+
+    return result;
+}
+
+}  // namespace detail
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT, typename OutputIt>
+inline std::vector<size_t>
+IndexTreeMixin<Derived, T>::find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                    const OutputIt& iter) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
+    auto order = derived.schedule(shapes);
+
+    std::vector<size_t> offsets;
+    offsets.reserve(shapes.size() + 1);
+    offsets.push_back(0);
+
+    size_t n_matches = 0;
+    auto out = iter;
+    auto counting_iter = boost::make_function_output_iterator(
+        [&n_matches, &out](const auto& value) {
+            *out = value;
+            ++out;
+            ++n_matches;
+        }
+    );
+
+    if(order.empty()) {
+        for(const auto& shape : shapes) {
+            derived.template find_intersecting<GeometryMode>(shape, counting_iter);
+            offsets.push_back(n_matches);
+        }
+
+        return offsets;
+    }
+
+    // The matches of `shapes[order[j]]` are `buffer[buffer_offsets[j], ...)`.
+    std::vector<T> buffer;
+    std::vector<size_t> buffer_offsets(shapes.size() + 1, 0);
+    for(size_t j = 0; j < shapes.size(); ++j) {
+        derived.template find_intersecting<GeometryMode>(shapes[order[j]],
+                                                         std::back_inserter(buffer));
+        buffer_offsets[j + 1] = buffer.size();
+    }
+
+    auto position = detail::inverse_permutation(order);
+    for(size_t i = 0; i < shapes.size(); ++i) {
+        auto j = position[i];
+        std::copy(buffer.begin() + buffer_offsets[j],
+                  buffer.begin() + buffer_offsets[j + 1],
+                  counting_iter);
+        offsets.push_back(n_matches);
+    }
+
+    return offsets;
+}
+
+template <typename Derived, typename T>
+inline size_t IndexTreeMixin<Derived, T>::effective_n_threads(size_t n_threads) {
+    return supports_concurrent_queries<Derived>::value ? n_threads : 1;
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_intersecting_batch_np(const std::vector<ShapeT>& shapes,
+                                                       size_t n_threads) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
+    using getter_t = iter_entry_getter<T>;
+
+    auto order = derived.schedule(shapes);
+
+    auto executor = WorkStealingExecutor(effective_n_threads(n_threads));
+    auto n_chunks = detail::n_batch_chunks(shapes.size(), executor.n_threads());
+
+    std::vector<detail::batch_query_result<T>> parts(n_chunks);
+    executor.for_each(n_chunks, [&](size_t k) {
+        auto range = util::balanced_chunks(shapes.size(), n_chunks, k);
+        auto& part = parts[k];
+
+        part.offsets.reserve(range.high - range.low + 1);
+        part.offsets.push_back(0);
+
+        auto getter = getter_t(part.values);
+        for(size_t j = range.low; j < range.high; ++j) {
+            auto i = order.empty() ? j : order[j];
+            derived.template find_intersecting<GeometryMode>(shapes[i], getter);
+            part.offsets.push_back(part.values.size());
+        }
+    });
+
+    auto result = detail::concatenate_batch_results(parts);
+    if(order.empty()) {
+        return result;
+    }
+
+    return detail::unpermute_batch_results(result, order, executor);
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<size_t>
+IndexTreeMixin<Derived, T>::count_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                     size_t n_threads) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
+    auto order = derived.schedule(shapes);
+
+    auto executor = WorkStealingExecutor(effective_n_threads(n_threads));
+    auto n_chunks = detail::n_batch_chunks(shapes.size(), executor.n_threads());
+
+    std::vector<size_t> counts(shapes.size());
+    executor.for_each(n_chunks, [&](size_t k) {
+        auto range = util::balanced_chunks(shapes.size(), n_chunks, k);
+        for(size_t j = range.low; j < range.high; ++j) {
+            auto i = order.empty() ? j : order[j];
+            counts[i] = derived.template count_intersecting<GeometryMode>(shapes[i]);
+        }
+    });
+
+    return counts;
+}
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline QueryCursor<Derived, GeometryMode, ShapeT>
+IndexTreeMixin<Derived, T>::query_cursor(const ShapeT& shape) const {
+    return QueryCursor<Derived, GeometryMode, ShapeT>(static_cast<const Derived&>(*this),
+                                                      shape);
+}
+
+
+/////////////////////////////////////////
+// class QueryCursor
+/////////////////////////////////////////
+
+template <typename Derived, typename T>
+inline decltype(auto) QueryCursorMixin<Derived, T>::next_np(size_t max_elements) {
+    auto& derived = static_cast<Derived&>(*this);
+
+    using getter_t = iter_entry_getter<T>;
+    typename getter_t::result_t result;
+    derived.next(max_elements, getter_t(result));
+    return result;
+}
+
+template <typename Index, typename GeometryMode, typename ShapeT>
+inline QueryCursor<Index, GeometryMode, ShapeT>::QueryCursor(const Index& index,
+                                                             const ShapeT& shape)
+    : index_(&index)
+    , it_(index.qbegin(detail::intersects_predicates<GeometryMode>(shape))) {}
+
+template <typename Index, typename GeometryMode, typename ShapeT>
+template <typename OutputIt>
+inline size_t QueryCursor<Index, GeometryMode, ShapeT>::next(size_t max_elements,
+                                                             const OutputIt& iter) {
+    auto out = iter;
+
+    size_t n = 0;
+    for(; n < max_elements && it_ != index_->qend(); ++n, ++it_) {
+        *out = *it_;
+        ++out;
+    }
+
+    return n;
+}
+
+
 template <typename Derived, typename T>
 template <typename ShapeT>
 inline decltype(auto) IndexTreeMixin<Derived, T>::find_nearest(const ShapeT& shape,
@@ -140,6 +434,114 @@ inline decltype(auto) IndexTreeMixin<Derived, T>::find_nearest(const ShapeT& sha
 }
 
 
+namespace detail {
+
+template <typename Value>
+inline NearestCandidates<Value>::NearestCandidates(size_t k_neighbors)
+    : k_neighbors_(k_neighbors) {
+    heap_.reserve(k_neighbors + 1);
+}
+
+
+template <typename Value>
+inline double NearestCandidates<Value>::max_distance() const {
+    if(k_neighbors_ == 0) {
+        return -std::numeric_limits<double>::infinity();
+    }
+
+    return heap_.size() < k_neighbors_ ? std::numeric_limits<double>::infinity()
+                                       : heap_.front().first;
+}
+
+
+template <typename Value>
+inline void NearestCandidates<Value>::push(double distance, const Value& value) {
+    if(!(distance < max_distance())) {
+        return;
+    }
+
+    heap_.emplace_back(distance, value);
+    std::push_heap(heap_.begin(), heap_.end(), closer);
+
+    if(heap_.size() > k_neighbors_) {
+        std::pop_heap(heap_.begin(), heap_.end(), closer);
+        heap_.pop_back();
+    }
+}
+
+
+template <typename Value>
+inline auto NearestCandidates<Value>::sorted() && -> std::vector<candidate_type> {
+    std::sort_heap(heap_.begin(), heap_.end(), closer);
+    return std::move(heap_);
+}
+
+
+template <typename Tree, typename Value>
+inline void find_nearest_exact(const Tree& tree,
+                               const Point3D& point,
+                               NearestCandidates<Value>& candidates) {
+    if(tree.size() == 0) {
+        return;
+    }
+
+    // The iterator is incremental, i.e. `n_elements` is merely an upper bound.
+    auto n_elements = util::integer_cast<unsigned>(tree.size());
+    for(auto it = tree.qbegin(bgi::nearest(point, n_elements)); it != tree.qend(); ++it) {
+        auto box_distance = bg::distance(point, bgi::indexable<typename Tree::value_type>{}(*it));
+        if(!(box_distance < candidates.max_distance())) {
+            break;
+        }
+
+        candidates.push(geometry_distance(point, *it), *it);
+    }
+}
+
+
+/// \brief The ids of the `candidates`.
+template <typename Value>
+inline auto nearest_ids(const std::vector<std::pair<double, Value>>& candidates) {
+    using ids_getter = typename id_getter_for<Value>::type;
+    std::vector<typename ids_getter::value_type> ids;
+    ids.reserve(candidates.size());
+
+    auto out = ids_getter(ids);
+    for(const auto& candidate : candidates) {
+        *out = candidate.second;
+        ++out;
+    }
+
+    return ids;
+}
+
+
+/// \brief The ids and distances of the `candidates`.
+template <typename Value>
+inline auto nearest_ids_and_distances(const std::vector<std::pair<double, Value>>& candidates) {
+    std::vector<CoordType> distances;
+    distances.reserve(candidates.size());
+    for(const auto& candidate : candidates) {
+        distances.push_back(static_cast<CoordType>(candidate.first));
+    }
+
+    return std::make_pair(nearest_ids(candidates), std::move(distances));
+}
+
+}  // namespace detail
+
+
+template <typename Derived, typename T>
+inline decltype(auto) IndexTreeMixin<Derived, T>::find_nearest_exact(const Point3D& point,
+                                                                     unsigned k_neighbors) const {
+    const auto& derived = static_cast<const Derived&>(*this);
+
+    auto candidates = detail::NearestCandidates<T>(k_neighbors);
+    detail::find_nearest_exact(derived, point, candidates);
+
+    return detail::nearest_ids_and_distances(std::move(candidates).sorted());
+}
+
+
 // Serialization: Load ctor
 template <typename T, typename A>
 inline IndexTree<T, A>::IndexTree(const std::string& path) {
@@ -151,24 +553,182 @@ inline IndexTree<T, A>::IndexTree(const std::string& path) {
 }
 
 
+namespace detail {
+
+// Name of the tree inside a memory mapped file.
+constexpr auto memory_mapped_tree_name = "rtree";
+
+// Name of the `MemoryMappedFormat` inside a memory mapped file.
+constexpr auto memory_mapped_format_name = "format";
+
+/** \brief Identifies the layout of the tree inside a memory mapped file.
+ *
+ * The tree is queried in place, therefore it can only be read by code which
+ * agrees on the layout of its nodes. These depend on the version of Boost,
+ * the type of the elements and the parameters of the tree. Increment
+ * `current_version` whenever the layout changes otherwise.
+ */
+struct MemoryMappedFormat {
+    static constexpr uint32_t current_version = 1;
+
+    uint32_t version;
+    uint32_t boost_version;
+    uint64_t value_size;
+    uint64_t tree_size;
+    uint64_t max_elements_per_node;
+    uint64_t min_elements_per_node;
+
+    template <class T>
+    static MemoryMappedFormat of() {
+        using tree_type = typename MemoryMappedIndexTree<T>::tree_type;
+        using parameters_type = typename tree_type::parameters_type;
+
+        return MemoryMappedFormat{current_version,
+                                  BOOST_VERSION,
+                                  sizeof(T),
+                                  sizeof(tree_type),
+                                  parameters_type::max_elements,
+                                  parameters_type::min_elements};
+    }
+
+    inline bool operator==(const MemoryMappedFormat& other) const {
+        return version == other.version
+            && boost_version == other.boost_version
+            && value_size == other.value_size
+            && tree_size == other.tree_size
+            && max_elements_per_node == other.max_elements_per_node
+            && min_elements_per_node == other.min_elements_per_node;
+    }
+
+    inline bool operator!=(const MemoryMappedFormat& other) const {
+        return !(*this == other);
+    }
+
+    inline std::string to_string() const {
+        return "{version: " + std::to_string(version)
+            + ", boost_version: " + std::to_string(boost_version)
+            + ", value_size: " + std::to_string(value_size)
+            + ", tree_size: " + std::to_string(tree_size)
+            + ", max_elements_per_node: " + std::to_string(max_elements_per_node)
+            + ", min_elements_per_node: " + std::to_string(min_elements_per_node) + "}";
+    }
+};
+
+/// \brief Throws unless `segment` was written with the format of `T`; `name` is for errors.
+template <typename T, typename Segment>
+inline void check_memory_mapped_format(Segment& segment, const std::string& name) {
+    auto format = segment.template find_no_lock<MemoryMappedFormat>(memory_mapped_format_name).first;
+    if(format == nullptr) {
+        throw std::runtime_error(
+            "The memory mapped index '" + name + "' doesn't record its format;"
+            " it was written by an older version and must be recreated.");
+    }
+
+    auto expected = MemoryMappedFormat::of<T>();
+    if(*format != expected) {
+        throw std::runtime_error(
+            "The memory mapped index '" + name + "' has the format " + format->to_string()
+            + ", but " + expected.to_string() + " is required; it must be recreated.");
+    }
+}
+
+/** \brief Bulk load the elements `[begin, end)` into a new managed segment.
+ *
+ * The segment `name` is either a memory mapped file or shared memory, i.e.
+ * `Segment` is `bip::managed_mapped_file` or `bip::managed_shared_memory`.
+ * The required size of the segment isn't known upfront. Therefore, it's
+ * created with an estimated size and recreated with twice the size whenever
+ * it's too small; `remove(name)` removes the previous attempt. Once the tree
+ * has been written the segment is shrunk to fit.
+ */
+template <typename T, typename Segment, typename Iterator, typename Remove>
+inline void write_managed_tree(const std::string& name,
+                               Iterator begin,
+                               Iterator end,
+                               size_t n_elements,
+                               Remove&& remove) {
+    using tree_type = typename MemoryMappedIndexTree<T>::tree_type;
+    static_assert(std::is_same<typename Segment::segment_manager,
+                               bip::managed_mapped_file::segment_manager>::value,
+                  "The tree must be readable by `MemoryMappedIndexTree`.");
+
+    // Roughly, leaves are full and there are few internal nodes.
+    size_t segment_size = 2 * n_elements * sizeof(T) + (size_t(1) << 20);
+
+    while(true) {
+        remove(name);
+
+        try {
+            auto segment = Segment(bip::create_only, name.c_str(), segment_size);
+            auto allocator = MemoryMappedAllocator<T>(segment.get_segment_manager());
+
+            segment.template construct<MemoryMappedFormat>(memory_mapped_format_name)(
+                MemoryMappedFormat::of<T>()
+            );
+            segment.template construct<tree_type>(memory_mapped_tree_name)(
+                begin, end,
+                bgi::linear<16, 2>(), bgi::indexable<T>(), bgi::equal_to<T>(),
+                allocator
+            );
+
+            if constexpr (std::is_same<Segment, bip::managed_mapped_file>::value) {
+                segment.flush();
+            }
+            break;
+        }
+        catch(const bip::bad_alloc&) {
+            util::check_signals();
+            segment_size *= 2;
+        }
+    }
+
+    Segment::shrink_to_fit(name.c_str());
+}
+
+/// \brief Bulk load the elements `[begin, end)` into a new memory mapped file.
+template <typename T, typename Iterator>
+inline void write_memory_mapped_tree(const std::string& filename,
+                                     Iterator begin,
+                                     Iterator end,
+                                     size_t n_elements) {
+    write_managed_tree<T, bip::managed_mapped_file>(
+        filename, begin, end, n_elements,
+        [](const std::string& filename) { std::filesystem::remove(filename); }
+    );
+}
+
+}  // namespace detail
+
+
 template <typename T, typename A>
-inline void IndexTree<T, A>::dump(const std::string& index_path) const {
+inline void IndexTree<T, A>::dump(const std::string& index_path, IndexFormat format) const {
     util::ensure_valid_output_directory(index_path);
 
-    auto heavy_data_relpath = "index.spi";
-    auto filename = join_path(index_path, heavy_data_relpath);
-    auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
-    boost::archive::binary_oarchive oa(ofs);
-    oa << *this;
-
     auto element_type = value_to_element_type<T>();
     auto meta_data = create_basic_meta_data(element_type);
 
-    meta_data[MetaDataConstants::in_memory_key] = {
-        // The heavy data, i.e. the relative path of the serialization
-        // of the index:
-        {"heavy_data_path", heavy_data_relpath}
-    };
+    if(format == IndexFormat::memory_mapped) {
+        auto heavy_data_relpath = "index.mmap";
+        auto filename = join_path(index_path, heavy_data_relpath);
+        detail::write_memory_mapped_tree<T>(filename, this->begin(), this->end(), this->size());
+
+        meta_data[MetaDataConstants::memory_mapped_key] = {
+            {"heavy_data_path", heavy_data_relpath}
+        };
+    }
+    else {
+        auto heavy_data_relpath = "index.spi";
+        auto filename = join_path(index_path, heavy_data_relpath);
+        auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
+        boost::archive::binary_oarchive oa(ofs);
+        oa << *this;
+
+        meta_data[MetaDataConstants::in_memory_key] = {
+            // The heavy data, i.e. the relative path of the serialization
+            // of the index:
+            {"heavy_data_path", heavy_data_relpath}
+        };
+    }
 
     write_meta_data(default_meta_data_path(index_path), meta_data);
 }
@@ -189,6 +749,192 @@ inline bool IndexTree<T, A>::is_intersecting(const ShapeT& shape) const {
 }
 
 
+namespace detail {
+
+/**
+ * \brief Does `shape` contain all of `box`?
+ *
+ * If so, every element in `box` intersects `shape` in bounding box mode. The
+ * check may be conservative, i.e. return `false` even if `box` is contained.
+ */
+template <typename ShapeT>
+inline bool shape_covers(const ShapeT& /* shape */, const Box3D& /* box */) {
+    return false;
+}
+
+inline bool shape_covers(const Box3D& query_box, const Box3D& box) {
+    return bg::covered_by(box, query_box);
+}
+
+inline bool shape_covers(const Sphere& sphere, const Box3D& box) {
+    // The corner furthest from the center. Note, that the distance to any
+    // point in `box` is at most this large, also in floating point arithmetic.
+    auto furthest = [](CoordType c, CoordType low, CoordType high) {
+        return std::max(std::abs(low - c), std::abs(high - c));
+    };
+
+    const auto& c = sphere.centroid;
+    const auto& low = box.min_corner();
+    const auto& high = box.max_corner();
+    auto d = Point3Dx{furthest(c.get<0>(), low.get<0>(), high.get<0>()),
+                      furthest(c.get<1>(), low.get<1>(), high.get<1>()),
+                      furthest(c.get<2>(), low.get<2>(), high.get<2>())};
+
+    return d.norm_sq() <= sphere.radius * sphere.radius;
+}
+
+
+/** \brief Counts the elements in the visited node, without testing them.
+ *
+ * The R-tree doesn't store the number of elements per node. Hence, every leaf
+ * below the node is visited, but only its size is read.
+ */
+template <class MembersHolder>
+struct CountElementsVisitor : public MembersHolder::visitor_const {
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+
+    inline void operator()(const internal_node& node) {
+        for(const auto& child : bgi::detail::rtree::elements(node)) {
+            bgi::detail::rtree::apply_visitor(*this, *child.second);
+        }
+    }
+
+    inline void operator()(const leaf& node) {
+        count += bgi::detail::rtree::elements(node).size();
+    }
+
+    size_t count = 0;
+};
+
+
+/**
+ * \brief Counts the elements intersecting `shape`.
+ *
+ * Children of internal nodes which `shape` covers are counted by
+ * `CountElementsVisitor`, if `GeometryMode` is `BoundingBoxGeometry`. Every
+ * leaf below a covered node is still visited to add up its size; only the
+ * per-element geometry tests are skipped.
+ */
+template <class MembersHolder, class ShapeT, class GeometryMode>
+struct CountIntersectingVisitor : public MembersHolder::visitor_const {
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+    using value_type = typename MembersHolder::value_type;
+
+    inline explicit CountIntersectingVisitor(const ShapeT& shape)
+        : shape(shape), query_box(bgi::indexable<ShapeT>{}(shape)) {}
+
+    inline void operator()(const internal_node& node) {
+        constexpr bool is_bounding_box_mode
+            = std::is_same<GeometryMode, BoundingBoxGeometry>::value;
+
+        for(const auto& child : bgi::detail::rtree::elements(node)) {
+            if(!bg::intersects(query_box, child.first)) {
+                continue;
+            }
+
+            if(is_bounding_box_mode && shape_covers(shape, child.first)) {
+                CountElementsVisitor<MembersHolder> count_elements;
+                bgi::detail::rtree::apply_visitor(count_elements, *child.second);
+                count += count_elements.count;
+            } else {
+                bgi::detail::rtree::apply_visitor(*this, *child.second);
+            }
+        }
+    }
+
+    inline void operator()(const leaf& node) {
+        // Same as the predicate of `IndexTreeMixin::find_intersecting`.
+        for(const auto& value : bgi::detail::rtree::elements(node)) {
+            if(bg::intersects(query_box, bgi::indexable<value_type>{}(value))
+               && geometry_intersects(shape, value, GeometryMode{})) {
+                ++count;
+            }
+        }
+    }
+
+    const ShapeT& shape;
+    Box3D query_box;
+    size_t count = 0;
+};
+
+
+/// \brief Counts the elements of `rtree` intersecting `shape`, see `CountIntersectingVisitor`.
+template <typename GeometryMode, typename ShapeT, typename... Args>
+inline size_t count_intersecting(const bgi::rtree<Args...>& rtree, const ShapeT& shape) {
+    using view_type = bgi::detail::rtree::utilities::view<bgi::rtree<Args...>>;
+    using members_holder = typename view_type::members_holder;
+
+    CountIntersectingVisitor<members_holder, ShapeT, GeometryMode> visitor(shape);
+    view_type(rtree).apply_visitor(visitor);
+
+    return visitor.count;
+}
+
+template <typename GeometryMode, typename ShapeT, typename T>
+inline size_t count_intersecting(const MemoryMappedIndexTree<T>& index, const ShapeT& shape) {
+    return index.template count_intersecting<GeometryMode>(shape);
+}
+
+
+/// \brief Counts the nodes of the visited subtree.
+template <class MembersHolder>
+struct CountNodesVisitor : public MembersHolder::visitor_const {
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+
+    inline void operator()(const internal_node& node) {
+        ++n_nodes;
+        for(const auto& child : bgi::detail::rtree::elements(node)) {
+            bgi::detail::rtree::apply_visitor(*this, *child.second);
+        }
+    }
+
+    inline void operator()(const leaf& /* node */) {
+        ++n_nodes;
+    }
+
+    size_t n_nodes = 0;
+};
+
+
+/**
+ * \brief The number of bytes of memory owned by `rtree`.
+ *
+ * The nodes store their elements in place and all nodes have the same size,
+ * which is the size of the largest node. Hence, it's the size of the R-tree
+ * itself plus the size of a node per node. The bookkeeping of the heap
+ * allocator isn't included.
+ */
+template <typename... Args>
+inline size_t memory_footprint(const bgi::rtree<Args...>& rtree) {
+    using view_type = bgi::detail::rtree::utilities::view<bgi::rtree<Args...>>;
+    using members_holder = typename view_type::members_holder;
+    using node_type = typename members_holder::node;
+
+    CountNodesVisitor<members_holder> visitor;
+    view_type(rtree).apply_visitor(visitor);
+
+    return sizeof(rtree) + visitor.n_nodes * sizeof(node_type);
+}
+
+/// \brief The number of bytes of memory used by `index`, see `Index::memory_footprint`.
+template <typename Index>
+inline auto memory_footprint(const Index& index) -> decltype(index.memory_footprint()) {
+    return index.memory_footprint();
+}
+
+}  // namespace detail
+
+
+template <typename T, typename A>
+template <typename GeometryMode, typename ShapeT>
+inline size_t IndexTree<T, A>::count_intersecting(const ShapeT& shape) const {
+    return detail::count_intersecting<GeometryMode>(*this, shape);
+}
+
+
 template <typename T, typename A>
 template <typename GeometryMode, typename ShapeT>
 inline std::vector<typename IndexTree<T, A>::cref_t>
@@ -310,6 +1056,71 @@ inline std::ostream& operator<<(std::ostream& os, const IndexTree<T, A>& index)
     return os << "])";
 }
 
+template <typename T>
+inline MemoryMappedIndexTree<T>::MemoryMappedIndexTree(const std::string& index_path)
+    : MemoryMappedIndexTree(open_file(
+        resolve_heavy_data_path(index_path, MetaDataConstants::memory_mapped_key)
+    )) {}
+
+
+template <typename T>
+inline MemoryMappedIndexTree<T>::MemoryMappedIndexTree(std::shared_ptr<const void> owner,
+                                                       const tree_type* tree,
+                                                       size_t n_bytes)
+    : owner_(std::move(owner))
+    , tree_(tree)
+    , n_bytes_(n_bytes) {}
+
+
+template <typename T>
+template <class Segment>
+inline MemoryMappedIndexTree<T>
+MemoryMappedIndexTree<T>::from_segment(Segment& segment, std::shared_ptr<const void> owner) {
+    detail::check_memory_mapped_format<T>(segment, "<segment>");
+
+    // Read-only mappings can't lock the segment manager, which is fine
+    // since nothing is allocated.
+    auto tree = segment.template find_no_lock<tree_type>(detail::memory_mapped_tree_name).first;
+    if(tree == nullptr) {
+        throw std::runtime_error("Segment doesn't contain a memory mapped index.");
+    }
+
+    return MemoryMappedIndexTree(std::move(owner), tree, segment.get_size());
+}
+
+
+template <typename T>
+inline MemoryMappedIndexTree<T>
+MemoryMappedIndexTree<T>::open_file(const std::string& filename) {
+    if(!std::filesystem::exists(filename)) {
+        throw std::runtime_error("No such file: " + filename);
+    }
+
+    auto file = std::make_shared<bip::managed_mapped_file>(bip::open_read_only,
+                                                           filename.c_str());
+    detail::check_memory_mapped_format<T>(*file, filename);
+
+    auto tree = file->template find_no_lock<tree_type>(detail::memory_mapped_tree_name).first;
+    if(tree == nullptr) {
+        throw std::runtime_error("Not a memory mapped index: " + filename);
+    }
+
+    auto n_bytes = file->get_size();
+    return MemoryMappedIndexTree(std::move(file), tree, n_bytes);
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline auto
+MemoryMappedIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const
+    -> std::vector<value_type> {
+
+    std::vector<value_type> results;
+    this->template find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
 }  // namespace brain_indexer
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../index_bulk_builder.hpp"
+#include "../parallel_bulk_loading.hpp"
 
 namespace brain_indexer {
 
@@ -38,7 +39,9 @@ inline void IndexBulkBuilder<Index, Value>::finalize() {
     size_t n_values = this->values_.size();
     this->n_total_values_ = n_values;
 
-    index_ = Index(this->values_);
+    index_ = parallel_bulk_load<Index>(this->values_.begin(),
+                                       this->values_.end(),
+                                       n_threads_);
 }
 
 template <class Index, class Value>
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "../geometries.hpp"
+
+// Batched intersection tests between one query shape and the segments of a
+// leaf, see `MorphBlockIndexTree`.
+//
+// The kernels process `leaf_batch_size` segments at once. Each kernel is a
+// loop over the lanes of a batch with a fixed trip count, and a body without
+// branches. Hence, the compiler vectorizes them for whichever instruction set
+// it targets, e.g. AVX2 or AVX-512 when building with `SI_NATIVE_ARCH`; and
+// they run as plain loops otherwise.
+//
+// Only `MorphBlockIndexTree` uses them; the leaves of `IndexTree` are nodes of
+// a Boost R-tree whose elements are tested one at a time by its queries.
+//
+// Vectorizing the loops containing `std::sqrt` and selects requires
+// `-fno-math-errno -fno-trapping-math`. The build adds them to the Python
+// extension and the tests only; projects including these headers should add
+// them to their own targets.
+//
+// The kernels perform the same floating point operations in the same order as
+// their scalar counterparts in `geometries.hpp`. Therefore, they give the same
+// results.
+
+namespace brain_indexer {
+namespace detail {
+
+/// \brief Number of segments tested by one call of a leaf kernel.
+static constexpr size_t leaf_batch_size = 16;
+
+template <typename T>
+using LeafLanes = std::array<T, leaf_batch_size>;
+
+/// \brief A boolean per lane; as wide as `CoordType` so that masks vectorize.
+using lane_mask_t = std::conditional_t<sizeof(CoordType) == 8, std::int64_t, std::int32_t>;
+
+
+/**
+ * \brief Up to `leaf_batch_size` segments, and their bounding boxes.
+ *
+ * Unused lanes are filled with degenerate segments at the origin, which
+ * `is_valid` masks out.
+ */
+struct SegmentBatch {
+    LeafLanes<CoordType> p1_x, p1_y, p1_z;
+    LeafLanes<CoordType> p2_x, p2_y, p2_z;
+    LeafLanes<CoordType> radius;
+
+    LeafLanes<CoordType> min_x, min_y, min_z;
+    LeafLanes<CoordType> max_x, max_y, max_z;
+
+    LeafLanes<lane_mask_t> is_valid;
+
+    /// \brief Load the segments `first, ..., first + n - 1`.
+    template <class Segments>
+    inline void load(const Segments& segments, size_t first, size_t n);
+
+    inline Cylinder cylinder(size_t k) const {
+        return Cylinder{Point3D{p1_x[k], p1_y[k], p1_z[k]},
+                        Point3D{p2_x[k], p2_y[k], p2_z[k]},
+                        radius[k]};
+    }
+
+    inline Box3D bounding_box(size_t k) const {
+        return Box3D{Point3D{min_x[k], min_y[k], min_z[k]},
+                     Point3D{max_x[k], max_y[k], max_z[k]}};
+    }
+
+  private:
+    /// \brief Same as `Cylinder::bounding_box`, for every lane.
+    inline void compute_bounding_boxes();
+};
+
+
+/// \brief All bits set if `x < y`, none otherwise.
+inline lane_mask_t lane_less(CoordType x, CoordType y) {
+    return -lane_mask_t(x < y);
+}
+
+/**
+ * \brief Same as `mask ? x : y`, for masks from `lane_less`.
+ *
+ * The blend is computed on the bit patterns. Otherwise, the compiler tends to
+ * rewrite chains of ternaries into selects between comparisons, which it then
+ * fails to vectorize.
+ */
+inline CoordType lane_select(lane_mask_t mask, CoordType x, CoordType y) {
+    lane_mask_t x_bits, y_bits;
+    std::memcpy(&x_bits, &x, sizeof(CoordType));
+    std::memcpy(&y_bits, &y, sizeof(CoordType));
+
+    lane_mask_t bits = (x_bits & mask) | (y_bits & ~mask);
+
+    CoordType z;
+    std::memcpy(&z, &bits, sizeof(CoordType));
+    return z;
+}
+
+inline CoordType max3(CoordType x, CoordType y, CoordType z) {
+    return std::max(x, std::max(y, z));
+}
+
+/// \brief Same as `square_distance_segment_segment`, without branches.
+inline CoordType square_distance_segment_segment_lane(
+        CoordType s1_0x, CoordType s1_0y, CoordType s1_0z,
+        CoordType s1_1x, CoordType s1_1y, CoordType s1_1z,
+        CoordType s2_0x, CoordType s2_0y, CoordType s2_0z,
+        CoordType s2_1x, CoordType s2_1y, CoordType s2_1z) {
+
+    const CoordType ux = s1_1x - s1_0x, uy = s1_1y - s1_0y, uz = s1_1z - s1_0z;
+    const CoordType vx = s2_1x - s2_0x, vy = s2_1y - s2_0y, vz = s2_1z - s2_0z;
+    const CoordType wx = s1_0x - s2_0x, wy = s1_0y - s2_0y, wz = s1_0z - s2_0z;
+
+    const CoordType a = ux * ux + uy * uy + uz * uz;
+    const CoordType b = ux * vx + uy * vy + uz * vz;
+    const CoordType c = vx * vx + vy * vy + vz * vz;
+    const CoordType d = ux * wx + uy * wy + uz * wz;
+    const CoordType e = vx * wx + vy * wy + vz * wz;
+    const CoordType D = a * c - b * b;
+    const CoordType EPSILON = 1e-6;
+
+    const CoordType sN_line = b * e - c * d;
+    const CoordType tN_line = a * e - b * d;
+    const CoordType e_plus_b = e + b;
+
+    // Closest points of the infinite lines, or of the first segment if the
+    // lines are almost parallel.
+    const lane_mask_t is_parallel = lane_less(D, EPSILON);
+    CoordType sN = lane_select(is_parallel, CoordType(0), sN_line);
+    CoordType sD = lane_select(is_parallel, CoordType(1), D);
+    CoordType tN = lane_select(is_parallel, e, tN_line);
+    CoordType tD = lane_select(is_parallel, c, D);
+
+    const lane_mask_t s_low = ~is_parallel & lane_less(sN, CoordType(0));
+    const lane_mask_t s_high = ~is_parallel & ~s_low & lane_less(sD, sN);
+    tN = lane_select(s_high, e_plus_b, tN);
+    tN = lane_select(s_low, e, tN);
+    tD = lane_select(s_low | s_high, c, tD);
+    sN = lane_select(s_high, sD, sN);
+    sN = lane_select(s_low, CoordType(0), sN);
+
+    // Clamp to the second segment, and recompute `sN` for that edge.
+    const lane_mask_t t_low = lane_less(tN, CoordType(0));
+    const lane_mask_t t_high = ~t_low & lane_less(tD, tN);
+    const CoordType m = lane_select(t_low, -d, -d + b);
+    const lane_mask_t m_low = (t_low | t_high) & lane_less(m, CoordType(0));
+    const lane_mask_t m_high = (t_low | t_high) & ~m_low & lane_less(a, m);
+    const lane_mask_t m_inside = (t_low | t_high) & ~m_low & ~m_high;
+
+    tN = lane_select(t_high, tD, tN);
+    tN = lane_select(t_low, CoordType(0), tN);
+    sN = lane_select(m_inside, m, sN);
+    sN = lane_select(m_high, sD, sN);
+    sN = lane_select(m_low, CoordType(0), sN);
+    sD = lane_select(m_inside, a, sD);
+
+    const CoordType sc = lane_select(lane_less(std::abs(sN), EPSILON), CoordType(0), sN / sD);
+    const CoordType tc = lane_select(lane_less(std::abs(tN), EPSILON), CoordType(0), tN / tD);
+
+    const CoordType dx = (wx + ux * sc) - vx * tc;
+    const CoordType dy = (wy + uy * sc) - vy * tc;
+    const CoordType dz = (wz + uz * sc) - vz * tc;
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+
+template <class Segments>
+inline void SegmentBatch::load(const Segments& segments, size_t first, size_t n) {
+    auto load_lanes = [first, n](LeafLanes<CoordType>& lanes, const auto& values) {
+        std::copy(values.begin() + first, values.begin() + first + n, lanes.begin());
+        std::fill(lanes.begin() + n, lanes.end(), CoordType(0));
+    };
+
+    load_lanes(p1_x, segments.p1_x);
+    load_lanes(p1_y, segments.p1_y);
+    load_lanes(p1_z, segments.p1_z);
+    load_lanes(p2_x, segments.p2_x);
+    load_lanes(p2_y, segments.p2_y);
+    load_lanes(p2_z, segments.p2_z);
+    load_lanes(radius, segments.radius);
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        is_valid[k] = k < n;
+    }
+
+    compute_bounding_boxes();
+}
+
+inline void SegmentBatch::compute_bounding_boxes() {
+    const auto tiny = std::numeric_limits<CoordType>::min();
+    const auto eps = std::numeric_limits<CoordType>::epsilon();
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        const CoordType r = radius[k];
+        const CoordType length_scale = std::max(
+            std::max(r * r, max3(p1_x[k] * p1_x[k], p1_y[k] * p1_y[k], p1_z[k] * p1_z[k])),
+            max3(p2_x[k] * p2_x[k], p2_y[k] * p2_y[k], p2_z[k] * p2_z[k])
+        );
+
+        const CoordType vx = p2_x[k] - p1_x[k];
+        const CoordType vy = p2_y[k] - p1_y[k];
+        const CoordType vz = p2_z[k] - p1_z[k];
+        const CoordType denominator = tiny + eps * length_scale + (vx * vx + vy * vy + vz * vz);
+
+        const CoordType ex = std::sqrt(CoordType(1) - (vx * vx) / denominator) * r;
+        const CoordType ey = std::sqrt(CoordType(1) - (vy * vy) / denominator) * r;
+        const CoordType ez = std::sqrt(CoordType(1) - (vz * vz) / denominator) * r;
+
+        min_x[k] = std::min(p1_x[k] - ex, p2_x[k] - ex);
+        min_y[k] = std::min(p1_y[k] - ey, p2_y[k] - ey);
+        min_z[k] = std::min(p1_z[k] - ez, p2_z[k] - ez);
+        max_x[k] = std::max(p1_x[k] + ex, p2_x[k] + ex);
+        max_y[k] = std::max(p1_y[k] + ey, p2_y[k] + ey);
+        max_z[k] = std::max(p1_z[k] + ez, p2_z[k] + ez);
+    }
+}
+
+
+/// \brief `is_match[k]` is set if the bounding box of segment `k` intersects `box`.
+inline void boxes_intersect(const Box3D& box, const SegmentBatch& batch,
+                            LeafLanes<lane_mask_t>& is_match) {
+    const auto& lo = box.min_corner();
+    const auto& hi = box.max_corner();
+    const CoordType lo_x = lo.get<0>(), lo_y = lo.get<1>(), lo_z = lo.get<2>();
+    const CoordType hi_x = hi.get<0>(), hi_y = hi.get<1>(), hi_z = hi.get<2>();
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        is_match[k] = batch.is_valid[k]
+            & (batch.max_x[k] >= lo_x) & (batch.min_x[k] <= hi_x)
+            & (batch.max_y[k] >= lo_y) & (batch.min_y[k] <= hi_y)
+            & (batch.max_z[k] >= lo_z) & (batch.min_z[k] <= hi_z);
+    }
+}
+
+/// \brief Keeps the lanes whose bounding box intersects `sphere`, see `Sphere::intersects(Box3D)`.
+inline void sphere_intersects_boxes(const Sphere& sphere, const SegmentBatch& batch,
+                                    LeafLanes<lane_mask_t>& is_match) {
+    const CoordType cx = sphere.centroid.get<0>();
+    const CoordType cy = sphere.centroid.get<1>();
+    const CoordType cz = sphere.centroid.get<2>();
+    const CoordType r2 = sphere.radius * sphere.radius;
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        const CoordType dx = std::min(std::max(batch.min_x[k], cx), batch.max_x[k]) - cx;
+        const CoordType dy = std::min(std::max(batch.min_y[k], cy), batch.max_y[k]) - cy;
+        const CoordType dz = std::min(std::max(batch.min_z[k], cz), batch.max_z[k]) - cz;
+
+        is_match[k] = is_match[k] & (dx * dx + dy * dy + dz * dz <= r2);
+    }
+}
+
+/// \brief Keeps the lanes which intersect `sphere`, see `Sphere::intersects(Cylinder)`.
+inline void sphere_intersects_capsules(const Sphere& sphere, const SegmentBatch& batch,
+                                       LeafLanes<lane_mask_t>& is_match) {
+    const CoordType cx = sphere.centroid.get<0>();
+    const CoordType cy = sphere.centroid.get<1>();
+    const CoordType cz = sphere.centroid.get<2>();
+    const CoordType radius = sphere.radius;
+    const CoordType eps = 100 * std::numeric_limits<CoordType>::epsilon();
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        const CoordType ux = cx - batch.p1_x[k], uy = cy - batch.p1_y[k], uz = cz - batch.p1_z[k];
+        const CoordType vx = batch.p2_x[k] - batch.p1_x[k];
+        const CoordType vy = batch.p2_y[k] - batch.p1_y[k];
+        const CoordType vz = batch.p2_z[k] - batch.p1_z[k];
+
+        const CoordType v_dot_u = vx * ux + vy * uy + vz * uz;
+        const CoordType v_dot_v = vx * vx + vy * vy + vz * vz;
+
+        const CoordType max_distance = radius + batch.radius[k];
+        const CoordType max_distance_sq = max_distance * max_distance;
+
+        // Next to the mantle.
+        const bool is_beside = (CoordType(0) <= v_dot_u) & (v_dot_u <= v_dot_v);
+        const CoordType line_dist_sq = (ux * ux + uy * uy + uz * uz)
+                                       - v_dot_u * v_dot_u / v_dot_v;
+
+        // Next to one of the caps.
+        const bool is_before = v_dot_u < CoordType(0);
+        const CoordType cap_x = is_before ? batch.p1_x[k] : batch.p2_x[k];
+        const CoordType cap_y = is_before ? batch.p1_y[k] : batch.p2_y[k];
+        const CoordType cap_z = is_before ? batch.p1_z[k] : batch.p2_z[k];
+
+        const CoordType qx = cx - cap_x, qy = cy - cap_y, qz = cz - cap_z;
+        const bool is_far = (qx * qx + qy * qy + qz * qz) > max_distance_sq;
+
+        const CoordType s = v_dot_u / v_dot_v;
+        const CoordType dx = cx - (vx * s + batch.p1_x[k]);
+        const CoordType dy = cy - (vy * s + batch.p1_y[k]);
+        const CoordType dz = cz - (vz * s + batch.p1_z[k]);
+        const CoordType d_norm = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        // See `project_point_onto_segment`.
+        const CoordType base_scale = batch.radius[k] / d_norm;
+        const CoordType dir_scale = 2 * batch.radius[k] / d_norm;
+        const CoordType base_x = cap_x - dx * base_scale;
+        const CoordType base_y = cap_y - dy * base_scale;
+        const CoordType base_z = cap_z - dz * base_scale;
+        const CoordType dir_x = dx * dir_scale, dir_y = dy * dir_scale, dir_z = dz * dir_scale;
+
+        const CoordType dir_dot_dir = dir_x * dir_x + dir_y * dir_y + dir_z * dir_z;
+        const CoordType x_dot_dir = (cx - base_x) * dir_x + (cy - base_y) * dir_y
+                                    + (cz - base_z) * dir_z;
+        const CoordType x_rel = std::min(std::max(x_dot_dir / dir_dot_dir, CoordType(0)),
+                                         CoordType(1));
+        const CoordType proj_x = dir_x * x_rel + base_x;
+        const CoordType proj_y = dir_y * x_rel + base_y;
+        const CoordType proj_z = dir_z * x_rel + base_z;
+
+        const bool is_on_axis = d_norm < eps;
+        const CoordType px = is_on_axis ? cap_x : proj_x;
+        const CoordType py = is_on_axis ? cap_y : proj_y;
+        const CoordType pz = is_on_axis ? cap_z : proj_z;
+
+        const CoordType rx = cx - px, ry = cy - py, rz = cz - pz;
+        const bool is_cap_hit = (rx * rx + ry * ry + rz * rz) <= radius * radius;
+
+        const bool hit = is_beside ? (line_dist_sq <= max_distance_sq) : (!is_far & is_cap_hit);
+        is_match[k] = is_match[k] & hit;
+    }
+}
+
+/// \brief Keeps the lanes which intersect `cylinder`, see `Cylinder::intersects(Cylinder)`.
+inline void cylinder_intersects_capsules(const Cylinder& cylinder, const SegmentBatch& batch,
+                                         LeafLanes<lane_mask_t>& is_match) {
+    const auto& q1 = cylinder.p1;
+    const auto& q2 = cylinder.p2;
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        const CoordType dist_sq = square_distance_segment_segment_lane(
+            q1.get<0>(), q1.get<1>(), q1.get<2>(),
+            q2.get<0>(), q2.get<1>(), q2.get<2>(),
+            batch.p1_x[k], batch.p1_y[k], batch.p1_z[k],
+            batch.p2_x[k], batch.p2_y[k], batch.p2_z[k]
+        );
+
+        const CoordType max_distance = cylinder.radius + batch.radius[k];
+        is_match[k] = is_match[k] & (dist_sq <= max_distance * max_distance);
+    }
+}
+
+/// \brief Keeps the lanes which intersect `box`, see `Cylinder::intersects(Box3D)`.
+inline void capsules_intersect_box(const Box3D& box, const SegmentBatch& batch,
+                                   LeafLanes<lane_mask_t>& is_match) {
+    const auto& lo = box.min_corner();
+    const auto& hi = box.max_corner();
+    const CoordType lo_x = lo.get<0>(), lo_y = lo.get<1>(), lo_z = lo.get<2>();
+    const CoordType hi_x = hi.get<0>(), hi_y = hi.get<1>(), hi_z = hi.get<2>();
+
+    auto cap_dist_sq = [&](CoordType x, CoordType y, CoordType z) {
+        const CoordType dx = std::min(std::max(lo_x, x), hi_x) - x;
+        const CoordType dy = std::min(std::max(lo_y, y), hi_y) - y;
+        const CoordType dz = std::min(std::max(lo_z, z), hi_z) - z;
+        return dx * dx + dy * dy + dz * dz;
+    };
+
+    LeafLanes<lane_mask_t> is_hit;
+    lane_mask_t is_decided = 1;
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        const CoordType r2 = batch.radius[k] * batch.radius[k];
+        is_hit[k] = (cap_dist_sq(batch.p1_x[k], batch.p1_y[k], batch.p1_z[k]) < r2)
+                  | (cap_dist_sq(batch.p2_x[k], batch.p2_y[k], batch.p2_z[k]) < r2);
+
+        is_decided = is_decided & (is_hit[k] | !is_match[k]);
+    }
+
+    if(!is_decided) {
+        const std::array<std::array<CoordType, 3>, 8> corners{{
+            {lo_x, lo_y, lo_z}, {hi_x, lo_y, lo_z}, {hi_x, hi_y, lo_z}, {lo_x, hi_y, lo_z},
+            {lo_x, lo_y, hi_z}, {hi_x, lo_y, hi_z}, {hi_x, hi_y, hi_z}, {lo_x, hi_y, hi_z}
+        }};
+
+        // The 12 edges, in the same order as `Cylinder::intersects(Box3D)`.
+        const std::array<std::array<size_t, 2>, 12> edges{{
+            {0, 1}, {1, 2}, {2, 3}, {3, 0},
+            {0, 4}, {1, 5}, {2, 6}, {3, 7},
+            {4, 5}, {5, 6}, {6, 7}, {7, 4}
+        }};
+
+        for(const auto& edge : edges) {
+            const auto& s1 = corners[edge[0]];
+            const auto& s2 = corners[edge[1]];
+
+            for(size_t k = 0; k < leaf_batch_size; ++k) {
+                const CoordType dist_sq = square_distance_segment_segment_lane(
+                    s1[0], s1[1], s1[2],
+                    s2[0], s2[1], s2[2],
+                    batch.p1_x[k], batch.p1_y[k], batch.p1_z[k],
+                    batch.p2_x[k], batch.p2_y[k], batch.p2_z[k]
+                );
+
+                is_hit[k] = is_hit[k] | (dist_sq < batch.radius[k] * batch.radius[k]);
+            }
+        }
+
+        // The axis might cross the box; this test is rarely needed.
+        for(size_t k = 0; k < leaf_batch_size; ++k) {
+            if(is_match[k] && !is_hit[k]) {
+                const auto c = batch.cylinder(k);
+                is_hit[k] = segment_intersects(box, c.p1, c.p2);
+            }
+        }
+    }
+
+    for(size_t k = 0; k < leaf_batch_size; ++k) {
+        is_match[k] = is_match[k] & is_hit[k];
+    }
+}
+
+
+/**
+ * \brief Which segments of `batch` intersect `shape`?
+ *
+ * Same as the predicate of `IndexTree` queries, i.e. the bounding box of the
+ * segment must intersect the bounding box of the query shape; and the
+ * segment must intersect the query shape according to `GeometryMode`.
+ */
+template <class GeometryMode, class ShapeT>
+inline void leaf_intersects(const ShapeT& shape,
+                            const Box3D& query_box,
+                            const SegmentBatch& batch,
+                            LeafLanes<lane_mask_t>& is_match) {
+    boxes_intersect(query_box, batch, is_match);
+
+    if constexpr (std::is_same<GeometryMode, BoundingBoxGeometry>::value) {
+        if constexpr (shape_matches_any_of<ShapeT, Box3D>()) {
+            // Done, the query shape is its bounding box.
+        } else if constexpr (shape_matches_any_of<ShapeT, Sphere>()) {
+            sphere_intersects_boxes(shape, batch, is_match);
+        } else {
+            for(size_t k = 0; k < leaf_batch_size; ++k) {
+                is_match[k] = is_match[k]
+                    && geometry_intersects(shape, batch.bounding_box(k), GeometryMode{});
+            }
+        }
+    } else {
+        if constexpr (shape_matches_any_of<ShapeT, Box3D>()) {
+            capsules_intersect_box(shape, batch, is_match);
+        } else if constexpr (shape_matches_any_of<ShapeT, Sphere>()) {
+            sphere_intersects_capsules(shape, batch, is_match);
+        } else if constexpr (shape_matches_any_of<ShapeT, Cylinder>()) {
+            cylinder_intersects_capsules(shape, batch, is_match);
+        } else {
+            for(size_t k = 0; k < leaf_batch_size; ++k) {
+                is_match[k] = is_match[k]
+                    && geometry_intersects(shape, batch.cylinder(k), GeometryMode{});
+            }
+        }
+    }
+}
+
+}  // namespace detail
+}  // namespace brain_indexer
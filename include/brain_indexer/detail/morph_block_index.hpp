@@ -0,0 +1,344 @@
+#pragma once
+
+#include "../morph_block_index.hpp"
+#include "leaf_kernels.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace brain_indexer {
+
+/////////////////////////////////////////
+// struct SegmentArrays
+/////////////////////////////////////////
+
+inline void SegmentArrays::reserve(size_t n) {
+    for(auto* coords : {&p1_x, &p1_y, &p1_z, &p2_x, &p2_y, &p2_z, &radius}) {
+        coords->reserve(n);
+    }
+
+    id.reserve(n);
+    section_type.reserve(n);
+}
+
+inline void SegmentArrays::push_back(const Segment& segment) {
+    p1_x.push_back(segment.p1.get<0>());
+    p1_y.push_back(segment.p1.get<1>());
+    p1_z.push_back(segment.p1.get<2>());
+    p2_x.push_back(segment.p2.get<0>());
+    p2_y.push_back(segment.p2.get<1>());
+    p2_z.push_back(segment.p2.get<2>());
+    radius.push_back(segment.radius);
+    id.push_back(segment.id);
+    section_type.push_back(segment.section_type());
+}
+
+inline Cylinder SegmentArrays::cylinder(size_t i) const noexcept {
+    return Cylinder{Point3D{p1_x[i], p1_y[i], p1_z[i]},
+                    Point3D{p2_x[i], p2_y[i], p2_z[i]},
+                    radius[i]};
+}
+
+inline Segment SegmentArrays::segment(size_t i) const {
+    auto ids = MorphPartId{};
+    ids.id = id[i];
+
+    auto c = cylinder(i);
+    return Segment(ids.gid(), ids.section_id(), ids.segment_id(),
+                   c.p1, c.p2, c.radius, section_type[i]);
+}
+
+
+/////////////////////////////////////////
+// class MorphBlockIndexTree
+/////////////////////////////////////////
+
+namespace detail {
+
+struct GetSegmentCentroid {
+    template <size_t dim>
+    inline static CoordType apply(const Segment& segment) {
+        return segment.get_centroid_coord<dim>();
+    }
+};
+
+}  // namespace detail
+
+template <typename InputIt>
+inline MorphBlockIndexTree::MorphBlockIndexTree(InputIt first, InputIt last) {
+    std::vector<Segment> segments;
+    std::vector<Soma> somas;
+
+    for(auto it = first; it != last; ++it) {
+        boost::apply_visitor([&segments, &somas](const auto& entry) {
+            if constexpr (std::is_same<std::decay_t<decltype(entry)>, Soma>::value) {
+                somas.push_back(entry);
+            } else {
+                segments.push_back(entry);
+            }
+        }, MorphoEntry(*it));
+    }
+
+    // Each part of the STR becomes one block. The heuristic picks at least
+    // `n / max_block_size` parts, therefore no block is larger than
+    // `max_block_size`.
+    auto str_params = SerialSTRParams::from_heuristic(segments.size(), max_block_size);
+    serial_sort_tile_recursion<Segment, detail::GetSegmentCentroid>(segments, str_params);
+    auto boundaries = str_params.partition_boundaries();
+
+    std::vector<IndexedSubtreeBox> blocks;
+    segments_.reserve(segments.size());
+    offsets_.push_back(0);
+
+    for(size_t k = 0; k + 1 < boundaries.size(); ++k) {
+        auto low = boundaries[k];
+        auto high = boundaries[k + 1];
+        if(low == high) {
+            continue;
+        }
+
+        auto box = segments[low].bounding_box();
+        for(size_t i = low; i < high; ++i) {
+            bg::expand(box, segments[i].bounding_box());
+            segments_.push_back(segments[i]);
+        }
+
+        blocks.emplace_back(offsets_.size() - 1, high - low, box);
+        offsets_.push_back(segments_.size());
+    }
+
+    blocks_ = IndexTree<IndexedSubtreeBox>(blocks);
+    somas_ = IndexTree<Soma>(somas);
+}
+
+template <typename GeometryMode, typename ShapeT, typename F>
+inline bool MorphBlockIndexTree::for_each_intersecting(const ShapeT& shape, F&& f) const {
+    const auto query_box = bgi::indexable<ShapeT>{}(shape);
+    auto real_intersects = [&shape](const auto& v) {
+        return geometry_intersects(shape, v, GeometryMode{});
+    };
+
+    auto soma_predicate = bgi::intersects(query_box) && bgi::satisfies(real_intersects);
+    for(auto it = somas_.qbegin(soma_predicate); it != somas_.qend(); ++it) {
+        if(!f(MorphoEntry(*it))) {
+            return false;
+        }
+    }
+
+    for(auto it = blocks_.qbegin(bgi::intersects(query_box)); it != blocks_.qend(); ++it) {
+        auto keep_going = for_each_intersecting_segment<GeometryMode>(
+            shape, query_box, *it, [this, &f](size_t i) {
+                return f(MorphoEntry(segments_.segment(i)));
+            }
+        );
+
+        if(!keep_going) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <typename GeometryMode, typename ShapeT, typename F>
+inline bool MorphBlockIndexTree::for_each_intersecting_segment(const ShapeT& shape,
+                                                               const Box3D& query_box,
+                                                               const IndexedSubtreeBox& block,
+                                                               F&& f) const {
+    detail::SegmentBatch batch;
+    detail::LeafLanes<detail::lane_mask_t> is_match;
+
+    auto last = offsets_[block.id + 1];
+    for(size_t first = offsets_[block.id]; first < last; first += detail::leaf_batch_size) {
+        auto n = std::min(detail::leaf_batch_size, last - first);
+        batch.load(segments_, first, n);
+        detail::leaf_intersects<GeometryMode>(shape, query_box, batch, is_match);
+
+        for(size_t k = 0; k < n; ++k) {
+            if(is_match[k] && !f(first + k)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template <typename GeometryMode, typename ShapeT, typename OutputIt>
+inline void MorphBlockIndexTree::find_intersecting(const ShapeT& shape,
+                                                   const OutputIt& iter) const {
+    auto out = iter;
+    for_each_intersecting<GeometryMode>(shape, [&out](const MorphoEntry& entry) {
+        *out = entry;
+        ++out;
+        return true;
+    });
+}
+
+template <typename GeometryMode, typename ShapeT>
+inline bool MorphBlockIndexTree::is_intersecting(const ShapeT& shape) const {
+    return !for_each_intersecting<GeometryMode>(shape, [](const MorphoEntry&) {
+        return false;
+    });
+}
+
+template <typename GeometryMode, typename ShapeT>
+inline size_t MorphBlockIndexTree::count_intersecting(const ShapeT& shape) const {
+    const auto query_box = bgi::indexable<ShapeT>{}(shape);
+    size_t count = somas_.template count_intersecting<GeometryMode>(shape);
+
+    for(auto it = blocks_.qbegin(bgi::intersects(query_box)); it != blocks_.qend(); ++it) {
+        if(std::is_same<GeometryMode, BoundingBoxGeometry>::value
+           && detail::shape_covers(shape, it->bounding_box())) {
+            count += it->n_elements;
+            continue;
+        }
+
+        for_each_intersecting_segment<GeometryMode>(shape, query_box, *it, [&count](size_t) {
+            ++count;
+            return true;
+        });
+    }
+
+    return count;
+}
+
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<MorphoEntry>
+MorphBlockIndexTree::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<MorphoEntry> results;
+    find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+template <typename ShapeT>
+inline std::vector<gid_segm_t>
+MorphBlockIndexTree::find_nearest(const ShapeT& shape, unsigned k_neighbors) const {
+    if(k_neighbors == 0) {
+        return {};
+    }
+
+    auto candidates = detail::NearestCandidates<MorphoEntry>(k_neighbors);
+
+    for(auto it = somas_.qbegin(bgi::nearest(shape, k_neighbors)); it != somas_.qend(); ++it) {
+        candidates.push(bg::comparable_distance(shape, it->bounding_box()), *it);
+    }
+
+    // Blocks are visited by increasing distance. Once a block is further away
+    // than the current k-th candidate, none of its segments can be closer.
+    if(!blocks_.empty()) {
+        auto n_blocks = util::integer_cast<unsigned>(blocks_.size());
+        for(auto it = blocks_.qbegin(bgi::nearest(shape, n_blocks)); it != blocks_.qend(); ++it) {
+            if(bg::comparable_distance(shape, it->bounding_box()) > candidates.max_distance()) {
+                break;
+            }
+
+            for(size_t i = offsets_[it->id]; i < offsets_[it->id + 1]; ++i) {
+                auto distance = bg::comparable_distance(
+                    shape, segments_.cylinder(i).bounding_box()
+                );
+
+                if(distance < candidates.max_distance()) {
+                    candidates.push(distance, segments_.segment(i));
+                }
+            }
+        }
+    }
+
+    return detail::nearest_ids(std::move(candidates).sorted());
+}
+
+inline std::pair<std::vector<gid_segm_t>, std::vector<CoordType>>
+MorphBlockIndexTree::find_nearest_exact(const Point3D& point, unsigned k_neighbors) const {
+    auto candidates = detail::NearestCandidates<MorphoEntry>(k_neighbors);
+
+    detail::find_nearest_exact(somas_, point, candidates);
+
+    // The bounding box of a block contains its segments.
+    if(!blocks_.empty()) {
+        auto n_blocks = util::integer_cast<unsigned>(blocks_.size());
+        for(auto it = blocks_.qbegin(bgi::nearest(point, n_blocks)); it != blocks_.qend(); ++it) {
+            if(!(bg::distance(point, it->bounding_box()) < candidates.max_distance())) {
+                break;
+            }
+
+            for(size_t i = offsets_[it->id]; i < offsets_[it->id + 1]; ++i) {
+                auto distance = geometry_distance(point, segments_.cylinder(i));
+                if(distance < candidates.max_distance()) {
+                    candidates.push(distance, segments_.segment(i));
+                }
+            }
+        }
+    }
+
+    return detail::nearest_ids_and_distances(std::move(candidates).sorted());
+}
+
+inline Box3D MorphBlockIndexTree::bounds() const {
+    if(somas_.empty()) {
+        return blocks_.bounds();
+    }
+
+    auto box = somas_.bounds();
+    if(!blocks_.empty()) {
+        bg::expand(box, blocks_.bounds());
+    }
+
+    return box;
+}
+
+
+/////////////////////////////////////////
+// class QueryCursor<MorphBlockIndexTree>
+/////////////////////////////////////////
+
+template <typename GeometryMode, typename ShapeT>
+inline QueryCursor<MorphBlockIndexTree, GeometryMode, ShapeT>::QueryCursor(
+    const MorphBlockIndexTree& index, const ShapeT& shape)
+    : index_(&index)
+    , shape_(shape)
+    , query_box_(bgi::indexable<ShapeT>{}(shape))
+    , soma_it_(index.somas_.qbegin(detail::intersects_predicates<GeometryMode>(shape)))
+    , block_it_(index.blocks_.qbegin(bgi::intersects(query_box_))) {}
+
+template <typename GeometryMode, typename ShapeT>
+template <typename OutputIt>
+inline size_t
+QueryCursor<MorphBlockIndexTree, GeometryMode, ShapeT>::next(size_t max_elements,
+                                                             const OutputIt& iter) {
+    auto out = iter;
+
+    size_t n = 0;
+    for(; n < max_elements && soma_it_ != index_->somas_.qend(); ++n, ++soma_it_) {
+        *out = MorphoEntry(*soma_it_);
+        ++out;
+    }
+
+    while(n < max_elements) {
+        if(next_match_ < matches_.size()) {
+            *out = MorphoEntry(index_->segments_.segment(matches_[next_match_]));
+            ++out;
+            ++next_match_;
+            ++n;
+            continue;
+        }
+
+        if(block_it_ == index_->blocks_.qend()) {
+            break;
+        }
+
+        matches_.clear();
+        next_match_ = 0;
+        index_->template for_each_intersecting_segment<GeometryMode>(
+            shape_, query_box_, *block_it_, [this](size_t i) {
+                matches_.push_back(i);
+                return true;
+            }
+        );
+        ++block_it_;
+    }
+
+    return n;
+}
+
+}  // namespace brain_indexer
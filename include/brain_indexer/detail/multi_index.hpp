@@ -1,10 +1,70 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <ostream>
+#include <streambuf>
+#include <system_error>
+#include <unordered_set>
+
+#include <boost/interprocess/streams/bufferstream.hpp>
+
 #include <brain_indexer/distributed_sort_tile_recursion.hpp>
 #include <brain_indexer/meta_data.hpp>
 
 namespace brain_indexer {
 
+namespace detail {
+
+/** \brief A stream buffer which appends everything written to a `std::string`.
+ *
+ * Unlike the buffer of `std::ostringstream`, the string can be moved out
+ * without copying it.
+ */
+class StringOutputBuffer : public std::streambuf {
+  public:
+    explicit StringOutputBuffer(std::string& buffer)
+        : buffer_(buffer) { }
+
+  protected:
+    int_type overflow(int_type c) override {
+        if(!traits_type::eq_int_type(c, traits_type::eof())) {
+            buffer_.push_back(traits_type::to_char_type(c));
+        }
+
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize n) override {
+        buffer_.append(data, size_t(n));
+        return n;
+    }
+
+  private:
+    std::string& buffer_;
+};
+
+/// \brief Boost serialize `object` into a string.
+template <class T>
+inline std::string binary_serialize(const T& object) {
+    auto buffer = std::string();
+    {
+        StringOutputBuffer streambuf(buffer);
+        std::ostream os(&streambuf);
+        boost::archive::binary_oarchive oa(os);
+        oa << object;
+    }
+
+    return buffer;
+}
+
+}  // namespace detail
+
+
 template <class Derived, class TopTree, class SubTree, class Filenames>
 MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::MultiIndexStorage(std::string output_dir)
     : output_dir(std::move(output_dir)) {
@@ -27,6 +87,21 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::save_subtree(
     Derived::save_tree(subtree, Filenames::subtree(output_dir, subtree_id));
 }
 template <class Derived, class TopTree, class SubTree, class Filenames>
+inline std::string
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::serialize_subtree(
+    const SubTree& subtree) {
+
+    return Derived::serialize_tree(subtree);
+}
+template <class Derived, class TopTree, class SubTree, class Filenames>
+inline void
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::write_subtree(
+    const std::string& buffer,
+    size_t subtree_id) const {
+
+    Derived::write_serialized_tree(buffer, Filenames::subtree(output_dir, subtree_id));
+}
+template <class Derived, class TopTree, class SubTree, class Filenames>
 inline void
 MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::save_top_tree(
     const TopTree& tree) const {
@@ -76,6 +151,14 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_top_tree(
     return Derived::template load_tree<TopTree>(Filenames::top_tree(output_dir));
 }
 
+template <class Derived, class TopTree, class SubTree, class Filenames>
+inline size_t
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::subtree_bytes_on_disk(
+    size_t subtree_id) const {
+
+    return std::filesystem::file_size(Filenames::subtree(output_dir, subtree_id));
+}
+
 template <class TopTree, class SubTree>
 inline
 NativeStorage<TopTree, SubTree>::NativeStorage(std::string output_dir)
@@ -88,7 +171,32 @@ inline void
 NativeStorage<TopTree, SubTree>::save_tree(const RTree& rtree,
                                            const std::string& filename) {
 
-    save_tree_impl(rtree, filename);
+    write_serialized_tree(serialize_tree(rtree), filename);
+}
+
+template <class TopTree, class SubTree>
+template <class RTree>
+inline std::string
+NativeStorage<TopTree, SubTree>::serialize_tree(const RTree& rtree) {
+    auto buffer = serialize_tree_impl(rtree);
+    util::check_signals();
+
+    return buffer;
+}
+
+template <class TopTree, class SubTree>
+inline void
+NativeStorage<TopTree, SubTree>::write_serialized_tree(const std::string& buffer,
+                                                       const std::string& filename) {
+    // The buffer is larger than the one of the stream; hence it's passed on
+    // to the filesystem as a single large write.
+    auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
+    ofs.write(buffer.data(), std::streamsize(buffer.size()));
+    ofs.close();
+
+    if(!ofs) {
+        throw std::runtime_error("Failed to write: " + filename);
+    }
     util::check_signals();
 }
 
@@ -115,85 +223,158 @@ NativeStorage<TopTree, SubTree>::load_tree_impl(bgi::rtree<Args...>& tree,
 
 template <class TopTree, class SubTree>
 template <class... Args>
+inline std::string
+NativeStorage<TopTree, SubTree>::serialize_tree_impl(const bgi::rtree<Args...>& tree) {
+    return detail::binary_serialize(tree);
+}
+
+
+template <class T>
 inline void
-NativeStorage<TopTree, SubTree>::save_tree_impl(const bgi::rtree<Args...>& tree,
-                                                const std::string& filename) {
-    auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
-    boost::archive::binary_oarchive oa(ofs);
-    oa << tree;
+MemoryMappedStorage<T>::save_subtree(const in_memory_subtree_type& subtree,
+                                     size_t subtree_id) const {
+    auto filename = MemoryMappedFilenames::subtree(output_dir, subtree_id);
+    detail::write_memory_mapped_tree<T>(filename, subtree.begin(), subtree.end(), subtree.size());
+    util::check_signals();
 }
 
+template <class T>
+inline void
+MemoryMappedStorage<T>::save_top_tree(const toptree_type& tree) const {
+    NativeStorageT<T>::save_top_tree(tree, output_dir);
+}
 
-template <class Storage>
-inline double
-UsageRateCache<Storage>::MetaData::usage_rate(size_t query_count) const {
-    if (query_count == load_generation_) {
-        // These were loaded during this query. Try not to evict these. However,
-        // it's safe to evict these since the subtree that will be queried next
-        // will be loaded after this eviction; and therefore can't be evicted
-        // before it's ever used.
-        return std::numeric_limits<double>::max();
-    }
+template <class T>
+inline auto
+MemoryMappedStorage<T>::load_subtree(size_t subtree_id) const -> subtree_type {
+    return subtree_type::open_file(MemoryMappedFilenames::subtree(output_dir, subtree_id));
+}
 
-    return double(access_count()) / double(incache_count(query_count));
+template <class T>
+inline auto
+MemoryMappedStorage<T>::load_top_tree() const -> toptree_type {
+    return NativeStorageT<T>::load_top_tree(output_dir);
 }
 
-template <class Storage>
+template <class T>
 inline size_t
-UsageRateCache<Storage>::MetaData::access_count() const {
-    return previous_access_count_ + current_access_count_;
+MemoryMappedStorage<T>::subtree_bytes_on_disk(size_t subtree_id) const {
+    return std::filesystem::file_size(MemoryMappedFilenames::subtree(output_dir, subtree_id));
 }
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::incache_count(size_t query_count) const {
-    return (query_count - load_generation_ + 1) + previous_age_;
+
+template <class T>
+SharedMemoryStorage<T>::SharedMemoryStorage(std::string output_dir,
+                                            const SharedSubtreeCacheParams& params)
+    : output_dir(std::move(output_dir))
+    , shared_cache_(std::make_shared<SharedSubtreeCache>(
+          SharedSubtreeCache::default_name(this->output_dir,
+                                           NativeFilenames::top_tree(this->output_dir)),
+          params)) {}
+
+template <class T>
+inline void
+SharedMemoryStorage<T>::save_subtree(const in_memory_subtree_type& subtree,
+                                     size_t subtree_id) const {
+    NativeStorageT<T>::save_subtree(subtree, output_dir, subtree_id);
 }
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::eviction_count() const {
-    return eviction_count_;
+template <class T>
+inline void
+SharedMemoryStorage<T>::save_top_tree(const toptree_type& tree) const {
+    NativeStorageT<T>::save_top_tree(tree, output_dir);
+}
+
+template <class T>
+inline auto
+SharedMemoryStorage<T>::load_subtree(size_t subtree_id) const -> subtree_type {
+    auto load = [this, subtree_id](const std::string& segment_name) {
+        auto subtree = NativeStorageT<T>::load_subtree(output_dir, subtree_id);
+        detail::write_managed_tree<T, bip::managed_shared_memory>(
+            segment_name, subtree.begin(), subtree.end(), subtree.size(),
+            [](const std::string& name) { bip::shared_memory_object::remove(name.c_str()); }
+        );
+    };
+
+    auto segment = shared_cache_->acquire(subtree_id, load);
+    return subtree_type::from_segment(*segment, segment);
 }
 
+template <class T>
+inline auto
+SharedMemoryStorage<T>::load_top_tree() const -> toptree_type {
+    return NativeStorageT<T>::load_top_tree(output_dir);
+}
+
+
 template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_query() {
-    ++current_access_count_;
+inline bool
+UsageRateCache<Storage>::Entry::is_cached() const {
+    return subtree.valid();
 }
 
 template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_load(size_t query_count) {
-    load_generation_ = query_count;
-    current_access_count_ = 1;
+inline bool
+UsageRateCache<Storage>::Entry::is_in_use() const {
+    auto status = subtree.wait_for(std::chrono::seconds(0));
+    if(status != std::future_status::ready) {
+        // Still being loaded.
+        return true;
+    }
+
+    if(!lease.expired()) {
+        // Someone holds a future of the subtree.
+        return true;
+    }
+
+    // One reference is owned by the cache itself.
+    return subtree.get().use_count() > 1;
 }
 
 template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_evict(size_t query_count) {
-    previous_access_count_ += current_access_count_;
-    previous_age_ = query_count - load_generation_ + 1;
+inline std::shared_ptr<const void>
+UsageRateCache<Storage>::Entry::acquire_lease() {
+    auto shared_lease = lease.lock();
+    if(shared_lease == nullptr) {
+        shared_lease = std::make_shared<char>();
+        lease = shared_lease;
+    }
 
-    current_access_count_ = 0;
-    eviction_count_ += 1;
+    return shared_lease;
+}
+
+template <class Storage>
+inline bool
+UsageRateCache<Storage>::Entry::is_evictable() const {
+    return is_cached() && !is_pinned && !is_in_use();
 }
 
 
 template <class Storage>
 UsageRateCache<Storage>::~UsageRateCache() {
+    // Pending loads refer to the cache. Those which haven't started are
+    // cancelled, the others must finish first.
+    is_stopping_ = true;
+    io_pool_ = nullptr;
+
     auto should_write = util::read_boolean_environment_variable("SI_REPORT_USAGE_STATS");
 
     if(should_write) {
+        auto query_count = most_recent_query_count.load();
+
         nlohmann::json j;
-        for(const auto &[id, md] : meta_data) {
-            j.push_back({
-                { "id", id },
-                { "access_count", md.access_count() },
-                { "eviction_count", md.eviction_count() },
-                { "incache_count", md.incache_count(most_recent_query_count) },
-                { "usage_rate", md.usage_rate(most_recent_query_count) }
-            });
+        for(auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for(const auto &[id, entry] : shard.entries) {
+                const auto& md = entry.meta_data;
+                j.push_back({
+                    { "id", id },
+                    { "access_count", md.access_count() },
+                    { "eviction_count", md.eviction_count() },
+                    { "incache_count", md.incache_count(query_count) },
+                    { "usage_rate", md.usage_rate(query_count) }
+                });
+            }
         }
 
         auto filename = "si_cache_stats_" + util::iso_datetime_now() + ".json";
@@ -207,91 +388,389 @@ template <class Storage>
 template<class SubtreeID>
 inline auto
 UsageRateCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t query_count)
-        -> const subtree_type& {
+        -> subtree_ptr {
 
-    most_recent_query_count = query_count;
     auto id = subtree_id.id;
+    auto n_elements = subtree_id.n_elements;
+
+    std::promise<subtree_ptr> promise;
+    subtree_future subtree;
+    if(!find_or_reserve(id, query_count, promise, subtree)) {
+        return subtree.get();
+    }
 
-    const auto& found = subtrees.find(id);
-    if (found == subtrees.end()) {
-        evict_subtrees(subtree_id, query_count);
+    fulfill(id, n_elements, query_count, promise);
+    return subtree.get();
+}
+
+
+template <class Storage>
+template<class SubtreeID>
+inline auto
+UsageRateCache<Storage>::load_subtree_async(const SubtreeID& subtree_id, size_t query_count)
+        -> subtree_future {
 
-        meta_data[id].on_load(query_count);
-        return subtrees[id] = storage.load_subtree(id);
+    auto id = subtree_id.id;
+    auto n_elements = subtree_id.n_elements;
+
+    // The promise must outlive this call, since it's fulfilled by the I/O thread.
+    auto promise = std::make_shared<std::promise<subtree_ptr>>();
+    subtree_future subtree;
+    if(!find_or_reserve(id, query_count, *promise, subtree)) {
+        return subtree;
     }
 
-    meta_data[id].on_query();
-    return found->second;
+    auto load = [this, id, n_elements, query_count, promise]() {
+        if(is_stopping_) {
+            cancel(id, *promise);
+            return;
+        }
+
+        try {
+            fulfill(id, n_elements, query_count, *promise);
+        }
+        catch(...) {
+            // The error has been stored in `promise`.
+        }
+    };
+
+    io_pool().submit(load, [this, id, promise]() { cancel(id, *promise); });
+
+    return subtree;
 }
 
+
 template <class Storage>
-inline size_t
-UsageRateCache<Storage>::cached_elements() const {
-    size_t n_cached_elements = 0ul;
-    for(const auto &[_, subtree] : subtrees) {
-        n_cached_elements += subtree.size();
+template<class SubtreeID>
+inline auto
+UsageRateCache<Storage>::prefetch(const std::vector<SubtreeID>& subtree_ids,
+                                  size_t query_count)
+        -> std::vector<subtree_future> {
+
+    auto requested = std::vector<subtree_future>();
+
+    size_t n_bytes = 0;
+    for(const auto& subtree_id : subtree_ids) {
+        n_bytes += estimated_footprint(subtree_id.n_elements);
+        if(n_bytes > cache_params.max_cached_bytes || is_stopping_) {
+            break;
+        }
+
+        requested.push_back(load_subtree_async(subtree_id, query_count));
     }
 
-    return n_cached_elements;
+    return requested;
 }
 
 
 template <class Storage>
 template<class SubtreeID>
+inline auto
+UsageRateCache<Storage>::pin(const SubtreeID& subtree_id, size_t query_count)
+        -> subtree_future {
+
+    // Pinned before loading, such that the subtree can't be evicted between
+    // being loaded and being pinned.
+    {
+        auto& shard = this->shard(subtree_id.id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries[subtree_id.id].is_pinned = true;
+    }
+
+    return load_subtree_async(subtree_id, query_count);
+}
+
+
+template <class Storage>
 inline void
-UsageRateCache<Storage>::evict_subtrees(const SubtreeID& subtree_id,
-                                        size_t query_count) {
-    auto n_cached_elements = cached_elements();
-    auto n_elements = subtree_id.n_elements;
+UsageRateCache<Storage>::unpin(size_t subtree_id) {
+    auto& shard = this->shard(subtree_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
-    if (n_cached_elements + n_elements <= cache_params.max_cached_elements) {
-        return;
+    auto it = shard.entries.find(subtree_id);
+    if(it != shard.entries.end()) {
+        it->second.is_pinned = false;
+    }
+}
+
+
+template <class Storage>
+inline void
+UsageRateCache<Storage>::unpin_all() {
+    for(auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for(auto& [id, entry] : shard.entries) {
+            entry.is_pinned = false;
+        }
     }
+}
 
-    auto loaded_subtree_ids = subtree_ids_sorted_by_usage_rate(query_count);
 
-    auto n_evict = std::min(cache_params.max_evict, loaded_subtree_ids.size());
-    for (size_t k = 0; k < n_evict; ++k) {
-        size_t i = loaded_subtree_ids[k];
-        auto it = subtrees.find(i);
-        if (it == subtrees.end()) {
-            throw std::runtime_error("Failed to find a supposedly loaded subtree.");
+template <class Storage>
+inline bool
+UsageRateCache<Storage>::find_or_reserve(size_t subtree_id,
+                                         size_t query_count,
+                                         std::promise<subtree_ptr>& promise,
+                                         subtree_future& subtree) {
+
+    most_recent_query_count.store(query_count, std::memory_order_relaxed);
+
+    {
+        auto& shard = this->shard(subtree_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& entry = shard.entries[subtree_id];
+
+        if (!entry.is_cached()) {
+            // The caller is responsible for loading the subtree. Others
+            // requesting it in the meantime wait on `entry.subtree`.
+            entry.subtree = promise.get_future().share();
+            entry.meta_data.on_load(query_count);
+
+            subtree = subtree_future(entry.subtree, entry.acquire_lease());
+            counters_->on_miss();
+            return true;
         }
 
-        meta_data[i].on_evict(query_count);
-        subtrees.erase(it);
+        entry.meta_data.on_query();
+        subtree = subtree_future(entry.subtree, entry.acquire_lease());
     }
+    counters_->on_hit();
+
+    // The policy is informed without holding the lock of the shard.
+    std::lock_guard<std::mutex> lock(policy_mutex);
+    policy->on_access(subtree_id, query_count);
+
+    return false;
 }
 
 
 template <class Storage>
-inline std::vector<size_t>
-UsageRateCache<Storage>::subtree_ids_sorted_by_usage_rate(size_t query_count) {
-    std::vector<size_t> loaded_subtree_ids;
-    loaded_subtree_ids.reserve(subtrees.size());
+inline void
+UsageRateCache<Storage>::fulfill(size_t subtree_id,
+                                 size_t n_elements,
+                                 size_t query_count,
+                                 std::promise<subtree_ptr>& promise) {
+
+    size_t n_reserved = 0;
+    try {
+        auto n_estimated = estimated_footprint(n_elements);
+        evict_subtrees(subtree_id, 0, n_estimated, query_count);
+        n_reserved = n_estimated;
+
+        // Constructing in-place avoids copying the subtree.
+        auto start = std::chrono::steady_clock::now();
+        auto loaded = subtree_ptr(new subtree_type(storage.load_subtree(subtree_id)));
+        auto load_time = std::chrono::steady_clock::now() - start;
+        counters_->on_load(load_time, bytes_on_disk(subtree_id));
+
+        auto n_bytes = detail::memory_footprint(*loaded);
+        evict_subtrees(subtree_id, n_reserved, n_bytes, query_count);
+        n_reserved = n_bytes;
+
+        n_measured_bytes += n_bytes;
+        n_measured_elements += n_elements;
+
+        {
+            auto& shard = this->shard(subtree_id);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.entries[subtree_id].n_bytes = n_bytes;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(policy_mutex);
+            policy->on_load(subtree_id, query_count);
+        }
 
-    for (const auto& [id, _]: subtrees) {
-        loaded_subtree_ids.push_back(id);
+        promise.set_value(std::move(loaded));
     }
+    catch(...) {
+        release_reservation(subtree_id);
+        n_cached_bytes -= n_reserved;
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
 
-    std::sort(loaded_subtree_ids.begin(),
-              loaded_subtree_ids.end(),
-              [&](const auto& il, const auto& ir) {
-                  auto usage_rate_left = meta_data[il].usage_rate(query_count);
-                  auto usage_rate_right = meta_data[ir].usage_rate(query_count);
 
-                  return usage_rate_left < usage_rate_right;
-              });
+template <class Storage>
+inline void
+UsageRateCache<Storage>::release_reservation(size_t subtree_id) {
+    auto& shard = this->shard(subtree_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
-    return loaded_subtree_ids;
+    auto& entry = shard.entries[subtree_id];
+    entry.subtree = std::shared_future<subtree_ptr>{};
+    entry.meta_data.on_load_failed();
+}
+
+
+template <class Storage>
+inline void
+UsageRateCache<Storage>::cancel(size_t subtree_id, std::promise<subtree_ptr>& promise) {
+    release_reservation(subtree_id);
+
+    auto error = std::runtime_error("The cache was destroyed before loading the subtree.");
+    promise.set_exception(std::make_exception_ptr(error));
+}
+
+
+template <class Storage>
+inline size_t
+UsageRateCache<Storage>::bytes_on_disk(size_t subtree_id) {
+    auto& shard = this->shard(subtree_id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto n_bytes_on_disk = shard.entries[subtree_id].n_bytes_on_disk;
+        if(n_bytes_on_disk != 0) {
+            return n_bytes_on_disk;
+        }
+    }
+
+    auto n_bytes_on_disk = detail::subtree_bytes_on_disk<Storage>::apply(storage, subtree_id);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entries[subtree_id].n_bytes_on_disk = n_bytes_on_disk;
+    return n_bytes_on_disk;
+}
+
+
+template <class Storage>
+inline ThreadPool&
+UsageRateCache<Storage>::io_pool() {
+    std::lock_guard<std::mutex> lock(io_pool_mutex);
+    if(io_pool_ == nullptr) {
+        io_pool_ = std::make_unique<ThreadPool>(std::max(cache_params.n_io_threads, 1ul));
+    }
+
+    return *io_pool_;
+}
+
+template <class Storage>
+inline size_t
+UsageRateCache<Storage>::cached_bytes() const {
+    return n_cached_bytes.load();
+}
+
+
+template <class Storage>
+inline MultiIndexStats
+UsageRateCache<Storage>::stats() const {
+    auto stats = counters_->snapshot();
+    stats.n_resident_bytes = cached_bytes();
+
+    return stats;
+}
+
+
+template <class Storage>
+inline SubtreeUsage
+UsageRateCache<Storage>::usage(size_t subtree_id) {
+    auto& shard = this->shard(subtree_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(subtree_id);
+    return it == shard.entries.end() ? SubtreeUsage{} : it->second.meta_data;
+}
+
+
+template <class Storage>
+inline size_t
+UsageRateCache<Storage>::estimated_footprint(size_t n_elements) const {
+    auto n_measured_elements = this->n_measured_elements.load();
+    if(n_measured_elements == 0) {
+        return n_elements * detail::assumed_element_size<subtree_type>::value;
+    }
+
+    auto bytes_per_element = double(n_measured_bytes.load()) / double(n_measured_elements);
+    return static_cast<size_t>(std::ceil(double(n_elements) * bytes_per_element));
+}
+
+
+template <class Storage>
+inline void
+UsageRateCache<Storage>::evict_subtrees(size_t subtree_id,
+                                        size_t n_reserved,
+                                        size_t n_bytes,
+                                        size_t query_count) {
+    std::lock_guard<std::mutex> lock(eviction_mutex);
+
+    auto fits = [this, n_reserved, n_bytes]() {
+        return cached_bytes() - n_reserved + n_bytes <= cache_params.max_cached_bytes;
+    };
+
+    auto is_evictable = [this, subtree_id](size_t id) {
+        return id != subtree_id && this->is_evictable(id);
+    };
+
+    while (!fits()) {
+        std::optional<size_t> victim;
+        {
+            std::lock_guard<std::mutex> policy_lock(policy_mutex);
+            victim = policy->pop_victim(query_count, is_evictable);
+        }
+
+        if (!victim) {
+            break;
+        }
+
+        if (!evict_subtree(*victim, query_count)) {
+            // It's started being used again since it was chosen.
+            std::lock_guard<std::mutex> policy_lock(policy_mutex);
+            policy->on_evict_aborted(*victim);
+        }
+    }
+
+    n_cached_bytes += n_bytes;
+    n_cached_bytes -= n_reserved;
+}
+
+
+template <class Storage>
+inline bool
+UsageRateCache<Storage>::is_evictable(size_t subtree_id) {
+    auto& shard = this->shard(subtree_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(subtree_id);
+    return it != shard.entries.end() && it->second.is_evictable();
+}
+
+
+template <class Storage>
+inline bool
+UsageRateCache<Storage>::evict_subtree(size_t subtree_id, size_t query_count) {
+    // The subtree is deallocated after releasing the lock.
+    std::shared_future<subtree_ptr> evicted;
+
+    auto& shard = this->shard(subtree_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(subtree_id);
+    if (it == shard.entries.end()) {
+        throw std::runtime_error("Failed to find a supposedly loaded subtree.");
+    }
+
+    auto& entry = it->second;
+    if(entry.is_evictable()) {
+        entry.meta_data.on_evict(query_count);
+        evicted = std::move(entry.subtree);
+        entry.subtree = std::shared_future<subtree_ptr>{};
+
+        n_cached_bytes -= entry.n_bytes;
+        counters_->on_evict();
+        return true;
+    }
+
+    return false;
 }
 
 
 template <class SubtreeCache>
 MultiIndexTreeBase<SubtreeCache>::MultiIndexTreeBase(const storage_type& storage,
-                                                     SubtreeCache subtree_cache)
+                                                     const UsageRateCacheParams& params)
     : top_rtree(storage.load_top_tree())
-    , subtree_cache(std::move(subtree_cache)) {
+    , subtree_cache(params, storage) {
 }
 
 
@@ -300,60 +779,95 @@ template <class Predicates, class OutIt>
 inline void
 MultiIndexTreeBase<SubtreeCache>::query(const Predicates& predicates,
                                         const OutIt& it) const {
+    auto query_id = query_count.fetch_add(1);
+
     auto to_query = std::vector<typename toptree_type::value_type>();
     top_rtree.query(predicates, std::back_inserter(to_query));
 
-    for (const auto& value: to_query) {
-        util::check_signals();
-        query_subtree(value, predicates, it);
-    }
+    auto& counters = subtree_cache.counters();
+    counters.on_query(to_query.size(), detail::count_elements(to_query));
 
-    ++query_count;
+    size_t n_results = 0;
+    for_each_subtree(to_query, query_id, [&predicates, &it, &n_results](const subtree_type& subtree) {
+        n_results += subtree.query(predicates, it);
+    });
+    counters.on_results(n_results);
 }
 
 
 template <class SubtreeCache>
-template <class SubtreeID, class Predicates, class OutIt>
+template <class SubtreeID, class F>
 inline void
-MultiIndexTreeBase<SubtreeCache>::query_subtree(const SubtreeID& subtree_id,
-                                                const Predicates& predicates,
-                                                const OutIt& it) const {
+MultiIndexTreeBase<SubtreeCache>::for_each_subtree(const std::vector<SubtreeID>& subtree_ids,
+                                                   size_t query_id,
+                                                   F&& f) const {
+    using subtree_future = decltype(subtree_cache.load_subtree_async(subtree_ids[0], 0ul));
+
+    auto window_size = subtree_cache.n_io_threads();
+    auto pending = std::deque<subtree_future>();
+    size_t n_requested = 0;
+
+    auto request_subtrees = [&]() {
+        for(; n_requested < subtree_ids.size() && pending.size() < window_size; ++n_requested) {
+            pending.push_back(subtree_cache.load_subtree_async(subtree_ids[n_requested], query_id));
+        }
+    };
+
+    request_subtrees();
+    while (!pending.empty()) {
+        util::check_signals();
 
-    const auto& subtree = load_subtree(subtree_id);
-    subtree.query(predicates, it);
+        // Prefer any subtree that's ready; otherwise, wait for the oldest
+        // request since it was submitted first.
+        auto ready = std::find_if(pending.begin(), pending.end(), [](const auto& subtree) {
+            return subtree.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+
+        if (ready == pending.end()) {
+            ready = pending.begin();
+        }
+
+        auto subtree = ready->get();
+        pending.erase(ready);
+
+        // The next subtree is loaded while this one is processed.
+        request_subtrees();
+
+        f(*subtree);
+    }
 }
 
 
 template <class SubtreeCache>
 template <class SubtreeID>
 inline auto
-MultiIndexTreeBase<SubtreeCache>::load_subtree(const SubtreeID& subtree_id) const
-        -> const subtree_type& {
-    return subtree_cache.load_subtree(subtree_id, query_count);
+MultiIndexTreeBase<SubtreeCache>::load_subtree(const SubtreeID& subtree_id) const {
+    return subtree_cache.load_subtree(subtree_id, query_count.load());
 }
 
-template <typename T>
-MultiIndexTree<T>::MultiIndexTree(const std::string& output_dir, size_t max_cached_bytes)
+template <typename T, typename Storage>
+MultiIndexTree<T, Storage>::MultiIndexTree(const std::string& output_dir,
+                                           size_t max_cached_bytes,
+                                           EvictionPolicy eviction_policy)
     : MultiIndexTree(
-        NativeStorageT<T>(
+        Storage(
             resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key)
         ),
-        UsageRateCacheParams(max_cached_bytes / sizeof(value_type)))
+        UsageRateCacheParams(max_cached_bytes, eviction_policy))
 {}
 
 
-template <typename T>
-MultiIndexTree<T>::MultiIndexTree(
-    const NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>& storage,
-    const UsageRateCacheParams& params)
-    : MultiIndexTree(storage, UsageRateCacheT<T>(params, storage))
+template <typename T, typename Storage>
+MultiIndexTree<T, Storage>::MultiIndexTree(const Storage& storage,
+                                           const UsageRateCacheParams& params)
+    : multi_index_base(storage, params)
 {}
 
 
-template <typename T>
+template <typename T, typename Storage>
 template <typename GeometryMode, typename ShapeT>
 inline bool
-MultiIndexTree<T>::is_intersecting(const ShapeT& shape) const {
+MultiIndexTree<T, Storage>::is_intersecting(const ShapeT& shape) const {
     auto inner_sweep = [&shape](const auto &tree) {
         auto it = tree.qbegin(
             bgi::intersects(bgi::indexable<ShapeT>{}(shape))
@@ -371,10 +885,15 @@ MultiIndexTree<T>::is_intersecting(const ShapeT& shape) const {
             return geometry_intersects(shape, v, GeometryMode{});
         })
     );
+    auto& counters = this->subtree_cache.counters();
+    counters.on_query(0, 0);
+
     for(; it != this->top_rtree.qend(); ++it) {
-        const auto &tree = this->load_subtree(*it);
+        counters.on_visit(it->n_elements);
+        auto tree = this->load_subtree(*it);
 
-        if(inner_sweep(tree)) {
+        if(inner_sweep(*tree)) {
+            counters.on_results(1);
             return true;
         }
     }
@@ -383,10 +902,127 @@ MultiIndexTree<T>::is_intersecting(const ShapeT& shape) const {
 }
 
 
-template <typename T>
+template <typename T, typename Storage>
+template <typename GeometryMode, typename ShapeT>
+inline size_t
+MultiIndexTree<T, Storage>::count_intersecting(const ShapeT& shape) const {
+    constexpr bool is_bounding_box_mode
+        = std::is_same<GeometryMode, BoundingBoxGeometry>::value;
+
+    auto query_id = this->query_count.fetch_add(1);
+
+    auto subtree_ids = std::vector<IndexedSubtreeBox>();
+    this->top_rtree.query(
+        bgi::intersects(bgi::indexable<ShapeT>{}(shape)), std::back_inserter(subtree_ids)
+    );
+
+    size_t count = 0;
+    auto to_load = std::vector<IndexedSubtreeBox>();
+    for(const auto& subtree_id : subtree_ids) {
+        if(is_bounding_box_mode && detail::shape_covers(shape, subtree_id.bounding_box())) {
+            count += subtree_id.n_elements;
+        } else {
+            to_load.push_back(subtree_id);
+        }
+    }
+
+    auto& counters = this->subtree_cache.counters();
+    counters.on_query(subtree_ids.size(), detail::count_elements(subtree_ids));
+
+    this->for_each_subtree(to_load, query_id, [&count, &shape](const auto& subtree) {
+        count += detail::count_intersecting<GeometryMode>(subtree, shape);
+    });
+    counters.on_results(count);
+
+    return count;
+}
+
+
+template <typename T, typename Storage>
+template <typename ShapeT>
+inline decltype(auto)
+MultiIndexTree<T, Storage>::find_nearest(const ShapeT& shape, unsigned k_neighbors) const {
+    auto candidates = detail::NearestCandidates<T>(k_neighbors);
+
+    // Once a subtree is further away than the current k-th candidate, none of
+    // its elements can be closer.
+    auto is_needed = [&shape, &candidates](const Box3D& box) {
+        return bg::comparable_distance(shape, box) <= candidates.max_distance();
+    };
+
+    this->for_each_nearest_subtree(shape, is_needed, [&](const auto& subtree) {
+        // Within a subtree, elements are visited by increasing distance too.
+        for(auto it = subtree.qbegin(bgi::nearest(shape, k_neighbors)); it != subtree.qend(); ++it) {
+            auto distance = bg::comparable_distance(shape, bgi::indexable<T>{}(*it));
+            if(!(distance < candidates.max_distance())) {
+                break;
+            }
+
+            candidates.push(distance, *it);
+        }
+    });
+
+    auto ids = detail::nearest_ids(std::move(candidates).sorted());
+    this->subtree_cache.counters().on_results(ids.size());
+
+    return ids;
+}
+
+
+template <typename T, typename Storage>
+inline decltype(auto)
+MultiIndexTree<T, Storage>::find_nearest_exact(const Point3D& point, unsigned k_neighbors) const {
+    auto candidates = detail::NearestCandidates<T>(k_neighbors);
+
+    // The bounding box of a subtree contains the shapes of its elements.
+    auto is_needed = [&point, &candidates](const Box3D& box) {
+        return bg::distance(point, box) < candidates.max_distance();
+    };
+
+    this->for_each_nearest_subtree(point, is_needed, [&](const auto& subtree) {
+        detail::find_nearest_exact(subtree, point, candidates);
+    });
+
+    auto ids_and_distances = detail::nearest_ids_and_distances(std::move(candidates).sorted());
+    this->subtree_cache.counters().on_results(ids_and_distances.first.size());
+
+    return ids_and_distances;
+}
+
+
+template <typename T, typename Storage>
+template <typename ShapeT, typename Pred, typename F>
+inline void
+MultiIndexTree<T, Storage>::for_each_nearest_subtree(const ShapeT& shape,
+                                                     Pred&& is_needed,
+                                                     F&& f) const {
+    auto& counters = this->subtree_cache.counters();
+    counters.on_query(0, 0);
+
+    const auto& top_rtree = this->top_rtree;
+    if(top_rtree.empty()) {
+        return;
+    }
+
+    auto query_id = this->query_count.fetch_add(1);
+
+    auto n_subtrees = util::integer_cast<unsigned>(top_rtree.size());
+    for(auto it = top_rtree.qbegin(bgi::nearest(shape, n_subtrees)); it != top_rtree.qend(); ++it) {
+        if(!is_needed(it->bounding_box())) {
+            break;
+        }
+
+        util::check_signals();
+        counters.on_visit(it->n_elements);
+        f(*this->subtree_cache.load_subtree(*it, query_id));
+    }
+}
+
+
+template <typename T, typename Storage>
 template <typename GeometryMode, typename ShapeT>
 inline auto
-MultiIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const
+MultiIndexTree<T, Storage>::find_intersecting_objs(const ShapeT& shape) const
     -> std::vector<value_type> {
 
     std::vector<value_type> results;
@@ -395,12 +1031,317 @@ MultiIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const
 }
 
 
+template <typename T, typename Storage>
+template <typename ShapeT>
+inline std::vector<size_t>
+MultiIndexTree<T, Storage>::schedule(const std::vector<ShapeT>& shapes) const {
+    auto n_queries = shapes.size();
+
+    auto box_center = [](const Box3D& box) {
+        return (Point3Dx(box.min_corner()) + box.max_corner()) * CoordType(0.5);
+    };
+
+    // The subtrees needed by the batch, and the first subtree each query needs.
+    auto subtree_ids = std::vector<IndexedSubtreeBox>();
+    auto subtree_index = std::unordered_map<size_t, size_t>();
+    auto query_subtrees = std::vector<std::vector<size_t>>(n_queries);
+    auto query_centers = std::vector<Point3Dx>(n_queries);
+
+    for(size_t i = 0; i < n_queries; ++i) {
+        auto query_box = bgi::indexable<ShapeT>{}(shapes[i]);
+        query_centers[i] = box_center(query_box);
+
+        auto it = this->top_rtree.qbegin(bgi::intersects(query_box));
+        for(; it != this->top_rtree.qend(); ++it) {
+            auto [pos, is_new] = subtree_index.emplace(it->id, subtree_ids.size());
+            if(is_new) {
+                subtree_ids.push_back(*it);
+            }
+            query_subtrees[i].push_back(pos->second);
+        }
+    }
+
+    // Rank the subtrees along a Hilbert curve through their centers.
+    auto subtree_centers = std::vector<Point3Dx>();
+    subtree_centers.reserve(subtree_ids.size());
+    for(const auto& subtree_id : subtree_ids) {
+        subtree_centers.push_back(box_center(subtree_id.bounding_box()));
+    }
+
+    auto subtree_order = experimental::space_filling_order(subtree_centers);
+    auto subtree_rank = detail::inverse_permutation(subtree_order);
+
+    // Queries which don't need any subtree go first.
+    auto by_rank = [&subtree_rank](size_t k, size_t l) {
+        return subtree_rank[k] < subtree_rank[l];
+    };
+
+    auto first_subtree = std::vector<size_t>(n_queries, 0);
+    for(size_t i = 0; i < n_queries; ++i) {
+        const auto& ks = query_subtrees[i];
+        if(!ks.empty()) {
+            first_subtree[i] = subtree_rank[*std::min_element(ks.begin(), ks.end(), by_rank)] + 1;
+        }
+    }
+
+    auto order = experimental::space_filling_order(query_centers);
+    std::stable_sort(order.begin(), order.end(), [&first_subtree](size_t i, size_t j) {
+        return first_subtree[i] < first_subtree[j];
+    });
+
+    auto is_requested = std::vector<bool>(subtree_ids.size(), false);
+    auto requested_subtree_ids = std::vector<IndexedSubtreeBox>();
+    requested_subtree_ids.reserve(subtree_ids.size());
+    for(auto i : order) {
+        for(auto k : query_subtrees[i]) {
+            if(!is_requested[k]) {
+                is_requested[k] = true;
+                requested_subtree_ids.push_back(subtree_ids[k]);
+            }
+        }
+    }
+    this->subtree_cache.prefetch(requested_subtree_ids, this->query_count.load());
+
+    return order;
+}
+
+
+template <typename T, typename Storage>
+template <typename ShapeT>
+inline size_t
+MultiIndexTree<T, Storage>::preload(const ShapeT& shape, bool wait) const {
+    auto pending = this->subtree_cache.prefetch(intersecting_subtrees(shape),
+                                                this->query_count.load());
+    if(wait) {
+        wait_for(pending);
+    }
+
+    return pending.size();
+}
+
+
+template <typename T, typename Storage>
+inline size_t
+MultiIndexTree<T, Storage>::warm_up(bool wait) const {
+    auto subtree_ids = std::vector<IndexedSubtreeBox>(this->top_rtree.begin(),
+                                                      this->top_rtree.end());
+
+    auto pending = this->subtree_cache.prefetch(subtree_ids, this->query_count.load());
+    if(wait) {
+        wait_for(pending);
+    }
+
+    return pending.size();
+}
+
+
+template <typename T, typename Storage>
+template <typename ShapeT>
+inline size_t
+MultiIndexTree<T, Storage>::pin(const ShapeT& shape, bool wait) {
+    auto query_count = this->query_count.load();
+
+    using subtree_future = typename UsageRateCache<Storage>::subtree_future;
+
+    auto pending = std::vector<subtree_future>();
+    for(const auto& subtree_id : intersecting_subtrees(shape)) {
+        pending.push_back(this->subtree_cache.pin(subtree_id, query_count));
+    }
+
+    if(wait) {
+        wait_for(pending);
+    }
+
+    return pending.size();
+}
+
+
+template <typename T, typename Storage>
+inline void
+MultiIndexTree<T, Storage>::unpin_all() {
+    this->subtree_cache.unpin_all();
+}
+
+
+template <typename T, typename Storage>
+template <typename ShapeT>
+inline std::vector<IndexedSubtreeBox>
+MultiIndexTree<T, Storage>::intersecting_subtrees(const ShapeT& shape) const {
+    auto subtree_ids = std::vector<IndexedSubtreeBox>();
+    this->top_rtree.query(
+        bgi::intersects(bgi::indexable<ShapeT>{}(shape))
+        && bgi::satisfies([&shape](const auto& v) {
+            return geometry_intersects(shape, v, BoundingBoxGeometry{});
+        }),
+        std::back_inserter(subtree_ids)
+    );
+
+    return subtree_ids;
+}
+
+
+template <typename T, typename Storage>
+template <typename Future>
+inline void
+MultiIndexTree<T, Storage>::wait_for(const std::vector<Future>& pending) {
+    for(const auto& subtree : pending) {
+        util::check_signals();
+
+        // Rethrows errors that occurred while loading.
+        subtree.get();
+    }
+}
+
+
+template <typename T, typename Storage, typename GeometryMode, typename ShapeT>
+inline QueryCursor<MultiIndexTree<T, Storage>, GeometryMode, ShapeT>::QueryCursor(
+    const index_type& index, const ShapeT& shape)
+    : index_(&index)
+    , predicates_(detail::intersects_predicates<GeometryMode>(shape))
+    , query_id_(index.query_count.fetch_add(1)) {
+
+    index.top_rtree.query(
+        bgi::intersects(bgi::indexable<ShapeT>{}(shape)), std::back_inserter(subtree_ids_)
+    );
+
+    index.subtree_cache.counters().on_query(subtree_ids_.size(), 0);
+}
+
+template <typename T, typename Storage, typename GeometryMode, typename ShapeT>
+template <typename OutputIt>
+inline size_t
+QueryCursor<MultiIndexTree<T, Storage>, GeometryMode, ShapeT>::next(size_t max_elements,
+                                                                    const OutputIt& iter) {
+    auto out = iter;
+
+    size_t n = 0;
+    while(n < max_elements) {
+        if(it_ && *it_ != subtree_->qend()) {
+            *out = **it_;
+            ++out;
+            ++(*it_);
+            ++n;
+            continue;
+        }
+
+        // Release the exhausted subtree before loading the next one.
+        it_ = boost::none;
+        subtree_ = nullptr;
+
+        if(next_subtree_ == subtree_ids_.size()) {
+            break;
+        }
+
+        util::check_signals();
+        index_->subtree_cache.counters().on_scan(subtree_ids_[next_subtree_].n_elements);
+        subtree_ = index_->subtree_cache.load_subtree(subtree_ids_[next_subtree_], query_id_);
+        it_ = subtree_->qbegin(predicates_);
+        ++next_subtree_;
+    }
+    index_->subtree_cache.counters().on_results(n);
+
+    return n;
+}
+
+
 template <size_t dim, typename Value>
 inline CoordType get_centroid_coordinate(const Value& value) {
     return value.template get_centroid_coord<dim>();
 }
 
 
+template <class T>
+inline void
+PackedStorage<T>::save_subtree(const in_memory_subtree_type& subtree,
+                               size_t subtree_id) const {
+    auto blob = detail::binary_serialize(subtree);
+    util::check_signals();
+
+    writer().write(subtree_id, blob);
+}
+
+template <class T>
+inline void
+PackedStorage<T>::save_top_tree(const toptree_type& tree) const {
+    NativeStorageT<T>::save_top_tree(tree, output_dir);
+}
+
+template <class T>
+inline void
+PackedStorage<T>::flush_subtrees() const {
+    writer().close();
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->writer = nullptr;
+}
+
+#if SI_MPI == 1
+template <class T>
+inline void
+PackedStorage<T>::flush_subtrees(MPI_Comm comm) const {
+    // Ranks without any subtrees still take part.
+    writer().close(comm);
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->writer = nullptr;
+}
+#endif
+
+template <class T>
+inline auto
+PackedStorage<T>::load_subtree(size_t subtree_id) const -> subtree_type {
+    auto blob = reader().read(subtree_id);
+
+    auto subtree = subtree_type{};
+    bip::ibufferstream ibs(blob.data(), blob.size(), std::ios::binary);
+    boost::archive::binary_iarchive ia(static_cast<std::istream&>(ibs));
+    ia >> subtree;
+    util::check_signals();
+
+    return subtree;
+}
+
+template <class T>
+inline auto
+PackedStorage<T>::load_top_tree() const -> toptree_type {
+    return NativeStorageT<T>::load_top_tree(output_dir);
+}
+
+template <class T>
+inline size_t
+PackedStorage<T>::subtree_bytes_on_disk(size_t subtree_id) const {
+    return reader().blob_size(subtree_id);
+}
+
+template <class T>
+inline PackedContainerWriter&
+PackedStorage<T>::writer() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if(state_->writer == nullptr) {
+        state_->writer = std::make_unique<PackedContainerWriter>(
+            PackedFilenames::subtrees(output_dir)
+        );
+    }
+
+    // Writing blobs is thread-safe.
+    return *state_->writer;
+}
+
+template <class T>
+inline const PackedContainerReader&
+PackedStorage<T>::reader() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if(state_->reader == nullptr) {
+        state_->reader = std::make_unique<PackedContainerReader>(
+            PackedFilenames::subtrees(output_dir)
+        );
+    }
+
+    // Reading from the container is thread-safe.
+    return *state_->reader;
+}
+
+
 template<size_t dim, typename... VariantArgs>
 inline CoordType get_centroid_coordinate(boost::variant<VariantArgs...> const& value) {
     return boost::apply_visitor(
@@ -411,20 +1352,21 @@ inline CoordType get_centroid_coordinate(boost::variant<VariantArgs...> const& v
     );
 }
 
-#if SI_MPI == 1
-
-template <class Value>
-MultiIndexBulkBuilder<Value>::MultiIndexBulkBuilder(std::string output_dir)
+template <class Value, class Storage>
+MultiIndexBulkBuilder<Value, Storage>::MultiIndexBulkBuilder(std::string output_dir,
+                                                             size_t n_threads)
     : output_dir_(std::move(output_dir)),
       index_reldir_("multi_index"),
-      index_dir_(join_path(output_dir_, index_reldir_)) {
+      index_dir_(join_path(output_dir_, index_reldir_)),
+      n_threads_(n_threads) {
 
     util::ensure_valid_output_directory(index_dir_);
 }
 
 
-template <class Value>
-inline void MultiIndexBulkBuilder<Value>::finalize(MPI_Comm comm) {
+#if SI_MPI == 1
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::finalize(MPI_Comm comm) {
     auto comm_size = mpi::size(comm);
 
     size_t n_values = this->values_.size();
@@ -432,36 +1374,200 @@ inline void MultiIndexBulkBuilder<Value>::finalize(MPI_Comm comm) {
     MPI_Allreduce(&n_values, &n_total_values, 1, MPI_SIZE_T, MPI_SUM, comm);
     this->n_total_values_ = n_total_values;
 
-    auto max_elements_per_part = size_t(4e6);
-
     auto str_params = two_level_str_heuristic(
         n_total_values,
-        max_elements_per_part,
+        multi_index_max_elements_per_part,
         comm_size
     );
-    auto storage = NativeStorageT<Value>(index_dir_);
+    auto storage = Storage(index_dir_);
     using GetCoordinate = GetCenterCoordinate<Value>;
-    distributed_partition<GetCoordinate>(storage, this->values_, str_params, comm);
+    distributed_partition<GetCoordinate>(storage, this->values_, str_params, comm, n_threads_);
 
     write_meta_data();
 }
+#endif
+
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::finalize_threaded() {
+    auto n_total_values = this->values_.size();
+    this->n_total_values_ = n_total_values;
 
+    auto str_params = SerialSTRParams::from_heuristic(n_total_values,
+                                                      multi_index_max_elements_per_part);
+    auto storage = Storage(index_dir_);
+    using GetCoordinate = GetCenterCoordinate<Value>;
+    threaded_partition<GetCoordinate>(storage, this->values_, str_params, n_threads_);
+
+    write_meta_data();
+}
+
+namespace detail {
 template <class Value>
-inline void MultiIndexBulkBuilder<Value>::write_meta_data() const {
+inline void write_multi_index_meta_data(const std::string& output_dir,
+                                        const std::string& index_reldir) {
     auto element_type = value_to_element_type<Value>();
     auto meta_data = create_basic_meta_data(element_type);
     meta_data[MetaDataConstants::multi_index_key] = {
         // Relative path of the heavy files.
-        {"heavy_data_path", index_reldir_}
+        {"heavy_data_path", index_reldir}
     };
 
-    brain_indexer::write_meta_data(default_meta_data_path(output_dir_), meta_data);
+    brain_indexer::write_meta_data(default_meta_data_path(output_dir), meta_data);
 }
+}  // namespace detail
 
-template <class Value>
-inline size_t MultiIndexBulkBuilder<Value>::local_size() const {
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::write_meta_data() const {
+    detail::write_multi_index_meta_data<Value>(output_dir_, index_reldir_);
+}
+
+template <class Value, class Storage>
+inline size_t MultiIndexBulkBuilder<Value, Storage>::local_size() const {
     return this->values_.size();
 }
-#endif
+
+
+template <class Value, class Storage>
+OutOfCoreMultiIndexBulkBuilder<Value, Storage>::OutOfCoreMultiIndexBulkBuilder(
+    std::string output_dir,
+    const std::string& scratch_dir,
+    size_t max_memory_bytes,
+    size_t n_threads)
+    : output_dir_(std::move(output_dir)),
+      index_reldir_("multi_index"),
+      index_dir_(join_path(output_dir_, index_reldir_)) {
+
+    // A quarter of the budget is kept for the subtrees, which `save_subtrees`
+    // builds on every thread while as many wait to be written. We assume a
+    // subtree, or its serialized copy, needs twice the size of its elements.
+    auto subtree_bytes = max_memory_bytes / 4;
+    auto n_subtrees_in_flight = 2 * WorkStealingExecutor(n_threads).n_threads() + 1;
+    auto subtree_bytes_per_element = 2 * sizeof(Value);
+    max_elements_per_part_ = std::max(
+        size_t(1), subtree_bytes / (n_subtrees_in_flight * subtree_bytes_per_element)
+    );
+
+    // The rest holds the buffered values, and the scratch space of sorting
+    // all of them at once.
+    using Key = STRKey<GetCenterCoordinate<Value>, 0>;
+    auto bytes_per_value = sizeof(Value)
+        + radix_sort_scratch_bytes_per_value<Key, Value>(max_memory_bytes / sizeof(Value));
+    auto max_values_in_memory = (max_memory_bytes - subtree_bytes) / bytes_per_value;
+
+    // Checked before creating any directories, which would be left behind.
+    if(max_values_in_memory < 8) {
+        auto min_memory_bytes = (4 * 8 * bytes_per_value + 2) / 3;
+        throw std::invalid_argument(
+            "The memory budget of " + std::to_string(max_memory_bytes)
+            + " bytes is too small; `max_memory_bytes` must be at least "
+            + std::to_string(min_memory_bytes) + " bytes.");
+    }
+
+    util::ensure_valid_output_directory(index_dir_);
+
+    // A private directory, such that several builders can share `scratch_dir`.
+    std::filesystem::create_directories(scratch_dir);
+    auto pattern = join_path(scratch_dir, "brain-indexer-spill-XXXXXX");
+    if(::mkdtemp(pattern.data()) == nullptr) {
+        throw std::runtime_error("Failed to create a directory in: " + scratch_dir);
+    }
+    spill_dir_ = pattern;
+
+    // Blocks of about 1 MiB; unless the budget is tiny, then 8 blocks fit.
+    auto values_per_block = std::min(std::max(size_t(1), (size_t(1) << 20) / sizeof(Value)),
+                                     max_values_in_memory / 8);
+
+    auto params = ExternalSTRParams{spill_dir_, max_values_in_memory, values_per_block, n_threads};
+    str_ = std::make_unique<ExternalSortTileRecursion<Value, GetCenterCoordinate<Value>>>(params);
+}
+
+
+template <class Value, class Storage>
+OutOfCoreMultiIndexBulkBuilder<Value, Storage>::~OutOfCoreMultiIndexBulkBuilder() {
+    str_.reset();
+
+    auto ec = std::error_code{};
+    std::filesystem::remove_all(spill_dir_, ec);
+}
+
+
+template <class Value, class Storage>
+template <class BeginIt, class EndIt>
+inline void OutOfCoreMultiIndexBulkBuilder<Value, Storage>::insert(BeginIt begin, EndIt end) {
+    for(auto it = begin; it != end; ++it) {
+        insert(*it);
+    }
+}
+
+
+template <class Value, class Storage>
+inline void OutOfCoreMultiIndexBulkBuilder<Value, Storage>::insert(const Value& value) {
+    values_.push_back(value);
+    ++n_inserted_;
+
+    spill_if_full();
+}
+
+
+template <class Value, class Storage>
+inline void OutOfCoreMultiIndexBulkBuilder<Value, Storage>::spill_if_full() {
+    if(values_.size() >= str_->params().max_values_in_memory) {
+        str_->spill(values_);
+    }
+}
+
+
+template <class Value, class Storage>
+inline void OutOfCoreMultiIndexBulkBuilder<Value, Storage>::reserve(size_t n_local_elements) {
+    values_.reserve(std::min(n_local_elements, str_->params().max_values_in_memory));
+}
+
+
+template <class Value, class Storage>
+inline void OutOfCoreMultiIndexBulkBuilder<Value, Storage>::finalize() {
+    const auto& params = str_->params();
+
+    auto n_total_values = n_inserted_;
+    this->n_total_values_ = n_total_values;
+
+    // Every part must fit into memory.
+    auto str_params = SerialSTRParams::from_heuristic(
+        n_total_values,
+        std::min({multi_index_max_elements_per_part,
+                  params.max_values_in_bucket(),
+                  max_elements_per_part_})
+    );
+
+    auto storage = Storage(index_dir_);
+    using GetCoordinate = GetCenterCoordinate<Value>;
+
+    if(str_->size() == 0 && values_.size() <= params.max_values_in_bucket()) {
+        threaded_partition<GetCoordinate>(storage, values_, str_params, params.n_threads);
+    }
+    else {
+        str_->spill(values_);
+        values_ = std::vector<Value>();
+
+        external_partition<GetCoordinate>(storage, *str_, str_params);
+    }
+
+    detail::write_multi_index_meta_data<Value>(output_dir_, index_reldir_);
+}
+
+
+template <class Value, class Storage>
+inline size_t OutOfCoreMultiIndexBulkBuilder<Value, Storage>::size() const {
+    if(!n_total_values_) {
+        throw std::runtime_error("Total number of elements not yet known.");
+    }
+
+    return *n_total_values_;
+}
+
+
+template <class Value, class Storage>
+inline size_t OutOfCoreMultiIndexBulkBuilder<Value, Storage>::local_size() const {
+    return n_inserted_;
+}
 
 }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+
+namespace brain_indexer {
+
+inline void
+MultiIndexCounters::on_load(std::chrono::steady_clock::duration latency, size_t n_bytes_read) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    auto n_us = static_cast<size_t>(std::max<decltype(us)>(us, 0));
+
+    // The number of bits needed to represent `n_us`.
+    size_t bucket = 0;
+    while(bucket + 1 < load_latency_histogram.size() && (n_us >> bucket) != 0) {
+        ++bucket;
+    }
+
+    increment(load_latency_histogram[bucket]);
+    increment(load_latency_us, n_us);
+    increment(this->n_bytes_read, n_bytes_read);
+}
+
+
+inline void
+MultiIndexCounters::on_query(size_t n_subtrees, size_t n_elements_scanned) {
+    increment(n_queries);
+    increment(n_subtrees_visited, n_subtrees);
+    increment(this->n_elements_scanned, n_elements_scanned);
+}
+
+
+inline MultiIndexStats
+MultiIndexCounters::snapshot() const {
+    auto load = [](const std::atomic<size_t>& counter) {
+        return counter.load(std::memory_order_relaxed);
+    };
+
+    auto stats = MultiIndexStats{};
+    stats.n_hits = load(n_hits);
+    stats.n_misses = load(n_misses);
+    stats.n_evictions = load(n_evictions);
+    stats.n_bytes_read = load(n_bytes_read);
+    for(size_t k = 0; k < load_latency_histogram.size(); ++k) {
+        stats.load_latency_histogram[k] = load(load_latency_histogram[k]);
+    }
+    stats.load_latency_us = load(load_latency_us);
+    stats.n_queries = load(n_queries);
+    stats.n_subtrees_visited = load(n_subtrees_visited);
+    stats.n_elements_scanned = load(n_elements_scanned);
+    stats.n_elements_returned = load(n_elements_returned);
+
+    return stats;
+}
+
+
+inline void
+MultiIndexCounters::reset() {
+    auto zero = [](std::atomic<size_t>& counter) {
+        counter.store(0, std::memory_order_relaxed);
+    };
+
+    zero(n_hits);
+    zero(n_misses);
+    zero(n_evictions);
+    zero(n_bytes_read);
+    for(auto& count : load_latency_histogram) {
+        zero(count);
+    }
+    zero(load_latency_us);
+    zero(n_queries);
+    zero(n_subtrees_visited);
+    zero(n_elements_scanned);
+    zero(n_elements_returned);
+}
+
+}  // namespace brain_indexer
@@ -96,6 +96,10 @@ inline SectionType get_section_type(const MorphoEntry& element) {
 
 // Structures that contains the results of a query.
 // Necessary to export data as numpy arrays.
+//
+// `for_each_field(f, results...)` calls `f` once per field, passing the
+// same field of each of the `results`. It allows generic code, e.g.
+// concatenating results, to handle all fields.
 
 template<typename Element>
 struct query_result;
@@ -105,13 +109,29 @@ struct query_result<MorphoEntry> {
     std::vector<identifier_t> gid;
     std::vector<unsigned> section_id;
     std::vector<unsigned> segment_id;
-    std::vector<gid_segm_t> ids;
     std::vector<Point3D> centroid;
     std::vector<CoordType> radius;
     std::vector<Point3D> endpoint1;
     std::vector<Point3D> endpoint2;
     std::vector<SectionType> section_type;
     boost::container::vector<bool> is_soma;
+
+    inline size_t size() const {
+        return gid.size();
+    }
+
+    template <class F, class... Results>
+    static void for_each_field(F&& f, Results&... results) {
+        f(results.gid...);
+        f(results.section_id...);
+        f(results.segment_id...);
+        f(results.centroid...);
+        f(results.radius...);
+        f(results.endpoint1...);
+        f(results.endpoint2...);
+        f(results.section_type...);
+        f(results.is_soma...);
+    }
 };
 
 template<>
@@ -120,6 +140,18 @@ struct query_result<Synapse> {
     std::vector<identifier_t> pre_gid;
     std::vector<identifier_t> post_gid;
     std::vector<Point3D> position;
+
+    inline size_t size() const {
+        return id.size();
+    }
+
+    template <class F, class... Results>
+    static void for_each_field(F&& f, Results&... results) {
+        f(results.id...);
+        f(results.pre_gid...);
+        f(results.post_gid...);
+        f(results.position...);
+    }
 };
 
 template<>
@@ -127,12 +159,41 @@ struct query_result<IndexedSphere> {
     std::vector<identifier_t> id;
     std::vector<Point3D> centroid;
     std::vector<CoordType> radius;
+
+    inline size_t size() const {
+        return id.size();
+    }
+
+    template <class F, class... Results>
+    static void for_each_field(F&& f, Results&... results) {
+        f(results.id...);
+        f(results.centroid...);
+        f(results.radius...);
+    }
 };
 
 template <>
 struct query_result<IndexedPoint> {
     std::vector<identifier_t> id;
     std::vector<Point3D> position;
+
+    inline size_t size() const {
+        return id.size();
+    }
+
+    template <class F, class... Results>
+    static void for_each_field(F&& f, Results&... results) {
+        f(results.id...);
+        f(results.position...);
+    }
+};
+
+// The results of a batch of queries in CSR format. The matches of the `i`-th
+// query are the entries `[offsets[i], offsets[i+1])` of `values`.
+template<typename Element>
+struct batch_query_result {
+    query_result<Element> values;
+    std::vector<size_t> offsets;
 };
 
 }  // namespace detail
@@ -220,7 +281,6 @@ struct iter_entry_getter<MorphoEntry> : public detail::iter_append_only<iter_ent
                 output_.gid.push_back(t.gid());
                 output_.section_id.push_back(t.section_id());
                 output_.segment_id.push_back(t.segment_id());
-                output_.ids.push_back(gid_segm_t{t.gid(), t.section_id(), t.segment_id()});
                 output_.centroid.push_back(t.get_centroid());
                 output_.radius.push_back(t.radius);
                 output_.endpoint1.push_back(detail::get_endpoint(t, 1));
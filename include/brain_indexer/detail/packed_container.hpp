@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+/// \brief Owns a POSIX file descriptor.
+class PosixFile {
+  public:
+    inline PosixFile(const std::string& filename, int flags)
+        : filename_(filename)
+        , fd_(::open(filename.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) {
+
+        if(fd_ < 0) {
+            throw_error("Failed to open");
+        }
+    }
+
+    PosixFile(const PosixFile&) = delete;
+    PosixFile& operator=(const PosixFile&) = delete;
+
+    inline ~PosixFile() {
+        ::close(fd_);
+    }
+
+    /// \brief Write all of `[data, data + n_bytes)` at `offset`.
+    inline void pwrite_all(const char* data, size_t n_bytes, size_t offset) const {
+        while(n_bytes > 0) {
+            auto n_written = ::pwrite(fd_, data, n_bytes, util::safe_integer_cast<off_t>(offset));
+            if(n_written < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw_error("Failed to write");
+            }
+
+            data += n_written;
+            n_bytes -= size_t(n_written);
+            offset += size_t(n_written);
+        }
+    }
+
+    /// \brief Read exactly `n_bytes` at `offset` into `data`.
+    inline void pread_all(char* data, size_t n_bytes, size_t offset) const {
+        while(n_bytes > 0) {
+            auto n_read = ::pread(fd_, data, n_bytes, util::safe_integer_cast<off_t>(offset));
+            if(n_read < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw_error("Failed to read");
+            }
+
+            if(n_read == 0) {
+                throw std::runtime_error("Unexpected end of file: " + filename_);
+            }
+
+            data += n_read;
+            n_bytes -= size_t(n_read);
+            offset += size_t(n_read);
+        }
+    }
+
+  private:
+    [[noreturn]] inline void throw_error(const std::string& what) const {
+        auto msg = boost::format("%s '%s': %s") % what % filename_ % std::strerror(errno);
+        throw std::runtime_error(msg.str());
+    }
+
+    std::string filename_;
+    int fd_;
+};
+
+
+inline size_t align_up(size_t n_bytes, size_t alignment) {
+    return (n_bytes + alignment - 1) / alignment * alignment;
+}
+
+/// \brief The offset of the first blob, i.e. the size of the padded header.
+constexpr size_t packed_data_offset = packed_container_alignment;
+static_assert(sizeof(PackedContainerHeader) <= packed_data_offset);
+
+/// \brief Create a new file named `prefix` followed by a random suffix.
+inline std::string create_unique_file(const std::string& prefix) {
+    auto random_device = std::random_device{};
+    for(size_t attempt = 0; attempt < 100; ++attempt) {
+        auto suffix = boost::format("%08x%08x") % random_device() % random_device();
+        auto filename = prefix + suffix.str();
+
+        auto fd = ::open(filename.c_str(),
+                         O_WRONLY | O_CREAT | O_EXCL,
+                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if(fd >= 0) {
+            ::close(fd);
+            return filename;
+        }
+
+        if(errno != EEXIST) {
+            auto msg = boost::format("Failed to create '%s': %s") % filename % std::strerror(errno);
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+    throw std::runtime_error("Failed to create a unique file: " + prefix);
+}
+
+/// \brief Copy `n_bytes` from `offset` in `source` to `target_offset` in `target`.
+inline void copy_between_files(const PosixFile& source,
+                               size_t offset,
+                               const PosixFile& target,
+                               size_t target_offset,
+                               size_t n_bytes) {
+    constexpr size_t chunk_size = size_t(1) << 24;
+
+    auto buffer = std::string(std::min(chunk_size, n_bytes), '\0');
+    while(n_bytes > 0) {
+        util::check_signals();
+
+        auto n_chunk = std::min(chunk_size, n_bytes);
+        source.pread_all(buffer.data(), n_chunk, offset);
+        target.pwrite_all(buffer.data(), n_chunk, target_offset);
+
+        offset += n_chunk;
+        target_offset += n_chunk;
+        n_bytes -= n_chunk;
+    }
+}
+
+}  // namespace detail
+
+
+inline PackedContainerReader::PackedContainerReader(const std::string& filename)
+    : filename_(filename)
+    , file_(std::make_unique<detail::PosixFile>(filename, O_RDONLY)) {
+
+    auto header = PackedContainerHeader{};
+    auto expected = PackedContainerHeader{};
+    file_->pread_all(reinterpret_cast<char*>(&header), sizeof(header), 0);
+    if(std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a packed container: " + filename);
+    }
+
+    auto entries = std::vector<PackedContainerEntry>(header.n_entries);
+    file_->pread_all(reinterpret_cast<char*>(entries.data()),
+                     entries.size() * sizeof(PackedContainerEntry),
+                     header.table_offset);
+
+    for(const auto& entry : entries) {
+        entries_[entry.id] = entry;
+    }
+}
+
+
+inline PackedContainerReader::~PackedContainerReader() = default;
+
+
+inline const PackedContainerEntry& PackedContainerReader::entry(size_t id) const {
+    auto it = entries_.find(id);
+    if(it == entries_.end()) {
+        auto msg = boost::format("No blob %d in '%s'.") % id % filename_;
+        throw std::runtime_error(msg.str());
+    }
+
+    return it->second;
+}
+
+
+inline size_t PackedContainerReader::blob_size(size_t id) const {
+    return entry(id).n_bytes;
+}
+
+
+inline std::string PackedContainerReader::read(size_t id) const {
+    const auto& entry = this->entry(id);
+    auto blob = std::string(entry.n_bytes, '\0');
+    file_->pread_all(blob.data(), blob.size(), entry.offset);
+
+    return blob;
+}
+
+
+inline PackedContainerWriter::PackedContainerWriter(std::string filename)
+    : filename_(std::move(filename))
+    , part_filename_(detail::create_unique_file(filename_ + ".part-"))
+    , file_(std::make_unique<detail::PosixFile>(part_filename_, O_RDWR))
+    , end_offset_(detail::packed_data_offset) { }
+
+
+inline PackedContainerWriter::~PackedContainerWriter() {
+    if(file_ != nullptr) {
+        file_ = nullptr;
+
+        std::error_code ec;
+        std::filesystem::remove(part_filename_, ec);
+    }
+}
+
+
+inline void PackedContainerWriter::write(size_t id, const std::string& blob) {
+    size_t offset = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        offset = end_offset_;
+        end_offset_ += detail::align_up(blob.size(), packed_container_alignment);
+        entries_.push_back(PackedContainerEntry{id, offset, blob.size()});
+    }
+
+    file_->pwrite_all(blob.data(), blob.size(), offset);
+}
+
+
+inline void
+PackedContainerWriter::write_table(const std::vector<PackedContainerEntry>& entries,
+                                   size_t table_offset) const {
+    auto header = PackedContainerHeader{};
+    header.n_entries = entries.size();
+    header.alignment = packed_container_alignment;
+    header.table_offset = table_offset;
+
+    file_->pwrite_all(reinterpret_cast<const char*>(entries.data()),
+                      entries.size() * sizeof(PackedContainerEntry),
+                      table_offset);
+    file_->pwrite_all(reinterpret_cast<const char*>(&header), sizeof(header), 0);
+}
+
+
+inline void PackedContainerWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    util::check_signals();
+
+    write_table(entries_, end_offset_);
+    std::filesystem::rename(part_filename_, filename_);
+    file_ = nullptr;
+}
+
+
+#if SI_MPI == 1
+inline void PackedContainerWriter::close(MPI_Comm comm) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto mpi_rank = mpi::rank(comm);
+
+    size_t n_local_entries = entries_.size();
+    size_t n_entries = 0;
+    MPI_Allreduce(&n_local_entries, &n_entries, 1, MPI_SIZE_T, MPI_SUM, comm);
+
+    // The blobs of rank `r` follow the blobs of all ranks `< r`.
+    size_t n_local_bytes = end_offset_ - detail::packed_data_offset;
+    size_t n_preceding_bytes = 0;
+    MPI_Exscan(&n_local_bytes, &n_preceding_bytes, 1, MPI_SIZE_T, MPI_SUM, comm);
+    if(mpi_rank == 0) {
+        n_preceding_bytes = 0;
+    }
+
+    size_t n_bytes = 0;
+    MPI_Allreduce(&n_local_bytes, &n_bytes, 1, MPI_SIZE_T, MPI_SUM, comm);
+
+    // The blobs of rank 0 are already at the right offsets.
+    if(mpi_rank == 0) {
+        std::filesystem::rename(part_filename_, filename_);
+    }
+    MPI_Barrier(comm);
+
+    if(mpi_rank != 0) {
+        // The padding after the last blob hasn't been written.
+        size_t n_written_bytes = 0;
+        for(const auto& entry : entries_) {
+            n_written_bytes = std::max(n_written_bytes, entry.offset + entry.n_bytes);
+        }
+        n_written_bytes -= std::min(n_written_bytes, detail::packed_data_offset);
+
+        {
+            auto container = detail::PosixFile(filename_, O_WRONLY);
+            detail::copy_between_files(*file_,
+                                       detail::packed_data_offset,
+                                       container,
+                                       detail::packed_data_offset + n_preceding_bytes,
+                                       n_written_bytes);
+        }
+
+        file_ = nullptr;
+        std::filesystem::remove(part_filename_);
+
+        for(auto& entry : entries_) {
+            entry.offset += n_preceding_bytes;
+        }
+    }
+
+    // Only the offset table is gathered on rank 0.
+    auto mpi_entry = mpi::Datatype(mpi::create_contiguous_datatype<PackedContainerEntry>());
+    auto recv_counts = mpi::gather_counts(entries_.size(), comm);
+    int n_send = util::safe_integer_cast<int>(entries_.size());
+
+    if(mpi_rank == 0) {
+        auto recv_offsets = mpi::offsets_from_counts(recv_counts);
+        auto all_entries = std::vector<PackedContainerEntry>(n_entries);
+
+        MPI_Gatherv(
+            (void *)entries_.data(), n_send, *mpi_entry,
+            (void *)all_entries.data(), recv_counts.data(), recv_offsets.data(), *mpi_entry,
+            /* root = */ 0,
+            comm
+        );
+
+        write_table(all_entries, detail::packed_data_offset + n_bytes);
+        file_ = nullptr;
+    } else {
+        MPI_Gatherv(
+            (void *)entries_.data(), n_send, *mpi_entry,
+            nullptr, nullptr, nullptr, MPI_DATATYPE_NULL,
+            /* root = */ 0,
+            comm
+        );
+    }
+
+    // Nobody reads the container before it's complete.
+    MPI_Barrier(comm);
+}
+#endif
+
+
+inline void write_packed_container(const std::string& filename, const PackedBlobs& blobs) {
+    auto writer = PackedContainerWriter(filename);
+    for(const auto& [id, blob] : blobs) {
+        util::check_signals();
+        writer.write(id, blob);
+    }
+
+    writer.close();
+}
+
+
+#if SI_MPI == 1
+inline void write_packed_container(const std::string& filename,
+                                   const PackedBlobs& blobs,
+                                   MPI_Comm comm) {
+    auto writer = PackedContainerWriter(filename);
+    for(const auto& [id, blob] : blobs) {
+        util::check_signals();
+        writer.write(id, blob);
+    }
+
+    writer.close(comm);
+}
+#endif
+
+}  // namespace brain_indexer
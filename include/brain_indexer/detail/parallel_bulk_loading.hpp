@@ -0,0 +1,639 @@
+#pragma once
+
+#include "../parallel_bulk_loading.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "../logging.hpp"
+
+#if SI_PARALLEL_BULK_LOAD == 1
+#include <boost/geometry/index/detail/rtree/pack_create.hpp>
+
+#include "../util.hpp"
+#include "../work_stealing.hpp"
+
+
+#ifdef BOOST_GEOMETRY_INDEX_EXPERIMENTAL_ENLARGE_BY_EPSILON
+#error "`parallel_bulk_load` doesn't enlarge the leaves by epsilon."
+#endif
+#endif
+
+
+namespace brain_indexer {
+
+namespace detail {
+
+// `ParallelPack` follows `bgi::detail::rtree::pack` step by step. Before
+// allowing another version in `SI_PARALLEL_BULK_LOAD`, compare it to
+// `pack_create.hpp` of that version; the unit test `ParallelBulkLoadIsIdentical`
+// checks that both produce the same tree.
+#if SI_PARALLEL_BULK_LOAD == 1
+
+/// The packing is split into this many independent jobs per thread.
+constexpr size_t parallel_pack_jobs_per_thread = 4;
+
+/** \brief A copy of `bgi::detail::rtree::pack`, which packs independent parts concurrently.
+ *
+ * The entries, splits and nodes are exactly those of `pack`. The recursion of
+ * `pack` is unrolled breadth first: each round performs the next split of all
+ * pending jobs concurrently, until there are enough jobs to keep all threads
+ * busy. Then the jobs are packed sequentially, each by one thread. Finally,
+ * the nodes created while splitting are filled with the nodes of their jobs.
+ *
+ * The node types and some helpers are internals of Boost.Geometry, hence the
+ * supported Boost versions are checked by `SI_PARALLEL_BULK_LOAD`.
+ */
+template <class Rtree>
+class ParallelPack {
+    using members_holder = typename bgi::detail::rtree::private_view<Rtree>::members_holder;
+
+    using internal_node = typename members_holder::internal_node;
+    using leaf = typename members_holder::leaf;
+    using node_pointer = typename members_holder::node_pointer;
+    using size_type = typename members_holder::size_type;
+    using allocators_type = typename members_holder::allocators_type;
+    using box_type = typename members_holder::box_type;
+    using point_type = typename bg::point_type<box_type>::type;
+    using coordinate_type = typename bg::coordinate_type<point_type>::type;
+
+    using internal_elements = typename bgi::detail::rtree::elements_type<internal_node>::type;
+    using internal_element = typename internal_elements::value_type;
+    using subtree_destroyer = bgi::detail::rtree::subtree_destroyer<members_holder>;
+
+    static constexpr size_t dimension = bg::dimension<point_type>::value;
+
+    // The entries refer to the values by their position, rather than by an
+    // iterator. This doesn't change the splits, since only the centroids are
+    // compared.
+    using entry_type = std::pair<point_type, size_t>;
+    using entry_iterator = typename std::vector<entry_type>::iterator;
+
+    struct SubtreeCounts {
+        size_type maxc;
+        size_type minc;
+    };
+
+    /** \brief A call of `per_level` or `per_level_packets` of `pack`.
+     *
+     * A job is either split into smaller `children`, or it's run and its
+     * nodes are stored in `elements`.
+     */
+    struct Job {
+        enum class Kind { level, packets };
+
+        Kind kind;
+        entry_iterator first;
+        entry_iterator last;
+        box_type hint_box;
+        size_type values_count;
+        SubtreeCounts subtree_counts;
+        SubtreeCounts next_subtree_counts;
+
+        std::vector<Job> children;
+        internal_elements elements;
+        box_type elements_box;
+    };
+
+  public:
+    template <class RandomAccessIt>
+    inline static void apply(Rtree& rtree,
+                             RandomAccessIt first,
+                             RandomAccessIt last,
+                             size_t n_threads);
+
+  private:
+    /// \brief Can `job` be split, rather than only be run?
+    inline static bool is_splittable(const Job& job);
+
+    /// \brief Split `job` as `pack` would, up to and including the next `nth_element`.
+    inline static void split(Job& job, const members_holder& members);
+
+    /// \brief Append the jobs of `job` which haven't been split to `pending`.
+    inline static void collect_pending(Job& job, std::vector<Job*>& pending);
+
+    template <class RandomAccessIt>
+    inline static void run(Job& job, const RandomAccessIt& values, members_holder& members);
+
+    /// \brief Append the nodes of `job` to `elements`, creating the nodes of splits.
+    inline static void assemble(Job& job,
+                                internal_elements& elements,
+                                box_type& elements_box,
+                                allocators_type& allocators);
+
+    /// \brief Destroy the nodes of all jobs which haven't been assembled.
+    inline static void destroy(Job& job, allocators_type& allocators);
+
+    template <class RandomAccessIt>
+    inline static internal_element per_level(entry_iterator first,
+                                             entry_iterator last,
+                                             const RandomAccessIt& values,
+                                             const box_type& hint_box,
+                                             size_type values_count,
+                                             const SubtreeCounts& subtree_counts,
+                                             members_holder& members);
+
+    template <class RandomAccessIt>
+    inline static void per_level_packets(entry_iterator first,
+                                         entry_iterator last,
+                                         const RandomAccessIt& values,
+                                         const box_type& hint_box,
+                                         size_type values_count,
+                                         const SubtreeCounts& subtree_counts,
+                                         const SubtreeCounts& next_subtree_counts,
+                                         internal_elements& elements,
+                                         box_type& elements_box,
+                                         members_holder& members);
+
+    inline static void destroy(internal_elements& elements, allocators_type& allocators);
+
+    inline static SubtreeCounts
+    calculate_subtree_elements_counts(size_type elements_count,
+                                      const typename members_holder::parameters_type& parameters,
+                                      size_type& leafs_level);
+
+    inline static size_type calculate_nodes_count(size_type count,
+                                                  const SubtreeCounts& subtree_counts);
+
+    inline static size_type calculate_median_count(size_type count,
+                                                   const SubtreeCounts& subtree_counts);
+};
+
+
+template <class Rtree>
+template <class RandomAccessIt>
+inline void ParallelPack<Rtree>::apply(Rtree& rtree,
+                                       RandomAccessIt first,
+                                       RandomAccessIt last,
+                                       size_t n_threads) {
+    auto view = bgi::detail::rtree::private_view<Rtree>(rtree);
+    auto& members = view.members();
+
+    auto values_count = size_type(last - first);
+    if(values_count == 0) {
+        return;
+    }
+
+    auto executor = WorkStealingExecutor(n_threads);
+    auto n_chunks = executor.n_threads();
+
+    // Both the hint box and the centroids are independent of the order in
+    // which the values are visited; hence they're computed in chunks.
+    auto entries = std::vector<entry_type>(values_count);
+    auto chunk_boxes = std::vector<box_type>(n_chunks);
+    executor.for_each(n_chunks, [&](size_t k_chunk) {
+        auto chunk = util::balanced_chunks(values_count, n_chunks, k_chunk);
+        auto& chunk_box = chunk_boxes[k_chunk];
+        bg::assign_inverse(chunk_box);
+
+        for(size_t i = chunk.low; i < chunk.high; ++i) {
+            const auto& value = first[i];
+            const auto& indexable = members.translator()(value);
+
+            bg::expand(chunk_box, indexable);
+            bg::centroid(indexable, entries[i].first);
+            entries[i].second = i;
+        }
+    });
+
+    box_type hint_box;
+    bg::assign_inverse(hint_box);
+    for(const auto& chunk_box : chunk_boxes) {
+        bg::expand(hint_box, chunk_box);
+    }
+
+    size_type leafs_level = 0;
+    auto subtree_counts =
+        calculate_subtree_elements_counts(values_count, members.parameters(), leafs_level);
+
+    auto root_job = Job{Job::Kind::level,
+                        entries.begin(),
+                        entries.end(),
+                        hint_box,
+                        values_count,
+                        subtree_counts,
+                        subtree_counts,
+                        {},
+                        {},
+                        {}};
+
+    internal_elements root_elements;
+    root_elements.reserve(1);
+    box_type root_box;
+    bg::assign_inverse(root_box);
+
+    try {
+        auto n_jobs = parallel_pack_jobs_per_thread * executor.n_threads();
+        auto pending = std::vector<Job*>{&root_job};
+        while(pending.size() < n_jobs) {
+            auto is_done = std::none_of(pending.begin(), pending.end(), [](const Job* job) {
+                return is_splittable(*job);
+            });
+
+            if(is_done) {
+                break;
+            }
+
+            executor.for_each(pending.size(), [&](size_t k_job) {
+                if(is_splittable(*pending[k_job])) {
+                    split(*pending[k_job], members);
+                }
+            });
+
+            auto next_pending = std::vector<Job*>{};
+            for(auto* job : pending) {
+                collect_pending(*job, next_pending);
+            }
+            pending = std::move(next_pending);
+        }
+
+        executor.for_each(pending.size(), [&](size_t k_job) {
+            run(*pending[k_job], first, members);
+        });
+
+        assemble(root_job, root_elements, root_box, members.allocators());
+    } catch(...) {
+        destroy(root_job, members.allocators());
+        destroy(root_elements, members.allocators());
+        throw;
+    }
+
+    subtree_destroyer previous_root(members.root, members.allocators());
+    members.root = root_elements.front().second;
+    members.values_count = values_count;
+    members.leafs_level = leafs_level;
+}
+
+
+template <class Rtree>
+inline bool ParallelPack<Rtree>::is_splittable(const Job& job) {
+    // A `level` job of leaves would merely copy the values into a leaf.
+    return job.children.empty()
+           && (job.kind == Job::Kind::packets || job.subtree_counts.maxc > 1);
+}
+
+
+template <class Rtree>
+inline void ParallelPack<Rtree>::split(Job& job, const members_holder& members) {
+    namespace pack_utils = bgi::detail::rtree::pack_utils;
+
+    auto make_job = [&job](typename Job::Kind kind,
+                           entry_iterator first,
+                           entry_iterator last,
+                           const box_type& hint_box,
+                           size_type values_count,
+                           const SubtreeCounts& subtree_counts,
+                           const SubtreeCounts& next_subtree_counts) {
+        job.children.push_back(Job{kind,
+                                   first,
+                                   last,
+                                   hint_box,
+                                   values_count,
+                                   subtree_counts,
+                                   next_subtree_counts,
+                                   {},
+                                   {},
+                                   {}});
+        return &job.children.back();
+    };
+
+    if(job.kind == Job::Kind::level) {
+        // The node is created when assembling; its packets are split right away.
+        const auto max_elements = members.parameters().get_max_elements();
+        auto next_subtree_counts = SubtreeCounts{job.subtree_counts.maxc / max_elements,
+                                                 job.subtree_counts.minc / max_elements};
+
+        auto child = make_job(Job::Kind::packets, job.first, job.last, job.hint_box,
+                              job.values_count, job.subtree_counts, next_subtree_counts);
+        split(*child, members);
+        return;
+    }
+
+    if(job.values_count <= job.subtree_counts.maxc) {
+        auto child = make_job(Job::Kind::level, job.first, job.last, job.hint_box,
+                              job.values_count, job.next_subtree_counts,
+                              job.next_subtree_counts);
+        if(is_splittable(*child)) {
+            split(*child, members);
+        }
+        return;
+    }
+
+    size_type median_count = calculate_median_count(job.values_count, job.subtree_counts);
+    auto median = job.first + median_count;
+
+    coordinate_type greatest_length;
+    size_t greatest_dim_index = 0;
+    pack_utils::biggest_edge<dimension>::apply(job.hint_box, greatest_length, greatest_dim_index);
+
+    box_type left, right;
+    pack_utils::nth_element_and_half_boxes<0, dimension>::apply(
+        job.first, median, job.last, job.hint_box, left, right, greatest_dim_index);
+
+    make_job(Job::Kind::packets, job.first, median, left,
+             median_count, job.subtree_counts, job.next_subtree_counts);
+    make_job(Job::Kind::packets, median, job.last, right,
+             job.values_count - median_count, job.subtree_counts, job.next_subtree_counts);
+}
+
+
+template <class Rtree>
+inline void ParallelPack<Rtree>::collect_pending(Job& job, std::vector<Job*>& pending) {
+    if(job.children.empty()) {
+        pending.push_back(&job);
+        return;
+    }
+
+    for(auto& child : job.children) {
+        collect_pending(child, pending);
+    }
+}
+
+
+template <class Rtree>
+template <class RandomAccessIt>
+inline void ParallelPack<Rtree>::run(Job& job,
+                                     const RandomAccessIt& values,
+                                     members_holder& members) {
+    bg::assign_inverse(job.elements_box);
+
+    if(job.kind == Job::Kind::level) {
+        auto el = per_level(job.first, job.last, values, job.hint_box,
+                            job.values_count, job.subtree_counts, members);
+
+        subtree_destroyer auto_remover(el.second, members.allocators());
+        job.elements.push_back(el);
+        auto_remover.release();
+
+        bg::expand(job.elements_box, el.first);
+    } else {
+        per_level_packets(job.first, job.last, values, job.hint_box,
+                          job.values_count, job.subtree_counts, job.next_subtree_counts,
+                          job.elements, job.elements_box, members);
+    }
+}
+
+
+template <class Rtree>
+inline void ParallelPack<Rtree>::assemble(Job& job,
+                                          internal_elements& elements,
+                                          box_type& elements_box,
+                                          allocators_type& allocators) {
+    namespace rtree = bgi::detail::rtree;
+
+    if(job.children.empty()) {
+        for(const auto& el : job.elements) {
+            elements.push_back(el);
+        }
+        job.elements.clear();
+
+        bg::expand(elements_box, job.elements_box);
+        return;
+    }
+
+    if(job.kind == Job::Kind::packets) {
+        for(auto& child : job.children) {
+            assemble(child, elements, elements_box, allocators);
+        }
+        return;
+    }
+
+    node_pointer n = rtree::create_node<allocators_type, internal_node>::apply(allocators);
+    subtree_destroyer auto_remover(n, allocators);
+
+    box_type node_box;
+    bg::assign_inverse(node_box);
+    auto& node_elements = rtree::elements(rtree::get<internal_node>(*n));
+    node_elements.reserve(calculate_nodes_count(job.values_count, job.subtree_counts));
+    for(auto& child : job.children) {
+        assemble(child, node_elements, node_box, allocators);
+    }
+
+    elements.push_back(internal_element(node_box, n));
+    auto_remover.release();
+
+    bg::expand(elements_box, node_box);
+}
+
+
+template <class Rtree>
+inline void ParallelPack<Rtree>::destroy(Job& job, allocators_type& allocators) {
+    destroy(job.elements, allocators);
+    for(auto& child : job.children) {
+        destroy(child, allocators);
+    }
+}
+
+
+template <class Rtree>
+template <class RandomAccessIt>
+inline auto ParallelPack<Rtree>::per_level(entry_iterator first,
+                                           entry_iterator last,
+                                           const RandomAccessIt& values,
+                                           const box_type& hint_box,
+                                           size_type values_count,
+                                           const SubtreeCounts& subtree_counts,
+                                           members_holder& members) -> internal_element {
+    namespace rtree = bgi::detail::rtree;
+
+    auto& allocators = members.allocators();
+
+    box_type elements_box;
+    bg::assign_inverse(elements_box);
+
+    if(subtree_counts.maxc <= 1) {
+        node_pointer n = rtree::create_node<allocators_type, leaf>::apply(allocators);
+        subtree_destroyer auto_remover(n, allocators);
+
+        auto& elements = rtree::elements(rtree::get<leaf>(*n));
+        elements.reserve(values_count);
+        for(; first != last; ++first) {
+            const auto& value = values[first->second];
+            bg::expand(elements_box, members.translator()(value));
+            elements.push_back(value);
+        }
+
+        auto_remover.release();
+        return internal_element(elements_box, n);
+    }
+
+    const auto max_elements = members.parameters().get_max_elements();
+    auto next_subtree_counts = SubtreeCounts{subtree_counts.maxc / max_elements,
+                                             subtree_counts.minc / max_elements};
+
+    node_pointer n = rtree::create_node<allocators_type, internal_node>::apply(allocators);
+    subtree_destroyer auto_remover(n, allocators);
+
+    auto& elements = rtree::elements(rtree::get<internal_node>(*n));
+    elements.reserve(calculate_nodes_count(values_count, subtree_counts));
+    per_level_packets(first,
+                      last,
+                      values,
+                      hint_box,
+                      values_count,
+                      subtree_counts,
+                      next_subtree_counts,
+                      elements,
+                      elements_box,
+                      members);
+
+    auto_remover.release();
+    return internal_element(elements_box, n);
+}
+
+
+template <class Rtree>
+template <class RandomAccessIt>
+inline void ParallelPack<Rtree>::per_level_packets(entry_iterator first,
+                                                   entry_iterator last,
+                                                   const RandomAccessIt& values,
+                                                   const box_type& hint_box,
+                                                   size_type values_count,
+                                                   const SubtreeCounts& subtree_counts,
+                                                   const SubtreeCounts& next_subtree_counts,
+                                                   internal_elements& elements,
+                                                   box_type& elements_box,
+                                                   members_holder& members) {
+    namespace pack_utils = bgi::detail::rtree::pack_utils;
+
+    if(values_count <= subtree_counts.maxc) {
+        auto el = per_level(
+            first, last, values, hint_box, values_count, next_subtree_counts, members);
+
+        subtree_destroyer auto_remover(el.second, members.allocators());
+        elements.push_back(el);
+        auto_remover.release();
+
+        bg::expand(elements_box, el.first);
+        return;
+    }
+
+    size_type median_count = calculate_median_count(values_count, subtree_counts);
+    auto median = first + median_count;
+
+    coordinate_type greatest_length;
+    size_t greatest_dim_index = 0;
+    pack_utils::biggest_edge<dimension>::apply(hint_box, greatest_length, greatest_dim_index);
+
+    box_type left, right;
+    pack_utils::nth_element_and_half_boxes<0, dimension>::apply(
+        first, median, last, hint_box, left, right, greatest_dim_index);
+
+    per_level_packets(first, median, values, left,
+                      median_count, subtree_counts, next_subtree_counts,
+                      elements, elements_box, members);
+    per_level_packets(median, last, values, right,
+                      values_count - median_count, subtree_counts, next_subtree_counts,
+                      elements, elements_box, members);
+}
+
+
+template <class Rtree>
+inline void ParallelPack<Rtree>::destroy(internal_elements& elements,
+                                         allocators_type& allocators) {
+    for(auto& el : elements) {
+        subtree_destroyer remover(el.second, allocators);
+    }
+    elements.clear();
+}
+
+
+template <class Rtree>
+inline auto ParallelPack<Rtree>::calculate_subtree_elements_counts(
+    size_type elements_count,
+    const typename members_holder::parameters_type& parameters,
+    size_type& leafs_level) -> SubtreeCounts {
+    auto counts = SubtreeCounts{1, 1};
+    leafs_level = 0;
+
+    size_type smax = parameters.get_max_elements();
+    for(; smax < elements_count; smax *= parameters.get_max_elements(), ++leafs_level) {
+        counts.maxc = smax;
+    }
+
+    counts.minc = parameters.get_min_elements() * (counts.maxc / parameters.get_max_elements());
+
+    return counts;
+}
+
+
+template <class Rtree>
+inline auto ParallelPack<Rtree>::calculate_nodes_count(size_type count,
+                                                       const SubtreeCounts& subtree_counts)
+    -> size_type {
+    size_type n = count / subtree_counts.maxc;
+    size_type r = count % subtree_counts.maxc;
+
+    if(0 < r && r < subtree_counts.minc) {
+        size_type count_minus_min = count - subtree_counts.minc;
+        n = count_minus_min / subtree_counts.maxc;
+        r = count_minus_min % subtree_counts.maxc;
+        ++n;
+    }
+
+    if(0 < r) {
+        ++n;
+    }
+
+    return n;
+}
+
+
+template <class Rtree>
+inline auto ParallelPack<Rtree>::calculate_median_count(size_type count,
+                                                        const SubtreeCounts& subtree_counts)
+    -> size_type {
+    size_type n = count / subtree_counts.maxc;
+    size_type r = count % subtree_counts.maxc;
+    size_type median_count = (n / 2) * subtree_counts.maxc;
+
+    if(0 != r) {
+        if(subtree_counts.minc <= r) {
+            median_count = ((n + 1) / 2) * subtree_counts.maxc;
+        } else {
+            size_type count_minus_min = count - subtree_counts.minc;
+            n = count_minus_min / subtree_counts.maxc;
+            r = count_minus_min % subtree_counts.maxc;
+            if(r == 0) {
+                median_count = ((n + 1) / 2) * subtree_counts.maxc;
+            } else if(n == 0) {
+                median_count = r;
+            } else {
+                median_count = ((n + 2) / 2) * subtree_counts.maxc;
+            }
+        }
+    }
+
+    return median_count;
+}
+#endif
+
+}  // namespace detail
+
+
+template <class Index, class RandomAccessIt>
+inline Index parallel_bulk_load(RandomAccessIt first, RandomAccessIt last, size_t n_threads) {
+#if SI_PARALLEL_BULK_LOAD == 1
+    if(n_threads == 1) {
+        return Index(first, last);
+    }
+
+    auto index = Index();
+    detail::ParallelPack<typename Index::rtree>::apply(index, first, last, n_threads);
+
+    return index;
+#else
+    if(n_threads != 1) {
+        static std::once_flag warned;
+        std::call_once(warned, []() {
+            log_warn("`parallel_bulk_load` hasn't been checked against this version of"
+                     " Boost; the index is packed by a single thread.");
+        });
+    }
+
+    return Index(first, last);
+#endif
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "../radix_sort.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/util.hpp>
+#include <brain_indexer/work_stealing.hpp>
+
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// Shorter ranges are sorted by `std::stable_sort`.
+constexpr size_t radix_sort_min_size = 1024;
+
+/// The minimum number of values per chunk of a pass.
+constexpr size_t radix_sort_min_chunk_size = size_t(1) << 14;
+
+constexpr size_t radix_sort_n_buckets = 256;
+
+
+template <class Float>
+struct RadixKeyType;
+
+template <>
+struct RadixKeyType<float> {
+    using type = uint32_t;
+};
+
+template <>
+struct RadixKeyType<double> {
+    using type = uint64_t;
+};
+
+
+/** \brief Map `x` to an unsigned integer which sorts like `x`.
+ *
+ * Positive numbers get the sign bit set, negative numbers have all bits
+ * flipped, such that larger magnitudes come first. Since `-0.0 == 0.0`, both
+ * are mapped to the same integer.
+ */
+template <class Float>
+inline typename RadixKeyType<Float>::type radix_key(Float x) {
+    using UInt = typename RadixKeyType<Float>::type;
+    static_assert(sizeof(UInt) == sizeof(Float));
+
+    if(x == Float(0)) {
+        x = Float(0);
+    }
+
+    UInt bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+
+    constexpr auto sign_bit = UInt(1) << (8 * sizeof(UInt) - 1);
+    return (bits & sign_bit) != 0 ? UInt(~bits) : UInt(bits | sign_bit);
+}
+
+
+/// \brief The number of chunks of a pass over `n` values.
+inline size_t radix_sort_n_chunks(size_t n, const WorkStealingExecutor& executor) {
+    return std::max(size_t(1), std::min(executor.n_threads(), n / radix_sort_min_chunk_size));
+}
+
+
+/// \brief Stably sort `permutation[0:n]` by `keys`, which are permuted alongside.
+template <class UInt, class Index>
+void radix_sort_pairs(std::vector<UInt>& keys,
+                      Index* permutation,
+                      const WorkStealingExecutor& executor) {
+
+    auto n = keys.size();
+    auto n_chunks = radix_sort_n_chunks(n, executor);
+
+    auto keys_out = std::vector<UInt>(n);
+    auto permutation_buffer = std::vector<Index>(n);
+
+    auto permutation_in = permutation;
+    auto permutation_out = permutation_buffer.data();
+
+    using Histogram = std::array<size_t, radix_sort_n_buckets>;
+    auto histograms = std::vector<Histogram>(n_chunks);
+
+    for(size_t shift = 0; shift < 8 * sizeof(UInt); shift += 8) {
+        util::check_signals();
+
+        executor.for_each(n_chunks, [&](size_t k) {
+            auto range = util::balanced_chunks(n, n_chunks, k);
+
+            auto& histogram = histograms[k];
+            histogram.fill(0);
+            for(size_t i = range.low; i < range.high; ++i) {
+                ++histogram[(keys[i] >> shift) & 0xff];
+            }
+        });
+
+        // The offset of the first value of chunk `k` with a given digit.
+        size_t offset = 0;
+        bool is_trivial = false;
+        for(size_t digit = 0; digit < radix_sort_n_buckets; ++digit) {
+            auto digit_begin = offset;
+            for(auto& histogram : histograms) {
+                auto count = histogram[digit];
+                histogram[digit] = offset;
+                offset += count;
+            }
+
+            is_trivial = is_trivial || (offset - digit_begin == n);
+        }
+
+        // Every value has the same digit; the pass wouldn't change anything.
+        if(is_trivial) {
+            continue;
+        }
+
+        executor.for_each(n_chunks, [&](size_t k) {
+            auto range = util::balanced_chunks(n, n_chunks, k);
+
+            auto& offsets = histograms[k];
+            for(size_t i = range.low; i < range.high; ++i) {
+                auto j = offsets[(keys[i] >> shift) & 0xff]++;
+                keys_out[j] = keys[i];
+                permutation_out[j] = permutation_in[i];
+            }
+        });
+
+        keys.swap(keys_out);
+        std::swap(permutation_in, permutation_out);
+    }
+
+    if(permutation_in != permutation) {
+        std::copy(permutation_in, permutation_in + n, permutation);
+    }
+}
+
+
+template <class Key, size_t k, class Value>
+using radix_component_key_t = typename RadixKeyType<
+    std::decay_t<decltype(Key::template component<k>(std::declval<const Value&>()))>
+>::type;
+
+
+/** \brief Sort `permutation[0:n]` by the components `k, k+1, ...` of the key.
+ *
+ * The keys of component `k` are extracted once and sorted by a radix sort.
+ * Only runs of values with equal keys need to be sorted by the remaining
+ * components. Long runs are sorted by a radix sort on the next component;
+ * short runs by `std::stable_sort`.
+ */
+template <class Key, size_t k, class Value, class Index>
+void radix_sort_components(const Value* values,
+                           Index* permutation,
+                           size_t n,
+                           const WorkStealingExecutor& executor) {
+
+    using UInt = radix_component_key_t<Key, k, Value>;
+
+    auto n_chunks = radix_sort_n_chunks(n, executor);
+    auto keys = std::vector<UInt>(n);
+    executor.for_each(n_chunks, [&](size_t i_chunk) {
+        auto range = util::balanced_chunks(n, n_chunks, i_chunk);
+        for(size_t i = range.low; i < range.high; ++i) {
+            keys[i] = radix_key(Key::template component<k>(values[permutation[i]]));
+        }
+    });
+
+    radix_sort_pairs(keys, permutation, executor);
+
+    if constexpr (k + 1 < Key::n_components) {
+        auto is_before = [values](Index i, Index j) {
+            return Key::compare(values[i], values[j]);
+        };
+
+        size_t run_begin = 0;
+        for(size_t i = 1; i <= n; ++i) {
+            if(i < n && keys[i] == keys[run_begin]) {
+                continue;
+            }
+
+            auto run_size = i - run_begin;
+            if(run_size >= radix_sort_min_size) {
+                radix_sort_components<Key, k + 1>(
+                    values, permutation + run_begin, run_size, executor
+                );
+            } else if(run_size > 1) {
+                std::stable_sort(permutation + run_begin, permutation + i, is_before);
+            }
+
+            run_begin = i;
+        }
+    }
+}
+
+
+/** \brief Reorder `values` such that `values[i]` becomes the old `values[permutation[i]]`.
+ *
+ * The permutation is applied in place by following its cycles; only a single
+ * value is held outside of `values` at any time. Afterwards `permutation` is
+ * the identity.
+ */
+template <class Value, class Index>
+void apply_permutation(Value* values, Index* permutation, size_t n) {
+    for(size_t i = 0; i < n; ++i) {
+        if(size_t(permutation[i]) == i) {
+            continue;
+        }
+
+        auto value = std::move(values[i]);
+        auto j = i;
+        while(size_t(permutation[j]) != i) {
+            auto next = size_t(permutation[j]);
+            values[j] = std::move(values[next]);
+            permutation[j] = Index(j);
+            j = next;
+        }
+
+        values[j] = std::move(value);
+        permutation[j] = Index(j);
+    }
+}
+
+
+template <class Key, class Index, class Value>
+void radix_sort_impl(Value* first, size_t n, size_t n_threads) {
+    auto executor = WorkStealingExecutor(n_threads);
+
+    auto permutation = std::vector<Index>(n);
+    for(size_t i = 0; i < n; ++i) {
+        permutation[i] = Index(i);
+    }
+
+    radix_sort_components<Key, 0>(first, permutation.data(), n, executor);
+
+    util::check_signals();
+    apply_permutation(first, permutation.data(), n);
+}
+
+}  // namespace detail
+
+
+template <class Key, class Value>
+inline void radix_sort(Value* first, Value* last, size_t n_threads) {
+    auto n = size_t(last - first);
+
+    if(n < detail::radix_sort_min_size) {
+        std::stable_sort(first, last, [](const Value& a, const Value& b) {
+            return Key::compare(a, b);
+        });
+        return;
+    }
+
+    if(n <= size_t(std::numeric_limits<uint32_t>::max())) {
+        detail::radix_sort_impl<Key, uint32_t>(first, n, n_threads);
+    } else {
+        detail::radix_sort_impl<Key, uint64_t>(first, n, n_threads);
+    }
+}
+
+
+template <class Key, class Value>
+inline size_t radix_sort_scratch_bytes_per_value(size_t n) {
+    using UInt = detail::radix_component_key_t<Key, 0, Value>;
+    auto index_bytes = n <= size_t(std::numeric_limits<uint32_t>::max()) ? sizeof(uint32_t)
+                                                                           : sizeof(uint64_t);
+
+    // While runs are sorted by the next component, the keys of all previous
+    // components are kept; `radix_sort_pairs` adds a buffer for the keys and
+    // one for the permutation.
+    return 2 * index_bytes + (Key::n_components + 1) * sizeof(UInt);
+}
+
+
+template <class Key, class Value>
+inline void sort_by_key(Value* first, Value* last, size_t n_threads) {
+    if constexpr (is_radix_sortable<Key>::value) {
+        radix_sort<Key>(first, last, n_threads);
+    } else {
+        std::sort(first, last, [](const Value& a, const Value& b) {
+            return Key::compare(a, b);
+        });
+    }
+}
+
+}  // namespace brain_indexer
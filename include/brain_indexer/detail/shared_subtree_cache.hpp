@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cerrno>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <brain_indexer/logging.hpp>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief Lock `mutex` of the shared subtree cache `name`, or throw on timeout.
+template <class Mutex>
+inline bip::scoped_lock<Mutex> lock_shared_cache_mutex(Mutex& mutex, const std::string& name) {
+    auto deadline = boost::posix_time::microsec_clock::universal_time()
+                    + boost::posix_time::milliseconds(SharedSubtreeCache::lock_timeout_ms);
+
+    bip::scoped_lock<Mutex> lock(mutex, deadline);
+    if(!lock.owns()) {
+        throw std::runtime_error(
+            "Timed out waiting for the shared subtree cache '" + name + "'. A process might"
+            " have crashed while holding its lock; remove it by"
+            " `SharedSubtreeCache::remove`.");
+    }
+
+    return lock;
+}
+
+/// \brief Is the process `pid` alive? Processes of other users count as alive.
+inline bool is_process_alive(int64_t pid) {
+    return ::kill(pid_t(pid), 0) == 0 || errno == EPERM;
+}
+
+}  // namespace detail
+
+
+inline SharedSubtreeCache::SharedSubtreeCache(std::string name,
+                                              const SharedSubtreeCacheParams& params)
+    : name_(std::move(name)) {
+
+    // Serializes attaching and detaching, since the last process to detach
+    // removes the table.
+    auto attach_mutex = bip::named_mutex(bip::open_or_create, attach_mutex_name(name_).c_str());
+    auto attach_lock = detail::lock_shared_cache_mutex(attach_mutex, name_);
+
+    table_segment_ = std::make_unique<segment_type>(
+        bip::open_or_create, name_.c_str(), params.table_bytes
+    );
+    table_ = table_segment_->find_or_construct<detail::SharedSubtreeTable>("table")(
+        params.max_shared_bytes, table_segment_->get_segment_manager()
+    );
+
+    auto lock = lock_table();
+    ++table_->n_attached;
+}
+
+
+inline SharedSubtreeCache::~SharedSubtreeCache() {
+    try {
+        auto attach_mutex = bip::named_mutex(bip::open_or_create,
+                                             attach_mutex_name(name_).c_str());
+        auto attach_lock = detail::lock_shared_cache_mutex(attach_mutex, name_);
+
+        bool is_last = false;
+        {
+            auto lock = lock_table();
+            is_last = --table_->n_attached == 0;
+        }
+
+        table_segment_ = nullptr;
+        if(is_last) {
+            // The mutex is kept, others might be waiting for it.
+            remove_segments(name_);
+        }
+    }
+    catch(const std::exception& e) {
+        // Destructors mustn't throw; the shared memory is merely leaked.
+        log_warn(std::string("Failed to detach from the shared subtree cache: ") + e.what());
+    }
+}
+
+
+inline auto
+SharedSubtreeCache::acquire(size_t subtree_id,
+                            const std::function<void(const std::string&)>& load)
+    -> segment_ptr {
+
+    auto self = shared_from_this();
+    auto open = [self, subtree_id]() {
+        return segment_ptr(
+            new segment_type(bip::open_read_only, segment_name(self->name_, subtree_id).c_str()),
+            [self, subtree_id](segment_type* segment) {
+                delete segment;
+                self->release(subtree_id);
+            }
+        );
+    };
+
+    {
+        auto lock = lock_table();
+        while(true) {
+            auto it = table_->slots.find(subtree_id);
+            if(it == table_->slots.end()) {
+                // This process is responsible for loading the subtree.
+                auto slot = detail::SharedSubtreeSlot{};
+                slot.loader_pid = ::getpid();
+                table_->slots.emplace(subtree_id, slot);
+                break;
+            }
+
+            auto& slot = it->second;
+            if(slot.is_loaded) {
+                ++slot.n_users;
+                lock.unlock();
+
+                try {
+                    return open();
+                }
+                catch(...) {
+                    release(subtree_id);
+                    throw;
+                }
+            }
+
+            if(!detail::is_process_alive(slot.loader_pid)) {
+                // The process loading the subtree died, this one takes over.
+                slot.loader_pid = ::getpid();
+                break;
+            }
+
+            // Since the loading process might die without notifying anyone,
+            // check on it periodically.
+            auto deadline = boost::posix_time::microsec_clock::universal_time()
+                            + boost::posix_time::milliseconds(loader_check_interval_ms);
+            table_->loaded.timed_wait(lock, deadline);
+        }
+    }
+
+    auto name = segment_name(name_, subtree_id);
+    try {
+        // Left over by a process which died while loading the subtree.
+        bip::shared_memory_object::remove(name.c_str());
+        load(name);
+
+        auto n_bytes = segment_type(bip::open_read_only, name.c_str()).get_size();
+
+        auto lock = lock_table();
+        evict_subtrees(n_bytes);
+
+        auto& slot = table_->slots.at(subtree_id);
+        slot.is_loaded = true;
+        slot.n_users = 1;
+        slot.n_bytes = n_bytes;
+
+        table_->n_shared_bytes += n_bytes;
+        ++table_->n_loads;
+    }
+    catch(...) {
+        {
+            auto lock = lock_table();
+            table_->slots.erase(subtree_id);
+        }
+        table_->loaded.notify_all();
+
+        bip::shared_memory_object::remove(name.c_str());
+        throw;
+    }
+    table_->loaded.notify_all();
+
+    try {
+        return open();
+    }
+    catch(...) {
+        release(subtree_id);
+        throw;
+    }
+}
+
+
+inline auto
+SharedSubtreeCache::lock_table() const -> bip::scoped_lock<bip::interprocess_mutex> {
+    return detail::lock_shared_cache_mutex(table_->mutex, name_);
+}
+
+
+inline void
+SharedSubtreeCache::release(size_t subtree_id) {
+    try {
+        auto lock = lock_table();
+
+        auto it = table_->slots.find(subtree_id);
+        if(it != table_->slots.end()) {
+            --it->second.n_users;
+            it->second.last_used = ++table_->clock;
+        }
+    }
+    catch(const std::exception& e) {
+        // Called when a segment is released, which mustn't throw. The subtree
+        // merely stays marked as in use.
+        log_warn(std::string("Failed to release a shared subtree: ") + e.what());
+    }
+}
+
+
+inline void
+SharedSubtreeCache::evict_subtrees(size_t n_bytes) {
+    auto fits = [this, n_bytes]() {
+        return table_->n_shared_bytes + n_bytes <= table_->max_shared_bytes;
+    };
+
+    while(!fits()) {
+        auto victim = table_->slots.end();
+        for(auto it = table_->slots.begin(); it != table_->slots.end(); ++it) {
+            const auto& slot = it->second;
+            if(slot.is_loaded && slot.n_users == 0
+               && (victim == table_->slots.end() || slot.last_used < victim->second.last_used)) {
+                victim = it;
+            }
+        }
+
+        if(victim == table_->slots.end()) {
+            // All subtrees are in use.
+            break;
+        }
+
+        // Processes mapping the segment keep it alive, but none is using it.
+        bip::shared_memory_object::remove(segment_name(name_, victim->first).c_str());
+        table_->n_shared_bytes -= victim->second.n_bytes;
+        table_->slots.erase(victim);
+    }
+}
+
+
+inline size_t
+SharedSubtreeCache::shared_bytes() const {
+    auto lock = lock_table();
+    return table_->n_shared_bytes;
+}
+
+
+inline size_t
+SharedSubtreeCache::n_shared_subtrees() const {
+    auto lock = lock_table();
+
+    size_t count = 0;
+    for(const auto& [id, slot] : table_->slots) {
+        count += slot.is_loaded;
+    }
+
+    return count;
+}
+
+
+inline size_t
+SharedSubtreeCache::n_loads() const {
+    auto lock = lock_table();
+    return table_->n_loads;
+}
+
+
+inline std::string
+SharedSubtreeCache::default_name(const std::string& output_dir,
+                                 const std::string& index_file) {
+    auto path = std::filesystem::weakly_canonical(std::filesystem::absolute(output_dir));
+
+    // Missing files are reported when the index is loaded; here they merely
+    // result in a fixed value.
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(index_file, ec);
+    auto n_bytes = std::filesystem::file_size(index_file, ec);
+
+    std::stringstream key;
+    key << path.string() << "\n"
+        << mtime.time_since_epoch().count() << "\n"
+        << n_bytes;
+
+    std::stringstream ss;
+    ss << "brain_indexer_" << std::hex << std::hash<std::string>{}(key.str());
+    return ss.str();
+}
+
+
+inline void
+SharedSubtreeCache::remove(const std::string& name) {
+    remove_segments(name);
+    bip::named_mutex::remove(attach_mutex_name(name).c_str());
+}
+
+
+inline void
+SharedSubtreeCache::remove_segments(const std::string& name) {
+    try {
+        auto table_segment = segment_type(bip::open_only, name.c_str());
+        auto table = table_segment.find<detail::SharedSubtreeTable>("table").first;
+        if(table != nullptr) {
+            for(const auto& [id, slot] : table->slots) {
+                bip::shared_memory_object::remove(segment_name(name, id).c_str());
+            }
+        }
+    }
+    catch(const bip::interprocess_exception&) {
+        // There's no table, hence nothing else to remove.
+    }
+
+    bip::shared_memory_object::remove(name.c_str());
+}
+
+
+inline std::string
+SharedSubtreeCache::segment_name(const std::string& name, size_t subtree_id) {
+    return name + "_" + std::to_string(subtree_id);
+}
+
+
+inline std::string
+SharedSubtreeCache::attach_mutex_name(const std::string& name) {
+    return name + "_attach";
+}
+
+}  // namespace brain_indexer
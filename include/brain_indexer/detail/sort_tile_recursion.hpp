@@ -1,5 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <boost/optional.hpp>
+
 #include <brain_indexer/util.hpp>
 
 namespace brain_indexer {
@@ -62,13 +74,7 @@ void SerialSortTileRecursion<Value, GetCoordinate, dim>::apply(std::vector<Value
 
     if constexpr(dim < 3) {
         util::check_signals();
-        std::sort(
-            values.data() + values_begin,
-            values.data() + values_end,
-            [](const Value &a, const Value &b) {
-                return Key::compare(a, b);
-            }
-        );
+        radix_sort<Key>(values.data() + values_begin, values.data() + values_end);
 
         auto n_parts_per_dim = str_params.n_parts_per_dim;
 
@@ -98,4 +104,287 @@ void serial_sort_tile_recursion(std::vector<Value>& values, const SerialSTRParam
     STR::apply(values, 0ul, values.size(), str_params);
 }
 
+
+template <typename Value, typename GetCoordinate>
+void parallel_sort_tile_recursion(std::vector<Value>& values,
+                                  const SerialSTRParams& str_params,
+                                  size_t n_threads) {
+
+    // Same as the first level of `SerialSortTileRecursion`; but the slices are
+    // independent and therefore processed concurrently.
+    using Key = STRKey<GetCoordinate, 0ul>;
+
+    util::check_signals();
+    radix_sort<Key>(values.data(), values.data() + values.size(), n_threads);
+
+    auto n_slices = str_params.n_parts_per_dim[0];
+    WorkStealingExecutor(n_threads).for_each(n_slices, [&](size_t i) {
+        auto range = util::balanced_chunks(values.size(), n_slices, i);
+
+        using STR = SerialSortTileRecursion<Value, GetCoordinate, 1ul>;
+        STR::apply(values, range.low, range.high, str_params);
+    });
+}
+
+
+namespace detail {
+
+template <class Storage, class = void>
+struct has_flush : std::false_type {};
+
+template <class Storage>
+struct has_flush<Storage, std::void_t<decltype(std::declval<const Storage&>().flush_subtrees())>>
+    : std::true_type {};
+
+
+inline void append_str_boundaries(size_t values_begin,
+                                  size_t values_end,
+                                  const std::array<size_t, 3>& n_parts_per_dim,
+                                  size_t dim,
+                                  std::vector<size_t>& boundaries) {
+    if(dim == 3) {
+        boundaries.push_back(values_end);
+        return;
+    }
+
+    for(size_t i = 0; i < n_parts_per_dim[dim]; ++i) {
+        auto range = util::balanced_chunks(values_end - values_begin, n_parts_per_dim[dim], i);
+        append_str_boundaries(values_begin + range.low,
+                              values_begin + range.high,
+                              n_parts_per_dim,
+                              dim + 1,
+                              boundaries);
+    }
+}
+
+
+inline std::vector<size_t> str_partition_boundaries(size_t n_values,
+                                                    const std::array<size_t, 3>& n_parts_per_dim,
+                                                    size_t dim) {
+    auto boundaries = std::vector<size_t>{0};
+    append_str_boundaries(0, n_values, n_parts_per_dim, dim, boundaries);
+
+    return boundaries;
+}
+
+
+/// \brief Storage which can serialize a subtree separately from writing it.
+template <class Storage, class = void>
+struct has_serialized_subtrees : std::false_type {};
+
+template <class Storage>
+struct has_serialized_subtrees<
+    Storage,
+    std::void_t<decltype(std::declval<const Storage&>().write_subtree(
+        Storage::serialize_subtree(std::declval<const typename Storage::in_memory_subtree_type&>()),
+        size_t{}))>>
+    : std::true_type {};
+
+
+/** \brief Writes serialized subtrees on a dedicated thread.
+ *
+ * The subtrees are built and serialized by other threads, and handed to the
+ * writer, which writes them one after the other. Hence, writing overlaps with
+ * building the next subtrees; and the filesystem sees one stream of large
+ * writes. At most `max_pending` subtrees wait to be written, `push` blocks
+ * while the queue is full. This bounds the memory used by the pipeline.
+ */
+template <class Storage>
+class SubtreeWriter {
+  public:
+    inline SubtreeWriter(const Storage& storage, size_t max_pending)
+        : storage_(storage),
+          max_pending_(std::max(size_t(1), max_pending)),
+          thread_([this]() { work(); }) {}
+
+    SubtreeWriter(const SubtreeWriter&) = delete;
+    SubtreeWriter& operator=(const SubtreeWriter&) = delete;
+
+    /// \brief Waits for the subtrees which have been pushed to be written.
+    inline ~SubtreeWriter() {
+        stop();
+    }
+
+    /// \brief Queue `buffer` to be written; rethrows if a write failed.
+    inline void push(std::string buffer, size_t subtree_id) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this]() {
+                return error_ != nullptr || pending_.size() < max_pending_;
+            });
+
+            if(error_ != nullptr) {
+                std::rethrow_exception(error_);
+            }
+
+            pending_.emplace_back(subtree_id, std::move(buffer));
+        }
+        changed_.notify_all();
+    }
+
+    /// \brief Wait for all subtrees to be written; rethrows if a write failed.
+    inline void close() {
+        stop();
+
+        if(error_ != nullptr) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+  private:
+    inline void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_closed_ = true;
+        }
+        changed_.notify_all();
+
+        if(thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    inline void work() {
+        while(true) {
+            auto item = std::pair<size_t, std::string>();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [this]() { return is_closed_ || !pending_.empty(); });
+
+                // Only stop once all pushed subtrees have been written.
+                if(pending_.empty()) {
+                    return;
+                }
+
+                item = std::move(pending_.front());
+                pending_.pop_front();
+            }
+            changed_.notify_all();
+
+            try {
+                storage_.write_subtree(item.second, item.first);
+            } catch(...) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    error_ = std::current_exception();
+                    pending_.clear();
+                }
+                changed_.notify_all();
+                return;
+            }
+        }
+    }
+
+    const Storage& storage_;
+    size_t max_pending_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::pair<size_t, std::string>> pending_;
+    bool is_closed_ = false;
+    std::exception_ptr error_ = nullptr;
+
+    std::thread thread_;
+};
+
+
+/** \brief Builds and saves the subtrees `[boundaries[k], boundaries[k+1])`.
+ *
+ * The subtree of part `k` has id `first_part + k`; and empty parts are
+ * skipped. The subtrees are built concurrently by `n_threads` threads. If the
+ * storage can serialize subtrees separately, the threads only serialize them;
+ * and they're written by a `SubtreeWriter` with a queue of `n_threads`
+ * buffers. Hence, at any one time, each thread holds at most one subtree and
+ * its buffer, while waiting to queue it; `n_threads` buffers are queued; and
+ * one is being written. That is at most `n_threads` subtrees and
+ * `2 * n_threads + 1` serialized subtrees.
+ *
+ * Returns the bounding boxes of the non-empty parts, in order.
+ */
+template <class Storage, class Value>
+std::vector<IndexedSubtreeBox> save_subtrees(const Storage& storage,
+                                             const std::vector<Value>& values,
+                                             const std::vector<size_t>& boundaries,
+                                             size_t first_part,
+                                             size_t n_threads) {
+
+    auto n_parts = boundaries.size() - 1;
+    auto bounding_boxes = std::vector<boost::optional<IndexedSubtreeBox>>(n_parts);
+
+    auto executor = WorkStealingExecutor(n_threads);
+    auto build_subtrees = [&](auto&& save) {
+        executor.for_each(n_parts, [&](size_t k) {
+            if(boundaries[k] == boundaries[k+1]) {
+                return;
+            }
+
+            util::check_signals();
+            auto subtree = typename Storage::in_memory_subtree_type(
+                values.data() + boundaries[k],
+                values.data() + boundaries[k+1]
+            );
+
+            auto subtree_id = first_part + k;
+            bounding_boxes[k] = IndexedSubtreeBox(subtree_id, subtree.size(), subtree.bounds());
+            save(subtree, subtree_id);
+        });
+    };
+
+    if constexpr (has_serialized_subtrees<Storage>::value) {
+        auto writer = SubtreeWriter<Storage>(storage, executor.n_threads());
+        build_subtrees([&](const auto& subtree, size_t subtree_id) {
+            writer.push(Storage::serialize_subtree(subtree), subtree_id);
+        });
+        writer.close();
+    } else {
+        build_subtrees([&](const auto& subtree, size_t subtree_id) {
+            storage.save_subtree(subtree, subtree_id);
+        });
+    }
+
+    auto non_empty_boxes = std::vector<IndexedSubtreeBox>();
+    non_empty_boxes.reserve(n_parts);
+    for(const auto& box : bounding_boxes) {
+        if(box) {
+            non_empty_boxes.push_back(*box);
+        }
+    }
+
+    return non_empty_boxes;
+}
+
+
+template <class Storage>
+void save_top_tree(const Storage& storage, std::vector<IndexedSubtreeBox>& top_level_boxes) {
+    // Storage which completes its subtrees in a final step, e.g. `PackedStorage`.
+    if constexpr (has_flush<Storage>::value) {
+        storage.flush_subtrees();
+    }
+
+    util::check_signals();
+    auto top_level_tree = typename Storage::toptree_type(
+        top_level_boxes.begin(),
+        top_level_boxes.end()
+    );
+
+    storage.save_top_tree(top_level_tree);
+}
+
+}  // namespace detail
+
+
+template <class GetCenterCoordinate, class Storage, class Value>
+void threaded_partition(const Storage& storage,
+                        std::vector<Value>& values,
+                        const SerialSTRParams& str_params,
+                        size_t n_threads) {
+
+    parallel_sort_tile_recursion<Value, GetCenterCoordinate>(values, str_params, n_threads);
+
+    auto boundaries = str_params.partition_boundaries();
+    auto top_level_boxes = detail::save_subtrees(storage, values, boundaries, 0, n_threads);
+
+    detail::save_top_tree(storage, top_level_boxes);
+}
+
 }
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../thread_pool.hpp"
+
+#include <algorithm>
+
+
+namespace brain_indexer {
+
+inline ThreadPool::ThreadPool(size_t n_threads) {
+    if(n_threads == 0) {
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threads_.reserve(n_threads);
+    for(size_t i = 0; i < n_threads; ++i) {
+        threads_.emplace_back([this]() { work(); });
+    }
+}
+
+
+inline ThreadPool::~ThreadPool() {
+    std::deque<Task> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopping_ = true;
+        std::swap(cancelled, tasks_);
+    }
+    has_tasks_.notify_all();
+
+    // Without holding the lock, since `on_cancel` might submit tasks.
+    for(auto& task : cancelled) {
+        if(task.on_cancel) {
+            task.on_cancel();
+        }
+    }
+
+    for(auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+
+inline void ThreadPool::submit(std::function<void()> task, std::function<void()> on_cancel) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!is_stopping_) {
+            tasks_.push_back(Task{std::move(task), std::move(on_cancel)});
+            has_tasks_.notify_one();
+            return;
+        }
+    }
+
+    if(on_cancel) {
+        on_cancel();
+    }
+}
+
+
+inline void ThreadPool::work() {
+    while(true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_tasks_.wait(lock, [this]() { return is_stopping_ || !tasks_.empty(); });
+
+            // The destructor cancels the remaining tasks.
+            if(is_stopping_ || tasks_.empty()) {
+                return;
+            }
+
+            task = std::move(tasks_.front().run);
+            tasks_.pop_front();
+        }
+
+        task();
+    }
+}
+
+}  // namespace brain_indexer
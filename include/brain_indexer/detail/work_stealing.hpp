@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../work_stealing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../util.hpp"
+
+
+namespace brain_indexer {
+
+namespace detail {
+
+inline void TaskRange::assign(size_t begin, size_t end) {
+    if(end > mask) {
+        throw std::runtime_error("Too many tasks for a `TaskRange`.");
+    }
+
+    bounds_.store(pack(begin, end));
+}
+
+inline bool TaskRange::pop_front(size_t& task) {
+    auto bounds = bounds_.load(std::memory_order_relaxed);
+    while(true) {
+        auto begin = bounds >> 32;
+        auto end = bounds & mask;
+
+        if(begin >= end) {
+            return false;
+        }
+
+        if(bounds_.compare_exchange_weak(bounds, pack(begin + 1, end))) {
+            task = begin;
+            return true;
+        }
+    }
+}
+
+inline bool TaskRange::pop_back(size_t& task) {
+    auto bounds = bounds_.load(std::memory_order_relaxed);
+    while(true) {
+        auto begin = bounds >> 32;
+        auto end = bounds & mask;
+
+        if(begin >= end) {
+            return false;
+        }
+
+        if(bounds_.compare_exchange_weak(bounds, pack(begin, end - 1))) {
+            task = end - 1;
+            return true;
+        }
+    }
+}
+
+}  // namespace detail
+
+
+inline WorkStealingExecutor::WorkStealingExecutor(size_t n_threads)
+    : n_threads_(n_threads) {
+    if(n_threads_ == 0) {
+        n_threads_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+
+template <class F>
+inline void WorkStealingExecutor::for_each(size_t n_tasks, F&& f) const {
+    auto n_workers = std::min(n_threads_, n_tasks);
+
+    if(n_workers <= 1) {
+        for(size_t k = 0; k < n_tasks; ++k) {
+            f(k);
+        }
+        return;
+    }
+
+    std::vector<detail::TaskRange> ranges(n_workers);
+    for(size_t i = 0; i < n_workers; ++i) {
+        auto range = util::balanced_chunks(n_tasks, n_workers, i);
+        ranges[i].assign(range.low, range.high);
+    }
+
+    std::atomic<bool> failed{false};
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+
+    auto work = [&](size_t i) {
+        try {
+            size_t task;
+            while(!failed.load(std::memory_order_relaxed) && ranges[i].pop_front(task)) {
+                f(task);
+            }
+
+            for(size_t j = 1; j < n_workers; ++j) {
+                auto& victim = ranges[(i + j) % n_workers];
+                while(!failed.load(std::memory_order_relaxed) && victim.pop_back(task)) {
+                    f(task);
+                }
+            }
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!failed.exchange(true)) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_workers - 1);
+    for(size_t i = 1; i < n_workers; ++i) {
+        threads.emplace_back(work, i);
+    }
+
+    work(0);
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}  // namespace brain_indexer
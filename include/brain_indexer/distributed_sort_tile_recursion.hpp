@@ -66,18 +66,22 @@ private:
 public:
     static void apply(std::vector<Value> &values,
                       const DistributedSTRParams&str_params,
-                      MPI_Comm mpi_comm);
+                      MPI_Comm mpi_comm,
+                      size_t n_threads = 1);
 };
 
 
 /** \brief  MPI-parallel Sort Tile Recursion.
+ *
+ * The values local to each MPI rank are sorted using `n_threads` threads.
  *
  * \sa `DistributedSortTileRecursion`.
  */
 template <typename Value, typename GetCoordinate>
 void distributed_sort_tile_recursion(std::vector<Value> &values,
                                      const DistributedSTRParams&str_params,
-                                     MPI_Comm mpi_comm);
+                                     MPI_Comm mpi_comm,
+                                     size_t n_threads = 1);
 
 
 inline std::vector<IndexedSubtreeBox> gather_bounding_boxes(
@@ -123,12 +127,18 @@ inline TwoLevelSTRParams two_level_str_heuristic(size_t n_elements,
                                           int comm_size);
 
 
-/// Creates the top-level and all subtrees of the multi-index.
+/** \brief Creates the top-level and all subtrees of the multi-index.
+ *
+ * Each rank sorts its values, and builds and saves its subtrees using
+ * `n_threads` threads, see `detail::save_subtrees`; `0` means one per hardware
+ * thread.
+ */
 template <class GetCenterCoordinate, class Storage, class Value>
 void distributed_partition(const Storage &storage,
                            std::vector<Value> &values,
                            const TwoLevelSTRParams &str_params,
-                           MPI_Comm comm);
+                           MPI_Comm comm,
+                           size_t n_threads = 1);
 
 
 }
@@ -12,6 +12,7 @@
 #include <cassert>
 
 #include <brain_indexer/mpi_wrapper.hpp>
+#include <brain_indexer/radix_sort.hpp>
 
 namespace brain_indexer {
 
@@ -34,7 +35,8 @@ namespace brain_indexer {
  *               bins. The static method
  *                   Key::compare(const T& a, const T& b)
  *               will be used for comparison. The additional method
- *               enables breaking ties.
+ *               enables breaking ties. If `Key` supports `radix_sort`,
+ *               the values are sorted locally by `radix_sort`.
  *
  * \sa https://en.wikipedia.org/wiki/Samplesort
  */
@@ -58,8 +60,10 @@ public:
      *                this MPI rank.
      *
      * \param comm MPI  The MPI communicator used for all communication.
+     *
+     * \param n_threads  The number of threads used to sort locally.
      */
-    static void sort_and_balance(Values &values, MPI_Comm comm);
+    static void sort_and_balance(Values &values, MPI_Comm comm, size_t n_threads = 1);
 
 private:
     DistributedMemorySorter();
@@ -78,7 +82,7 @@ private:
      *       invalidates all references to `values`, e.g. by reallocating or
      *       moving into `values`.
      */
-    void sort(Values &values, MPI_Comm mpiComm);
+    void sort(Values &values, MPI_Comm mpiComm, size_t n_threads);
 
     /**
      * \brief Distributes elements evenly across all MPI ranks.
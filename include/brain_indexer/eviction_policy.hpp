@@ -0,0 +1,352 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+
+namespace brain_indexer {
+
+/// \brief The policies for deciding which subtree of a multi-index to evict.
+enum class EvictionPolicy {
+    /// Evict the subtree with the lowest usage rate, see `UsageRatePolicy`.
+    usage_rate,
+
+    /// Evict the least recently used subtree, see `LRUPolicy`.
+    lru,
+
+    /// Evict the least frequently used subtree, see `LFUPolicy`.
+    lfu,
+
+    /// Evict a subtree which hasn't been used recently, see `ClockPolicy`.
+    clock,
+
+    /// Adapt between recency and frequency, see `ARCPolicy`.
+    arc
+};
+
+/// \brief The policy called `name`, i.e. one of "usage_rate", "lru", "lfu", "clock" or "arc".
+inline EvictionPolicy eviction_policy_from_string(const std::string& name);
+
+
+/** \brief The meta data required to compute usage rate.
+ *
+ * The assumption is that there's a global query counter. It increases on
+ * every query of the spatial index.
+ *
+ * The current value query counter at time of loading the subtree is stored as
+ * the `load_generation`. The `current_access_count` is increased everytime
+ * the subtree is requested.
+ *
+ * On eviction `previous_*` are increased such that they reflect the historic usage
+ * rate.
+ */
+class SubtreeUsage {
+  public:
+    inline double usage_rate(size_t query_count) const;
+    inline size_t access_count() const;
+    inline size_t eviction_count() const;
+    inline size_t incache_count(size_t query_count) const;
+
+
+    /// \brief To be called every time the subtree is queries while residing cache.
+    inline void on_query();
+
+    /// \brief To be called every time the subtree is loaded into cache.
+    inline void on_load(size_t query_count);
+
+    /// \brief To be called if loading failed, it undoes `on_load`.
+    inline void on_load_failed();
+
+    /// \brief To be called immediately before evicting the subtree.
+    inline void on_evict(size_t query_count);
+
+  private:
+    size_t load_generation_ = 0;
+    size_t previous_load_generation_ = 0;
+    size_t current_access_count_ = 0;
+
+    size_t previous_access_count_ = 0;
+    size_t previous_age_ = 0;
+
+    size_t eviction_count_ = 0;
+};
+
+
+/** \brief Decides which subtree of a multi-index to evict.
+ *
+ * The cache tells the policy when a subtree has been loaded and when a
+ * subtree in cache is requested again. When the cache needs room, it asks the
+ * policy for a victim. Subtrees which are still in use mustn't be evicted;
+ * they're skipped using the predicate `is_evictable`.
+ *
+ * Except for `UsageRatePolicy`, all operations take constant time, not
+ * counting the subtrees skipped because they're in use.
+ *
+ * A victim may be requested again before the cache evicts it. Then the cache
+ * aborts the eviction and the policy puts the victim back where it was.
+ *
+ * Policies aren't thread-safe, the cache serializes all calls.
+ */
+class SubtreeEvictionPolicy {
+  public:
+    virtual ~SubtreeEvictionPolicy() = default;
+
+    /// \brief The subtree `subtree_id` has been loaded into cache.
+    virtual void on_load(size_t subtree_id, size_t query_count) = 0;
+
+    /// \brief The subtree was requested while in cache. Unknown subtrees are ignored.
+    virtual void on_access(size_t subtree_id, size_t query_count) = 0;
+
+    /** \brief Stop tracking and return the subtree that should be evicted next.
+     *
+     * Only subtrees for which `is_evictable` returns `true` are considered.
+     * If there are none, `std::nullopt` is returned.
+     */
+    virtual std::optional<size_t>
+    pop_victim(size_t query_count, const std::function<bool(size_t)>& is_evictable) = 0;
+
+    /** \brief The eviction of `subtree_id`, the last victim, was aborted.
+     *
+     * The victim is tracked again, with the position or frequency it had
+     * before `pop_victim` returned it. This must be called before the next
+     * call of `pop_victim`.
+     */
+    virtual void on_evict_aborted(size_t subtree_id) = 0;
+
+    /// \brief The number of subtrees in cache known to the policy.
+    virtual size_t size() const = 0;
+};
+
+/// \brief A new instance of the policy `policy`.
+inline std::unique_ptr<SubtreeEvictionPolicy> make_eviction_policy(EvictionPolicy policy);
+
+
+/** \brief Evicts the subtree with the lowest usage rate.
+ *
+ * For each subtree the number of times the subtree is accessed per query that
+ * occurs while this tree is loaded can be computed. This number is called
+ * "usage rate", see `SubtreeUsage`.
+ *
+ * Finding the victim sorts all subtrees in cache by their usage rate.
+ */
+class UsageRatePolicy : public SubtreeEvictionPolicy {
+  public:
+    inline void on_load(size_t subtree_id, size_t query_count) override;
+    inline void on_access(size_t subtree_id, size_t query_count) override;
+
+    inline std::optional<size_t>
+    pop_victim(size_t query_count, const std::function<bool(size_t)>& is_evictable) override;
+    inline void on_evict_aborted(size_t subtree_id) override;
+
+    inline size_t size() const override {
+        return n_cached_;
+    }
+
+  private:
+    struct State {
+        SubtreeUsage usage;
+        bool is_cached = false;
+    };
+
+    struct Victim {
+        size_t subtree_id;
+        SubtreeUsage usage;
+    };
+
+    // The usage of evicted subtrees is kept, it's part of their usage rate.
+    std::unordered_map<size_t, State> states_;
+    size_t n_cached_ = 0;
+
+    std::optional<Victim> last_victim_;
+};
+
+
+/// \brief Evicts the subtree which has been requested least recently.
+class LRUPolicy : public SubtreeEvictionPolicy {
+  public:
+    inline void on_load(size_t subtree_id, size_t query_count) override;
+    inline void on_access(size_t subtree_id, size_t query_count) override;
+
+    inline std::optional<size_t>
+    pop_victim(size_t query_count, const std::function<bool(size_t)>& is_evictable) override;
+    inline void on_evict_aborted(size_t subtree_id) override;
+
+    inline size_t size() const override {
+        return order_.size();
+    }
+
+  private:
+    struct Victim {
+        size_t subtree_id;
+
+        // The subtree used less recently than the victim, if any.
+        std::optional<size_t> next;
+    };
+
+    // Most recently used first.
+    std::list<size_t> order_;
+    std::unordered_map<size_t, std::list<size_t>::iterator> positions_;
+
+    std::optional<Victim> last_victim_;
+};
+
+
+/** \brief Evicts the subtree which has been requested least often.
+ *
+ * The subtrees are grouped into buckets of equal frequency, which are kept in
+ * order of increasing frequency. Hence, a request moves the subtree into the
+ * next bucket in constant time. Ties are broken by evicting the least recently
+ * used subtree. Frequencies are only counted while the subtree is in cache.
+ */
+class LFUPolicy : public SubtreeEvictionPolicy {
+  public:
+    inline void on_load(size_t subtree_id, size_t query_count) override;
+    inline void on_access(size_t subtree_id, size_t query_count) override;
+
+    inline std::optional<size_t>
+    pop_victim(size_t query_count, const std::function<bool(size_t)>& is_evictable) override;
+    inline void on_evict_aborted(size_t subtree_id) override;
+
+    inline size_t size() const override {
+        return positions_.size();
+    }
+
+  private:
+    struct Bucket {
+        size_t frequency;
+
+        // Most recently used first.
+        std::list<size_t> subtree_ids;
+    };
+
+    using bucket_iterator = std::list<Bucket>::iterator;
+
+    struct Position {
+        bucket_iterator bucket;
+        std::list<size_t>::iterator it;
+    };
+
+    struct Victim {
+        size_t subtree_id;
+        size_t frequency;
+
+        // The subtree of equal frequency used less recently than the victim, if any.
+        std::optional<size_t> next;
+    };
+
+    inline void erase(size_t subtree_id, const Position& position);
+
+    std::list<Bucket> buckets_;
+    std::unordered_map<size_t, Position> positions_;
+
+    std::optional<Victim> last_victim_;
+};
+
+
+/** \brief Approximates LRU by giving recently used subtrees a second chance.
+ *
+ * The subtrees are arranged in a circle. A request only sets the reference
+ * bit of the subtree. To find a victim, the hand moves along the circle and
+ * clears the reference bits, until it finds a subtree whose bit isn't set.
+ */
+class ClockPolicy : public SubtreeEvictionPolicy {
+  public:
+    inline void on_load(size_t subtree_id, size_t query_count) override;
+    inline void on_access(size_t subtree_id, size_t query_count) override;
+
+    inline std::optional<size_t>
+    pop_victim(size_t query_count, const std::function<bool(size_t)>& is_evictable) override;
+    inline void on_evict_aborted(size_t subtree_id) override;
+
+    inline size_t size() const override {
+        return slots_.size();
+    }
+
+  private:
+    struct Slot {
+        size_t subtree_id;
+        bool is_referenced;
+    };
+
+    std::list<Slot> slots_;
+    std::unordered_map<size_t, std::list<Slot>::iterator> positions_;
+    std::list<Slot>::iterator hand_ = slots_.end();
+
+    // The hand points to the slot after the victim.
+    struct Victim {
+        size_t subtree_id;
+    };
+
+    std::optional<Victim> last_victim_;
+};
+
+
+/** \brief An adaptive replacement cache (ARC).
+ *
+ * The subtrees in cache are split into those requested once since being
+ * loaded, `T1`, and those requested repeatedly, `T2`; both in LRU order. The
+ * ids of recently evicted subtrees are remembered in `B1` and `B2`. A miss on
+ * a subtree in `B1` means `T1` is too small, and a miss in `B2` means `T2`
+ * is too small; the target size of `T1` is adapted accordingly.
+ *
+ * Since the cache is limited by bytes rather than the number of subtrees, the
+ * number of subtrees currently in cache is used as the capacity of the ARC.
+ */
+class ARCPolicy : public SubtreeEvictionPolicy {
+  public:
+    inline void on_load(size_t subtree_id, size_t query_count) override;
+    inline void on_access(size_t subtree_id, size_t query_count) override;
+
+    inline std::optional<size_t>
+    pop_victim(size_t query_count, const std::function<bool(size_t)>& is_evictable) override;
+    inline void on_evict_aborted(size_t subtree_id) override;
+
+    inline size_t size() const override {
+        return t1_.size() + t2_.size();
+    }
+
+  private:
+    enum class ListId { t1, t2, b1, b2 };
+
+    struct Position {
+        ListId list_id;
+        std::list<size_t>::iterator it;
+    };
+
+    struct Victim {
+        size_t subtree_id;
+        ListId list_id;
+
+        // The subtree in `list_id` used less recently than the victim, if any.
+        std::optional<size_t> next;
+    };
+
+    inline std::list<size_t>& list(ListId list_id);
+
+    /// \brief Move the subtree to the front of `list_id`.
+    inline void move_to_front(size_t subtree_id, ListId list_id);
+
+    /// \brief Evict the least recently used evictable subtree in `from`.
+    inline std::optional<size_t>
+    pop_victim(ListId from, ListId ghost, const std::function<bool(size_t)>& is_evictable);
+
+    /// \brief Forget the oldest evicted subtrees, if there are too many.
+    inline void trim_ghosts();
+
+    // Most recently used first.
+    std::list<size_t> t1_, t2_, b1_, b2_;
+    std::unordered_map<size_t, Position> positions_;
+
+    // The target size of `T1`.
+    double p_ = 0.0;
+
+    std::optional<Victim> last_victim_;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/eviction_policy.hpp"
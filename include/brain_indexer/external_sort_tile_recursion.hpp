@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_container.hpp>
+#include <brain_indexer/sort_tile_recursion.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A file in scratch space holding values, as raw bytes.
+ *
+ * Values are appended in blocks and read back by offset. Like the MPI
+ * datatypes of `Value`, the bytes are copied as is; hence the file is only
+ * meaningful to the process which wrote it. The file is removed when the
+ * `SpillFile` is destroyed.
+ */
+template <class Value>
+class SpillFile {
+  public:
+    inline explicit SpillFile(std::string filename);
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    inline ~SpillFile();
+
+    /// \brief Append the values `[values, values + n_values)`.
+    inline void append(const Value* values, size_t n_values);
+
+    /// \brief Read `n_values` values, starting with the value at `offset`.
+    inline void read(Value* values, size_t n_values, size_t offset) const;
+
+    /// \brief The number of values in the file.
+    inline size_t size() const noexcept {
+        return n_values_;
+    }
+
+  private:
+    std::string filename_;
+    std::unique_ptr<detail::PosixFile> file_;
+    size_t n_values_ = 0;
+};
+
+
+/** \brief Parameters of the out-of-core Sort Tile Recursion.
+ *
+ * The parameters bound the number of values held in memory. Half of them
+ * are used to hold the part of the values being partitioned in memory; the
+ * other half for the buffers used while merging sorted runs. Sorting them
+ * needs scratch space on top, see `radix_sort_scratch_bytes_per_value`; as
+ * do the subtrees built from the parts.
+ */
+struct ExternalSTRParams {
+    /// Directory where the runs are spilled; it must exist.
+    std::string scratch_dir;
+
+    /// The maximum number of values in memory, approximately.
+    size_t max_values_in_memory;
+
+    /// The number of values read from a run at once.
+    size_t values_per_block;
+
+    /// The number of threads used to sort the values and to build the subtrees.
+    size_t n_threads = 1;
+
+    /// \brief Buckets with at most this many values are partitioned in memory.
+    inline size_t max_values_in_bucket() const {
+        return max_values_in_memory / 2;
+    }
+
+    /// \brief The maximum number of runs merged in one pass.
+    inline size_t max_fan_in() const {
+        return std::max(size_t(2), max_values_in_bucket() / values_per_block);
+    }
+};
+
+
+/** \brief Sort Tile Recursion for values which don't fit into memory.
+ *
+ * Values are added in batches by `spill`, each batch is sorted and written to
+ * scratch space as a run. The runs are partitioned by an external multi-pass
+ * merge sort along the first axis. Its output is split into slices, and
+ * written as runs sorted along the second axis; and so on. Any bucket of
+ * values, i.e. slice, column or part, which fits into memory is loaded and
+ * partitioned by `SerialSortTileRecursion`. Hence, the parts are the same as
+ * the ones of `serial_sort_tile_recursion`, up to the order of values with
+ * the same centroid.
+ *
+ * \sa `SerialSortTileRecursion`.
+ */
+template <class Value, class GetCoordinate>
+class ExternalSortTileRecursion {
+  public:
+    using run_type = std::unique_ptr<SpillFile<Value>>;
+
+    inline explicit ExternalSortTileRecursion(ExternalSTRParams params);
+
+    /// \brief Sort `values` along the first axis and write them as a run.
+    ///
+    /// The `values` are left empty; but keep their capacity.
+    inline void spill(std::vector<Value>& values);
+
+    /// \brief The total number of values spilled.
+    inline size_t size() const noexcept {
+        return n_values_;
+    }
+
+    /// \brief The parameters this STR was created with.
+    inline const ExternalSTRParams& params() const noexcept {
+        return params_;
+    }
+
+    /// \brief The number of runs currently in scratch space.
+    inline size_t n_runs() const noexcept {
+        return runs_.size();
+    }
+
+    /** \brief Partition all spilled values, and pass the parts to `f`.
+     *
+     * In order of the parts, `f(values, boundaries, first_part)` is called
+     * for each bucket which fits into memory. The `k`-th part of the bucket
+     * is `[boundaries[k], boundaries[k+1])` and it's the part with index
+     * `first_part + k` overall. The runs are removed as they're consumed.
+     */
+    template <class F>
+    inline void for_each_bucket(const SerialSTRParams& str_params, F&& f);
+
+  private:
+    template <size_t dim, class F>
+    inline void partition_bucket(std::vector<run_type> runs,
+                                 size_t n_values,
+                                 const SerialSTRParams& str_params,
+                                 size_t& next_part,
+                                 F& f);
+
+    template <size_t dim>
+    inline std::vector<run_type> reduce_runs(std::vector<run_type> runs);
+
+    inline run_type make_run();
+
+    ExternalSTRParams params_;
+    std::vector<run_type> runs_;
+    size_t n_values_ = 0;
+    size_t next_run_id_ = 0;
+};
+
+
+/** \brief Creates the top-level and all subtrees of the multi-index, out-of-core.
+ *
+ * The values spilled to `str` are partitioned by the external STR. As soon as a
+ * bucket has been partitioned, its subtrees are built and saved concurrently
+ * using `ExternalSTRParams::n_threads`. The subtree of part `k` has id `k`;
+ * and empty parts are skipped, as in `threaded_partition`.
+ */
+template <class GetCenterCoordinate, class Storage, class Value>
+void external_partition(const Storage& storage,
+                        ExternalSortTileRecursion<Value, GetCenterCoordinate>& str,
+                        const SerialSTRParams& str_params);
+
+}  // namespace brain_indexer
+
+#include "detail/external_sort_tile_recursion.hpp"
@@ -42,6 +42,11 @@ struct Sphere {
 
     inline bool contains(Point3D const& p) const;
 
+    /// \brief The distance from `p` to the sphere; zero if `p` is inside.
+    inline CoordType distance(Point3D const& p) const {
+        return std::max(Point3Dx(centroid).distance(p) - radius, CoordType(0));
+    }
+
     inline void translate(Point3D const& vec) {
         bg::add_point(centroid, vec);
     }
@@ -191,6 +196,15 @@ struct Cylinder {
     inline bool intersects(Box3D const& b) const;
     inline bool contains(Point3D const& p) const;
 
+    /**
+     * \brief The distance from `p` to the capsule; zero exactly if `p` is inside it.
+     *
+     *  As for `intersects` with boxes and cylinders, the caps are round; unlike
+     *  for points, see `contains`. Therefore, the caps may stick out of
+     *  `bounding_box`, see `geometry_distance`.
+     */
+    inline CoordType distance(Point3D const& p) const;
+
     inline void translate(Point3D const& vec) {
         bg::add_point(p1, vec);
         bg::add_point(p2, vec);
@@ -322,6 +336,44 @@ inline bool geometry_intersects(const QueryShape& query_shape,
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Distances
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The distance from `point` to the exact shape of the element.
+inline CoordType geometry_distance(const Point3D& point, const Point3D& element_shape) {
+    return static_cast<CoordType>(bg::distance(point, element_shape));
+}
+
+inline CoordType geometry_distance(const Point3D& point, const Box3D& element_shape) {
+    return static_cast<CoordType>(bg::distance(point, element_shape));
+}
+
+inline CoordType geometry_distance(const Point3D& point, const Sphere& element_shape) {
+    return element_shape.distance(point);
+}
+
+/**
+ * \brief The distance from `point` to the part of the capsule inside its bounding box.
+ *
+ * The index only knows the bounding box of a cylinder, which is the one of
+ * the cylinder with flat caps. Parts of the round caps outside of it are never
+ * found by queries; and they're not considered closer than the bounding box.
+ * Hence, the distance is a lower bound as required by `find_nearest_exact`.
+ */
+inline CoordType geometry_distance(const Point3D& point, const Cylinder& element_shape) {
+    return std::max(element_shape.distance(point),
+                    static_cast<CoordType>(bg::distance(point, element_shape.bounding_box())));
+}
+
+template <class... V>
+inline CoordType geometry_distance(const Point3D& point, const boost::variant<V...>& element) {
+    return boost::apply_visitor(
+        [&point](const auto& element_shape) { return geometry_distance(point, element_shape); },
+        element
+    );
+}
+
+
 inline std::ostream& operator<<(std::ostream& os, const Sphere& s);
 inline std::ostream& operator<<(std::ostream& os, const Cylinder& c);
 
@@ -6,6 +6,7 @@
 #include <cstdio>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <unordered_map>
 
 // boost::serialize before boost::geometry
@@ -16,6 +17,8 @@
 #include <boost/serialization/version.hpp>
 
 #include <boost/geometry/index/rtree.hpp>
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
 #include <boost/variant.hpp>
 
 #include <brain_indexer/meta_data.hpp>
@@ -468,6 +471,17 @@ template <typename T, typename A = boost::container::new_allocator<T>>
 using IndexTreeBaseT = bgi::rtree<T, bgi::linear<16, 2>, bgi::indexable<T>, bgi::equal_to<T>, A>;
 
 
+template <typename Index, typename GeometryMode, typename ShapeT>
+class QueryCursor;
+
+/**
+ * \brief Queries common to all indexes.
+ *
+ * `Derived` must provide `query(predicates, out)`. Indexes which don't store
+ * their elements in a `bgi::rtree` can instead shadow `find_intersecting` and
+ * `find_nearest`; the remaining queries are implemented in terms of
+ * `Derived::find_intersecting`.
+ */
 template <typename Derived, typename T>
 class IndexTreeMixin {
   public:
@@ -503,6 +517,18 @@ class IndexTreeMixin {
     template <typename ShapeT>
     inline decltype(auto) find_nearest(const ShapeT& shape, unsigned k_neighbors) const;
 
+    /**
+     * \brief Gets the ids of the nearest K objects, by the distance to their exact shape.
+     *
+     * Elements are visited by increasing distance of their bounding box, which
+     * is a lower bound of the distance to their shape, see `geometry_distance`.
+     * The search stops once the next bounding box is further away than the
+     * current K-th candidate.
+     *
+     * \returns The object ids and their distances, both by increasing distance.
+     */
+    inline decltype(auto) find_nearest_exact(const Point3D& point, unsigned k_neighbors) const;
+
     /// \brief Counts objects intersecting the given region deliminted by the shape
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline size_t count_intersecting(const ShapeT& shape) const;
@@ -511,6 +537,198 @@ class IndexTreeMixin {
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline std::unordered_map<identifier_t, size_t> count_intersecting_agg_gid(
         const ShapeT& shape) const;
+
+    /**
+     * \brief Find elements in tree that intersect with any of the given shapes.
+     *
+     * All matches are written to `iter`. The returned offsets follow the CSR
+     * convention, i.e. the matches of `shapes[i]` are the elements
+     * `[offsets[i], offsets[i+1])` of the output. If `schedule` reorders the
+     * queries, the matches are buffered and written in the given order.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename OutputIt>
+    inline std::vector<size_t> find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                       const OutputIt& iter) const;
+
+    /**
+     * \brief Finds & return objects which intersect, batched numpy version.
+     *
+     * The queries are distributed over `n_threads` threads using a
+     * `WorkStealingExecutor`. Indexes which don't support concurrent queries,
+     * see `supports_concurrent_queries`, always use a single thread. The
+     * result doesn't depend on the number of threads.
+     *
+     * \returns The matches of all queries as one POD object and the CSR offsets
+     *     delimiting the matches of each query.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_intersecting_batch_np(const std::vector<ShapeT>& shapes,
+                                                     size_t n_threads = 1) const;
+
+    /// \brief Counts objects intersecting each of the given shapes, using `n_threads`.
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<size_t> count_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                        size_t n_threads = 1) const;
+
+    /**
+     * \brief Prepares the index for querying all of `shapes`.
+     *
+     * Called at the start of the batch queries. Returns the order in which the
+     * queries should be performed; an empty order means in the given order.
+     * The results are always returned in the given order. Indexes which load
+     * their elements lazily shadow it to start loading what the batch needs,
+     * and to group queries which need the same parts of the index.
+     */
+    template <typename ShapeT>
+    inline std::vector<size_t> schedule(const std::vector<ShapeT>& /* shapes */) const {
+        return {};
+    }
+
+    /**
+     * \brief A resumable query, which returns the matches in chunks.
+     *
+     * The index must outlive the cursor, see `QueryCursor`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline QueryCursor<Derived, GeometryMode, ShapeT> query_cursor(const ShapeT& shape) const;
+
+  private:
+    inline static size_t effective_n_threads(size_t n_threads);
+};
+
+/**
+ * \brief Can `const` queries of `Index` be issued from several threads concurrently?
+ *
+ * An `IndexTree` doesn't modify any state while being queried. Therefore, any
+ * number of threads can query the same `IndexTree` concurrently, as long as no
+ * thread modifies the tree at the same time. Indexes which modify internal
+ * state during queries must specialize this trait.
+ */
+template <class Index>
+struct supports_concurrent_queries : std::true_type {};
+
+
+namespace detail {
+
+/// \brief A `bgi::satisfies` predicate testing the geometry of the elements.
+template <typename ShapeT, typename GeometryMode>
+struct GeometryIntersectsPredicate {
+    ShapeT shape;
+
+    template <typename Value>
+    inline bool operator()(const Value& value) const {
+        return geometry_intersects(shape, value, GeometryMode{});
+    }
+};
+
+/// \brief The predicates of the query `find_intersecting<GeometryMode>(shape, ...)`.
+template <typename GeometryMode, typename ShapeT>
+inline auto intersects_predicates(const ShapeT& shape) {
+    return bgi::intersects(bgi::indexable<ShapeT>{}(shape))
+           && bgi::satisfies(GeometryIntersectsPredicate<ShapeT, GeometryMode>{shape});
+}
+
+/**
+ * \brief The best candidates of a search for the `k` nearest neighbours.
+ *
+ * The candidates are kept in a max-heap. Hence, the distance a further element
+ * must beat, i.e. the one of the k-th candidate, is known at all times.
+ */
+template <typename Value>
+class NearestCandidates {
+  public:
+    using candidate_type = std::pair<double, Value>;
+
+    inline explicit NearestCandidates(size_t k_neighbors);
+
+    /// \brief The distance of the k-th candidate; infinite while there are fewer.
+    inline double max_distance() const;
+
+    /// \brief Adds `value`, if it's closer than the k-th candidate.
+    inline void push(double distance, const Value& value);
+
+    /// \brief The candidates, by increasing distance.
+    inline std::vector<candidate_type> sorted() &&;
+
+  private:
+    inline static bool closer(const candidate_type& a, const candidate_type& b) {
+        return a.first < b.first;
+    }
+
+    size_t k_neighbors_;
+    std::vector<candidate_type> heap_;
+};
+
+/**
+ * \brief Adds the elements of `tree` closest to `point` to `candidates`.
+ *
+ * The distance is the one to the exact shape of the elements. Elements are
+ * visited by increasing distance of their bounding box, until it exceeds the
+ * distance of the current k-th candidate.
+ */
+template <typename Tree, typename Value>
+inline void find_nearest_exact(const Tree& tree,
+                               const Point3D& point,
+                               NearestCandidates<Value>& candidates);
+
+}  // namespace detail
+
+/**
+ * \brief Functionality common to all `QueryCursor`s.
+ *
+ * `Derived` must provide `next(max_elements, iter)`, which writes at most
+ * `max_elements` further matches to `iter` and returns their number. Fewer
+ * than `max_elements` matches are returned only once the query is complete.
+ */
+template <typename Derived, typename T>
+class QueryCursorMixin {
+  public:
+    /**
+     * \brief The next at most `max_elements` matches, numpy version.
+     * \returns A POD object, as for `IndexTreeMixin::find_intersecting_np`.
+     */
+    inline decltype(auto) next_np(size_t max_elements);
+};
+
+/**
+ * \brief A resumable query, which returns the matches in chunks.
+ *
+ * The cursor stores the state of a query of `index` with `shape`. Each call to
+ * `next` continues where the previous call stopped. Hence, the matches of a
+ * query with a huge number of results can be processed in chunks of bounded
+ * size, instead of materializing all of them at once.
+ *
+ * This primary template works for any index providing `qbegin`, e.g.
+ * `IndexTree` and `MemoryMappedIndexTree`; other indexes specialize it. The
+ * index must outlive the cursor and must not be modified while the cursor is
+ * in use.
+ */
+template <typename Index, typename GeometryMode, typename ShapeT>
+class QueryCursor: public QueryCursorMixin<QueryCursor<Index, GeometryMode, ShapeT>,
+                                           typename Index::value_type> {
+  public:
+    inline QueryCursor(const Index& index, const ShapeT& shape);
+
+    template <typename OutputIt>
+    inline size_t next(size_t max_elements, const OutputIt& iter);
+
+  private:
+    using predicates_type
+        = decltype(detail::intersects_predicates<GeometryMode>(std::declval<ShapeT>()));
+    using iterator_type
+        = decltype(std::declval<const Index&>().qbegin(std::declval<predicates_type>()));
+
+    const Index* index_;
+    iterator_type it_;
+};
+
+/// \brief The on-disk formats of an `IndexTree`, see `IndexTree::dump`.
+enum class IndexFormat {
+    /// Boost serialization. Loading rebuilds every node and element on the heap.
+    serialized,
+
+    /// A file which is memory mapped and queried in place, see `MemoryMappedIndexTree`.
+    memory_mapped
 };
 
 /**
@@ -551,13 +769,32 @@ class IndexTree: public IndexTreeMixin<IndexTree<T, A>, T>, public IndexTreeBase
     inline explicit IndexTree(const char* dump_file)
         : IndexTree(std::string(dump_file)) {}
 
-    /// \brief Output tree to binary data file
-    inline void dump(const std::string& filename) const;
+    /**
+     * \brief Write the index and its meta data to the directory `index_path`.
+     *
+     * Indexes written as `IndexFormat::serialized` are opened with the
+     * constructor of `IndexTree`; and those written as
+     * `IndexFormat::memory_mapped` with `MemoryMappedIndexTree`.
+     */
+    inline void dump(const std::string& index_path,
+                     IndexFormat format = IndexFormat::serialized) const;
 
     /// \brief Checks whether a given shape intersects any object in the tree
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline bool is_intersecting(const ShapeT& shape) const;
 
+    /**
+     * \brief Counts objects intersecting the given region deliminted by the shape
+     *
+     * Elements in nodes of the tree which lie inside `shape` are counted
+     * without testing them against `shape`, if `GeometryMode` is
+     * `BoundingBoxGeometry`. Since the R-tree doesn't store the number of
+     * elements per node, the leaves below such a node are still visited, to
+     * add up their sizes.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
     /**
      * \brief Finds & return objects which intersect. To be used mainly with id-less objects
      * \returns A vector of references to tree objects
@@ -604,6 +841,116 @@ private:
     }
 };
 
+
+namespace bip = boost::interprocess;
+
+/// \brief Allocator which places objects in a memory mapped file.
+template <typename T>
+using MemoryMappedAllocator = bip::allocator<T, bip::managed_mapped_file::segment_manager>;
+
+/**
+ * \brief An `IndexTree` stored in a memory mapped file.
+ *
+ * The nodes and elements of the tree are allocated inside the file, using
+ * offset pointers. Hence, the file is mapped read-only and queried in place.
+ * Opening the index doesn't read or deserialize anything, pages are read
+ * from disk as queries touch them. Since the mapping is shared and read-only,
+ * all processes on the same node which open the same index share the page
+ * cache.
+ *
+ * These files are created by `IndexTree::dump` with `IndexFormat::memory_mapped`.
+ */
+template <typename T>
+class MemoryMappedIndexTree: public IndexTreeMixin<MemoryMappedIndexTree<T>, T> {
+  public:
+    using value_type = T;
+    using tree_type = IndexTree<T, MemoryMappedAllocator<T>>;
+
+    /// \brief Open the index stored in the directory `index_path`.
+    inline explicit MemoryMappedIndexTree(const std::string& index_path);
+
+    /** \brief Open the memory mapped file `filename` directly.
+     *
+     * Throws `std::runtime_error` if the file was written with a different
+     * layout, e.g. by another version of Boost or for another element type.
+     */
+    inline static MemoryMappedIndexTree open_file(const std::string& filename);
+
+    /**
+     * \brief The index stored in the managed memory `segment`.
+     *
+     * The segment has the layout of the files written by `IndexTree::dump`
+     * with `IndexFormat::memory_mapped`, e.g. it's managed shared memory
+     * written by `detail::write_managed_tree`. The segment must stay mapped
+     * while `owner` is alive. Like `open_file`, its layout is checked.
+     */
+    template <class Segment>
+    inline static MemoryMappedIndexTree from_segment(Segment& segment,
+                                                     std::shared_ptr<const void> owner);
+
+    /// \brief Writes all elements matching `predicates` to `it`; returns their number.
+    template <class Predicates, class OutIt>
+    inline size_t query(const Predicates& predicates, const OutIt& it) const {
+        return tree_->query(predicates, it);
+    }
+
+    template <class Predicates>
+    inline auto qbegin(const Predicates& predicates) const {
+        return tree_->qbegin(predicates);
+    }
+
+    inline auto qend() const {
+        return tree_->qend();
+    }
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const {
+        return tree_->template is_intersecting<GeometryMode>(shape);
+    }
+
+    /// \brief Counts objects intersecting the shape, see `IndexTree::count_intersecting`.
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const {
+        return tree_->template count_intersecting<GeometryMode>(shape);
+    }
+
+    /**
+     * \brief Finds & return objects which intersect. To be used mainly with id-less objects
+     * \returns A vector of copies of the tree objects
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline auto find_intersecting_objs(const ShapeT& shape) const -> std::vector<value_type>;
+
+    inline size_t size() const {
+        return tree_->size();
+    }
+
+    inline Box3D bounds() const {
+        return tree_->bounds();
+    }
+
+    /**
+     * \brief The size of the mapping in bytes.
+     *
+     * This is an upper bound of the memory used, since only the pages which
+     * have been accessed are read from disk.
+     */
+    inline size_t memory_footprint() const {
+        return n_bytes_;
+    }
+
+  private:
+    inline MemoryMappedIndexTree(std::shared_ptr<const void> owner,
+                                 const tree_type* tree,
+                                 size_t n_bytes);
+
+    // Owns the mapping, it's shared between copies.
+    std::shared_ptr<const void> owner_;
+    const tree_type* tree_ = nullptr;
+    size_t n_bytes_ = 0;
+};
+
 }  // namespace brain_indexer
 
 #include "detail/index.hpp"
@@ -31,6 +31,10 @@ class IndexBulkBuilderBase {
 template<class Index, class Value = typename Index::value_type>
 class IndexBulkBuilder : public IndexBulkBuilderBase<Value> {
   public:
+    /// \brief Pack the index with `n_threads` threads, see `parallel_bulk_load`.
+    inline explicit IndexBulkBuilder(size_t n_threads = 1)
+        : n_threads_(n_threads) {}
+
     inline void finalize();
 
     /// \brief Obtain the index after it's been built.
@@ -38,6 +42,7 @@ class IndexBulkBuilder : public IndexBulkBuilderBase<Value> {
 
   protected:
     boost::optional<Index> index_ = boost::none;
+    size_t n_threads_;
 };
 
 }
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/sort_tile_recursion.hpp>
+
+namespace brain_indexer {
+
+/**
+ * \brief Segments stored as a structure of arrays.
+ *
+ * The `i`-th segment consists of the `i`-th entry of every array. The ids are
+ * stored packed, in the same way as `MorphPartId`.
+ */
+struct SegmentArrays {
+    std::vector<CoordType> p1_x, p1_y, p1_z;
+    std::vector<CoordType> p2_x, p2_y, p2_z;
+    std::vector<CoordType> radius;
+    std::vector<identifier_t> id;
+    std::vector<SectionType> section_type;
+
+    inline size_t size() const noexcept {
+        return radius.size();
+    }
+
+    inline void reserve(size_t n);
+    inline void push_back(const Segment& segment);
+
+    /// \brief The geometry of the `i`-th segment.
+    inline Cylinder cylinder(size_t i) const noexcept;
+
+    /// \brief A copy of the `i`-th segment.
+    inline Segment segment(size_t i) const;
+};
+
+
+/**
+ * \brief A read-only index of morphologies optimized for segments.
+ *
+ * An `IndexTree<MorphoEntry>` stores every element as a `boost::variant`,
+ * which needs room for the larger alternative plus a discriminator; and every
+ * intersection test dispatches through `boost::apply_visitor`.
+ *
+ * Instead, this index groups spatially close segments into blocks of at most
+ * `max_block_size` segments, using sort tile recursion. The segments of all
+ * blocks are stored contiguously as a `SegmentArrays`, and an R-tree indexes
+ * the bounding box of each block. Queries find the intersecting blocks and
+ * then test all segments of the block in a tight loop. The few somas are
+ * stored in a separate `IndexTree<Soma>`.
+ *
+ * Queries return the same elements as `IndexTree<MorphoEntry>`.
+ */
+class MorphBlockIndexTree: public IndexTreeMixin<MorphBlockIndexTree, MorphoEntry> {
+  public:
+    using value_type = MorphoEntry;
+
+    /// \brief The maximum number of segments in a block.
+    static constexpr size_t max_block_size = 32;
+
+    inline MorphBlockIndexTree() = default;
+
+    template <typename InputIt>
+    inline MorphBlockIndexTree(InputIt first, InputIt last);
+
+    inline explicit MorphBlockIndexTree(const std::vector<MorphoEntry>& entries)
+        : MorphBlockIndexTree(entries.begin(), entries.end()) {}
+
+    /**
+     * \brief Find elements in tree that intersect with the given shape.
+     *
+     * \sa `IndexTreeMixin::find_intersecting`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename OutputIt>
+    inline void find_intersecting(const ShapeT& shape, const OutputIt& iter) const;
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Counts objects intersecting the given region deliminted by the shape
+     *
+     * Blocks which lie inside `shape` are counted without testing their
+     * segments, if `GeometryMode` is `BoundingBoxGeometry`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Finds & return objects which intersect.
+     * \returns A vector of copies of the tree objects
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<value_type> find_intersecting_objs(const ShapeT& shape) const;
+
+    /**
+     * \brief Gets the ids of the the nearest K objects
+     *
+     * The distance is measured to the bounding box of the elements, as for
+     * `IndexTree`. The ids are sorted by increasing distance.
+     */
+    template <typename ShapeT>
+    inline std::vector<gid_segm_t> find_nearest(const ShapeT& shape,
+                                                unsigned k_neighbors) const;
+
+    /**
+     * \brief Gets the ids of the nearest K objects, by the distance to their exact shape.
+     *
+     * \returns The ids and distances, by increasing distance.
+     * \sa `IndexTreeMixin::find_nearest_exact`.
+     */
+    inline std::pair<std::vector<gid_segm_t>, std::vector<CoordType>>
+    find_nearest_exact(const Point3D& point, unsigned k_neighbors) const;
+
+    /// \brief The number of elements in the index.
+    inline size_t size() const noexcept {
+        return segments_.size() + somas_.size();
+    }
+
+    /// \brief The number of blocks of segments.
+    inline size_t n_blocks() const noexcept {
+        return blocks_.size();
+    }
+
+    inline Box3D bounds() const;
+
+  private:
+    /**
+     * \brief Calls `f(element)` for every element intersecting `shape`.
+     *
+     * Stops early if `f` returns `false`. Returns `false` if it stopped early.
+     */
+    template <typename GeometryMode, typename ShapeT, typename F>
+    inline bool for_each_intersecting(const ShapeT& shape, F&& f) const;
+
+    /**
+     * \brief Calls `f(i)` for every segment `i` of `block` intersecting `shape`.
+     *
+     * The segments are tested in batches, see `detail::leaf_intersects`. Stops
+     * early if `f` returns `false`. Returns `false` if it stopped early.
+     */
+    template <typename GeometryMode, typename ShapeT, typename F>
+    inline bool for_each_intersecting_segment(const ShapeT& shape,
+                                              const Box3D& query_box,
+                                              const IndexedSubtreeBox& block,
+                                              F&& f) const;
+
+    template <typename Index, typename GeometryMode, typename ShapeT>
+    friend class QueryCursor;
+
+    SegmentArrays segments_;
+
+    // The segments of block `b` are `offsets_[b], ..., offsets_[b+1] - 1`. The
+    // id of a block in `blocks_` is its index into `offsets_`.
+    std::vector<size_t> offsets_;
+    IndexTree<IndexedSubtreeBox> blocks_;
+
+    IndexTree<Soma> somas_;
+};
+
+
+/**
+ * \brief A resumable query of a `MorphBlockIndexTree`.
+ *
+ * The somas are returned first, then the segments block by block.
+ *
+ * \sa `QueryCursor`.
+ */
+template <typename GeometryMode, typename ShapeT>
+class QueryCursor<MorphBlockIndexTree, GeometryMode, ShapeT>
+    : public QueryCursorMixin<QueryCursor<MorphBlockIndexTree, GeometryMode, ShapeT>,
+                              MorphoEntry> {
+  public:
+    inline QueryCursor(const MorphBlockIndexTree& index, const ShapeT& shape);
+
+    template <typename OutputIt>
+    inline size_t next(size_t max_elements, const OutputIt& iter);
+
+  private:
+    using soma_predicates_type
+        = decltype(detail::intersects_predicates<GeometryMode>(std::declval<ShapeT>()));
+    using soma_iterator_type = decltype(
+        std::declval<const IndexTree<Soma>&>().qbegin(std::declval<soma_predicates_type>())
+    );
+    using block_iterator_type = decltype(
+        std::declval<const IndexTree<IndexedSubtreeBox>&>().qbegin(bgi::intersects(Box3D{}))
+    );
+
+    const MorphBlockIndexTree* index_;
+    ShapeT shape_;
+    Box3D query_box_;
+
+    soma_iterator_type soma_it_;
+    block_iterator_type block_it_;
+
+    // The matching segments of the current block, which haven't been returned.
+    std::vector<size_t> matches_;
+    size_t next_match_ = 0;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/morph_block_index.hpp"
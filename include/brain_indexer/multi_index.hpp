@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include <boost/serialization/utility.hpp>
@@ -8,10 +13,17 @@
 
 #include <nlohmann/json.hpp>
 
+#include <brain_indexer/eviction_policy.hpp>
+#include <brain_indexer/external_sort_tile_recursion.hpp>
 #include <brain_indexer/geometries.hpp>
 #include <brain_indexer/index.hpp>
 #include <brain_indexer/index_bulk_builder.hpp>
+#include <brain_indexer/multi_index_stats.hpp>
+#include <brain_indexer/packed_container.hpp>
+#include <brain_indexer/query_ordering.hpp>
+#include <brain_indexer/shared_subtree_cache.hpp>
 #include <brain_indexer/sort_tile_recursion.hpp>
+#include <brain_indexer/thread_pool.hpp>
 #include <brain_indexer/util.hpp>
 
 #if SI_MPI == 1
@@ -55,6 +67,9 @@ class MultiIndexStorage {
     /// \brief The type of the subtrees of the multi index.
     using subtree_type = SubTree;
 
+    /// \brief The type of the subtrees passed to `save_subtree`.
+    using in_memory_subtree_type = SubTree;
+
   public:
     MultiIndexStorage() = default;
 
@@ -65,6 +80,12 @@ class MultiIndexStorage {
                              const std::string& output_dir,
                              size_t subtree_id);
 
+    /// \brief Boost serialize the subtree into a buffer, without writing it.
+    inline static std::string serialize_subtree(const SubTree& subtree);
+
+    /// \brief Write a buffer created by `serialize_subtree` as the subtree `subtree_id`.
+    inline void write_subtree(const std::string& buffer, size_t subtree_id) const;
+
     inline void save_top_tree(const TopTree& tree) const;
     inline static void save_top_tree(const TopTree& tree, const std::string& output_dir);
 
@@ -74,6 +95,9 @@ class MultiIndexStorage {
     inline TopTree load_top_tree() const;
     inline static TopTree load_top_tree(const std::string& output_dir);
 
+    /// \brief The size of the file of the subtree `subtree_id`.
+    inline size_t subtree_bytes_on_disk(size_t subtree_id) const;
+
   private:
     std::string output_dir;
 };
@@ -113,12 +137,20 @@ class NativeStorage : public MultiIndexStorage<
     template <class RTree>
     inline static RTree load_tree(const std::string& filename);
 
+    /// \brief Boost serialize `rtree` into a buffer.
+    template <class RTree>
+    inline static std::string serialize_tree(const RTree& rtree);
+
+    /// \brief Write a buffer created by `serialize_tree` to `filename`, in one write.
+    inline static void write_serialized_tree(const std::string& buffer,
+                                             const std::string& filename);
+
   private:
     template <class ...Args>
     inline static void load_tree_impl(bgi::rtree<Args...> &tree, const std::string& filename);
 
     template <class ...Args>
-    inline static void save_tree_impl(const bgi::rtree<Args...> &tree, const std::string& filename);
+    inline static std::string serialize_tree_impl(const bgi::rtree<Args...> &tree);
 };
 
 using MultiIndexTopTreeT = bgi::rtree<IndexedSubtreeBox, bgi::linear<16, 2>>;
@@ -130,29 +162,328 @@ template<class T>
 using NativeStorageT = NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>;
 
 
+/// \brief The filenames of the subtrees used by `MemoryMappedStorage`.
+struct MemoryMappedFilenames {
+    static inline
+    std::string subtree(const std::string& output_dir, size_t subtree_id) {
+        auto dirname = std::filesystem::path(output_dir);
+        auto basename = std::string("index-l") + std::to_string(subtree_id) + ".mmap";
+        auto p = dirname / basename;
+        return p.string();
+    }
+};
+
+/** \brief Storage policy with memory mapped subtrees.
+ *
+ *  The subtrees are stored in the format of `MemoryMappedIndexTree`. Hence,
+ *  loading a subtree only maps the file into memory, which makes cache misses
+ *  cheap and shares the page cache between processes. The top-level tree is
+ *  small and uses Boost serialization, as in `NativeStorage`.
+ *
+ *  \tparam T  The type of the elements of the multi index.
+ */
+template <class T>
+class MemoryMappedStorage {
+  public:
+    using toptree_type = MultiIndexTopTreeT;
+    using subtree_type = MemoryMappedIndexTree<T>;
+    using in_memory_subtree_type = MultiIndexSubTreeT<T>;
+
+  public:
+    MemoryMappedStorage() = default;
+
+    explicit MemoryMappedStorage(std::string output_dir)
+        : output_dir(std::move(output_dir)) { }
+
+    inline void save_subtree(const in_memory_subtree_type& subtree, size_t subtree_id) const;
+    inline void save_top_tree(const toptree_type& tree) const;
+
+    inline subtree_type load_subtree(size_t subtree_id) const;
+    inline toptree_type load_top_tree() const;
+
+    /// \brief The size of the file of the subtree `subtree_id`.
+    inline size_t subtree_bytes_on_disk(size_t subtree_id) const;
+
+  private:
+    std::string output_dir;
+};
+
+
+/** \brief Storage policy with subtrees in node-wide shared memory.
+ *
+ *  The subtrees are stored on disk as in `NativeStorage`. When loaded, they're
+ *  written into POSIX shared memory, in the format of `MemoryMappedIndexTree`.
+ *  All processes on the node which open the same multi-index with this
+ *  storage share a `SharedSubtreeCache`. Hence, each subtree is read from
+ *  disk once per node and mapped by all processes which need it.
+ *
+ *  Each process still has its own `UsageRateCache`, which decides how many
+ *  subtrees the process keeps mapped; and therefore in use. The node-wide
+ *  cache evicts subtrees which no process uses.
+ *
+ *  \tparam T  The type of the elements of the multi index.
+ */
+template <class T>
+class SharedMemoryStorage {
+  public:
+    using toptree_type = MultiIndexTopTreeT;
+    using subtree_type = MemoryMappedIndexTree<T>;
+    using in_memory_subtree_type = MultiIndexSubTreeT<T>;
+
+  public:
+    SharedMemoryStorage() = default;
+
+    /** \brief Attach to the node-wide cache of the multi-index in `output_dir`.
+     *
+     * The cache is named by `SharedSubtreeCache::default_name`, based on the
+     * top-level tree.
+     */
+    SharedMemoryStorage(std::string output_dir, const SharedSubtreeCacheParams& params);
+
+    inline void save_subtree(const in_memory_subtree_type& subtree, size_t subtree_id) const;
+    inline void save_top_tree(const toptree_type& tree) const;
+
+    inline subtree_type load_subtree(size_t subtree_id) const;
+    inline toptree_type load_top_tree() const;
+
+    /// \brief The node-wide cache of subtrees.
+    inline const SharedSubtreeCache& shared_cache() const {
+        return *shared_cache_;
+    }
+
+  private:
+    std::string output_dir;
+    std::shared_ptr<SharedSubtreeCache> shared_cache_;
+};
+
+
+/// \brief The filename of the container of all subtrees used by `PackedStorage`.
+struct PackedFilenames {
+    static inline std::string subtrees(const std::string& output_dir) {
+        auto p = std::filesystem::path(output_dir) / "subtrees.pack";
+        return p.string();
+    }
+};
+
+/** \brief Storage policy with all subtrees in a single packed container.
+ *
+ *  Storing every subtree in its own file results in many thousand files per
+ *  multi-index, which parallel filesystems handle poorly. Instead, the
+ *  subtrees are Boost serialized into the blobs of one packed container,
+ *  see `write_packed_container`. Loading a subtree is a single `pread` at the
+ *  offset listed in the offset table. The top-level tree is small and uses
+ *  Boost serialization, as in `NativeStorage`.
+ *
+ *  `save_subtree` writes the subtree right away, through a
+ *  `PackedContainerWriter`, hence no subtree is kept in memory. The offset
+ *  table is written by `flush_subtrees`, which must be called after the last
+ *  subtree was saved. Copies of the storage share the container being written.
+ *
+ *  \tparam T  The type of the elements of the multi index.
+ */
+template <class T>
+class PackedStorage {
+  public:
+    using toptree_type = MultiIndexTopTreeT;
+    using subtree_type = MultiIndexSubTreeT<T>;
+    using in_memory_subtree_type = MultiIndexSubTreeT<T>;
+
+  public:
+    PackedStorage() = default;
+
+    explicit PackedStorage(std::string output_dir)
+        : output_dir(std::move(output_dir))
+        , state_(std::make_shared<State>()) { }
+
+    inline void save_subtree(const in_memory_subtree_type& subtree, size_t subtree_id) const;
+    inline void save_top_tree(const toptree_type& tree) const;
+
+    /// \brief Complete the container of all saved subtrees.
+    inline void flush_subtrees() const;
+
+#if SI_MPI == 1
+    /**
+     * \brief Complete the container of the subtrees saved by any MPI rank.
+     *
+     * \note This is an MPI collective operation and all ranks must participate.
+     */
+    inline void flush_subtrees(MPI_Comm comm) const;
+#endif
+
+    inline subtree_type load_subtree(size_t subtree_id) const;
+    inline toptree_type load_top_tree() const;
+
+    /// \brief The size of the blob of the subtree `subtree_id`.
+    inline size_t subtree_bytes_on_disk(size_t subtree_id) const;
+
+  private:
+    struct State {
+        std::mutex mutex;
+        std::unique_ptr<PackedContainerWriter> writer;
+        std::unique_ptr<PackedContainerReader> reader;
+    };
+
+    /// \brief The container is only created when the first subtree is saved.
+    inline PackedContainerWriter& writer() const;
+
+    /// \brief The container is only opened when the first subtree is loaded.
+    inline const PackedContainerReader& reader() const;
+
+    std::string output_dir;
+    std::shared_ptr<State> state_;
+};
+
+
 /// \brief The parameters control the eviction policy of `UsageRateCache`.
 struct UsageRateCacheParams {
     UsageRateCacheParams() = default;
 
-    explicit UsageRateCacheParams(size_t max_cached_elements)
-        : max_cached_elements(max_cached_elements) { }
+    explicit UsageRateCacheParams(size_t max_cached_bytes)
+        : max_cached_bytes(max_cached_bytes) { }
+
+    UsageRateCacheParams(size_t max_cached_bytes, EvictionPolicy eviction_policy)
+        : max_cached_bytes(max_cached_bytes)
+        , eviction_policy(eviction_policy) { }
 
-    size_t max_cached_elements = 1ul;
-    size_t max_evict = 1ul;
+    /// The memory used by the cached subtrees, see `detail::memory_footprint`.
+    size_t max_cached_bytes = 1ul;
     size_t current_cached_subtrees = 0ul;
+
+    /// The number of threads which load subtrees in the background.
+    size_t n_io_threads = 4ul;
+
+    /// How to choose the subtree to evict, see `SubtreeEvictionPolicy`.
+    EvictionPolicy eviction_policy = EvictionPolicy::usage_rate;
 };
 
+namespace detail {
+
+/**
+ * \brief The number of bytes per element of `Tree`, assumed before any subtree
+ * has been measured.
+ */
+template <class Tree, class = void>
+struct assumed_element_size : std::integral_constant<size_t, 1> {};
+
+template <class Tree>
+struct assumed_element_size<Tree, std::void_t<typename Tree::value_type>>
+    : std::integral_constant<size_t, sizeof(typename Tree::value_type)> {};
+
+/// \brief The total number of elements of the subtrees `subtree_ids`.
+template <class SubtreeID>
+inline size_t count_elements(const std::vector<SubtreeID>& subtree_ids) {
+    size_t n_elements = 0;
+    for(const auto& subtree_id : subtree_ids) {
+        n_elements += subtree_id.n_elements;
+    }
+
+    return n_elements;
+}
+
+/**
+ * \brief The number of bytes read from disk to load the subtree `subtree_id`.
+ *
+ * It's zero for storage policies which can't tell, e.g. because the subtree
+ * might have been loaded by another process.
+ */
+template <class Storage, class = void>
+struct subtree_bytes_on_disk {
+    static size_t apply(const Storage&, size_t) {
+        return 0;
+    }
+};
+
+template <class Storage>
+struct subtree_bytes_on_disk<
+    Storage,
+    std::void_t<decltype(std::declval<const Storage&>().subtree_bytes_on_disk(size_t{}))>> {
+
+    static size_t apply(const Storage& storage, size_t subtree_id) {
+        return storage.subtree_bytes_on_disk(subtree_id);
+    }
+};
+
+}  // namespace detail
+
+
+/** \brief A subtree requested from a `UsageRateCache`, possibly still loading.
+ *
+ * Behaves like a `std::shared_future` of the subtree. Additionally, it holds a
+ * lease on the subtree: the cache counts the subtree as in use, and hence
+ * doesn't evict it, as long as any copy of the future exists; not only while
+ * the pointer returned by `get` is alive.
+ */
+template <class SubtreePtr>
+class SubtreeFuture {
+  public:
+    SubtreeFuture() = default;
+    SubtreeFuture(std::shared_future<SubtreePtr> future, std::shared_ptr<const void> lease)
+        : future_(std::move(future))
+        , lease_(std::move(lease)) { }
+
+    inline SubtreePtr get() const {
+        return future_.get();
+    }
+
+    inline bool valid() const noexcept {
+        return future_.valid();
+    }
+
+    inline void wait() const {
+        future_.wait();
+    }
+
+    template <class Rep, class Period>
+    inline std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout) const {
+        return future_.wait_for(timeout);
+    }
+
+  private:
+    std::shared_future<SubtreePtr> future_;
+    std::shared_ptr<const void> lease_;
+};
+
+
 /** \brief A cache for loading and keeping R-trees in memory.
  *
  *  When using a multi-index a cache is needed to incrementally load more
  *  subtrees as they are needed and decide which trees should be evicted once
  *  there is insufficient memory to load further subtrees.
  *
- *  The eviction policy is the following: For each subtree the number of times
- *  the subtree is accessed per query that occurs while this tree is loaded can
- *  be computed. This number is called "usage rate". The subtrees with the lowest
- *  usage rate is evicted.
- * 
+ *  The subtree to evict is chosen by the policy
+ *  `UsageRateCacheParams::eviction_policy`. By default, it's the following: For
+ *  each subtree the number of times the subtree is accessed per query that
+ *  occurs while this tree is loaded can be computed. This number is called
+ *  "usage rate". The subtrees with the lowest usage rate is evicted. Since
+ *  this requires sorting all subtrees in cache, constant-time policies such as
+ *  LRU, LFU, CLOCK and ARC are available as well, see `EvictionPolicy`.
+ *
+ *  The cache can be used from multiple threads concurrently:
+ *    - The subtrees are distributed over shards, each protected by its own
+ *      mutex. Hence, threads using different subtrees rarely contend.
+ *    - Loading is single-flight: if several threads request the same subtree
+ *      while it's not in cache, only the first reads it from disk, the others
+ *      wait for it to be loaded.
+ *    - Subtrees are returned as `std::shared_ptr` or as `SubtreeFuture`. A
+ *      subtree that is still referenced by either isn't evicted. Therefore,
+ *      the cache can temporarily use more memory than `max_cached_bytes`.
+ *
+ *  The budget is in bytes. Once a subtree is loaded its actual memory
+ *  footprint, see `detail::memory_footprint`, is measured; which includes the
+ *  nodes of the R-tree and their unused slots. Before loading, room is made
+ *  for an estimate based on the number of bytes per element of the subtrees
+ *  measured so far.
+ *
+ *  Subtrees can also be loaded asynchronously, by a pool of
+ *  `UsageRateCacheParams::n_io_threads` threads, which is only started when
+ *  it's first needed. Hence, loading several subtrees from disk can overlap
+ *  with each other and with querying subtrees that are already in cache.
+ *
+ *  Subtrees can be pinned, they're then never evicted, see `UsageRateCache::pin`.
+ *
+ *  The cache counts hits, misses, evictions and the time needed to load
+ *  subtrees, see `UsageRateCache::stats`.
+ *
  *  See `UsageRateCacheT` for a convenient alias in the context of building a
  *  `MultiIndexTree`.
  *
@@ -160,83 +491,217 @@ struct UsageRateCacheParams {
  */
 template <class Storage>
 class UsageRateCache {
-    /** \brief The meta data required to compute usage rate.
-     *
-     * The assumption is that there's a global query counter. It increases on
-     * every query of the spatial index.
-     *
-     * The current value query counter at time of loading the subtree is stored as
-     * the `load_generation`. The `current_access_count` is increased everytime
-     * the subtree is requested.
-     *
-     * On eviction `previous_*` are increased such that they reflect the historic usage
-     * rate.
-     */
-    class MetaData {
-      public:
-        double usage_rate(size_t query_count) const;
-        size_t access_count() const;
-        size_t eviction_count() const;
-        size_t incache_count(size_t query_count) const;
-
-
-        /// \brief To be called every time the subtree is queries while residing cache.
-        inline void on_query();
+    using MetaData = SubtreeUsage;
 
-        /// \brief To be called every time the subtree is loaded into cache.
-        inline void on_load(size_t query_count);
-
-        /// \brief To be called immediately before evicting the subtree.
-        inline void on_evict(size_t query_count);
-
-      private:
-        size_t load_generation_ = 0;
-        size_t current_access_count_ = 0;
+  public:
+    using storage_type = Storage;
+    using subtree_type = typename storage_type::subtree_type;
+    using subtree_ptr = std::shared_ptr<const subtree_type>;
+    using subtree_future = SubtreeFuture<subtree_ptr>;
 
-        size_t previous_access_count_ = 0;
-        size_t previous_age_ = 0;
+  private:
+    /// \brief The state of one subtree, it's kept after the subtree is evicted.
+    struct Entry {
+        /// Valid while the subtree is being loaded or is in cache.
+        std::shared_future<subtree_ptr> subtree;
+        /// The measured memory footprint of the subtree.
+        size_t n_bytes = 0;
+        /// The bytes read from disk to load the subtree, zero until it's known.
+        size_t n_bytes_on_disk = 0;
+        MetaData meta_data;
+        /// Pinned subtrees are never evicted, see `UsageRateCache::pin`.
+        bool is_pinned = false;
+        /// Shared by all `SubtreeFuture`s of the subtree; expired if there are none.
+        std::weak_ptr<const void> lease;
+
+        inline std::shared_ptr<const void> acquire_lease();
+
+        inline bool is_cached() const;
+        inline bool is_in_use() const;
+        inline bool is_evictable() const;
+    };
 
-        size_t eviction_count_ = 0;
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<size_t, Entry> entries;
     };
 
-  public:
-    using storage_type = Storage;
-    using subtree_type = typename storage_type::subtree_type;
+    static constexpr size_t n_shards = 32;
 
   public:
-    UsageRateCache() = default;
+    UsageRateCache()
+        : shards(n_shards)
+        , policy(make_eviction_policy(cache_params.eviction_policy)) { }
 
     UsageRateCache(const UsageRateCacheParams& cache_params, Storage storage)
         : storage(std::move(storage))
-        , cache_params(cache_params) { }
+        , shards(n_shards)
+        , cache_params(cache_params)
+        , policy(make_eviction_policy(cache_params.eviction_policy)) { }
+
+    /// Pending loads refer to the cache, hence it can't be moved.
+    UsageRateCache(UsageRateCache&& other) = delete;
 
     ~UsageRateCache();
 
     /** \brief Return the subtree with id `subtree_id`.
+     *
+     * This method is thread-safe. The subtree stays in memory at least until
+     * the returned pointer is released.
      *
      * \param query_count The query count increses on every query to the spatial index.
      */
     template<class SubtreeID>
-    inline const subtree_type& load_subtree(const SubtreeID& subtree_id, size_t query_count);
+    inline subtree_ptr load_subtree(const SubtreeID& subtree_id, size_t query_count);
 
-  protected:
-    /// \brief Total number of elements across all subtrees loaded.
-    size_t cached_elements() const;
+    /** \brief Start loading the subtree `subtree_id` in the background.
+     *
+     * Returns immediately; the future is ready right away if the subtree is
+     * already in cache. Errors while loading are reported through the
+     * future. Otherwise, as `load_subtree`.
+     */
+    template<class SubtreeID>
+    inline subtree_future load_subtree_async(const SubtreeID& subtree_id,
+                                             size_t query_count);
+
+    /** \brief Start loading the subtrees in the background, without waiting.
+     *
+     * Only a prefix of `subtree_ids` that fits into the cache is loaded, since
+     * loading more would evict the subtrees loaded first. Returns the futures
+     * of the subtrees requested, they shouldn't be kept longer than needed,
+     * since they keep the subtrees alive.
+     */
+    template<class SubtreeID>
+    inline std::vector<subtree_future>
+    prefetch(const std::vector<SubtreeID>& subtree_ids, size_t query_count);
 
+    /** \brief Load the subtree in the background and keep it in cache.
+     *
+     * The subtree isn't evicted until it's unpinned. Pinned subtrees count
+     * towards `max_cached_bytes`; if they exceed it, the cache uses more memory
+     * than `max_cached_bytes`, as if the subtrees were in use.
+     */
     template<class SubtreeID>
-    inline void evict_subtrees(const SubtreeID& subtree_id, size_t query_count);
+    inline subtree_future pin(const SubtreeID& subtree_id, size_t query_count);
 
-    inline std::vector<size_t> subtree_ids_sorted_by_usage_rate(size_t query_count);
+    /// \brief Allow the subtree `subtree_id` to be evicted again.
+    inline void unpin(size_t subtree_id);
 
+    /// \brief Unpin all subtrees.
+    inline void unpin_all();
+
+    /// \brief The number of threads loading subtrees in the background.
+    inline size_t n_io_threads() const {
+        return std::max(cache_params.n_io_threads, 1ul);
+    }
+
+    /// \brief The counters of the cache, queries record their statistics here too.
+    inline MultiIndexCounters& counters() const {
+        return *counters_;
+    }
+
+    /// \brief The current statistics, including the bytes in cache.
+    inline MultiIndexStats stats() const;
+
+    /// \brief The usage of the subtree `subtree_id`, as reported by `SI_REPORT_USAGE_STATS`.
+    inline SubtreeUsage usage(size_t subtree_id);
+
+  protected:
+    /// \brief Total number of bytes reserved for or used by subtrees loaded.
+    size_t cached_bytes() const;
+
+    /// \brief The estimated memory footprint of a subtree with `n_elements` elements.
+    inline size_t estimated_footprint(size_t n_elements) const;
+
+    /**
+     * \brief Replace a reservation of `n_reserved` bytes by `n_bytes` bytes.
+     *
+     * Subtrees are evicted, in the order chosen by the eviction policy, until
+     * the cache fits into `max_cached_bytes`, or there are no more subtrees
+     * which may be evicted.
+     */
+    inline void evict_subtrees(size_t subtree_id,
+                               size_t n_reserved,
+                               size_t n_bytes,
+                               size_t query_count);
+
+    /// \brief Is the subtree in cache, neither pinned nor in use?
+    inline bool is_evictable(size_t subtree_id);
+
+    /// \brief Evict the subtree, unless it's started being used again.
+    inline bool evict_subtree(size_t subtree_id, size_t query_count);
+
+    inline Shard& shard(size_t subtree_id) {
+        return shards[subtree_id % shards.size()];
+    }
+
+    /** \brief Sets `subtree` to the future of the subtree `subtree_id`.
+     *
+     * If the subtree is neither in cache nor being loaded, the future of
+     * `promise` is registered as the subtree and `true` is returned. The
+     * caller must then call `fulfill`. The future holds a lease on the
+     * subtree, which is acquired while holding the lock of the shard.
+     */
+    inline bool find_or_reserve(size_t subtree_id,
+                                size_t query_count,
+                                std::promise<subtree_ptr>& promise,
+                                subtree_future& subtree);
+
+    /** \brief Load the subtree reserved by `find_or_reserve` into `promise`.
+     *
+     * The subtree is moved into `promise`, no other reference to it is kept.
+     */
+    inline void fulfill(size_t subtree_id,
+                        size_t n_elements,
+                        size_t query_count,
+                        std::promise<subtree_ptr>& promise);
+
+    /// \brief Release the reservation of `find_or_reserve`, without loading the subtree.
+    inline void release_reservation(size_t subtree_id);
+
+    /// \brief Fail `promise`, since the cache is destroyed before the subtree was loaded.
+    inline void cancel(size_t subtree_id, std::promise<subtree_ptr>& promise);
+
+    /**
+     * \brief The bytes read from disk to load the subtree `subtree_id`.
+     *
+     * The storage is only asked once per subtree, e.g. since it might need to
+     * `stat` the file of the subtree.
+     */
+    inline size_t bytes_on_disk(size_t subtree_id);
+
+    /// \brief The pool of I/O threads, it's started on first use.
+    inline ThreadPool& io_pool();
 
   private:
     Storage storage;
 
-    std::unordered_map<size_t, subtree_type> subtrees;
-    std::unordered_map<size_t, MetaData> meta_data;
+    std::vector<Shard> shards;
     UsageRateCacheParams cache_params;
 
-    size_t most_recent_query_count = 0;
+    // Serializes eviction, i.e. deciding which subtrees to evict and
+    // reserving space for the new subtree.
+    std::mutex eviction_mutex;
+    std::atomic<size_t> n_cached_bytes{0};
+
+    // The total footprint and size of all subtrees measured so far.
+    std::atomic<size_t> n_measured_bytes{0};
+    std::atomic<size_t> n_measured_elements{0};
+
+    std::atomic<size_t> most_recent_query_count{0};
+
+    // Once set, loads which haven't started are cancelled.
+    std::atomic<bool> is_stopping_{false};
+
+    std::mutex io_pool_mutex;
+    std::unique_ptr<ThreadPool> io_pool_;
+
+    // Locks are acquired in the order: `eviction_mutex`, `policy_mutex` and
+    // then the mutex of a shard.
+    std::mutex policy_mutex;
+    std::unique_ptr<SubtreeEvictionPolicy> policy;
+
+    std::unique_ptr<MultiIndexCounters> counters_ = std::make_unique<MultiIndexCounters>();
 };
 
 template<typename T>
@@ -249,6 +714,9 @@ using UsageRateCacheT = UsageRateCache<NativeStorageT<T>>;
  * index as they are needed. Please consult the high-level API REF for a
  * detailed explanation of the multi index.
  *
+ * Queries may be issued concurrently, provided the `SubtreeCache` is
+ * thread-safe.
+ *
  * \tparam SubtreeCache  A policy for maintaining a cache of in-memory subtrees.
  */
 template <class SubtreeCache>
@@ -260,8 +728,13 @@ class MultiIndexTreeBase {
 
   public:
     MultiIndexTreeBase() = default;
-    MultiIndexTreeBase(const storage_type& storage, SubtreeCache subtree_cache);
+    MultiIndexTreeBase(const storage_type& storage, const UsageRateCacheParams& params);
 
+    /** \brief Writes all elements matching `predicates` to `it`.
+     *
+     * The subtrees are loaded in the background and queried as soon as they're
+     * available. Hence, the order of the elements is unspecified.
+     */
     template <class Predicates, class OutIt>
     inline void query(const Predicates& predicates, const OutIt& it) const;
 
@@ -269,22 +742,39 @@ class MultiIndexTreeBase {
       return top_rtree.bounds();
     }
 
+    /// \brief The statistics of the cache and the queries, see `MultiIndexStats`.
+    inline MultiIndexStats stats() const {
+        return subtree_cache.stats();
+    }
+
+    /// \brief Set all counters of `stats` to zero.
+    inline void reset_stats() {
+        subtree_cache.counters().reset();
+    }
+
   protected:
-    template <class SubtreeID, class Predicates, class OutIt>
-    inline void query_subtree(const SubtreeID& subtree_id,
-                       const Predicates& predicates,
-                       const OutIt& it) const;
+    /** \brief Calls `f(subtree)` for each of the subtrees `subtree_ids`.
+     *
+     * The cache loads the missing subtrees in the background. Only a window of
+     * `n_io_threads` subtrees is requested ahead of the subtree being
+     * processed, since requested subtrees can't be evicted. Within the window,
+     * subtrees are processed in the order in which they become available.
+     */
+    template <class SubtreeID, class F>
+    inline void for_each_subtree(const std::vector<SubtreeID>& subtree_ids,
+                                 size_t query_id,
+                                 F&& f) const;
 
     template <class SubtreeID>
-    inline auto load_subtree(const SubtreeID& subtree_id) const -> const subtree_type&;
+    inline auto load_subtree(const SubtreeID& subtree_id) const;
 
     toptree_type top_rtree;
     mutable SubtreeCache subtree_cache;
-    mutable size_t query_count = 0;
+    mutable std::atomic<size_t> query_count{0};
 };
 
-template<class T>
-using MultiIndexTreeBaseT = MultiIndexTreeBase<UsageRateCacheT<T>>;
+template<class T, class Storage = NativeStorageT<T>>
+using MultiIndexTreeBaseT = MultiIndexTreeBase<UsageRateCache<Storage>>;
 
 
 /** \brief A spatial index consisting of multiple subtrees.
@@ -308,12 +798,18 @@ using MultiIndexTreeBaseT = MultiIndexTreeBase<UsageRateCacheT<T>>;
  * 
  *  The available caches policies are:
  *   - `UsageRateCache` which evicts the least used subtree.
+ *
+ *  The available storage policies are:
+ *   - `NativeStorageT` which deserializes subtrees when loading them;
+ *   - `MemoryMappedStorage` which memory maps the subtrees;
+ *   - `SharedMemoryStorage` which shares loaded subtrees between processes;
+ *   - `PackedStorage` which stores all subtrees in a single file.
  */
-template <typename T>
-class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
-                      public MultiIndexTreeBaseT<T> {
+template <typename T, typename Storage = NativeStorageT<T>>
+class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T, Storage>, T>,
+                      public MultiIndexTreeBaseT<T, Storage> {
   private:
-    using multi_index_base = MultiIndexTreeBaseT<T>;
+    using multi_index_base = MultiIndexTreeBaseT<T, Storage>;
 
   public:
     using value_type = T;
@@ -322,15 +818,50 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
     inline MultiIndexTree() = default;
     using multi_index_base::multi_index_base;
 
-    MultiIndexTree(const std::string& output_dir, size_t max_cached_bytes);
+    MultiIndexTree(const std::string& output_dir,
+                   size_t max_cached_bytes,
+                   EvictionPolicy eviction_policy = EvictionPolicy::usage_rate);
 
-    MultiIndexTree(const NativeStorageT<T>& storage,
+    MultiIndexTree(const Storage& storage,
                    const UsageRateCacheParams& params);
 
     /// \brief Checks whether a given shape intersects any object in the tree
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline bool is_intersecting(const ShapeT& shape) const;
 
+    /**
+     * \brief Counts objects intersecting the given region deliminted by the shape
+     *
+     * Subtrees which lie inside `shape` are counted using
+     * `IndexedSubtreeBox::n_elements`, without loading them, if `GeometryMode`
+     * is `BoundingBoxGeometry`. The other subtrees are counted by
+     * `IndexTree::count_intersecting`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Finds the `k_neighbors` elements closest to `shape`.
+     *
+     * Subtrees are visited by increasing distance of their bounding box, and
+     * are only loaded if they can contain an element closer than the current
+     * k-th candidate. Hence, the result is the global k nearest neighbours,
+     * not the nearest neighbours of each subtree.
+     *
+     * \returns The ids of the elements, by increasing distance.
+     */
+    template <typename ShapeT>
+    inline decltype(auto) find_nearest(const ShapeT& shape, unsigned k_neighbors) const;
+
+    /**
+     * \brief Finds the `k_neighbors` elements closest to `point`, by their exact shape.
+     *
+     * As `find_nearest`, but subtrees and elements are ranked by the distance
+     * to their bounding box only until they're refined using the distance to
+     * their exact shape, see `IndexTreeMixin::find_nearest_exact`.
+     */
+    inline decltype(auto) find_nearest_exact(const Point3D& point, unsigned k_neighbors) const;
+
 
     /**
      * \brief Finds & return objects which intersect. To be used mainly with id-less objects
@@ -339,6 +870,57 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline auto find_intersecting_objs(const ShapeT& shape) const -> std::vector<value_type>;
 
+    /**
+     * \brief Groups the queries of a batch by the subtrees they need.
+     *
+     * Each query is routed through the top-level tree. The subtrees needed by
+     * the batch are ordered along a Hilbert curve through their centers. The
+     * queries are sorted by the first subtree they need in that order; and
+     * queries with the same first subtree along a Hilbert curve through the
+     * centers of the queries. Hence, consecutive queries need the same
+     * subtrees and each subtree is loaded as few times as possible, even if
+     * the cache is small.
+     *
+     * The subtrees are loaded in the background, in the order in which the
+     * scheduled queries first need them, and only as many as fit into the
+     * cache.
+     *
+     * \sa `IndexTreeMixin::schedule`.
+     */
+    template <typename ShapeT>
+    inline std::vector<size_t> schedule(const std::vector<ShapeT>& shapes) const;
+
+    /**
+     * \brief Load the subtrees intersecting `shape` in the background.
+     *
+     * The subtrees are loaded by the I/O threads of the cache, in parallel;
+     * and only as many as fit into the cache. Queries can be issued while the
+     * subtrees are being loaded, they wait only for the subtrees they need.
+     * If `wait` is `true`, this returns once all subtrees are loaded. If the
+     * index is destroyed first, the loads which haven't started are cancelled.
+     *
+     * \returns The number of subtrees requested.
+     */
+    template <typename ShapeT>
+    inline size_t preload(const ShapeT& shape, bool wait = false) const;
+
+    /// \brief Fill the cache with subtrees, in the order of the top-level tree.
+    inline size_t warm_up(bool wait = false) const;
+
+    /**
+     * \brief Load the subtrees intersecting `shape` and never evict them.
+     *
+     * Unlike `preload`, all subtrees intersecting `shape` are loaded, even if
+     * they don't fit into the cache. They stay in memory until `unpin_all`.
+     *
+     * \returns The number of subtrees pinned.
+     */
+    template <typename ShapeT>
+    inline size_t pin(const ShapeT& shape, bool wait = false);
+
+    /// \brief Allow all pinned subtrees to be evicted again.
+    inline void unpin_all();
+
     /** \brief Total number of index elements.
      */
     inline size_t size() const {
@@ -350,6 +932,66 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
 
       return count;
     }
+
+  private:
+    /// \brief The subtrees of which the bounding box intersects `shape`.
+    template <typename ShapeT>
+    inline std::vector<IndexedSubtreeBox> intersecting_subtrees(const ShapeT& shape) const;
+
+    template <typename Future>
+    inline static void wait_for(const std::vector<Future>& pending);
+
+    /**
+     * \brief Calls `f` for the subtrees closest to `shape`.
+     *
+     * Subtrees are visited by increasing distance of their bounding box, and
+     * only while `is_needed(bounding_box)`; they're loaded only if visited.
+     */
+    template <typename ShapeT, typename Pred, typename F>
+    inline void for_each_nearest_subtree(const ShapeT& shape, Pred&& is_needed, F&& f) const;
+
+    template <typename Index, typename GeometryMode, typename ShapeT>
+    friend class QueryCursor;
+};
+
+
+/**
+ * \brief A resumable query of a multi index.
+ *
+ * The subtrees are queried one after the other. Only the subtree currently
+ * being queried is kept alive by the cursor, hence it may be evicted once the
+ * cursor moves on to the next subtree.
+ *
+ * \sa `QueryCursor`.
+ */
+template <typename T, typename Storage, typename GeometryMode, typename ShapeT>
+class QueryCursor<MultiIndexTree<T, Storage>, GeometryMode, ShapeT>
+    : public QueryCursorMixin<QueryCursor<MultiIndexTree<T, Storage>, GeometryMode, ShapeT>, T> {
+  private:
+    using index_type = MultiIndexTree<T, Storage>;
+    using subtree_type = typename index_type::subtree_type;
+
+  public:
+    inline QueryCursor(const index_type& index, const ShapeT& shape);
+
+    template <typename OutputIt>
+    inline size_t next(size_t max_elements, const OutputIt& iter);
+
+  private:
+    using predicates_type
+        = decltype(detail::intersects_predicates<GeometryMode>(std::declval<ShapeT>()));
+    using iterator_type
+        = decltype(std::declval<const subtree_type&>().qbegin(std::declval<predicates_type>()));
+
+    const index_type* index_;
+    predicates_type predicates_;
+    size_t query_id_;
+
+    std::vector<IndexedSubtreeBox> subtree_ids_;
+    size_t next_subtree_ = 0;
+
+    std::shared_ptr<const subtree_type> subtree_;
+    boost::optional<iterator_type> it_;
 };
 
 template<size_t dim, typename Value>
@@ -365,20 +1007,24 @@ public:
     }
 };
 
-#if SI_MPI == 1
+/// The maximum number of elements in any one subtree of a multi-index built in bulk.
+constexpr size_t multi_index_max_elements_per_part = size_t(4e6);
 
 /** \brief Build the multi index in bulk.
  *
  * This class offers an API which allows adding elements to the "index" one by one. However, no
- * index is created until `finalize()` is called.
+ * index is created until `finalize()` or `finalize_threaded()` is called.
  *
  * @tparam Value  The type of the elements in the index, e.g. `MorphoEntry`.
+ * @tparam Storage  The storage policy used to write the subtrees.
  */
-template<class Value>
+template<class Value, class Storage = NativeStorageT<Value>>
 class MultiIndexBulkBuilder : public IndexBulkBuilderBase<Value> {
 public:
-    explicit MultiIndexBulkBuilder(std::string output_dir);
+    /// \brief The subtrees are built by `n_threads` threads; `0` means one per hardware thread.
+    explicit MultiIndexBulkBuilder(std::string output_dir, size_t n_threads = 1);
 
+#if SI_MPI == 1
     /** \brief Finalize the builder and build the index.
      *
      * Indicates that the user does not want to add anymore elements. Hence the
@@ -387,6 +1033,15 @@ public:
      * \note This is an MPI collective operation and all ranks must participate.
      */
     inline void finalize(MPI_Comm comm = MPI_COMM_WORLD);
+#endif
+
+    /** \brief Finalize the builder and build the index using threads.
+     *
+     * All elements must have been added to this builder. The index is
+     * partitioned by `threaded_partition` and has the same layout on disk as
+     * the one created by `finalize(comm)`. MPI isn't required.
+     */
+    inline void finalize_threaded();
 
     /** \brief The current number of elements on this MPI rank.
      */
@@ -399,9 +1054,80 @@ private:
     std::string output_dir_;
     std::string index_reldir_;
     std::string index_dir_;
+    size_t n_threads_;
 };
 
-#endif
+
+/** \brief Build the multi index in bulk, out-of-core.
+ *
+ * Unlike `MultiIndexBulkBuilder`, the elements aren't all kept in memory.
+ * Whenever the buffer of inserted elements is full, it's sorted and spilled to
+ * a directory in `scratch_dir`. The index is then created by
+ * `external_partition`, which writes subtrees as soon as their part of the
+ * index is known.
+ *
+ * Apart from the top-level tree, the builder uses about `max_memory_bytes`
+ * bytes. A quarter of it is kept for the subtrees, which are built and
+ * written concurrently; it bounds the number of elements per subtree. The
+ * rest holds the buffered elements and the scratch space needed to sort them.
+ *
+ * The index has the same layout as the one created by `MultiIndexBulkBuilder`.
+ *
+ * @tparam Value  The type of the elements in the index, e.g. `MorphoEntry`.
+ * @tparam Storage  The storage policy used to write the subtrees.
+ */
+template<class Value, class Storage = NativeStorageT<Value>>
+class OutOfCoreMultiIndexBulkBuilder {
+public:
+    /** \brief `n_threads` is used to build the subtrees; `0` means one per hardware thread.
+     *
+     * Throws `std::invalid_argument` if `max_memory_bytes` can't hold at least
+     * eight elements, together with the scratch space to sort them.
+     */
+    OutOfCoreMultiIndexBulkBuilder(std::string output_dir,
+                                   const std::string& scratch_dir,
+                                   size_t max_memory_bytes,
+                                   size_t n_threads = 1);
+
+    OutOfCoreMultiIndexBulkBuilder(const OutOfCoreMultiIndexBulkBuilder&) = delete;
+    OutOfCoreMultiIndexBulkBuilder& operator=(const OutOfCoreMultiIndexBulkBuilder&) = delete;
+
+    /// \brief Removes the spilled elements, if any are left.
+    inline ~OutOfCoreMultiIndexBulkBuilder();
+
+    template<class BeginIt, class EndIt>
+    inline void insert(BeginIt begin, EndIt end);
+
+    inline void insert(const Value &value);
+
+    /// \brief Resize the internal buffer, up to the memory budget.
+    inline void reserve(size_t n_local_elements);
+
+    /// \brief Build the index, all elements must have been inserted.
+    inline void finalize();
+
+    /// \brief The total number of elements in the created index.
+    ///
+    /// This method can only be called after `finalize()`.
+    inline size_t size() const;
+
+    /// \brief The number of elements inserted so far.
+    inline size_t local_size() const;
+
+private:
+    inline void spill_if_full();
+
+    std::string output_dir_;
+    std::string index_reldir_;
+    std::string index_dir_;
+    std::string spill_dir_;
+
+    std::vector<Value> values_;
+    std::unique_ptr<ExternalSortTileRecursion<Value, GetCenterCoordinate<Value>>> str_;
+    size_t max_elements_per_part_;
+    size_t n_inserted_ = 0;
+    boost::optional<size_t> n_total_values_ = boost::none;
+};
 
 }  // namespace brain_indexer
 
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+namespace brain_indexer {
+
+/** \brief A snapshot of the statistics of a multi-index.
+ *
+ *  Counters are accumulated since the multi-index was opened or since the
+ *  last `MultiIndexTree::reset_stats`, except for `n_resident_bytes`, which is
+ *  the current state of the cache.
+ */
+struct MultiIndexStats {
+    /// The number of buckets of `load_latency_histogram`.
+    static constexpr size_t n_latency_buckets = 24;
+
+    /// Subtrees requested from the cache which were already loaded or loading.
+    size_t n_hits = 0;
+
+    /// Subtrees requested from the cache which had to be loaded.
+    size_t n_misses = 0;
+
+    /// Subtrees evicted from the cache.
+    size_t n_evictions = 0;
+
+    /// The memory used by the cached subtrees, see `detail::memory_footprint`.
+    size_t n_resident_bytes = 0;
+
+    /// The size of the subtrees loaded, as stored on disk.
+    size_t n_bytes_read = 0;
+
+    /**
+     * \brief Histogram of the time needed to load a subtree.
+     *
+     * Bucket `k` counts loads which took less than `2**k` microseconds, but at
+     * least `2**(k-1)`; the last bucket also counts all slower loads.
+     */
+    std::array<size_t, n_latency_buckets> load_latency_histogram{};
+
+    /// Total time needed to load subtrees, in microseconds.
+    size_t load_latency_us = 0;
+
+    /// Number of queries.
+    size_t n_queries = 0;
+
+    /**
+     * \brief Number of subtrees the queries were routed to by the top-level tree.
+     *
+     * Queries which stop at the first match, i.e. `is_intersecting`, only
+     * count the subtrees they searched.
+     */
+    size_t n_subtrees_visited = 0;
+
+    /// Number of elements of the subtrees visited by the queries.
+    size_t n_elements_scanned = 0;
+
+    /// Number of elements matching the queries.
+    size_t n_elements_returned = 0;
+
+    /// \brief The average number of subtrees a query visits.
+    inline double mean_fan_out() const {
+        return n_queries == 0 ? 0.0 : double(n_subtrees_visited) / double(n_queries);
+    }
+
+    /// \brief The fraction of requested subtrees which were in cache.
+    inline double hit_rate() const {
+        auto n_requests = n_hits + n_misses;
+        return n_requests == 0 ? 0.0 : double(n_hits) / double(n_requests);
+    }
+};
+
+
+/** \brief The live counters of a multi-index.
+ *
+ *  All counters are relaxed atomics, they're updated once per subtree or query,
+ *  never per element. Hence, they're cheap enough to be always on.
+ */
+class MultiIndexCounters {
+  public:
+    inline void on_hit() {
+        increment(n_hits);
+    }
+
+    inline void on_miss() {
+        increment(n_misses);
+    }
+
+    inline void on_evict() {
+        increment(n_evictions);
+    }
+
+    /// \brief A subtree of size `n_bytes_read` on disk was loaded in `latency`.
+    inline void on_load(std::chrono::steady_clock::duration latency, size_t n_bytes_read);
+
+    /// \brief A query visited `n_subtrees`, containing `n_elements_scanned` elements.
+    inline void on_query(size_t n_subtrees, size_t n_elements_scanned);
+
+    /// \brief A query searched another subtree, containing `n_elements` elements.
+    inline void on_scan(size_t n_elements) {
+        increment(n_elements_scanned, n_elements);
+    }
+
+    /// \brief As `on_scan`, for queries which visit subtrees one at a time.
+    inline void on_visit(size_t n_elements) {
+        increment(n_subtrees_visited);
+        increment(n_elements_scanned, n_elements);
+    }
+
+    inline void on_results(size_t n_elements) {
+        increment(n_elements_returned, n_elements);
+    }
+
+    /// \brief The current value of all counters.
+    inline MultiIndexStats snapshot() const;
+
+    /// \brief Set all counters to zero, without synchronizing with queries.
+    inline void reset();
+
+  private:
+    inline static void increment(std::atomic<size_t>& counter, size_t n = 1) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::atomic<size_t> n_hits{0};
+    std::atomic<size_t> n_misses{0};
+    std::atomic<size_t> n_evictions{0};
+    std::atomic<size_t> n_bytes_read{0};
+    std::array<std::atomic<size_t>, MultiIndexStats::n_latency_buckets> load_latency_histogram{};
+    std::atomic<size_t> load_latency_us{0};
+    std::atomic<size_t> n_queries{0};
+    std::atomic<size_t> n_subtrees_visited{0};
+    std::atomic<size_t> n_elements_scanned{0};
+    std::atomic<size_t> n_elements_returned{0};
+};
+
+}  // namespace brain_indexer
+
+#include "detail/multi_index_stats.hpp"
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if SI_MPI == 1
+#include <brain_indexer/mpi_wrapper.hpp>
+#endif
+
+namespace brain_indexer {
+
+/** \brief A file containing many binary blobs, each identified by an id.
+ *
+ *  The layout of the file is:
+ *    - a header `PackedContainerHeader`, padded to `alignment` bytes;
+ *    - the blobs, each starts at a multiple of `alignment` bytes;
+ *    - the offset table, i.e. one `PackedContainerEntry` per blob.
+ *
+ *  The table follows the blobs, such that blobs can be written before it's
+ *  known how many there are. All offsets are relative to the start of the
+ *  file; and all integers are stored in the byte order of the machine which
+ *  wrote the file.
+ */
+struct PackedContainerHeader {
+    char magic[8] = {'S', 'I', 'P', 'A', 'C', 'K', '0', '1'};
+    std::uint64_t n_entries = 0;
+    std::uint64_t alignment = 0;
+    std::uint64_t table_offset = 0;
+};
+
+/// \brief The location of one blob in a packed container.
+struct PackedContainerEntry {
+    std::uint64_t id;
+    std::uint64_t offset;
+    std::uint64_t n_bytes;
+};
+
+/// \brief The blobs of a packed container, i.e. pairs of id and content.
+using PackedBlobs = std::vector<std::pair<size_t, std::string>>;
+
+/// \brief The blobs are aligned to pages, such that they can be mapped individually.
+constexpr size_t packed_container_alignment = 4096;
+
+namespace detail {
+class PosixFile;
+}
+
+
+/** \brief Reads blobs from a packed container by offset.
+ *
+ *  The offset table is read when opening the container. Reading a blob is a
+ *  single `pread`, hence it's thread-safe.
+ */
+class PackedContainerReader {
+  public:
+    inline explicit PackedContainerReader(const std::string& filename);
+
+    PackedContainerReader(const PackedContainerReader&) = delete;
+    PackedContainerReader& operator=(const PackedContainerReader&) = delete;
+
+    inline ~PackedContainerReader();
+
+    /// \brief The content of the blob `id`.
+    inline std::string read(size_t id) const;
+
+    /// \brief The size of the blob `id`, in bytes.
+    inline size_t blob_size(size_t id) const;
+
+    /// \brief Number of blobs in the container.
+    inline size_t size() const {
+        return entries_.size();
+    }
+
+  private:
+    inline const PackedContainerEntry& entry(size_t id) const;
+
+    std::string filename_;
+    std::unique_ptr<detail::PosixFile> file_;
+    std::unordered_map<std::uint64_t, PackedContainerEntry> entries_;
+};
+
+
+/** \brief Writes a packed container one blob at a time.
+ *
+ *  Each blob is written as soon as it's passed to `write`, into a part file
+ *  next to the container; only the offset table is kept in memory. `close`
+ *  appends the offset table and renames the part file to `filename`. If the
+ *  writer isn't closed, the part file is removed.
+ *
+ *  Writing blobs is thread-safe: the offset of a blob is reserved under a
+ *  lock, the blob itself is written without holding it.
+ */
+class PackedContainerWriter {
+  public:
+    inline explicit PackedContainerWriter(std::string filename);
+
+    PackedContainerWriter(const PackedContainerWriter&) = delete;
+    PackedContainerWriter& operator=(const PackedContainerWriter&) = delete;
+
+    inline ~PackedContainerWriter();
+
+    /// \brief Write the blob `id`.
+    inline void write(size_t id, const std::string& blob);
+
+    /// \brief Complete the container `filename`.
+    inline void close();
+
+#if SI_MPI == 1
+    /** \brief Complete the container `filename` with the blobs of all MPI ranks.
+     *
+     * The offsets are agreed on collectively. Rank 0 turns its part file into
+     * the container, the other ranks copy their blobs into it, in chunks; and
+     * only the offset table is gathered on rank 0. Hence, no blob is sent to
+     * another rank.
+     *
+     * \note This is an MPI collective operation and all ranks must participate.
+     */
+    inline void close(MPI_Comm comm);
+#endif
+
+  private:
+    /// \brief Write the offset table and the header into the part file.
+    inline void write_table(const std::vector<PackedContainerEntry>& entries,
+                            size_t table_offset) const;
+
+    std::string filename_;
+    std::string part_filename_;
+    std::unique_ptr<detail::PosixFile> file_;
+
+    std::mutex mutex_;
+    size_t end_offset_ = 0;
+    std::vector<PackedContainerEntry> entries_;
+};
+
+
+/// \brief Write `blobs` into the new packed container `filename`.
+inline void write_packed_container(const std::string& filename, const PackedBlobs& blobs);
+
+#if SI_MPI == 1
+/** \brief Write the `blobs` of all MPI ranks into the packed container `filename`.
+ *
+ * \sa `PackedContainerWriter::close(MPI_Comm)`.
+ *
+ * \note This is an MPI collective operation and all ranks must participate.
+ */
+inline void write_packed_container(const std::string& filename,
+                                   const PackedBlobs& blobs,
+                                   MPI_Comm comm);
+#endif
+
+}  // namespace brain_indexer
+
+#include "detail/packed_container.hpp"
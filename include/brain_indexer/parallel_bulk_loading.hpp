@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include <boost/version.hpp>
+
+#include <brain_indexer/index.hpp>
+
+
+// `parallel_bulk_load` copies internals of Boost.Geometry; it only packs in
+// parallel for the versions of Boost it's been checked against.
+#if BOOST_VERSION >= 107900 && BOOST_VERSION <= 108500
+#define SI_PARALLEL_BULK_LOAD 1
+#else
+#define SI_PARALLEL_BULK_LOAD 0
+#endif
+
+
+namespace brain_indexer {
+
+/** \brief Bulk load the values `[first, last)` into an `Index` using `n_threads` threads.
+ *
+ * The tree is packed by the same algorithm as the constructor `Index(first, last)`:
+ * the values are split recursively at the median of their centroids, along the
+ * longest edge of a hint box. The ranges resulting from a split are
+ * independent; they're split concurrently, one round of splits after the
+ * other, until there are a few ranges per thread. These are then packed
+ * concurrently. Therefore, the tree is identical, node by node, to the one
+ * built sequentially; and it serializes to the same bytes.
+ *
+ * The centroids are computed in parallel. The first splits are inherently
+ * sequential, e.g. the split of the root partitions all values on one thread.
+ *
+ * `Index` must be an `IndexTree` with the default allocator. If `n_threads` is
+ * `0`, one thread per hardware thread is used.
+ *
+ * If `SI_PARALLEL_BULK_LOAD` is `0`, i.e. for unchecked versions of Boost, this
+ * warns once and falls back to the sequential `Index(first, last)`.
+ */
+template <class Index, class RandomAccessIt>
+inline Index parallel_bulk_load(RandomAccessIt first, RandomAccessIt last, size_t n_threads);
+
+}  // namespace brain_indexer
+
+#include "detail/parallel_bulk_loading.hpp"
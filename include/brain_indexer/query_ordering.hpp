@@ -1,12 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include <brain_indexer/index.hpp>
 #include <zisa/math/space_filling_curve.hpp>
 
 namespace brain_indexer {
 namespace experimental {
 
-std::vector<size_t> space_filling_order(Point3Dx const * points, size_t n_points) {
+/**
+ * \brief The order of `points` along a Hilbert curve.
+ *
+ * The curve passes through the bounding box of the points.
+ */
+inline std::vector<size_t> space_filling_order(Point3Dx const * points, size_t n_points) {
     auto sfc_index = std::vector<size_t>(n_points);
 
     auto float_max = std::numeric_limits<CoordType>::max();
@@ -20,7 +29,14 @@ std::vector<size_t> space_filling_order(Point3Dx const * points, size_t n_points
         max_corner = max(max_corner, points[i]);
     }
 
-    auto box_size = max_corner - min_corner;
+    // Avoids dividing by zero if all points lie in a plane.
+    auto extent = [](CoordType low, CoordType high) {
+        return high > low ? high - low : CoordType(1);
+    };
+
+    auto box_size = Point3Dx{extent(min_corner.get<0>(), max_corner.get<0>()),
+                             extent(min_corner.get<1>(), max_corner.get<1>()),
+                             extent(min_corner.get<2>(), max_corner.get<2>())};
 
     auto normalize = [min_corner, box_size](const Point3D& xyz) {
         return Point3D{
@@ -51,7 +67,7 @@ std::vector<size_t> space_filling_order(Point3Dx const * points, size_t n_points
     return order;
 }
 
-std::vector<size_t> space_filling_order(const std::vector<Point3Dx> & points) {
+inline std::vector<size_t> space_filling_order(const std::vector<Point3Dx> & points) {
     return space_filling_order(points.data(), points.size());
 }
 
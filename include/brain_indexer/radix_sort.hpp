@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+
+namespace brain_indexer {
+
+/** \brief Can values be sorted by `Key` using `radix_sort`?
+ *
+ * `Key` must define `n_components` and `Key::component<k>(value)`, which
+ * returns a floating point number for `k < n_components`. Values are ordered
+ * lexicographically by their components, i.e. in the same order as by
+ * `Key::compare`. For example, `STRKey`.
+ */
+template <class Key, class = void>
+struct is_radix_sortable : std::false_type {};
+
+template <class Key>
+struct is_radix_sortable<Key, std::void_t<decltype(Key::n_components)>>
+    : std::true_type {};
+
+
+/** \brief Sort `[first, last)` by `Key` using a least significant digit radix sort.
+ *
+ * The first component of the key is extracted once per value, and mapped to
+ * an unsigned integer with the same order as the floating point number. Then
+ * a permutation of the values is sorted by these integers, one byte at a time.
+ * Passes in which all values have the same byte are skipped. Runs of values
+ * with the same first component are sorted by the next component, and so on.
+ * Finally, the permutation is applied to the values in place, by following
+ * its cycles.
+ *
+ * Each pass is split into chunks, which are processed by `n_threads` threads;
+ * `0` means one per hardware thread. The sort is stable; short ranges are
+ * sorted by `std::stable_sort`, which results in the same order.
+ */
+template <class Key, class Value>
+inline void radix_sort(Value* first, Value* last, size_t n_threads = 1);
+
+
+/** \brief The bytes per value that `radix_sort` allocates, at most, to sort `n` values.
+ *
+ * This is the permutation, the keys and the buffers they're sorted into. It
+ * doesn't include the values themselves, which are sorted in place.
+ */
+template <class Key, class Value>
+inline size_t radix_sort_scratch_bytes_per_value(size_t n);
+
+
+/** \brief Sort `[first, last)` by `Key::compare`.
+ *
+ * Uses `radix_sort` if `Key` permits, otherwise `std::sort`.
+ */
+template <class Key, class Value>
+inline void sort_by_key(Value* first, Value* last, size_t n_threads = 1);
+
+}  // namespace brain_indexer
+
+#include "detail/radix_sort.hpp"
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/named_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+
+namespace brain_indexer {
+
+namespace bip = boost::interprocess;
+
+/// \brief The parameters of the node-wide `SharedSubtreeCache`.
+struct SharedSubtreeCacheParams {
+    SharedSubtreeCacheParams() = default;
+
+    explicit SharedSubtreeCacheParams(size_t max_shared_bytes)
+        : max_shared_bytes(max_shared_bytes) { }
+
+    /// The total size of the segments of all subtrees in shared memory.
+    size_t max_shared_bytes = 1ul;
+
+    /// The size of the table which tracks the subtrees, it's mostly untouched.
+    size_t table_bytes = size_t(1) << 24;
+};
+
+namespace detail {
+
+/// \brief The state of one subtree in shared memory.
+struct SharedSubtreeSlot {
+    /// The subtree is being loaded by some process, while `false`.
+    bool is_loaded = false;
+
+    /// The PID of the process loading the subtree.
+    int64_t loader_pid = 0;
+
+    /// The number of processes, or rather subtree handles, using the subtree.
+    size_t n_users = 0;
+
+    /// The size of the segment.
+    size_t n_bytes = 0;
+
+    /// The value of `SharedSubtreeTable::clock` when the subtree was last released.
+    size_t last_used = 0;
+};
+
+/// \brief The table of subtrees, it's placed in shared memory.
+struct SharedSubtreeTable {
+    using segment_manager = bip::managed_shared_memory::segment_manager;
+    using value_type = std::pair<const size_t, SharedSubtreeSlot>;
+    using allocator_type = bip::allocator<value_type, segment_manager>;
+    using slots_type = bip::map<size_t, SharedSubtreeSlot, std::less<size_t>, allocator_type>;
+
+    SharedSubtreeTable(size_t max_shared_bytes, segment_manager* manager)
+        : max_shared_bytes(max_shared_bytes)
+        , slots(std::less<size_t>(), allocator_type(manager)) { }
+
+    // Protects everything below, and is used to wait for subtrees being loaded.
+    bip::interprocess_mutex mutex;
+    bip::interprocess_condition loaded;
+
+    size_t max_shared_bytes;
+    size_t n_shared_bytes = 0;
+    size_t n_attached = 0;
+    size_t n_loads = 0;
+    size_t clock = 0;
+
+    slots_type slots;
+};
+
+}  // namespace detail
+
+
+/** \brief A node-wide cache of subtrees in POSIX shared memory.
+ *
+ *  Many processes on the same node which query the same multi-index would each
+ *  load private copies of the same subtrees. Instead, they can attach to the
+ *  same `SharedSubtreeCache`, which keeps each subtree in its own shared memory
+ *  segment. A subtree is read from disk by the first process that needs it;
+ *  and mapped read-only by all others.
+ *
+ *  The subtrees are tracked by a table, which itself lives in shared memory:
+ *    - Loading is single-flight across processes. While a subtree is being
+ *      loaded, other processes requesting it wait for it. They periodically
+ *      check that the loading process is still alive; if it isn't, one of
+ *      them takes over loading the subtree. Hence, all processes must share
+ *      the same PID namespace.
+ *    - Subtrees are reference counted across processes. A subtree is in use
+ *      while any `acquire`d segment of it is alive; it isn't evicted.
+ *    - Before a subtree is added, the least recently used subtrees which
+ *      aren't in use are removed, until all subtrees fit into
+ *      `max_shared_bytes`. This is a linear scan, which is cheap compared to
+ *      reading a subtree from disk.
+ *
+ *  The cache is removed from shared memory when the last process detaches.
+ *  Processes which crash while using subtrees leave them marked as in use,
+ *  the shared memory is then only removed by `SharedSubtreeCache::remove`.
+ *  The mutex of the table isn't robust, i.e. it stays locked if a process
+ *  crashes while holding it. Therefore, it's locked with a timeout of
+ *  `lock_timeout_ms`; when the timeout expires a `std::runtime_error` is
+ *  thrown, after which the cache must be removed.
+ *
+ *  The first process to attach decides `max_shared_bytes`.
+ */
+class SharedSubtreeCache : public std::enable_shared_from_this<SharedSubtreeCache> {
+  public:
+    using segment_type = bip::managed_shared_memory;
+    using segment_ptr = std::shared_ptr<segment_type>;
+
+    /// How long to wait for the mutex of the table, before giving up.
+    static constexpr long lock_timeout_ms = 60000;
+
+    /// How often to check if the process loading a subtree is still alive.
+    static constexpr long loader_check_interval_ms = 100;
+
+    /// \brief Attach to the cache called `name`, it's created if needed.
+    inline SharedSubtreeCache(std::string name, const SharedSubtreeCacheParams& params);
+
+    SharedSubtreeCache(const SharedSubtreeCache&) = delete;
+    SharedSubtreeCache& operator=(const SharedSubtreeCache&) = delete;
+
+    /// \brief Detach from the cache, the last process removes it.
+    inline ~SharedSubtreeCache();
+
+    /** \brief Map the segment of the subtree `subtree_id` read-only.
+     *
+     * If the subtree isn't in shared memory, `load(segment_name)` is called to
+     * create the shared memory segment `segment_name` containing the subtree.
+     * The subtree is in use until the returned pointer, and all its copies,
+     * are released.
+     *
+     * This method is thread-safe.
+     */
+    inline segment_ptr acquire(size_t subtree_id,
+                               const std::function<void(const std::string&)>& load);
+
+    /// \brief Total size of the segments of all subtrees in shared memory.
+    inline size_t shared_bytes() const;
+
+    /// \brief Number of subtrees in shared memory.
+    inline size_t n_shared_subtrees() const;
+
+    /// \brief Number of subtrees read from disk, by any process.
+    inline size_t n_loads() const;
+
+    /** \brief The name of the cache of the multi-index stored in `output_dir`.
+     *
+     * Apart from the path of `output_dir`, the name depends on the modification
+     * time and size of `index_file`, which must be rewritten whenever the
+     * index is, e.g. the top-level tree. Hence, an index which is rebuilt in
+     * place gets a new cache, instead of the stale subtrees of the old one.
+     */
+    inline static std::string default_name(const std::string& output_dir,
+                                           const std::string& index_file);
+
+    /// \brief Remove the cache `name` from shared memory, e.g. after a crash.
+    inline static void remove(const std::string& name);
+
+  private:
+    inline static std::string segment_name(const std::string& name, size_t subtree_id);
+    inline static std::string attach_mutex_name(const std::string& name);
+
+    /// \brief Remove the table and the segments of all subtrees it lists.
+    inline static void remove_segments(const std::string& name);
+
+    /// \brief Lock the mutex of the table, or throw after `lock_timeout_ms`.
+    inline bip::scoped_lock<bip::interprocess_mutex> lock_table() const;
+
+    /// \brief Releases the subtree `subtree_id`, acquired by `acquire`.
+    inline void release(size_t subtree_id);
+
+    /**
+     * \brief Remove subtrees which aren't in use until `n_bytes` more fit.
+     *
+     * The caller must hold the lock of the table.
+     */
+    inline void evict_subtrees(size_t n_bytes);
+
+    std::string name_;
+    std::unique_ptr<segment_type> table_segment_;
+    detail::SharedSubtreeTable* table_ = nullptr;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/shared_subtree_cache.hpp"
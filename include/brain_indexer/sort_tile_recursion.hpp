@@ -4,17 +4,27 @@
 #include <cmath>
 
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/radix_sort.hpp>
+#include <brain_indexer/work_stealing.hpp>
 
 
 namespace brain_indexer {
 
 template<class GetCoordinate, size_t dim>
 struct STRKey {
+    /// The coordinates `dim, ..., 2` which are compared, see `radix_sort`.
+    static constexpr size_t n_components = 3 - dim;
+
     template<class Value>
     static auto apply(const Value &a) {
         return GetCoordinate::template apply<dim>(a);
     }
 
+    template<size_t k, class Value>
+    static auto component(const Value &a) {
+        return GetCoordinate::template apply<dim + k>(a);
+    }
+
     template<class Value>
     static auto compare(const Value &a, const Value &b) {
         auto xa = STRKey<GetCoordinate, dim>::apply(a);
@@ -105,6 +115,8 @@ struct SerialSTRParams {
  * be complete. In three or more dimensions the steps are repeated
  * as needed.
  *
+ * The points are sorted by `radix_sort`, on a single thread.
+ *
  * \sa `serial_sort_tile_recursion` for a more convenient interface.
  *
  * \tparam Value  The type of the element that is undergoing
@@ -141,6 +153,33 @@ public:
 template <typename Value, typename GetCoordinate>
 void serial_sort_tile_recursion(std::vector<Value> &values, const SerialSTRParams&str_params);
 
+/** \brief Sort Tile Recursion using `n_threads` threads.
+ *
+ * The values are sorted along the first axis by `radix_sort` using `n_threads`
+ * threads; then the slices are processed concurrently, each by
+ * `SerialSortTileRecursion`. The result is the same as that of
+ * `serial_sort_tile_recursion`.
+ *
+ * \sa `SerialSortTileRecursion`.
+ */
+template <typename Value, typename GetCoordinate>
+void parallel_sort_tile_recursion(std::vector<Value> &values,
+                                  const SerialSTRParams &str_params,
+                                  size_t n_threads);
+
+/** \brief Creates the top-level and all subtrees of the multi-index, without MPI.
+ *
+ * This is the shared memory counterpart of `distributed_partition`. The values
+ * are partitioned by `parallel_sort_tile_recursion`, then the subtrees are
+ * built and saved concurrently using `n_threads` threads. The subtree of part
+ * `k` has id `k`; and empty parts are skipped.
+ */
+template <class GetCenterCoordinate, class Storage, class Value>
+void threaded_partition(const Storage &storage,
+                        std::vector<Value> &values,
+                        const SerialSTRParams &str_params,
+                        size_t n_threads);
+
 inline bool is_power_of_two(int n) { return (n & (n - 1)) == 0; }
 inline int int_log2(int n) { return int(std::round(std::log2(n))); }
 inline int int_pow2(int k) { return 1 << k; }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace brain_indexer {
+
+/** \brief A fixed set of threads which run tasks in the background.
+ *
+ * Unlike `WorkStealingExecutor`, which runs a known set of tasks to
+ * completion, the threads of the pool stay alive and run tasks in the order
+ * they were submitted. It's meant for blocking work, e.g. reading from disk,
+ * which should overlap with computations on the submitting thread.
+ *
+ * The destructor cancels the tasks which haven't started, i.e. it calls their
+ * `on_cancel` instead. Then it joins the threads, once they've finished the
+ * tasks they're running.
+ */
+class ThreadPool {
+  public:
+    /// \brief Use `n_threads` threads; `0` means one per hardware thread.
+    inline explicit ThreadPool(size_t n_threads);
+    inline ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** \brief Run `task` on one of the threads; `task` must not throw.
+     *
+     * If the pool is destroyed before `task` started, `on_cancel` is called
+     * instead, by the destructor. Neither may throw.
+     */
+    inline void submit(std::function<void()> task, std::function<void()> on_cancel = nullptr);
+
+    inline size_t n_threads() const noexcept {
+        return threads_.size();
+    }
+
+  private:
+    struct Task {
+        std::function<void()> run;
+        std::function<void()> on_cancel;
+    };
+
+    inline void work();
+
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::deque<Task> tasks_;
+    bool is_stopping_ = false;
+
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/thread_pool.hpp"
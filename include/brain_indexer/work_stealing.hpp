@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace brain_indexer {
+
+namespace detail {
+
+/** \brief The tasks `[begin, end)` which have not been started yet.
+ *
+ * The owner of the range takes tasks from the front, other threads steal
+ * from the back. Both ends are packed into a single atomic such that taking
+ * a task is one compare-and-swap.
+ *
+ * The ranges of different threads are aligned to a cache line to avoid false
+ * sharing.
+ */
+class alignas(64) TaskRange {
+  public:
+    /// \brief Reset the range to `[begin, end)`; not thread-safe.
+    inline void assign(size_t begin, size_t end);
+
+    /// \brief Take the first task; returns `false` if the range is empty.
+    inline bool pop_front(size_t& task);
+
+    /// \brief Take the last task; returns `false` if the range is empty.
+    inline bool pop_back(size_t& task);
+
+  private:
+    static constexpr uint64_t mask = (uint64_t(1) << 32) - 1;
+
+    static inline uint64_t pack(uint64_t begin, uint64_t end) {
+        return (begin << 32) | end;
+    }
+
+    std::atomic<uint64_t> bounds_{0};
+};
+
+}  // namespace detail
+
+
+/** \brief Runs a set of independent tasks on several threads.
+ *
+ * The tasks `0, ..., n_tasks - 1` are split into contiguous ranges, one per
+ * thread. A thread first works through its own range in order. Once it's
+ * empty, it steals tasks from the back of the ranges of the other threads.
+ * Therefore, threads which happen to get only cheap tasks keep helping until
+ * all tasks have been started, which is important when the cost per task is
+ * very skewed, e.g. queries in dense regions vs. queries in empty space.
+ *
+ * The calling thread participates as one of the workers. If any task throws,
+ * the remaining tasks are skipped and the first exception is rethrown by
+ * `for_each`.
+ */
+class WorkStealingExecutor {
+  public:
+    /// \brief Use `n_threads` threads; `0` means one per hardware thread.
+    inline explicit WorkStealingExecutor(size_t n_threads);
+
+    /// \brief Calls `f(k_task)` exactly once for each `k_task < n_tasks`.
+    template <class F>
+    inline void for_each(size_t n_tasks, F&& f) const;
+
+    inline size_t n_threads() const noexcept {
+        return n_threads_;
+    }
+
+  private:
+    size_t n_threads_;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/work_stealing.hpp"
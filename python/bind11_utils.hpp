@@ -38,6 +38,28 @@ inline auto as_pyarray(Sequence&& seq) {
 }
 
 
+/**
+ * \brief "Casts" a Cpp sequence of `dim`-tuples to a `(n, dim)` python array.
+ *
+ * Each element of the sequence must consist of exactly `dim` values of type
+ * `T`, e.g. a point of three coordinates. As `as_pyarray`, the sequence is
+ * moved into a Python capsule, i.e. no copies are made.
+ */
+template <typename T, size_t dim, typename Sequence>
+inline auto as_pyarray_2d(Sequence&& seq) {
+    static_assert(sizeof(typename Sequence::value_type) == dim * sizeof(T),
+                  "The elements must consist of exactly `dim` values of type `T`.");
+
+    Sequence* seq_ptr = new Sequence(std::move(seq));
+    auto capsule = py::capsule(seq_ptr,
+                               [](void* p) { delete reinterpret_cast<Sequence*>(p); });
+
+    return py::array_t<T>({seq_ptr->size(), dim},
+                          reinterpret_cast<const T*>(seq_ptr->data()),
+                          capsule);
+}
+
+
 /**
  * \brief Converts and STL Sequence to numpy array by copying i
  */
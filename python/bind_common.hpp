@@ -30,6 +30,58 @@ using array_ids = pybind_array_t<id_t>;
 using array_offsets = pybind_array_t<unsigned>;
 using array_types = pybind_array_t<unsigned int>;
 
+/// \brief A placeholder which keeps the GIL, see `query_gil_release`.
+struct gil_scoped_keep {
+    gil_scoped_keep() {}
+};
+
+/** \brief Releases the GIL while querying indexes that support concurrent queries.
+ *
+ *  Without the GIL other Python threads can run, including threads that query
+ *  the same index. Hence, the GIL is kept if `Class` doesn't support concurrent
+ *  queries, see `si::supports_concurrent_queries`.
+ */
+template <class Class>
+using query_gil_release = std::conditional_t<
+    si::supports_concurrent_queries<Class>::value,
+    py::gil_scoped_release,
+    gil_scoped_keep
+>;
+
+/** \brief Calls `f()` with the GIL released, if `Class` supports it.
+ *
+ *  Note that `f` must not touch any Python objects. Any conversion to Python
+ *  must happen after this function returns.
+ */
+template <class Class, class F>
+inline decltype(auto) call_without_gil(F&& f) {
+    query_gil_release<Class> release;
+    return f();
+}
+
+/** \brief Deletes the object with the GIL released.
+ *
+ *  The destructor of multi-indexes waits for the subtrees that are being
+ *  loaded in the background. Meanwhile, other Python threads can run; and
+ *  the I/O threads can log through the Python logger.
+ */
+template <class T>
+struct gil_release_delete {
+    void operator()(T* ptr) const {
+        if(PyGILState_Check()) {
+            py::gil_scoped_release release;
+            delete ptr;
+        }
+        else {
+            delete ptr;
+        }
+    }
+};
+
+/// \brief A holder which destroys the object with the GIL released.
+template <class T>
+using gil_release_unique_ptr = std::unique_ptr<T, gil_release_delete<T>>;
+
 inline coord_t const* extract_radii_ptr(array_t const& radii) {
     return static_cast<coord_t const*>(radii.data());
 }
@@ -55,6 +107,48 @@ extract_points_radii_ptrs(array_t const& points, array_t const& radii) {
     return std::make_pair(extract_points_ptr(points), extract_radii_ptr(radii));
 }
 
+/// \brief Creates the query boxes spanned by pairs of opposite corners.
+inline std::vector<si::Box3D>
+make_query_boxes(array_t const& corners, array_t const& opposite_corners) {
+    if (corners.ndim() != 2 || opposite_corners.ndim() != 2
+        || corners.shape(0) != opposite_corners.shape(0)) {
+        throw std::invalid_argument("Please provide exactly one opposite corner per corner.");
+    }
+
+    auto corners_ptr = extract_points_ptr(corners);
+    auto opposite_corners_ptr = extract_points_ptr(opposite_corners);
+
+    auto n_boxes = static_cast<size_t>(corners.shape(0));
+    auto boxes = std::vector<si::Box3D>{};
+    boxes.reserve(n_boxes);
+
+    for (size_t i = 0; i < n_boxes; ++i) {
+        boxes.push_back(si::make_query_box(corners_ptr[i], opposite_corners_ptr[i]));
+    }
+
+    return boxes;
+}
+
+/// \brief Creates the query spheres from their centers and radii.
+inline std::vector<si::Sphere>
+make_query_spheres(array_t const& centers, array_t const& radii) {
+    if (radii.ndim() != 1 || centers.shape(0) != radii.shape(0)) {
+        throw std::invalid_argument("Please provide exactly one radius per center.");
+    }
+
+    auto [centers_ptr, radii_ptr] = extract_points_radii_ptrs(centers, radii);
+
+    auto n_spheres = static_cast<size_t>(centers.shape(0));
+    auto spheres = std::vector<si::Sphere>{};
+    spheres.reserve(n_spheres);
+
+    for (size_t i = 0; i < n_spheres; ++i) {
+        spheres.push_back(si::Sphere{centers_ptr[i], radii_ptr[i]});
+    }
+
+    return spheres;
+}
+
 namespace detail {
 template <class Int>
 inline Int const *
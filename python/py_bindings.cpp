@@ -11,6 +11,12 @@ namespace si_python = si::py_bindings;
 namespace brain_indexer { namespace py_bindings {
 
 void check_signals() {
+    // Signals can only be checked while holding the GIL. Long running
+    // computations that released the GIL, e.g. queries, skip the check.
+    if (PyGILState_Check() == 0) {
+        return;
+    }
+
     if (PyErr_CheckSignals() != 0) {
         throw py::error_already_set();
     }
@@ -31,6 +37,9 @@ PYBIND11_MODULE(_brain_indexer, m) {
         [](py::object python_logger) {
             si::register_logging_callback(
                 [python_logger](si::LogSeverity log_severity, const std::string& message) {
+                    // Messages can be logged from threads not holding the GIL.
+                    py::gil_scoped_acquire acquire;
+
                     if(log_severity == si::LogSeverity::DEBUG) {
                         python_logger.attr("debug")(py::str(message));
                     }
@@ -96,6 +105,7 @@ PYBIND11_MODULE(_brain_indexer, m) {
     si_python::create_Sphere_bindings(m);
     si_python::create_Synapse_bindings(m);
     si_python::create_MorphoEntry_bindings(m);
+    si_python::create_QueryCursor_bindings(m);
 
     si_python::create_PointIndex_bindings(m, "PointIndex");
     si_python::create_SphereIndex_bindings(m, "SphereIndex");
@@ -105,14 +115,31 @@ PYBIND11_MODULE(_brain_indexer, m) {
     si_python::create_SynapseIndexBulkBuilder_bindings(m, "SynapseIndexBulkBuilder");
     si_python::create_MorphIndexBulkBuilder_bindings(m, "MorphIndexBulkBuilder");
 
+    // Read-only indexes backed by a memory mapped file.
+    si_python::create_PointMemoryMappedIndex_bindings(m, "PointMemoryMappedIndex");
+    si_python::create_SphereMemoryMappedIndex_bindings(m, "SphereMemoryMappedIndex");
+    si_python::create_SynapseMemoryMappedIndex_bindings(m, "SynapseMemoryMappedIndex");
+    si_python::create_MorphMemoryMappedIndex_bindings(m, "MorphMemoryMappedIndex");
+
+    // Read-only morphology index with blocks of segments.
+    si_python::create_MorphBlockIndex_bindings(m, "MorphBlockIndex");
+
     // Distributed/lazy R-trees, multi-indexes.
     si_python::create_MorphMultiIndex_bindings(m, "MorphMultiIndex");
     si_python::create_SynapseMultiIndex_bindings(m, "SynapseMultiIndex");
+    si_python::create_MorphSharedMemoryMultiIndex_bindings(m, "MorphSharedMemoryMultiIndex");
+    si_python::create_SynapseSharedMemoryMultiIndex_bindings(m, "SynapseSharedMemoryMultiIndex");
 
-#if SI_MPI == 1
     si_python::create_MorphMultiIndexBulkBuilder_bindings(m, "MorphMultiIndexBulkBuilder");
     si_python::create_SynapseMultiIndexBulkBuilder_bindings(m, "SynapseMultiIndexBulkBuilder");
+    si_python::create_MorphOutOfCoreMultiIndexBulkBuilder_bindings(
+        m, "MorphOutOfCoreMultiIndexBulkBuilder"
+    );
+    si_python::create_SynapseOutOfCoreMultiIndexBulkBuilder_bindings(
+        m, "SynapseOutOfCoreMultiIndexBulkBuilder"
+    );
 
+#if SI_MPI == 1
     si_python::create_call_some_mpi_from_cxx_bindings(m);
     si_python::create_analysis_bindings(m);
     si_python::create_is_valid_comm_size_bindings(m);
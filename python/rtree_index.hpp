@@ -1,9 +1,12 @@
 #pragma once
 #include "bind_common.hpp"
 #include <iostream>
+#include <mutex>
 #include <pybind11/eval.h>
 
 #include <brain_indexer/logging.hpp>
+#include <brain_indexer/morph_block_index.hpp>
+#include <brain_indexer/parallel_bulk_loading.hpp>
 #include <brain_indexer/query_ordering.hpp>
 
 namespace bg = boost::geometry;
@@ -185,6 +188,29 @@ inline void add_IndexTree_add_points_bindings(py::class_<Class>& c) {
     );
 }
 
+/// \brief A `QueryCursor` of any index, which returns chunks as Python objects.
+struct PyQueryCursor {
+    std::function<py::tuple(size_t)> next;
+};
+
+inline void create_QueryCursor_bindings(py::module& m) {
+    py::class_<PyQueryCursor>(m, "_QueryCursor")
+    .def("next",
+        [](PyQueryCursor& cursor, size_t chunk_size) {
+            return cursor.next(chunk_size);
+        },
+        py::arg("chunk_size"),
+        R"(
+        Returns the next at most `chunk_size` matches of the query.
+
+        Returns:
+            A tuple of the matches, in the same format as `_find_intersecting_np`,
+            and their number. Fewer than `chunk_size` matches are returned only
+            once the query is complete.
+        )"
+    );
+}
+
 namespace detail {
 
 template<typename Class, typename Shape>
@@ -229,6 +255,40 @@ find_intersecting_np(Class& obj, const Shape& query_shape, const std::string& ge
     throw std::runtime_error("Invalid geometry: " + geometry + ".");
 }
 
+template<typename Class, typename Shape>
+inline decltype(auto)
+find_intersecting_batch_np(Class& obj,
+                           const std::vector<Shape>& query_shapes,
+                           const std::string& geometry,
+                           size_t n_threads) {
+    if(geometry == "bounding_box") {
+        return obj.template find_intersecting_batch_np<BoundingBoxGeometry>(query_shapes, n_threads);
+    }
+
+    if(geometry == "best_effort") {
+        return obj.template find_intersecting_batch_np<BestEffortGeometry>(query_shapes, n_threads);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
+template<typename Class, typename Shape>
+inline decltype(auto)
+count_intersecting_batch(Class& obj,
+                         const std::vector<Shape>& query_shapes,
+                         const std::string& geometry,
+                         size_t n_threads) {
+    if(geometry == "bounding_box") {
+        return obj.template count_intersecting_batch<BoundingBoxGeometry>(query_shapes, n_threads);
+    }
+
+    if(geometry == "best_effort") {
+        return obj.template count_intersecting_batch<BestEffortGeometry>(query_shapes, n_threads);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
 template<typename Class, typename Shape>
 inline decltype(auto)
 count_intersecting(Class& obj, const Shape& query_shape, const std::string& geometry) {
@@ -257,6 +317,49 @@ count_intersecting_agg_gid(Class& obj, const Shape& query_shape, const std::stri
     throw std::runtime_error("Invalid geometry: " + geometry + ".");
 }
 
+template<typename Class, typename Shape, typename WrapAsDict>
+inline PyQueryCursor make_query_cursor(const Class& obj,
+                                       const Shape& query_shape,
+                                       const std::string& geometry,
+                                       const WrapAsDict& wrap_as_dict) {
+    auto make = [&](auto geometry_mode) {
+        using cursor_t = decltype(
+            obj.template query_cursor<decltype(geometry_mode)>(query_shape)
+        );
+
+        // The mutex prevents two Python threads advancing the cursor at the
+        // same time, since the GIL is released while doing so.
+        struct State {
+            cursor_t cursor;
+            std::mutex mutex;
+        };
+
+        auto state = std::shared_ptr<State>(new State{
+            obj.template query_cursor<decltype(geometry_mode)>(query_shape), {}
+        });
+
+        return PyQueryCursor{[state, wrap_as_dict](size_t chunk_size) {
+            auto results = call_without_gil<Class>([&]() {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                return state->cursor.next_np(chunk_size);
+            });
+
+            auto n_elements = results.size();
+            return py::make_tuple(wrap_as_dict(std::move(results)), n_elements);
+        }};
+    };
+
+    if(geometry == "bounding_box") {
+        return make(BoundingBoxGeometry{});
+    }
+
+    if(geometry == "best_effort") {
+        return make(BestEffortGeometry{});
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
 }
 
 template<typename Class>
@@ -264,7 +367,10 @@ inline void add_IndexTree_is_intersecting_bindings(py::class_<Class>& c) {
     c
     .def("_is_intersecting_sphere",
         [](Class& obj, const array_t& point, const coord_t radius, const std::string& geometry) {
-            return detail::is_intersecting(obj, si::Sphere{mk_point(point), radius}, geometry);
+            auto sphere = si::Sphere{mk_point(point), radius};
+            return call_without_gil<Class>([&]() {
+                return detail::is_intersecting(obj, sphere, geometry);
+            });
         },
         py::arg("point"),
         py::arg("radius"),
@@ -274,9 +380,10 @@ inline void add_IndexTree_is_intersecting_bindings(py::class_<Class>& c) {
     c
     .def("_is_intersecting_box",
          [](Class& obj, const array_t& c1, const array_t& c2, const std::string& geometry) {
-             return detail::is_intersecting(
-                 obj, si::make_query_box(mk_point(c1), mk_point(c2)), geometry
-             );
+             auto box = si::make_query_box(mk_point(c1), mk_point(c2));
+             return call_without_gil<Class>([&]() {
+                 return detail::is_intersecting(obj, box, geometry);
+             });
          },
          py::arg("corner"),
          py::arg("opposite_corner"),
@@ -290,9 +397,10 @@ inline void add_IndexTree_find_intersecting_objs_bindings(py::class_<Class>& c)
     c
     .def("_find_intersecting_objs",
         [](Class& obj, const array_t& centroid, const coord_t& radius, const std::string& geometry) {
-            return detail::find_intersecting_objs(
-                obj, si::Sphere{mk_point(centroid), radius}, geometry
-            );
+            auto sphere = si::Sphere{mk_point(centroid), radius};
+            return call_without_gil<Class>([&]() {
+                return detail::find_intersecting_objs(obj, sphere, geometry);
+            });
         },
         py::arg("centroid"),
         py::arg("radius"),
@@ -305,9 +413,10 @@ inline void add_IndexTree_find_intersecting_box_objs_bindings(py::class_<Class>&
     c
     .def("_find_intersecting_box_objs",
         [](Class& obj, const array_t& corner, const array_t& opposite_corner, const std::string& geometry) {
-            return detail::find_intersecting_objs(
-                obj, si::make_query_box(mk_point(corner), mk_point(opposite_corner)), geometry
-            );
+            auto box = si::make_query_box(mk_point(corner), mk_point(opposite_corner));
+            return call_without_gil<Class>([&]() {
+                return detail::find_intersecting_objs(obj, box, geometry);
+            });
         },
         py::arg("corner"),
         py::arg("opposite_corner"),
@@ -319,24 +428,21 @@ inline void add_IndexTree_find_intersecting_box_objs_bindings(py::class_<Class>&
 
 template<typename Class>
 inline void add_MorphIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_results_in_dict = [](const auto& results) {
-        auto centroid = py::array_t<CoordType>({results.centroid.size(), 3ul},
-                                                (CoordType*)results.endpoint1.data());
-        auto endpoint1 = py::array_t<CoordType>({results.endpoint1.size(), 3ul},
-                                                (CoordType*)results.endpoint1.data());
-        auto endpoint2 = py::array_t<CoordType>({results.endpoint2.size(), 3ul},
-                                                (CoordType*)results.endpoint2.data());
-
+    // The columns are moved into the numpy arrays. The column `ids` is
+    // assembled from `gid`, `section_id` and `segment_id` by Python, if needed.
+    auto wrap_results_in_dict = [](auto&& results) {
         return py::dict(
-            "gid"_a=pyutil::to_pyarray(results.gid), 
-            "section_id"_a=pyutil::to_pyarray(results.section_id),
-            "segment_id"_a=pyutil::to_pyarray(results.segment_id),
-            "ids"_a=pyutil::to_pyarray(results.ids),
-            "centroid"_a=centroid,
-            "radius"_a=pyutil::to_pyarray(results.radius),
-            "endpoints"_a=py::make_tuple(endpoint1, endpoint2),
-            "section_type"_a=pyutil::to_pyarray(results.section_type),
-            "is_soma"_a=pyutil::to_pyarray(results.is_soma)
+            "gid"_a=pyutil::as_pyarray(std::move(results.gid)),
+            "section_id"_a=pyutil::as_pyarray(std::move(results.section_id)),
+            "segment_id"_a=pyutil::as_pyarray(std::move(results.segment_id)),
+            "centroid"_a=pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.centroid)),
+            "radius"_a=pyutil::as_pyarray(std::move(results.radius)),
+            "endpoints"_a=py::make_tuple(
+                pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.endpoint1)),
+                pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.endpoint2))
+            ),
+            "section_type"_a=pyutil::as_pyarray(std::move(results.section_type)),
+            "is_soma"_a=pyutil::as_pyarray(std::move(results.is_soma))
         );
     };
 
@@ -348,10 +454,10 @@ inline void add_IndexTree_count_intersecting_bindings(py::class_<Class>& c) {
     c
     .def("_count_intersecting",
          [](Class& obj, const array_t& corner, const array_t& opposite_corner, const std::string& geometry) {
-             return detail::count_intersecting(
-                obj,
-                si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
-                geometry);
+             auto box = si::make_query_box(mk_point(corner), mk_point(opposite_corner));
+             return call_without_gil<Class>([&]() {
+                 return detail::count_intersecting(obj, box, geometry);
+             });
          },
          py::arg("corner"),
          py::arg("opposite_corner"),
@@ -359,14 +465,60 @@ inline void add_IndexTree_count_intersecting_bindings(py::class_<Class>& c) {
     )
     .def("_count_intersecting_sphere",
          [](Class& obj, const array_t& center, CoordType radius, const std::string& geometry) {
-             return detail::count_intersecting(
-                obj,
-                si::Sphere{mk_point(center), radius},
-                geometry);
+             auto sphere = si::Sphere{mk_point(center), radius};
+             return call_without_gil<Class>([&]() {
+                 return detail::count_intersecting(obj, sphere, geometry);
+             });
          },
          py::arg("center"),
          py::arg("radius"),
          py::arg("geometry")
+    )
+    .def("_count_intersecting_batch",
+         [](Class& obj,
+            const array_t& corners, const array_t& opposite_corners,
+            const std::string& geometry, size_t n_threads) {
+             auto boxes = make_query_boxes(corners, opposite_corners);
+             auto counts = call_without_gil<Class>([&]() {
+                 return detail::count_intersecting_batch(obj, boxes, geometry, n_threads);
+             });
+             return pyutil::as_pyarray(std::move(counts));
+         },
+         py::arg("corners"),
+         py::arg("opposite_corners"),
+         py::arg("geometry"),
+         py::arg("n_threads") = 1,
+         R"(
+        Counts the elements intersecting each of the N boxes.
+
+        Args:
+            corners(np.array): A Nx3 array[float32] of box corners.
+            opposite_corners(np.array): A Nx3 array[float32] of the opposite corners.
+            n_threads(int): Number of threads used to process the queries.
+        )"
+    )
+    .def("_count_intersecting_sphere_batch",
+         [](Class& obj,
+            const array_t& centers, const array_t& radii,
+            const std::string& geometry, size_t n_threads) {
+             auto spheres = make_query_spheres(centers, radii);
+             auto counts = call_without_gil<Class>([&]() {
+                 return detail::count_intersecting_batch(obj, spheres, geometry, n_threads);
+             });
+             return pyutil::as_pyarray(std::move(counts));
+         },
+         py::arg("centers"),
+         py::arg("radii"),
+         py::arg("geometry"),
+         py::arg("n_threads") = 1,
+         R"(
+        Counts the elements intersecting each of the N spheres.
+
+        Args:
+            centers(np.array): A Nx3 array[float32] of the centers of the spheres.
+            radii(np.array): An array[float32] with the N radii.
+            n_threads(int): Number of threads used to process the queries.
+        )"
     );
 }
 
@@ -375,9 +527,28 @@ inline void add_IndexTree_find_nearest_bindings(py::class_<Class>& c) {
     c
     .def("_find_nearest",
         [](Class& obj, const array_t& point, const int k_neighbors) {
-            const auto& vec = obj.find_nearest(mk_point(point), k_neighbors);
+            const auto& query_point = mk_point(point);
+            const auto& vec = call_without_gil<Class>([&]() {
+                return obj.find_nearest(query_point, k_neighbors);
+            });
             return pyutil::to_pyarray(vec);
         }
+    )
+    .def("_find_nearest_exact",
+        [](Class& obj, const array_t& point, const int k_neighbors) {
+            const auto& query_point = mk_point(point);
+            auto [ids, distances] = call_without_gil<Class>([&]() {
+                return obj.find_nearest_exact(query_point, k_neighbors);
+            });
+            return py::make_tuple(pyutil::as_pyarray(std::move(ids)),
+                                  pyutil::as_pyarray(std::move(distances)));
+        },
+        R"(
+        Finds the k elements nearest to the point, by the distance to their exact shape.
+
+        Returns:
+            A tuple of the ids and the distances, both by increasing distance.
+        )"
     );
 }
 
@@ -464,12 +635,20 @@ inline py::class_<Class> create_IndexTree_bindings(py::module& m,
     )
 
     .def("_dump",
-        [](const Class& obj, const std::string& filename) { obj.dump(filename); },
+        [](const Class& obj, const std::string& filename, bool memory_mapped) {
+            obj.dump(filename,
+                     memory_mapped ? si::IndexFormat::memory_mapped
+                                   : si::IndexFormat::serialized);
+        },
+        py::arg("filename"),
+        py::arg("memory_mapped") = false,
         R"(
         Save the spatial index tree to a file on disk.
 
         Args:
             filename(str): The file path to write the spatial index to.
+            memory_mapped(bool): Write the index in a format that can be opened
+                by memory mapping the file, instead of deserializing it.
         )"
     );
 }
@@ -570,12 +749,11 @@ inline void add_IndexTree_find_intersecting_box_np(
                            const array_t& corner, const array_t& opposite_corner,
                            const std::string& geometry) {
 
-                const auto& results = detail::find_intersecting_np(
-                    obj,
-                    si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
-                    geometry
-                );
-                return wrap_as_dict(results);
+                auto box = si::make_query_box(mk_point(corner), mk_point(opposite_corner));
+                auto results = call_without_gil<Class>([&]() {
+                    return detail::find_intersecting_np(obj, box, geometry);
+                });
+                return wrap_as_dict(std::move(results));
             },
             py::arg("corner"),
             py::arg("opposite_corner"),
@@ -587,29 +765,138 @@ inline void add_IndexTree_find_intersecting_box_np(
             [wrap_as_dict](Class& obj,
                            const array_t& center, CoordType radius,
                            const std::string& geometry) {
-                const auto& results = detail::find_intersecting_np(
-                    obj,
-                    si::Sphere{mk_point(center), radius},
-                    geometry
-                );
+                auto sphere = si::Sphere{mk_point(center), radius};
+                auto results = call_without_gil<Class>([&]() {
+                    return detail::find_intersecting_np(obj, sphere, geometry);
+                });
 
-                return wrap_as_dict(results); 
+                return wrap_as_dict(std::move(results));
             },
             py::arg("center"),
             py::arg("radius"),
             py::arg("geometry")
         );
-    
+
+    c
+    .def("_box_query_cursor",
+            [wrap_as_dict](const Class& obj,
+                           const array_t& corner, const array_t& opposite_corner,
+                           const std::string& geometry) {
+                auto box = si::make_query_box(mk_point(corner), mk_point(opposite_corner));
+                return detail::make_query_cursor(obj, box, geometry, wrap_as_dict);
+            },
+            py::arg("corner"),
+            py::arg("opposite_corner"),
+            py::arg("geometry"),
+            py::keep_alive<0, 1>(),
+            R"(
+        Starts a query for the elements intersecting the box.
+
+        The matches are returned in chunks by `next`, see `_QueryCursor`. The
+        index must not be modified while the cursor is in use.
+        )"
+        );
+
+    c
+    .def("_sphere_query_cursor",
+            [wrap_as_dict](const Class& obj,
+                           const array_t& center, CoordType radius,
+                           const std::string& geometry) {
+                auto sphere = si::Sphere{mk_point(center), radius};
+                return detail::make_query_cursor(obj, sphere, geometry, wrap_as_dict);
+            },
+            py::arg("center"),
+            py::arg("radius"),
+            py::arg("geometry"),
+            py::keep_alive<0, 1>(),
+            R"(
+        Starts a query for the elements intersecting the sphere.
+
+        The matches are returned in chunks by `next`, see `_QueryCursor`. The
+        index must not be modified while the cursor is in use.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_box_batch_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& corners, const array_t& opposite_corners,
+                           const std::string& geometry, size_t n_threads) {
+
+                auto boxes = make_query_boxes(corners, opposite_corners);
+                auto results = call_without_gil<Class>([&]() {
+                    return detail::find_intersecting_batch_np(obj, boxes, geometry, n_threads);
+                });
+
+                return py::make_tuple(
+                    wrap_as_dict(std::move(results.values)),
+                    pyutil::as_pyarray(std::move(results.offsets))
+                );
+            },
+            py::arg("corners"),
+            py::arg("opposite_corners"),
+            py::arg("geometry"),
+            py::arg("n_threads") = 1,
+            R"(
+        Finds the elements intersecting each of the N boxes.
+
+        The results of all queries are concatenated. The matches of the
+        `i`-th box are the entries `offsets[i]:offsets[i+1]`.
+
+        Args:
+            corners(np.array): A Nx3 array[float32] of box corners.
+            opposite_corners(np.array): A Nx3 array[float32] of the opposite corners.
+            n_threads(int): Number of threads used to process the queries.
+
+        Returns:
+            A tuple of the results as a dictionary and the offsets.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_batch_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& centers, const array_t& radii,
+                           const std::string& geometry, size_t n_threads) {
+
+                auto spheres = make_query_spheres(centers, radii);
+                auto results = call_without_gil<Class>([&]() {
+                    return detail::find_intersecting_batch_np(obj, spheres, geometry, n_threads);
+                });
+
+                return py::make_tuple(
+                    wrap_as_dict(std::move(results.values)),
+                    pyutil::as_pyarray(std::move(results.offsets))
+                );
+            },
+            py::arg("centers"),
+            py::arg("radii"),
+            py::arg("geometry"),
+            py::arg("n_threads") = 1,
+            R"(
+        Finds the elements intersecting each of the N spheres.
+
+        The results of all queries are concatenated. The matches of the
+        `i`-th sphere are the entries `offsets[i]:offsets[i+1]`.
+
+        Args:
+            centers(np.array): A Nx3 array[float32] of the centers of the spheres.
+            radii(np.array): An array[float32] with the N radii.
+            n_threads(int): Number of threads used to process the queries.
+
+        Returns:
+            A tuple of the results as a dictionary and the offsets.
+        )"
+        );
 }
 
 template<typename Class>
 inline void add_SphereIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
+    auto wrap_as_dict = [](auto&& results) {
         return py::dict(
-            "id"_a=pyutil::to_pyarray(results.id),
-            "centroid"_a=py::array_t<CoordType>({results.centroid.size(), 3ul},
-                                                (CoordType*)results.centroid.data()),
-            "radius"_a=pyutil::to_pyarray(results.radius)
+            "id"_a=pyutil::as_pyarray(std::move(results.id)),
+            "centroid"_a=pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.centroid)),
+            "radius"_a=pyutil::as_pyarray(std::move(results.radius))
         );
     };
 
@@ -623,7 +910,10 @@ inline void create_SphereIndex_bindings(py::module& m, const char* class_name) {
     add_IndexTree_insert_themed_bindings<value_type, value_type, Class>(c);
 
 
-    c.def(py::init([](const array_t& centroids, const array_t& radii, const array_ids& ids) {
+    c.def(py::init([](const array_t& centroids,
+                      const array_t& radii,
+                      const array_ids& ids,
+                      size_t n_threads) {
               if (centroids.shape(0) == 0) {
                   throw std::invalid_argument("Please provide at least one centroid.");
               }
@@ -642,11 +932,13 @@ inline void create_SphereIndex_bindings(py::module& m, const char* class_name) {
               auto soa = si::util::make_soa_reader<si::IndexedSphere>(ids_unchecked,
                                                                       points_ptr,
                                                                       radii_ptr);
-              return std::make_unique<Class>(soa.begin(), soa.end());
+              return std::make_unique<Class>(
+                  si::parallel_bulk_load<Class>(soa.begin(), soa.end(), n_threads));
           }),
           py::arg("centroids"),
           py::arg("radii"),
           py::arg("ids"),
+          py::arg("n_threads") = 1,
           R"(
         Creates a BrainIndexer prefilled with spheres with explicit ids
         or points with explicit ids and radii = None.
@@ -655,6 +947,9 @@ inline void create_SphereIndex_bindings(py::module& m, const char* class_name) {
             centroids(np.array): A Nx3 array[float32] of the spheres centroids
             radii(np.array): An array[float32] with the radii
             ids(np.array): An array[int64] with the ids of the spheres
+            n_threads(int): The number of threads used to build the index,
+                `0` means one per hardware thread. The index doesn't depend
+                on the number of threads.
         )");
 
     add_SphereIndex_find_intersecting_box_np(c);
@@ -681,11 +976,10 @@ inline void add_PointIndex_fields_bindings(py::class_<Class>& c) {
 
 template <typename Class>
 inline void add_PointIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
-        return py::dict("id"_a = pyutil::to_pyarray(results.id),
+    auto wrap_as_dict = [](auto&& results) {
+        return py::dict("id"_a = pyutil::as_pyarray(std::move(results.id)),
                         "position"_a =
-                            py::array_t<CoordType>({results.position.size(), 3ul},
-                                                   (CoordType*) results.position.data()));
+                            pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.position)));
     };
 
     add_IndexTree_find_intersecting_box_np(c, wrap_as_dict);
@@ -697,7 +991,7 @@ inline void create_PointIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
     auto c = create_IndexTree_bindings<value_type, value_type, Class>(m, class_name);
 
-    c.def(py::init([](const array_t& positions, const array_ids& ids) {
+    c.def(py::init([](const array_t& positions, const array_ids& ids, size_t n_threads) {
               if (positions.shape(0) == 0) {
                   throw std::invalid_argument("Please provide at least one centroid.");
               }
@@ -710,16 +1004,21 @@ inline void create_PointIndex_bindings(py::module& m, const char* class_name) {
               auto ids_unchecked = ids.template unchecked<1>();
 
               auto soa = si::util::make_soa_reader<si::IndexedPoint>(ids_unchecked, points_ptr);
-              return std::make_unique<Class>(soa.begin(), soa.end());
+              return std::make_unique<Class>(
+                  si::parallel_bulk_load<Class>(soa.begin(), soa.end(), n_threads));
           }),
           py::arg("positions"),
           py::arg("ids"),
+          py::arg("n_threads") = 1,
           R"(
         Creates a spatial index prefilled with points with explicit ids.
 
         Args:
             positions(np.array): A Nx3 array[float32] of the points
             ids(np.array): An array[int64] with the ids of the points
+            n_threads(int): The number of threads used to build the index,
+                `0` means one per hardware thread. The index doesn't depend
+                on the number of threads.
         )");
 
     add_PointIndex_find_intersecting_box_np(c);
@@ -763,13 +1062,12 @@ inline void create_Synapse_bindings(py::module& m) {
 
 template<typename Class>
 inline void add_SynapseIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
+    auto wrap_as_dict = [](auto&& results) {
         return py::dict(
-            "id"_a=pyutil::to_pyarray(results.id),
-            "pre_gid"_a=pyutil::to_pyarray(results.pre_gid),
-            "post_gid"_a=pyutil::to_pyarray(results.post_gid),
-            "position"_a=py::array_t<CoordType>({results.position.size(), 3ul},
-                                                (CoordType*)results.position.data())
+            "id"_a=pyutil::as_pyarray(std::move(results.id)),
+            "pre_gid"_a=pyutil::as_pyarray(std::move(results.pre_gid)),
+            "post_gid"_a=pyutil::as_pyarray(std::move(results.post_gid)),
+            "position"_a=pyutil::as_pyarray_2d<CoordType, 3>(std::move(results.position))
         );
     };
 
@@ -822,10 +1120,10 @@ inline void add_SynapseIndex_count_intersecting_agg_gid_bindings(py::class_<Clas
            const array_t& corner, const array_t& opposite_corner,
            const std::string& geometry) {
 
-            return detail::count_intersecting_agg_gid(obj, 
-                si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
-                geometry
-            );
+            auto box = si::make_query_box(mk_point(corner), mk_point(opposite_corner));
+            return call_without_gil<Class>([&]() {
+                return detail::count_intersecting_agg_gid(obj, box, geometry);
+            });
         },
         py::arg("corner"),
         py::arg("opposite_corner"),
@@ -837,10 +1135,10 @@ inline void add_SynapseIndex_count_intersecting_agg_gid_bindings(py::class_<Clas
            const array_t& center, CoordType radius,
            const std::string& geometry) {
 
-            return detail::count_intersecting_agg_gid(obj, 
-                si::Sphere{mk_point(center), radius},
-                geometry
-            );
+            auto sphere = si::Sphere{mk_point(center), radius};
+            return call_without_gil<Class>([&]() {
+                return detail::count_intersecting_agg_gid(obj, sphere, geometry);
+            });
         },
         py::arg("point"),
         py::arg("radius"),
@@ -1267,7 +1565,8 @@ inline py::class_<Class>
 create_IndexBulkBuilder_bindings(py::module& m, const char* class_name) {
     py::class_<Class> c = py::class_<Class>(m, class_name);
     c
-    .def(py::init<>(),
+    .def(py::init<size_t>(),
+         py::arg("n_threads") = 1,
          R"(
         Create a `IndexBulkBuilder`.
 
@@ -1275,6 +1574,11 @@ create_IndexBulkBuilder_bindings(py::module& m, const char* class_name) {
         indexes can only be built in bulk. Meaning first all elements to be
         indexed are loaded, then the index is created. As a consequence, the multi
         index in only created once `_finalize` is called.
+
+        Args:
+            n_threads(int): The number of threads used by `_finalize`, `0` means
+                one per hardware thread. The index doesn't depend on the number
+                of threads.
         )"
     )
 
@@ -1322,29 +1626,32 @@ inline void create_SphereIndexBulkBuilder_bindings(py::module& m, const char* cl
 }
 
 
-#if SI_MPI == 1
-
 template<typename Class>
 inline void add_MultiIndexBulkBuilder_creation_bindings(py::class_<Class>& c) {
     add_IndexBulkBuilder_reserve_bindings(c);
 
     c
-    .def(py::init<std::string>(),
+    .def(py::init<std::string, size_t>(),
          py::arg("output_dir"),
+         py::arg("n_threads") = 1,
          R"(
         Create a `MultiIndexBulkBuilder` that writes output to `output_dir`.
 
         A `MultiIndexBulkBuilder` is an interface to build a multi index. Currently,
         a multi index can only be built in bulk. Meaning first all elements to be
         indexed are loaded, then the index is created. As a consequence, the multi
-        index in only created once `_finalize` is called.
+        index in only created once `_finalize` or `_finalize_threaded` is called.
 
         Args:
             output_dir(string):  The directory where the all files that make up
                 the multi index are stored.
+
+            n_threads(int): The number of threads used by `_finalize_threaded`,
+                `0` means one per hardware thread.
         )"
     )
 
+#if SI_MPI == 1
     .def("_finalize",
          [](Class &obj) {
             auto comm_size = mpi::size(MPI_COMM_WORLD);
@@ -1356,6 +1663,16 @@ inline void add_MultiIndexBulkBuilder_creation_bindings(py::class_<Class>& c) {
          R"(
         This will trigger building the multi index in bulk.
         )"
+    )
+#endif
+
+    .def("_finalize_threaded",
+         [](Class &obj) { obj.finalize_threaded(); },
+         R"(
+        Build the multi index in bulk using threads of this process, without MPI.
+
+        All elements must have been inserted into this builder.
+        )"
     );
 
 }
@@ -1403,16 +1720,195 @@ inline void create_SynapseMultiIndexBulkBuilder_bindings(py::module& m, const ch
     add_SynapseIndex_add_synapses_bindings<Class>(c);
 }
 
-#endif
+
+template <typename Value, typename Class=si::OutOfCoreMultiIndexBulkBuilder<Value>>
+inline py::class_<Class>
+create_OutOfCoreMultiIndexBulkBuilder_bindings(py::module& m, const char* class_name) {
+    py::class_<Class> c = py::class_<Class>(m, class_name);
+
+    add_IndexBulkBuilder_reserve_bindings(c);
+    add_MultiIndexBulkBuilder_local_size_bindings(c);
+    add_len_for_size_bindings(c);
+
+    c
+    .def(py::init<std::string, std::string, size_t, size_t>(),
+         py::arg("output_dir"),
+         py::arg("scratch_dir"),
+         py::arg("max_memory_bytes"),
+         py::arg("n_threads") = 1,
+         R"(
+        Create a `OutOfCoreMultiIndexBulkBuilder` that writes output to `output_dir`.
+
+        Like a `MultiIndexBulkBuilder`, but the inserted elements are spilled to
+        `scratch_dir` whenever they'd use more than `max_memory_bytes` bytes.
+        The multi index is then built by an out-of-core Sort Tile Recursion.
+
+        Args:
+            output_dir(string):  The directory where the all files that make up
+                the multi index are stored.
+
+            scratch_dir(string):  A private directory for the spilled elements
+                is created in this directory; and removed again afterwards.
+
+            max_memory_bytes(int):  The bytes used by the builder,
+                approximately. This includes the elements in memory, the
+                scratch space to sort them and the subtrees being built; but
+                not the top-level tree.
+
+            n_threads(int): The number of threads used to build the subtrees,
+                `0` means one per hardware thread.
+        )"
+    )
+
+    .def("_finalize_threaded",
+         [](Class &obj) { obj.finalize(); },
+         R"(
+        Build the multi index in bulk, using threads of this process.
+
+        All elements must have been inserted into this builder.
+        )"
+    );
+
+    return c;
+}
+
+template <typename Class = si::OutOfCoreMultiIndexBulkBuilder<MorphoEntry>>
+inline void create_MorphOutOfCoreMultiIndexBulkBuilder_bindings(py::module& m,
+                                                               const char* class_name) {
+    py::class_<Class> c = create_OutOfCoreMultiIndexBulkBuilder_bindings<MorphoEntry>(m, class_name);
+
+    add_MorphIndex_common_insert_bindings<Class>(c);
+}
+
+
+template <typename Class = si::OutOfCoreMultiIndexBulkBuilder<Synapse>>
+inline void create_SynapseOutOfCoreMultiIndexBulkBuilder_bindings(py::module& m,
+                                                                 const char* class_name) {
+    py::class_<Class> c = create_OutOfCoreMultiIndexBulkBuilder_bindings<Synapse>(m, class_name);
+
+    add_IndexTree_insert_bindings<Synapse, Synapse, Class>(c);
+    add_SynapseIndex_add_synapses_bindings<Class>(c);
+}
+
+template <typename Class>
+inline void add_MultiIndex_preload_bindings(py::class_<Class>& c) {
+    auto preload = [](Class& obj, const auto& shape, bool pin, bool wait) {
+        return call_without_gil<Class>([&]() {
+            return pin ? obj.pin(shape, wait) : obj.preload(shape, wait);
+        });
+    };
+
+    c
+    .def("_preload_box",
+        [preload](Class& obj,
+                  const array_t& corner, const array_t& opposite_corner,
+                  bool pin, bool wait) {
+            auto box = si::make_query_box(mk_point(corner), mk_point(opposite_corner));
+            return preload(obj, box, pin, wait);
+        },
+        py::arg("corner"),
+        py::arg("opposite_corner"),
+        py::arg("pin") = false,
+        py::arg("wait") = false,
+        R"(
+        Load the subtrees intersecting the box in the background.
+
+        Without `pin`, only as many subtrees as fit into the cache are loaded.
+        Pinned subtrees are all loaded and never evicted, until `_unpin_all`.
+        Returns the number of subtrees requested.
+        )"
+    )
+    .def("_preload_sphere",
+        [preload](Class& obj, const array_t& center, CoordType radius, bool pin, bool wait) {
+            auto sphere = si::Sphere{mk_point(center), radius};
+            return preload(obj, sphere, pin, wait);
+        },
+        py::arg("center"),
+        py::arg("radius"),
+        py::arg("pin") = false,
+        py::arg("wait") = false,
+        R"(
+        Load the subtrees intersecting the sphere in the background.
+
+        See `_preload_box`.
+        )"
+    )
+    .def("_warm_up",
+        [](Class& obj, bool wait) {
+            return call_without_gil<Class>([&]() {
+                return obj.warm_up(wait);
+            });
+        },
+        py::arg("wait") = false,
+        R"(
+        Fill the cache with subtrees in the background.
+        )"
+    )
+    .def("_unpin_all",
+        [](Class& obj) {
+            obj.unpin_all();
+        },
+        R"(
+        Allow all pinned subtrees to be evicted again.
+        )"
+    );
+}
+
+
+template <typename Class>
+inline void add_MultiIndex_stats_bindings(py::class_<Class>& c) {
+    c
+    .def("_stats",
+        [](const Class& obj) {
+            auto stats = obj.stats();
+            const auto& histogram = stats.load_latency_histogram;
+
+            return py::dict(
+                "n_hits"_a = stats.n_hits,
+                "n_misses"_a = stats.n_misses,
+                "n_evictions"_a = stats.n_evictions,
+                "n_resident_bytes"_a = stats.n_resident_bytes,
+                "n_bytes_read"_a = stats.n_bytes_read,
+                "load_latency_histogram"_a = std::vector<size_t>(histogram.begin(),
+                                                                 histogram.end()),
+                "load_latency_us"_a = stats.load_latency_us,
+                "n_queries"_a = stats.n_queries,
+                "n_subtrees_visited"_a = stats.n_subtrees_visited,
+                "n_elements_scanned"_a = stats.n_elements_scanned,
+                "n_elements_returned"_a = stats.n_elements_returned
+            );
+        },
+        R"(
+        The statistics of the subtree cache and the queries, see `MultiIndexStats`.
+        )"
+    )
+    .def("_reset_stats",
+        [](Class& obj) {
+            obj.reset_stats();
+        },
+        R"(
+        Set all counters of the statistics to zero.
+        )"
+    );
+}
+
 
 template <typename Value, typename Class = si::MultiIndexTree<Value>>
 inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* class_name) {
-    py::class_<Class> c = py::class_<Class>(m, class_name);
+    using holder_type = gil_release_unique_ptr<Class>;
+    py::class_<Class> c = py::class_<Class, holder_type>(m, class_name);
 
     c
-    .def(py::init<std::string, std::size_t>(),
+    .def(py::init([](const std::string& output_dir,
+                     std::size_t max_cached_bytes,
+                     const std::string& eviction_policy) {
+            return holder_type(new Class(
+                output_dir, max_cached_bytes, si::eviction_policy_from_string(eviction_policy)
+            ));
+         }),
          py::arg("output_dir"),
          py::arg("max_cached_bytes"),
+         py::arg("eviction_policy") = "usage_rate",
          R"(
         Create a `MultiIndexBulkBuilder` that writes output to `output_dir`.
 
@@ -1425,12 +1921,19 @@ inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* c
             output_dir(string):  The directory where the all files that make up
                 the multi index are stored.
 
-            max_cached_bytes(int):  The total size of the index should, up to a
-                log factor, not use more than `max_cached_bytes` bytes of memory.
+            max_cached_bytes(int):  The subtrees kept in memory, including
+                their tree structure, use at most `max_cached_bytes` bytes.
+                Subtrees which are being queried aren't evicted and may
+                exceed the limit temporarily.
+
+            eviction_policy(str):  How to choose the subtree to evict, one of
+                "usage_rate", "lru", "lfu", "clock" or "arc".
         )"
     );
 
     add_IndexTree_query_bindings(c);
+    add_MultiIndex_stats_bindings(c);
+    add_MultiIndex_preload_bindings(c);
 
     add_IndexTree_bounds_bindings(c);
     add_len_for_size_bindings(c);
@@ -1462,6 +1965,195 @@ inline py::class_<Class> create_SynapseMultiIndex_bindings(py::module& m, const
     return c;
 }
 
+
+template <typename Value, typename Class = si::MultiIndexTree<Value, si::SharedMemoryStorage<Value>>>
+inline py::class_<Class> create_SharedMemoryMultiIndex_bindings(py::module& m,
+                                                                const char* class_name) {
+    using holder_type = gil_release_unique_ptr<Class>;
+    py::class_<Class> c = py::class_<Class, holder_type>(m, class_name);
+
+    c
+    .def(py::init([](const std::string& output_dir,
+                     std::size_t max_cached_bytes,
+                     std::size_t max_shared_bytes,
+                     const std::string& eviction_policy) {
+            auto storage = si::SharedMemoryStorage<Value>(
+                si::resolve_heavy_data_path(output_dir, si::MetaDataConstants::multi_index_key),
+                si::SharedSubtreeCacheParams(max_shared_bytes)
+            );
+
+            return holder_type(new Class(
+                storage,
+                si::UsageRateCacheParams(
+                    max_cached_bytes, si::eviction_policy_from_string(eviction_policy)
+                )
+            ));
+         }),
+         py::arg("output_dir"),
+         py::arg("max_cached_bytes"),
+         py::arg("max_shared_bytes"),
+         py::arg("eviction_policy") = "usage_rate",
+         R"(
+        Open a multi index, sharing its subtrees with other processes.
+
+        Subtrees are placed in POSIX shared memory when loaded. All processes
+        on the node which open the same multi index this way share them;
+        hence each subtree is read from disk once per node.
+
+        Args:
+            output_dir(string):  The directory where the all files that make up
+                the multi index are stored.
+
+            max_cached_bytes(int):  The subtrees used by this process, including
+                their tree structure, use at most `max_cached_bytes` bytes.
+
+            max_shared_bytes(int):  The subtrees in shared memory use at most
+                `max_shared_bytes` bytes. It's decided by the first process
+                to open the index. Subtrees used by any process aren't evicted
+                and may exceed the limit temporarily.
+
+            eviction_policy(str):  How this process chooses the subtree to
+                release, one of "usage_rate", "lru", "lfu", "clock" or "arc".
+        )"
+    );
+
+    add_IndexTree_query_bindings(c);
+    add_MultiIndex_stats_bindings(c);
+    add_MultiIndex_preload_bindings(c);
+
+    add_IndexTree_bounds_bindings(c);
+    add_len_for_size_bindings(c);
+
+    return c;
+}
+
+
+template <typename Class = si::MultiIndexTree<MorphoEntry, si::SharedMemoryStorage<MorphoEntry>>>
+inline void create_MorphSharedMemoryMultiIndex_bindings(py::module& m, const char* class_name) {
+    using value_type = typename Class::value_type;
+    auto c = create_SharedMemoryMultiIndex_bindings<value_type>(m, class_name);
+
+    add_MorphIndex_find_intersecting_box_np(c);
+    add_MorphIndex_fields_bindings(c);
+}
+
+
+template <typename Class = si::MultiIndexTree<Synapse, si::SharedMemoryStorage<Synapse>>>
+inline void create_SynapseSharedMemoryMultiIndex_bindings(py::module& m, const char* class_name) {
+    using value_type = typename Class::value_type;
+    auto c = create_SharedMemoryMultiIndex_bindings<value_type>(m, class_name);
+
+    add_SynapseIndex_find_intersecting_box_np(c);
+    add_SynapseIndex_fields_bindings(c);
+}
+
+
+///
+/// 3 - Memory mapped indexes
+///
+
+template <typename Value, typename Class = si::MemoryMappedIndexTree<Value>>
+inline py::class_<Class> create_MemoryMappedIndex_bindings(py::module& m,
+                                                           const char* class_name) {
+    py::class_<Class> c = py::class_<Class>(m, class_name);
+
+    c
+    .def(py::init<std::string>(),
+         py::arg("index_path"),
+         R"(
+        Open an index that was dumped with `memory_mapped=True`.
+
+        The file is mapped read-only into the address space of the process. No
+        elements are copied or deserialized; pages of the index are loaded by
+        the OS as they are touched by queries.
+
+        Args:
+            index_path(string):  The directory containing the memory mapped index.
+        )"
+    );
+
+    add_IndexTree_query_bindings(c);
+
+    add_IndexTree_bounds_bindings(c);
+    add_len_for_size_bindings(c);
+
+    return c;
+}
+
+
+template <typename Class = si::MemoryMappedIndexTree<MorphoEntry>>
+inline void create_MorphMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_MemoryMappedIndex_bindings<MorphoEntry>(m, class_name);
+
+    add_MorphIndex_find_intersecting_box_np(c);
+    add_MorphIndex_fields_bindings(c);
+}
+
+
+template <typename Class = si::MemoryMappedIndexTree<Synapse>>
+inline void create_SynapseMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_MemoryMappedIndex_bindings<Synapse>(m, class_name);
+
+    add_SynapseIndex_count_intersecting_agg_gid_bindings(c);
+    add_SynapseIndex_find_intersecting_box_np(c);
+    add_SynapseIndex_fields_bindings(c);
+}
+
+
+template <typename Class = si::MemoryMappedIndexTree<si::IndexedSphere>>
+inline void create_SphereMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_MemoryMappedIndex_bindings<si::IndexedSphere>(m, class_name);
+
+    add_SphereIndex_find_intersecting_box_np(c);
+    add_SphereIndex_fields_bindings(c);
+}
+
+
+template <typename Class = si::MemoryMappedIndexTree<si::IndexedPoint>>
+inline void create_PointMemoryMappedIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_MemoryMappedIndex_bindings<si::IndexedPoint>(m, class_name);
+
+    add_PointIndex_find_intersecting_box_np(c);
+    add_PointIndex_fields_bindings(c);
+}
+
+
+
+///
+/// 4 - Block index of morphologies
+///
+
+template <typename Class = si::MorphBlockIndexTree>
+inline void create_MorphBlockIndex_bindings(py::module& m, const char* class_name) {
+    py::class_<Class> c = py::class_<Class>(m, class_name);
+
+    c
+    .def(py::init([](const si::IndexTree<MorphoEntry>& index) {
+            return std::make_unique<Class>(index.begin(), index.end());
+        }),
+        py::arg("index"),
+        R"(
+        Create a read-only copy of a `MorphIndex` optimized for segments.
+
+        The segments are grouped into small blocks of nearby segments, which
+        are stored as a structure of arrays. This needs less memory per segment
+        and makes the intersection tests with the segments of a block cheaper.
+
+        Args:
+            index(MorphIndex):  The in-memory index to copy.
+        )"
+    );
+
+    add_IndexTree_query_bindings(c);
+
+    add_IndexTree_bounds_bindings(c);
+    add_len_for_size_bindings(c);
+
+    add_MorphIndex_find_intersecting_box_np(c);
+    add_MorphIndex_fields_bindings(c);
+}
+
+
 inline void create_MetaDataConstants_bindings(py::module& m) {
     py::class_<MetaDataConstants> c = py::class_<MetaDataConstants>(m, "_MetaDataConstants");
 
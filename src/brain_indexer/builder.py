@@ -12,7 +12,12 @@ class _WriteSONATAMetadataMixin:
 
 class _WriteSONATAMetadataMultiMixin:
     def _write_extended_meta_data_section(*a, **kw):
-        from mpi4py import MPI
+        try:
+            from mpi4py import MPI
+        except ImportError:
+            # Built by threads of a single process.
+            write_sonata_meta_data_section(*a, **kw)
+            return
 
         if MPI.COMM_WORLD.Get_rank() == 0:
             write_sonata_meta_data_section(*a, **kw)
@@ -22,7 +27,7 @@ class _WriteSONATAMetadataMultiMixin:
 
 class SimpleShapeIndexBuilder:
     @classmethod
-    def create(cls, *args, ids=None, output_dir=None):
+    def create(cls, *args, ids=None, output_dir=None, n_threads=1):
         assert len(args) > 0
 
         builder = cls()
@@ -30,7 +35,7 @@ class SimpleShapeIndexBuilder:
         if ids is None:
             ids = np.arange(args[0].shape[0])
 
-        builder._core_index = cls.core_index_type(*args, ids)
+        builder._core_index = cls.core_index_type(*args, ids, n_threads=n_threads)
 
         builder._write_index_if_needed(output_dir)
         return builder._index_if_loaded
@@ -57,8 +62,9 @@ class SphereIndexBuilder(SimpleShapeIndexBuilder):
     index_type = SphereIndex
 
     @classmethod
-    def from_numpy(cls, centroids, radii, ids=None, output_dir=None):
-        return cls.create(centroids, radii, ids=ids, output_dir=output_dir)
+    def from_numpy(cls, centroids, radii, ids=None, output_dir=None, n_threads=1):
+        return cls.create(centroids, radii, ids=ids, output_dir=output_dir,
+                          n_threads=n_threads)
 
     def add_sphere(self, *a, **kw):
         import warnings
@@ -72,5 +78,6 @@ class PointIndexBuilder(SimpleShapeIndexBuilder):
     index_type = PointIndex
 
     @classmethod
-    def from_numpy(cls, positions, ids=None, output_dir=None):
-        return cls.create(positions, ids=ids, output_dir=output_dir)
+    def from_numpy(cls, positions, ids=None, output_dir=None, n_threads=1):
+        return cls.create(positions, ids=ids, output_dir=output_dir,
+                          n_threads=n_threads)
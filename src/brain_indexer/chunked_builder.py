@@ -1,3 +1,4 @@
+import tempfile
 from abc import ABCMeta, abstractmethod
 
 import numpy as np
@@ -45,9 +46,54 @@ class MultiIndexBuilderMixin:
     def local_size(self):
         return self._core_builder.local_size()
 
+    @staticmethod
+    def _uses_threads(n_threads, max_memory_mb=None):
+        """Is the multi-index built by threads of this process, without MPI?
+
+        This is the case if `n_threads` or `max_memory_mb` is set, or if the C++
+        backend was compiled without MPI support.
+        """
+        return (
+            n_threads is not None
+            or max_memory_mb is not None
+            or not hasattr(core, "is_valid_comm_size")
+        )
+
+    @staticmethod
+    def _make_core_builder(core_builder_type, out_of_core_builder_type, output_dir,
+                           n_threads=None, max_memory_mb=None, scratch_dir=None):
+        assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
+        n_threads = 1 if n_threads is None else n_threads
+
+        if max_memory_mb is None:
+            return core_builder_type(output_dir, n_threads=n_threads)
+
+        if scratch_dir is None:
+            scratch_dir = tempfile.gettempdir()
+
+        return out_of_core_builder_type(
+            output_dir, scratch_dir, int(max_memory_mb * 1024**2), n_threads=n_threads
+        )
+
     @classmethod
-    def create(cls, *args, output_dir=None, progress=False, **kw):
-        """Interactively create, with some progress"""
+    def create(cls, *args, output_dir=None, progress=False, n_threads=None, **kw):
+        """Interactively create, with some progress
+
+        If `n_threads` is not ``None``, the multi-index is built by this process
+        using `n_threads` threads, instead of using MPI; ``0`` means one thread per
+        hardware thread. This is also the default if MPI isn't available.
+
+        If `max_memory_mb` is passed, the elements are spilled to `scratch_dir`,
+        by default the temporary directory, whenever they'd use more memory; and
+        the multi-index is built out-of-core, also by this process.
+        """
+        if cls._uses_threads(n_threads, kw.get("max_memory_mb")):
+            n_threads = 0 if n_threads is None else n_threads
+            cls._create_threaded(
+                *args, output_dir=output_dir, progress=progress, n_threads=n_threads, **kw
+            )
+            return
+
         from mpi4py import MPI
         register_mpi_excepthook()
 
@@ -87,6 +133,18 @@ class MultiIndexBuilderMixin:
         builder._finalize()
         comm.Barrier()
 
+    @classmethod
+    def _create_threaded(cls, *args, output_dir=None, progress=False, n_threads=0, **kw):
+        builder = cls(*args, output_dir=output_dir, n_threads=n_threads, **kw)
+
+        n_elements = builder.n_elements_to_import()
+        make_ranges = ranges_with_progress if progress else gen_ranges
+        for range_ in make_ranges(n_elements, builder.N_ELEMENTS_CHUNK):
+            builder.process_range(range_)
+
+        brain_indexer.logger.info("Starting to build the index using threads.")
+        builder._core_builder._finalize_threaded()
+
 
 class MultiIndexWorkQueue:
     """Dynamic work queue for loading even number of elements.
@@ -11,6 +11,10 @@ from .io import write_sonata_meta_data_section
 from .util import is_non_string_iterable, strip_singleton_non_string_iterable
 
 
+# The default number of elements per chunk of `box_query_chunks`.
+DEFAULT_CHUNK_SIZE = 2**20
+
+
 class IndexInterface(abc.ABC):
     @abc.abstractmethod
     def box_query(self, corner, opposite_corner, *,
@@ -178,6 +182,127 @@ class IndexInterface(abc.ABC):
         """
         pass
 
+    @abc.abstractmethod
+    def box_query_batch(self, corners, opposite_corners, *,
+                        fields=None, accuracy=None, n_threads=1,
+                        populations=None, population_mode=None):
+        """Find all elements intersecting with each of the query boxes.
+
+        The boxes are passed as two arrays of shape ``(n_queries, 3)``. The
+        results of all queries are concatenated and returned together with an
+        array ``offsets`` of length ``n_queries + 1``. The elements found by
+        the ``i``-th query are ``values[offsets[i]:offsets[i+1]]``.
+
+        The queries are distributed over ``n_threads`` threads. Threads which
+        run out of work take over queries from the other threads. Therefore,
+        a few expensive queries don't serialize the batch. The result doesn't
+        depend on the number of threads.
+
+        Arguments:
+            fields(str,list):  As in `box_query`.
+            accuracy(str):     As in `box_query`.
+            n_threads(int):    Number of threads used to process the queries.
+                Indexes which can't be queried concurrently use one thread.
+            populations(str,list):  As in `box_query`.
+            population_mode(str):  As in `box_query`.
+
+        Returns:
+            A tuple ``(values, offsets)``, where ``values`` has the same format
+            as the return value of `box_query`.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_query_batch(self, centers, radii, *,
+                           fields=None, accuracy=None, n_threads=1,
+                           populations=None, population_mode=None):
+        """Find all elements intersecting with each of the query spheres.
+
+        The spheres are passed as an array of centers of shape
+        ``(n_queries, 3)`` and an array of ``n_queries`` radii. The format of
+        the return value is explained in `box_query_batch`.
+
+        Arguments:
+            fields(str,list):  As in `sphere_query`.
+            accuracy(str):     As in `sphere_query`.
+            n_threads(int):    As in `box_query_batch`.
+            populations(str,list):  As in `sphere_query`.
+            population_mode(str):  As in `sphere_query`.
+        """
+        pass
+
+    @abc.abstractmethod
+    def box_query_chunks(self, corner, opposite_corner, *,
+                         chunk_size=DEFAULT_CHUNK_SIZE, fields=None, accuracy=None,
+                         populations=None, population_mode=None):
+        """Find all elements intersecting with the query box, in chunks.
+
+        Returns a generator which yields the matches in chunks of at most
+        ``chunk_size`` elements. Each chunk has the same format as the return
+        value of `box_query`. The query is resumed whenever the next chunk is
+        requested. Hence, only one chunk needs to be held in memory, which
+        bounds the memory needed by queries with very many matches.
+
+        The index must not be modified while the generator is in use.
+
+        Arguments:
+            chunk_size(int):   The maximum number of elements per chunk.
+            fields(str,list):  As in `box_query`.
+            accuracy(str):     As in `box_query`.
+            populations(str,list):  As in `box_query`.
+            population_mode(str):  As in `box_query`.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_query_chunks(self, center, radius, *,
+                            chunk_size=DEFAULT_CHUNK_SIZE, fields=None, accuracy=None,
+                            populations=None, population_mode=None):
+        """Find all elements intersecting with the query sphere, in chunks.
+
+        The format of the return value is explained in `box_query_chunks`.
+
+        Arguments:
+            chunk_size(int):   As in `box_query_chunks`.
+            fields(str,list):  As in `sphere_query`.
+            accuracy(str):     As in `sphere_query`.
+            populations(str,list):  As in `sphere_query`.
+            population_mode(str):  As in `sphere_query`.
+        """
+        pass
+
+    @abc.abstractmethod
+    def box_counts_batch(self, corners, opposite_corners, *,
+                         accuracy=None, n_threads=1,
+                         populations=None, population_mode=None):
+        """Counts all elements intersecting with each of the query boxes.
+
+        Returns an array with one count per query box.
+
+        Arguments:
+            accuracy(str):  As in `box_counts`.
+            n_threads(int):  As in `box_query_batch`.
+            populations(str,list):  As in `box_counts`.
+            population_mode(str):  As in `box_counts`.
+        """
+        pass
+
+    @abc.abstractmethod
+    def sphere_counts_batch(self, centers, radii, *,
+                            accuracy=None, n_threads=1,
+                            populations=None, population_mode=None):
+        """Counts all elements intersecting with each of the query spheres.
+
+        Returns an array with one count per query sphere.
+
+        Arguments:
+            accuracy(str):  As in `sphere_counts`.
+            n_threads(int):  As in `box_query_batch`.
+            populations(str,list):  As in `sphere_counts`.
+            population_mode(str):  As in `sphere_counts`.
+        """
+        pass
+
     @abc.abstractmethod
     def bounds(self, populations=None, population_mode=None):
         """The joint minimal bounding box of all elements in the index.
@@ -326,6 +451,70 @@ class Index(IndexInterface):
             methods=self._sphere_counts
         )
 
+    @_wrap_single_as_multi_population
+    def box_query_batch(self, corners, opposite_corners, *,
+                        fields=None, accuracy=None, n_threads=1):
+        return self._batch_query(
+            (corners, opposite_corners),
+            fields=fields,
+            accuracy=accuracy,
+            n_threads=n_threads,
+            method=self._core_index._find_intersecting_box_batch_np,
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_query_batch(self, centers, radii, *,
+                           fields=None, accuracy=None, n_threads=1):
+        return self._batch_query(
+            (centers, radii),
+            fields=fields,
+            accuracy=accuracy,
+            n_threads=n_threads,
+            method=self._core_index._find_intersecting_batch_np,
+        )
+
+    @_wrap_single_as_multi_population
+    def box_query_chunks(self, corner, opposite_corner, *,
+                         chunk_size=DEFAULT_CHUNK_SIZE, fields=None, accuracy=None):
+        return self._chunked_query(
+            (corner, opposite_corner),
+            chunk_size=chunk_size,
+            fields=fields,
+            accuracy=accuracy,
+            method=self._core_index._box_query_cursor,
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_query_chunks(self, center, radius, *,
+                            chunk_size=DEFAULT_CHUNK_SIZE, fields=None, accuracy=None):
+        return self._chunked_query(
+            (center, radius),
+            chunk_size=chunk_size,
+            fields=fields,
+            accuracy=accuracy,
+            method=self._core_index._sphere_query_cursor,
+        )
+
+    @_wrap_single_as_multi_population
+    def box_counts_batch(self, corners, opposite_corners, *,
+                         accuracy=None, n_threads=1):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        return self._core_index._count_intersecting_batch(
+            corners, opposite_corners,
+            geometry=accuracy,
+            n_threads=n_threads
+        )
+
+    @_wrap_single_as_multi_population
+    def sphere_counts_batch(self, centers, radii, *,
+                            accuracy=None, n_threads=1):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        return self._core_index._count_intersecting_sphere_batch(
+            centers, radii,
+            geometry=accuracy,
+            n_threads=n_threads
+        )
+
     @_wrap_single_as_multi_population
     def box_empty(self, corner, opposite_corner, *, accuracy=None):
         accuracy = self._enforce_accuracy_default(accuracy)
@@ -385,7 +574,7 @@ class Index(IndexInterface):
                                fields=None, accuracy=None, methods=None):
 
         result = methods["_np"](*query_shape, geometry=accuracy)
-        return {k: result[k] for k in fields}
+        return {k: self._extract_field(result, k) for k in fields}
 
     def _single_field_box_query(self, query_shape, *,
                                 field=None, accuracy=None, methods=None):
@@ -395,7 +584,49 @@ class Index(IndexInterface):
 
         else:
             result = methods["_np"](*query_shape, geometry=accuracy)
-            return result[field]
+            return self._extract_field(result, field)
+
+    def _extract_field(self, result, field):
+        """Returns the field `field` of the numpy query result `result`."""
+        return result[field]
+
+    def _batch_query(self, query_shapes, *,
+                     fields=None, accuracy=None, n_threads=1, method=None):
+        accuracy = self._enforce_accuracy_default(accuracy)
+        result, offsets = method(*query_shapes, geometry=accuracy, n_threads=n_threads)
+
+        # The concatenated results have the same format as the results of a
+        # single query. Therefore, the fields can be selected in the same way.
+        methods = {"_np": lambda *args, **kwargs: result}
+        values = self._query((), fields=fields, accuracy=accuracy, methods=methods)
+
+        return values, offsets
+
+    def _chunked_query(self, query_shape, *,
+                       chunk_size=None, fields=None, accuracy=None, method=None):
+        if chunk_size <= 0:
+            raise ValueError(f"Invalid chunk_size: {chunk_size}")
+
+        # Arguments are checked here, rather than when the first chunk is
+        # requested.
+        fields = self._enforce_fields_default(fields)
+        accuracy = self._enforce_accuracy_default(accuracy)
+        cursor = method(*query_shape, geometry=accuracy)
+
+        def chunks():
+            while True:
+                result, n_elements = cursor.next(chunk_size)
+
+                if n_elements > 0:
+                    methods = {"_np": lambda *args, **kwargs: result}
+                    yield self._query(
+                        (), fields=fields, accuracy=accuracy, methods=methods
+                    )
+
+                if n_elements < chunk_size:
+                    return
+
+        return chunks()
 
     def _enforce_accuracy_default(self, accuracy):
         if accuracy is None:
@@ -560,17 +791,21 @@ class SynapseIndexBase(SONATAIndex):
 
 
 class _WriteSONATAInMemoryIndex:
-    def write(self, index_path, *, sonata_filename=None, population=None):
+    def write(self, index_path, *, sonata_filename=None, population=None,
+              memory_mapped=False):
         """Saves the index to disk.
 
         If both ``sonata_filename`` and ``population`` are passed, then the
         additional metadata needed to load an index supporting fetching
         attributes from SONATA is also saved.
 
+        If ``memory_mapped`` is ``True`` the index is written such that
+        ``open_index`` maps it into memory read-only, instead of loading it.
+
         No action is performed if ``index_path`` is ``None``.
         """
         if index_path is not None:
-            self._core_index._dump(index_path)
+            self._core_index._dump(index_path, memory_mapped=memory_mapped)
 
             if sonata_filename is not None and population is not None:
                 write_sonata_meta_data_section(
@@ -578,11 +813,78 @@ class _WriteSONATAInMemoryIndex:
                 )
 
 
+class _MultiIndexCache:
+    def box_preload(self, corner, opposite_corner, *, pin=False, wait=False):
+        """Load the subtrees intersecting the box in the background.
+
+        The subtrees are loaded in parallel while queries are being served; a
+        query only waits for the subtrees it needs. Only as many subtrees as
+        fit into the cache are loaded, unless ``pin=True``; pinned subtrees
+        are never evicted, until ``unpin_all`` is called. If ``wait=True``
+        this returns once the subtrees are loaded.
+
+        Returns the number of subtrees requested.
+        """
+        return self._core_index._preload_box(corner, opposite_corner, pin=pin, wait=wait)
+
+    def sphere_preload(self, center, radius, *, pin=False, wait=False):
+        """Load the subtrees intersecting the sphere in the background.
+
+        See ``box_preload``.
+        """
+        return self._core_index._preload_sphere(center, radius, pin=pin, wait=wait)
+
+    def warm_up(self, *, wait=False):
+        """Fill the cache with subtrees in the background.
+
+        Returns the number of subtrees requested.
+        """
+        return self._core_index._warm_up(wait=wait)
+
+    def unpin_all(self):
+        """Allow all pinned subtrees to be evicted again."""
+        self._core_index._unpin_all()
+
+    def stats(self):
+        """Statistics of the subtree cache and the queries of this process.
+
+        Returns a dictionary with the following counters:
+
+          - ``n_hits``, ``n_misses``: subtrees needed by a query which were
+            already in cache, or had to be loaded.
+          - ``n_evictions``: subtrees evicted from the cache.
+          - ``n_resident_bytes``: memory used by the cached subtrees, this is
+            the current value rather than a counter.
+          - ``n_bytes_read``: size on disk of the subtrees loaded.
+          - ``load_latency_histogram``: entry ``k`` counts the subtrees which
+            took less than ``2**k`` microseconds to load, but at least
+            ``2**(k-1)``. The last entry also counts all slower loads.
+          - ``load_latency_us``: total time needed to load subtrees.
+          - ``n_queries``: number of queries.
+          - ``n_subtrees_visited``: subtrees the queries were routed to by
+            the top-level tree; divided by ``n_queries`` it's the fan-out.
+          - ``n_elements_scanned``, ``n_elements_returned``: elements in the
+            subtrees visited, and elements matching the queries.
+
+        The counters are accumulated since the index was opened, or since
+        ``reset_stats`` was called.
+        """
+        return self._core_index._stats()
+
+    def reset_stats(self):
+        """Set all counters of ``stats`` to zero."""
+        self._core_index._reset_stats()
+
+
 class SynapseIndex(SynapseIndexBase, _WriteSONATAInMemoryIndex):
     pass
 
 
-class SynapseMultiIndex(SynapseIndexBase):
+class SynapseMultiIndex(SynapseIndexBase, _MultiIndexCache):
+    pass
+
+
+class SynapseMemoryMappedIndex(SynapseIndexBase):
     pass
 
 
@@ -620,25 +922,70 @@ class MorphIndexBase(SONATAIndex):
         """
         return "gid"
 
+    def _extract_field(self, result, field):
+        # The composite ids are only assembled if they're requested.
+        if field == "ids":
+            return _morph_ids(result)
+
+        return super()._extract_field(result, field)
+
+
+def _morph_ids(result):
+    """Assembles the field `"ids"` from `"gid"`, `"section_id"`, `"segment_id"`."""
+    ids = np.empty(
+        result["gid"].shape[0],
+        dtype=[("gid", np.uint64), ("section_id", np.uint32), ("segment_id", np.uint32)]
+    )
+
+    ids["gid"] = result["gid"]
+    ids["section_id"] = result["section_id"]
+    ids["segment_id"] = result["segment_id"]
+
+    return ids
+
 
 class _WriteInMemoryIndex:
-    def write(self, index_path):
+    def write(self, index_path, *, memory_mapped=False):
         """Saves the index to disk.
 
+        If `memory_mapped` is `True` the index is written such that
+        `open_index` maps it into memory read-only, instead of loading it.
+
         No action is performed if `index_path` is `None`.
         """
         if index_path is not None:
-            self._core_index._dump(index_path)
+            self._core_index._dump(index_path, memory_mapped=memory_mapped)
 
 
 class MorphIndex(MorphIndexBase, _WriteSONATAInMemoryIndex):
     pass
 
 
-class MorphMultiIndex(MorphIndexBase):
+class MorphMultiIndex(MorphIndexBase, _MultiIndexCache):
     pass
 
 
+class MorphMemoryMappedIndex(MorphIndexBase):
+    pass
+
+
+class MorphBlockIndex(MorphIndexBase):
+    """A read-only morphology index which stores segments in blocks.
+
+    Spatially close segments are grouped into small blocks, stored as a
+    structure of arrays. Compared to ``MorphIndex`` this needs less memory per
+    segment and speeds up the intersection tests of dense segment indexes.
+    Queries return the same results as for the ``MorphIndex`` it was created
+    from.
+    """
+
+    @classmethod
+    def from_morph_index(cls, index):
+        """Create a ``MorphBlockIndex`` containing the elements of ``index``."""
+        core_index = brain_indexer.core.MorphBlockIndex(index._core_index)
+        return cls(core_index, getattr(index, "_sonata_dataset", None))
+
+
 class SphereIndexBase(Index, _FromMetaDataWithOutSonata):
     @property
     def element_type(self):
@@ -658,6 +1005,10 @@ class SphereIndex(SphereIndexBase, _WriteInMemoryIndex):
         self._core_index._add_spheres(centroids, radii, ids)
 
 
+class SphereMemoryMappedIndex(SphereIndexBase):
+    pass
+
+
 class PointIndexBase(Index, _FromMetaDataWithOutSonata):
     @property
     def element_type(self):
@@ -668,6 +1019,10 @@ class PointIndex(PointIndexBase, _WriteInMemoryIndex):
     pass
 
 
+class PointMemoryMappedIndex(PointIndexBase):
+    pass
+
+
 def _wrap_as_multi_population(func):
     @functools.wraps(func)
     def _multi_pop_func(self, *args, population_mode=None, populations=None, **kwargs):
@@ -716,6 +1071,30 @@ class MultiPopulationIndex(IndexInterface):
     def sphere_empty(self, index, *args, **kwargs):
         return index.sphere_empty(*args, **kwargs)
 
+    @_wrap_as_multi_population
+    def box_query_batch(self, index, *args, **kwargs):
+        return index.box_query_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_query_batch(self, index, *args, **kwargs):
+        return index.sphere_query_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def box_query_chunks(self, index, *args, **kwargs):
+        return index.box_query_chunks(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_query_chunks(self, index, *args, **kwargs):
+        return index.sphere_query_chunks(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def box_counts_batch(self, index, *args, **kwargs):
+        return index.box_counts_batch(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def sphere_counts_batch(self, index, *args, **kwargs):
+        return index.sphere_counts_batch(*args, **kwargs)
+
     @_wrap_as_multi_population
     def bounds(self, index, *args, **kwargs):
         return index.bounds(*args, **kwargs)
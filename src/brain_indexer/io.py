@@ -96,6 +96,7 @@ class MetaData:
     def index_variant(self):
         known_index_variants = [
             MetaData._Constants.in_memory_key,
+            MetaData._Constants.memory_mapped_key,
             MetaData._Constants.multi_index_key
         ]
 
@@ -114,6 +115,10 @@ class MetaData:
     def in_memory(self):
         return self._sub_config(MetaData._Constants.in_memory_key)
 
+    @property
+    def memory_mapped(self):
+        return self._sub_config(MetaData._Constants.memory_mapped_key)
+
     @property
     def multi_index(self):
         return self._sub_config(MetaData._Constants.multi_index_key)
@@ -134,16 +139,30 @@ class MetaData:
         return core.deduce_meta_data_path(path)
 
 
-def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, resolver=None):
+def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, eviction_policy=None,
+                             shared_cache_size_mb=None, resolver=None):
     if in_memory_conf := meta_data.in_memory:
         return resolver.core_class("in_memory")(in_memory_conf.index_path)
 
+    elif memory_mapped_conf := meta_data.memory_mapped:
+        return resolver.core_class("memory_mapped")(memory_mapped_conf.index_path)
+
     elif multi_index_conf := meta_data.multi_index:
         max_cache_size_mb = max_cache_size_mb or 1024
         mem = 1024 ** 2 * max_cache_size_mb
 
+        if shared_cache_size_mb is not None:
+            return resolver.core_class("shared_memory_multi_index")(
+                multi_index_conf.index_path,
+                max_cached_bytes=mem,
+                max_shared_bytes=1024 ** 2 * shared_cache_size_mb,
+                eviction_policy=eviction_policy or "usage_rate",
+            )
+
         return resolver.core_class("multi_index")(
-            multi_index_conf.index_path, max_cached_bytes=mem
+            multi_index_conf.index_path,
+            max_cached_bytes=mem,
+            eviction_policy=eviction_policy or "usage_rate",
         )
 
     else:
@@ -44,6 +44,8 @@ class MorphologyLib:
 
 
 class MorphIndexBuilderBase:
+    N_ELEMENTS_CHUNK = 100
+
     def __init__(self, morphology_dir, nodes_file, population=None, gids=None):
         """Initializes a node index builder
 
@@ -183,9 +185,10 @@ class MorphIndexBuilder(MorphIndexBuilderBase,
     """A MorphIndexBuilder is a helper class to create a `MorphIndex`
     from a SONATA nodes file and a morphology library.
     """
-    def __init__(self, morphology_dir, nodes_file, population=None, gids=None):
+    def __init__(self, morphology_dir, nodes_file, population=None, gids=None,
+                 n_threads=1):
         super().__init__(morphology_dir, nodes_file, population, gids)
-        self._core_builder = core.MorphIndexBulkBuilder()
+        self._core_builder = core.MorphIndexBulkBuilder(n_threads=n_threads)
         self._warn_when_too_large()
 
     def _warn_when_too_large(self):
@@ -214,23 +217,26 @@ class MorphIndexBuilder(MorphIndexBuilderBase,
             self._core_index._dump(output_dir)
 
 
-# Only provide MPI MultiIndex builders if enabled at the core
-if hasattr(core, "MorphMultiIndexBulkBuilder"):
+class MorphMultiIndexBuilder(MultiIndexBuilderMixin,
+                             _WriteSONATAMetadataMultiMixin,
+                             MorphIndexBuilderBase):
 
-    class MorphMultiIndexBuilder(MultiIndexBuilderMixin,
-                                 _WriteSONATAMetadataMultiMixin,
-                                 MorphIndexBuilderBase):
+    def __init__(self, morphology_dir, nodes_file, population=None, gids=None,
+                 output_dir=None, n_threads=None, max_memory_mb=None, scratch_dir=None):
+        super().__init__(morphology_dir, nodes_file, population=population, gids=gids)
 
-        def __init__(self, morphology_dir, nodes_file, population=None, gids=None,
-                     output_dir=None):
-            super().__init__(morphology_dir, nodes_file, population=population, gids=gids)
-
-            assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
-            self._core_builder = core.MorphMultiIndexBulkBuilder(output_dir)
+        self._core_builder = self._make_core_builder(
+            core.MorphMultiIndexBulkBuilder,
+            core.MorphOutOfCoreMultiIndexBulkBuilder,
+            output_dir,
+            n_threads=n_threads,
+            max_memory_mb=max_memory_mb,
+            scratch_dir=scratch_dir,
+        )
 
-        @property
-        def _index_if_loaded(self):
-            return None
+    @property
+    def _index_if_loaded(self):
+        return None
 
-        def _write_index_if_needed(self, output_dir):
-            pass
+    def _write_index_if_needed(self, output_dir):
+        pass
@@ -1,13 +1,14 @@
 from brain_indexer import core
 
-from .morphology_builder import MorphIndexBuilder
-from .synapse_builder import SynapseIndexBuilder
+from .morphology_builder import MorphIndexBuilder, MorphMultiIndexBuilder
+from .synapse_builder import SynapseIndexBuilder, SynapseMultiIndexBuilder
 
 from .builder import SphereIndexBuilder, PointIndexBuilder
 
-from .index import MorphIndex, MorphMultiIndex
-from .index import SynapseIndex, SynapseMultiIndex
+from .index import MorphIndex, MorphMultiIndex, MorphMemoryMappedIndex
+from .index import SynapseIndex, SynapseMultiIndex, SynapseMemoryMappedIndex
 from .index import SphereIndex, PointIndex
+from .index import SphereMemoryMappedIndex, PointMemoryMappedIndex
 from .index import MultiPopulationIndex
 
 from .io import MetaData
@@ -47,10 +48,12 @@ class PointIndexResolver(_SingleKindIndexResolverBase):
     """
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.PointIndex,
+        core._MetaDataConstants.memory_mapped_key: core.PointMemoryMappedIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: PointIndex,
+        core._MetaDataConstants.memory_mapped_key: PointMemoryMappedIndex,
     }
 
     _builder_classes = {
@@ -65,10 +68,12 @@ class SphereIndexResolver(_SingleKindIndexResolverBase):
     """
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.SphereIndex,
+        core._MetaDataConstants.memory_mapped_key: core.SphereMemoryMappedIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: SphereIndex,
+        core._MetaDataConstants.memory_mapped_key: SphereMemoryMappedIndex,
     }
 
     _builder_classes = {
@@ -81,61 +86,50 @@ class SynapseIndexResolver(_SingleKindIndexResolverBase):
 
     This class is for all classes related to indexes of synapses.
     """
-    try:
-        from .synapse_builder import SynapseMultiIndexBuilder  # noqa
-        si_has_mpi = True
-    except ImportError:
-        si_has_mpi = False
-
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.SynapseIndex,
+        core._MetaDataConstants.memory_mapped_key: core.SynapseMemoryMappedIndex,
         core._MetaDataConstants.multi_index_key: core.SynapseMultiIndex,
+        "shared_memory_multi_index": core.SynapseSharedMemoryMultiIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: SynapseIndex,
+        core._MetaDataConstants.memory_mapped_key: SynapseMemoryMappedIndex,
         core._MetaDataConstants.multi_index_key: SynapseMultiIndex,
+        "shared_memory_multi_index": SynapseMultiIndex,
     }
 
     _builder_classes = {
         core._MetaDataConstants.in_memory_key: SynapseIndexBuilder,
+        core._MetaDataConstants.multi_index_key: SynapseMultiIndexBuilder,
     }
 
-    if si_has_mpi:
-        key = core._MetaDataConstants.multi_index_key
-        _builder_classes[key] = SynapseMultiIndexBuilder
-
 
 class MorphIndexResolver(_SingleKindIndexResolverBase):
     """Provides string to class mapping.
 
     This class is for all classes related to indexes of morphologies.
     """
-    try:
-        from .morphology_builder import MorphMultiIndexBuilder  # noqa
-        si_has_mpi = True
-    except ImportError:
-        MorphMultiIndexBuilder = None
-        si_has_mpi = False
-
     _core_classes = {
         core._MetaDataConstants.in_memory_key: core.MorphIndex,
+        core._MetaDataConstants.memory_mapped_key: core.MorphMemoryMappedIndex,
         core._MetaDataConstants.multi_index_key: core.MorphMultiIndex,
+        "shared_memory_multi_index": core.MorphSharedMemoryMultiIndex,
     }
 
     _index_classes = {
         core._MetaDataConstants.in_memory_key: MorphIndex,
+        core._MetaDataConstants.memory_mapped_key: MorphMemoryMappedIndex,
         core._MetaDataConstants.multi_index_key: MorphMultiIndex,
+        "shared_memory_multi_index": MorphMultiIndex,
     }
 
     _builder_classes = {
         core._MetaDataConstants.in_memory_key: MorphIndexBuilder,
+        core._MetaDataConstants.multi_index_key: MorphMultiIndexBuilder,
     }
 
-    if si_has_mpi:
-        key = core._MetaDataConstants.multi_index_key
-        _builder_classes[key] = MorphMultiIndexBuilder
-
 
 class IndexResolver:
     """Provides string to class mapping.
@@ -195,7 +189,8 @@ def _open_multi_population_index(meta_data, **kwargs):
     return MultiPopulationIndex(indexes)
 
 
-def open_index(path, max_cache_size_mb=None):
+def open_index(path, max_cache_size_mb=None, eviction_policy=None,
+               shared_cache_size_mb=None):
     """Open an index.
 
     Indexes are stored in folders, these folders contain the actual index and
@@ -205,11 +200,24 @@ def open_index(path, max_cache_size_mb=None):
 
     When opening multi-indexes one must specify the amount of memory the index
     is allowed to consume. This is done through ``max_cache_size_mb`` which is
-    the size maximum amount of memory all loaded indexed elements may consume,
-    in MB. Note that this does not include the space required for the tree
-    structure itself. The User Guide contains more information about how a
-    multi-index works and how the cache size affects performance. Regular,
-    in-memory indexes will ignore this flag.
+    the maximum amount of memory all loaded subtrees may consume, in MB. This
+    includes the space required for the tree structure itself. The User Guide
+    contains more information about how a multi-index works and how the cache
+    size affects performance. Regular, in-memory indexes will ignore this flag.
+
+    The ``eviction_policy`` of multi-indexes decides which subtree is evicted
+    when the cache is full. It's one of ``"usage_rate"`` (default), ``"lru"``,
+    ``"lfu"``, ``"clock"`` or ``"arc"``. Except for ``"usage_rate"``, the
+    policies take constant time, which matters if many small subtrees are
+    cached.
+
+    If ``shared_cache_size_mb`` is given, the subtrees of multi-indexes are
+    placed in POSIX shared memory, and shared by all processes on the node
+    which open the same index with ``shared_cache_size_mb``. Hence, each
+    subtree is read from disk once per node. At most ``shared_cache_size_mb``
+    MB of subtrees are kept in shared memory, the first process to open the
+    index decides the size. Each process still uses at most
+    ``max_cache_size_mb`` MB of them.
     """
 
     meta_data = MetaData(path)
@@ -217,11 +225,15 @@ def open_index(path, max_cache_size_mb=None):
     if meta_data.multi_population:
         return _open_multi_population_index(
             meta_data,
-            max_cache_size_mb=max_cache_size_mb
+            max_cache_size_mb=max_cache_size_mb,
+            eviction_policy=eviction_policy,
+            shared_cache_size_mb=shared_cache_size_mb,
         )
 
     else:
         return _open_single_population_index(
             meta_data,
-            max_cache_size_mb=max_cache_size_mb
+            max_cache_size_mb=max_cache_size_mb,
+            eviction_policy=eviction_policy,
+            shared_cache_size_mb=shared_cache_size_mb,
         )
@@ -86,7 +86,7 @@ class SynapseIndexBuilderBase:
     @classmethod
     def from_sonata_tgids(cls, sonata_edges, target_gids, **kw):
         """Creates a synapse index from an edge file and a set of target GIDs."""
-        selection = cls._make_sonata_selection(sonata_edges, target_gids)
+        selection = cls._make_sonata_selection(sonata_edges, target_gids, **kw)
         return cls.from_sonata_selection(sonata_edges, selection, **kw)
 
     @classmethod
@@ -111,9 +111,9 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
     # set in `SynapseIndexBuilderBase` not `ChunkedProcessingMixin`.
     N_ELEMENTS_CHUNK = SynapseIndexBuilderBase.N_ELEMENTS_CHUNK
 
-    def __init__(self, sonata_edges, selection):
+    def __init__(self, sonata_edges, selection, n_threads=1):
         super().__init__(sonata_edges, selection)
-        self._core_builder = core.SynapseIndexBulkBuilder()
+        self._core_builder = core.SynapseIndexBulkBuilder(n_threads=n_threads)
         self._warn_when_too_large()
 
     def _warn_when_too_large(self):
@@ -142,83 +142,97 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
             self._core_index._dump(output_dir)
 
 
-# Only provide MPI MultiIndex builders if enabled at the core
-if hasattr(core, "SynapseMultiIndexBulkBuilder"):
-
-    class SynapseMultiIndexBuilder(MultiIndexBuilderMixin,
-                                   _WriteSONATAMetadataMultiMixin,
-                                   SynapseIndexBuilderBase):
-        """Builder for multi-index synapse indexes.
+class SynapseMultiIndexBuilder(MultiIndexBuilderMixin,
+                               _WriteSONATAMetadataMultiMixin,
+                               SynapseIndexBuilderBase):
+    """Builder for multi-index synapse indexes.
 
-        Note: this requires MPI support. Guidance on choosing the number of
-        MPI ranks can be found in the User Guide.
-        """
-        def __init__(self, sonata_edges, selection, output_dir=None):
-            super().__init__(sonata_edges, selection)
+    Note: unless `n_threads` or `max_memory_mb` is passed, this requires MPI
+    support. Guidance on choosing the number of MPI ranks can be found in the
+    User Guide.
+    """
+    def __init__(self, sonata_edges, selection, output_dir=None, n_threads=None,
+                 max_memory_mb=None, scratch_dir=None):
+        self._use_threads = self._uses_threads(n_threads, max_memory_mb)
+        super().__init__(sonata_edges, selection)
 
-            assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
-            self._core_builder = core.SynapseMultiIndexBulkBuilder(output_dir)
+        self._core_builder = self._make_core_builder(
+            core.SynapseMultiIndexBulkBuilder,
+            core.SynapseOutOfCoreMultiIndexBulkBuilder,
+            output_dir,
+            n_threads=n_threads,
+            max_memory_mb=max_memory_mb,
+            scratch_dir=scratch_dir,
+        )
 
-        @classmethod
-        def constructor_rank(cls, mpi_comm=None):
-            """The MPI rank of the *constructor rank*.
+    @classmethod
+    def constructor_rank(cls, mpi_comm=None):
+        """The MPI rank of the *constructor rank*.
+
+        The *constructor rank* is the rank on which all argument to the
+        constructor need to have valid values. Some keyword-arguments
+        point to MB of data, e.g. ``target_gids``; those sometimes don't
+        need to present on all MPI ranks. When a particular keyword argument
+        is optional this is clearly stated in the API documentation stated in
+        the API documentation.
+
+        Please consult the User Guide for tips on using SI in an MPI parallel
+        setting.
+        """
 
-            The *constructor rank* is the rank on which all argument to the
-            constructor need to have valid values. Some keyword-arguments
-            point to MB of data, e.g. ``target_gids``; those sometimes don't
-            need to present on all MPI ranks. When a particular keyword argument
-            is optional this is clearly stated in the API documentation stated in
-            the API documentation.
+        if mpi_comm is None:
+            from mpi4py import MPI
+            mpi_comm = MPI.COMM_WORLD
 
-            Please consult the User Guide for tips on using SI in an MPI parallel
-            setting.
-            """
+        return mpi_comm.Get_size() - 1
 
-            if mpi_comm is None:
-                from mpi4py import MPI
-                mpi_comm = MPI.COMM_WORLD
+    @property
+    def _index_if_loaded(self):
+        return None
 
-            return mpi_comm.Get_size() - 1
+    def _write_index_if_needed(self, output_dir):
+        pass
 
-        @property
-        def _index_if_loaded(self):
-            return None
+    @classmethod
+    def _mpi_comm(cls):
+        from mpi4py import MPI
 
-        def _write_index_if_needed(self, output_dir):
-            pass
+        return MPI.COMM_WORLD
 
-        @classmethod
-        def _mpi_comm(cls):
-            from mpi4py import MPI
+    @classmethod
+    def _make_sonata_selection(cls, sonata_edges, target_gids, n_threads=None,
+                               max_memory_mb=None, **kw):
+        if cls._uses_threads(n_threads, max_memory_mb):
+            return SynapseIndexBuilderBase._make_sonata_selection(
+                sonata_edges, target_gids
+            )
 
-            return MPI.COMM_WORLD
+        comm = cls._mpi_comm()
+        mpi_rank = comm.Get_rank()
+        root = cls.constructor_rank(mpi_comm=comm)
 
-        @classmethod
-        def _make_sonata_selection(cls, sonata_edges, target_gids, **kw):
-            comm = cls._mpi_comm()
-            mpi_rank = comm.Get_rank()
-            root = cls.constructor_rank(mpi_comm=comm)
+        if mpi_rank == root:
+            selection = SynapseIndexBuilderBase._make_sonata_selection(
+                sonata_edges, target_gids
+            )
+        else:
+            selection = None
 
-            if mpi_rank == root:
-                selection = SynapseIndexBuilderBase._make_sonata_selection(
-                    sonata_edges, target_gids
-                )
-            else:
-                selection = None
+        return bcast_sonata_selection(selection, root=root, mpi_comm=comm)
 
-            return bcast_sonata_selection(selection, root=root, mpi_comm=comm)
+    def _normalize_selection(self, selection):
+        if self._use_threads:
+            return super()._normalize_selection(selection)
 
-        @classmethod
-        def _normalize_selection(cls, selection):
-            comm = cls._mpi_comm()
-            comm_size = comm.Get_size()
+        comm = self._mpi_comm()
+        comm_size = comm.Get_size()
 
-            chunk_size = cls.MAX_SYN_COUNT_RANGE
-            while chunk_size >= 1:
-                candidate_selection = chunk_sonata_selection(selection, chunk_size)
-                if len(candidate_selection.ranges) >= comm_size - 1:
-                    return candidate_selection
+        chunk_size = self.MAX_SYN_COUNT_RANGE
+        while chunk_size >= 1:
+            candidate_selection = chunk_sonata_selection(selection, chunk_size)
+            if len(candidate_selection.ranges) >= comm_size - 1:
+                return candidate_selection
 
-                chunk_size = chunk_size // 8
+            chunk_size = chunk_size // 8
 
-            raise ValueError("Unable to create a suitable selection.")
+        raise ValueError("Unable to create a suitable selection.")
@@ -0,0 +1 @@
+#include <brain_indexer/eviction_policy.hpp>
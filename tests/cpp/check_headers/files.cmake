@@ -12,4 +12,14 @@ target_sources(si_check_headers
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/index.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_sorting.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_analysis.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/work_stealing.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/morph_block_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/thread_pool.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/eviction_policy.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/shared_subtree_cache.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/packed_container.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/multi_index_stats.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/parallel_bulk_loading.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/external_sort_tile_recursion.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/radix_sort.cpp
 )
@@ -0,0 +1 @@
+#include <brain_indexer/morph_block_index.hpp>
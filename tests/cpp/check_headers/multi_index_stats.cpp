@@ -0,0 +1 @@
+#include <brain_indexer/multi_index_stats.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/packed_container.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/parallel_bulk_loading.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/radix_sort.hpp>
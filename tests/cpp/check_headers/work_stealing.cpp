@@ -0,0 +1 @@
+#include <brain_indexer/work_stealing.hpp>
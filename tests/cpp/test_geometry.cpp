@@ -4,6 +4,7 @@
 #include <random>
 #include <vector>
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/morph_block_index.hpp>
 #include <brain_indexer/util.hpp>
 
 using namespace brain_indexer;
@@ -746,3 +747,191 @@ BOOST_AUTO_TEST_CASE(CylinderSelectedCases) {
     }
 }
 BOOST_AUTO_TEST_SUITE_END()
+
+
+//////////////////////////////////////////////////////////////////
+// Distance from a point
+//////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_SUITE(PointDistance)
+BOOST_AUTO_TEST_CASE(CylinderSelectedCases) {
+    auto eps = CoordType(1e3) * std::numeric_limits<CoordType>::epsilon();
+
+    auto c = Cylinder{{-1.0, 0.0, 0.0}, {1.0, 0.0, 0.0}, 2.0};
+    auto rc = Cylinder{c.p2, c.p1, c.radius};
+
+    auto test_cases = std::vector<std::pair<Point3D, CoordType>>{
+        // Inside.
+        { {0.0, 0.0, 0.0}, 0.0 },
+        { {1.0, 1.0, 1.0}, 0.0 },
+
+        // Next to the round part.
+        { {0.5, 5.0, 0.0}, 3.0 },
+        { {0.5, 3.0, 4.0}, 3.0 },
+
+        // Beyond a cap, within the radius; the caps are round.
+        { {4.0, 1.0, 0.0}, std::sqrt(CoordType(10.0)) - 2.0 },
+        { {2.0, 1.0, 0.0}, 0.0 },
+
+        // Beyond a cap, outside the radius.
+        { {-4.0, 0.0, 6.0}, std::sqrt(CoordType(45.0)) - 2.0 },
+    };
+
+    for(const auto& [x, expected] : test_cases) {
+        for(const auto& cyl : {c, rc}) {
+            BOOST_CHECK_MESSAGE(
+                std::abs(cyl.distance(x) - expected) < eps,
+                cyl << ", " << Point3Dx(x) << ", " << expected
+            );
+        }
+    }
+
+    // Without an axis, the cylinder is treated as a sphere.
+    auto degenerate = Cylinder{{1.0, 0.0, 0.0}, {1.0, 0.0, 0.0}, 2.0};
+    BOOST_CHECK(std::abs(degenerate.distance(Point3D{1.0, 3.0, 4.0}) - 3.0) < eps);
+}
+
+BOOST_AUTO_TEST_CASE(CylinderCapsMatchIntersects) {
+    auto gen = std::mt19937{0};
+    auto coord = std::uniform_real_distribution<CoordType>(-2.0, 2.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.1, 1.0);
+
+    size_t n_in_caps = 0;
+    for(size_t i = 0; i < 1000; ++i) {
+        auto c = Cylinder{Point3D{coord(gen), coord(gen), coord(gen)},
+                          Point3D{coord(gen), coord(gen), coord(gen)},
+                          radius(gen)};
+
+        // A point beyond the cap at `p1`, within a few radii of `p1`.
+        auto axis = Point3Dx(c.p2) - c.p1;
+        auto offset = Point3Dx{coord(gen), coord(gen), coord(gen)};
+        if(offset.dot(axis) > 0) {
+            offset = offset * CoordType(-1);
+        }
+        auto x = Point3D(Point3Dx(c.p1) + offset * c.radius);
+
+        auto is_inside = c.intersects(Box3D{x, x});
+        n_in_caps += is_inside && !c.contains(x);
+
+        BOOST_CHECK_EQUAL(c.distance(x) == CoordType(0), is_inside);
+
+        // Points intersect the cylinder with flat caps.
+        BOOST_CHECK_EQUAL(c.intersects(x), c.contains(x));
+    }
+
+    // Some points are in the round part of a cap, but not in the flat cylinder.
+    BOOST_TEST(n_in_caps > 0ul);
+}
+
+BOOST_AUTO_TEST_CASE(NotLessThanBoundingBox) {
+    auto gen = std::mt19937{0};
+    auto coord = std::uniform_real_distribution<CoordType>(-2.0, 2.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.01, 0.5);
+
+    auto eps = CoordType(1e3) * std::numeric_limits<CoordType>::epsilon();
+    for(size_t i = 0; i < 1000; ++i) {
+        auto p1 = Point3D{coord(gen), coord(gen), coord(gen)};
+        auto p2 = Point3D{coord(gen), coord(gen), coord(gen)};
+        auto x = Point3D{coord(gen), coord(gen), coord(gen)};
+
+        auto c = Cylinder{p1, p2, radius(gen)};
+        auto s = Sphere{p1, radius(gen)};
+
+        BOOST_CHECK(geometry_distance(x, c) + eps >= geometry_distance(x, c.bounding_box()));
+        BOOST_CHECK(geometry_distance(x, s) + eps >= geometry_distance(x, s.bounding_box()));
+        BOOST_CHECK_EQUAL(c.intersects(Box3D{x, x}) && bg::covered_by(x, c.bounding_box()),
+                          geometry_distance(x, c) == CoordType(0));
+    }
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+
+//////////////////////////////////////////////////////////////////
+// Leaf Kernels
+//////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_SUITE(LeafKernels)
+
+// Some segments are degenerate or parallel to the query, to cover all branches
+// of the scalar versions.
+SegmentArrays random_segment_arrays(size_t n, std::mt19937& gen) {
+    auto coord = std::uniform_real_distribution<CoordType>(-2.0, 2.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.0, 0.5);
+    auto kind = std::uniform_int_distribution<int>(0, 3);
+
+    SegmentArrays segments;
+    for(size_t i = 0; i < n; ++i) {
+        auto p1 = Point3D{coord(gen), coord(gen), coord(gen)};
+        auto p2 = Point3D{coord(gen), coord(gen), coord(gen)};
+
+        auto k = kind(gen);
+        if(k == 0) {
+            p2 = p1;
+        } else if(k == 1) {
+            p2 = Point3D{p2.get<0>(), p1.get<1>(), p1.get<2>()};
+        }
+
+        segments.push_back(Segment(identifier_t(i), 0u, 0u, p1, p2, radius(gen)));
+    }
+
+    return segments;
+}
+
+template <class GeometryMode, class Shape>
+void check_leaf_kernel(const Shape& shape, const SegmentArrays& segments) {
+    auto query_box = bgi::indexable<Shape>{}(shape);
+
+    detail::SegmentBatch batch;
+    detail::LeafLanes<detail::lane_mask_t> is_match;
+
+    for(size_t first = 0; first < segments.size(); first += detail::leaf_batch_size) {
+        auto n = std::min(detail::leaf_batch_size, segments.size() - first);
+        batch.load(segments, first, n);
+        detail::leaf_intersects<GeometryMode>(shape, query_box, batch, is_match);
+
+        for(size_t k = 0; k < n; ++k) {
+            auto cylinder = segments.cylinder(first + k);
+            auto box = cylinder.bounding_box();
+
+            BOOST_CHECK(bg::equals(box, batch.bounding_box(k)));
+
+            bool expected = bg::intersects(query_box, box);
+            if constexpr (std::is_same<GeometryMode, BoundingBoxGeometry>::value) {
+                expected = expected && geometry_intersects(shape, box, GeometryMode{});
+            } else {
+                expected = expected && geometry_intersects(shape, cylinder, GeometryMode{});
+            }
+
+            BOOST_CHECK_MESSAGE(is_match[k] == expected,
+                                "segment " << first + k << ": expected = " << expected);
+        }
+
+        for(size_t k = n; k < detail::leaf_batch_size; ++k) {
+            BOOST_CHECK(!is_match[k]);
+        }
+    }
+}
+
+template <class Shape>
+void check_leaf_kernels(const Shape& shape, const SegmentArrays& segments) {
+    check_leaf_kernel<BoundingBoxGeometry>(shape, segments);
+    check_leaf_kernel<BestEffortGeometry>(shape, segments);
+}
+
+BOOST_AUTO_TEST_CASE(MatchesScalarVersions) {
+    auto gen = std::mt19937(3218);
+    auto segments = random_segment_arrays(1000 + 7, gen);
+
+    auto coord = std::uniform_real_distribution<CoordType>(-2.0, 2.0);
+    auto length = std::uniform_real_distribution<CoordType>(0.0, 1.0);
+
+    for(size_t i = 0; i < 20; ++i) {
+        auto p1 = Point3D{coord(gen), coord(gen), coord(gen)};
+        auto p2 = Point3D{coord(gen), coord(gen), coord(gen)};
+        auto r = length(gen);
+
+        check_leaf_kernels(Box3D{min(p1, p2), max(p1, p2)}, segments);
+        check_leaf_kernels(Sphere{p1, r}, segments);
+        check_leaf_kernels(Cylinder{p1, p2, r}, segments);
+        check_leaf_kernels(Cylinder{p1, p1, r}, segments);
+    }
+}
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,8 +3,22 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <brain_indexer/multi_index.hpp>
 #include <brain_indexer/distributed_sorting.hpp>
@@ -16,6 +30,23 @@ struct SubtreeState {
     std::unordered_map<size_t, size_t> n_loaded;
     std::unordered_map<size_t, size_t> n_evicted;
     std::unordered_map<size_t, size_t> n_elements;
+    std::unordered_map<size_t, size_t> n_bytes;
+    std::chrono::milliseconds load_delay{0};
+    std::unordered_map<size_t, size_t> n_bytes_on_disk_queries;
+
+    // Loading these subtrees throws.
+    std::unordered_set<size_t> failing;
+
+    // Loads block until `n_concurrent_loads` loads have been in progress at
+    // the same time, or until `load_timeout` passed.
+    size_t n_loading = 0;
+    size_t max_loading = 0;
+    size_t n_concurrent_loads = 0;
+    std::chrono::seconds load_timeout{10};
+    std::condition_variable loading_changed;
+
+    // Subtrees may be loaded by several threads concurrently.
+    std::mutex mutex;
 };
 
 
@@ -26,12 +57,14 @@ struct MockRTree {
     MockRTree(std::shared_ptr<SubtreeState> subtree_state, size_t subtree_id)
         : subtree_id(subtree_id),
           subtree_state(std::move(subtree_state)) {
+        auto lock = std::lock_guard<std::mutex>(this->subtree_state->mutex);
         ++(*this->subtree_state).n_loaded[subtree_id];
     }
 
     ~MockRTree() {
         if(subtree_state != nullptr) {
-        ++(*subtree_state).n_evicted[subtree_id];
+            auto lock = std::lock_guard<std::mutex>(subtree_state->mutex);
+            ++(*subtree_state).n_evicted[subtree_id];
         }
     }
 
@@ -46,6 +79,17 @@ struct MockRTree {
         return subtree_state->n_elements[subtree_id];
     }
 
+    // Unless specified otherwise, every element uses one byte.
+    size_t memory_footprint() const {
+        auto lock = std::lock_guard<std::mutex>(subtree_state->mutex);
+        auto it = subtree_state->n_bytes.find(subtree_id);
+        if(it != subtree_state->n_bytes.end()) {
+            return it->second;
+        }
+
+        return subtree_state->n_elements[subtree_id];
+    }
+
     size_t subtree_id;
     std::shared_ptr<SubtreeState> subtree_state;
 };
@@ -61,9 +105,43 @@ class MockStorage {
         : subtree_state(std::move(subtree_state)) {}
 
     MockRTree load_subtree(size_t subtree_id) {
+        {
+            auto lock = std::unique_lock<std::mutex>(subtree_state->mutex);
+            if(subtree_state->failing.count(subtree_id) != 0) {
+                throw std::runtime_error("Failed to load subtree.");
+            }
+
+            subtree_state->n_loading += 1;
+            subtree_state->max_loading = std::max(subtree_state->max_loading,
+                                                  subtree_state->n_loading);
+            subtree_state->loading_changed.notify_all();
+
+            subtree_state->loading_changed.wait_for(
+                lock, subtree_state->load_timeout, [this]() {
+                    return subtree_state->max_loading >= subtree_state->n_concurrent_loads;
+                });
+        }
+
+        std::this_thread::sleep_for(subtree_state->load_delay);
+
+        {
+            auto lock = std::lock_guard<std::mutex>(subtree_state->mutex);
+            subtree_state->n_loading -= 1;
+        }
         return MockRTree(subtree_state, subtree_id);
     }
 
+    MockRTree load_top_tree() const {
+        return MockRTree();
+    }
+
+    // Every subtree is 100 bytes on disk.
+    size_t subtree_bytes_on_disk(size_t subtree_id) const {
+        auto lock = std::lock_guard<std::mutex>(subtree_state->mutex);
+        ++subtree_state->n_bytes_on_disk_queries[subtree_id];
+        return 100ul;
+    }
+
   private:
     std::shared_ptr<SubtreeState> subtree_state;
 };
@@ -112,9 +190,831 @@ BOOST_AUTO_TEST_CASE(MultiIndexLoad) {
 }
 
 
+BOOST_AUTO_TEST_CASE(MultiIndexCacheStats) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t k = 0; k < 3; ++k) {
+        subtree_state->n_elements[k] = 8ul;
+    }
+
+    auto params = UsageRateCacheParams(20ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 1ul);
+    cache.load_subtree(SubtreeID{1ul, 8ul}, /* query_count */ 2ul);
+    cache.load_subtree(SubtreeID{2ul, 8ul}, /* query_count */ 3ul);
+
+    auto stats = cache.stats();
+    BOOST_TEST(stats.n_hits == 1ul);
+    BOOST_TEST(stats.n_misses == 3ul);
+    BOOST_TEST(stats.n_evictions == 1ul);
+    BOOST_TEST(stats.n_resident_bytes == 16ul);
+    BOOST_TEST(stats.hit_rate() == 0.25);
+
+    auto n_loads = std::accumulate(stats.load_latency_histogram.begin(),
+                                   stats.load_latency_histogram.end(),
+                                   size_t(0));
+    BOOST_TEST(n_loads == 3ul);
+
+    // Resetting the counters doesn't evict any subtrees.
+    cache.counters().reset();
+    stats = cache.stats();
+    BOOST_TEST(stats.n_hits == 0ul);
+    BOOST_TEST(stats.n_misses == 0ul);
+    BOOST_TEST(stats.n_evictions == 0ul);
+    BOOST_TEST(stats.n_resident_bytes == 16ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexFailedLoad) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->n_elements[0ul] = 8ul;
+    subtree_state->failing.insert(0ul);
+
+    auto params = UsageRateCacheParams(20ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    BOOST_CHECK_THROW(cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 3ul),
+                      std::runtime_error);
+
+    // The failed load isn't recorded as a load.
+    auto stats = cache.stats();
+    auto n_loads = std::accumulate(stats.load_latency_histogram.begin(),
+                                   stats.load_latency_histogram.end(),
+                                   size_t(0));
+    BOOST_TEST(n_loads == 0ul);
+    BOOST_TEST(stats.n_resident_bytes == 0ul);
+    BOOST_TEST(cache.usage(0ul).access_count() == 0ul);
+
+    // The subtree can be loaded once loading works again.
+    subtree_state->failing.clear();
+    auto subtree = cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 4ul);
+    BOOST_TEST(subtree->subtree_id == 0ul);
+    BOOST_TEST(cache.usage(0ul).access_count() == 1ul);
+    BOOST_TEST(cache.stats().n_resident_bytes == 8ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexFutureKeepsSubtreeInUse) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t k = 0; k < 3; ++k) {
+        subtree_state->n_elements[k] = 8ul;
+    }
+
+    auto params = UsageRateCacheParams(20ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    // Only the future is kept, the subtree itself isn't referenced.
+    auto future = cache.load_subtree_async(SubtreeID{0ul, 8ul}, /* query_count */ 0ul);
+    future.wait();
+
+    cache.load_subtree(SubtreeID{1ul, 8ul}, /* query_count */ 1ul);
+    cache.load_subtree(SubtreeID{2ul, 8ul}, /* query_count */ 2ul);
+    BOOST_TEST((*subtree_state).n_evicted[0ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_evicted[1ul] == 1ul);
+
+    // Once the future is released, the subtree may be evicted again. Hence,
+    // it must be loaded a second time.
+    future = {};
+    cache.load_subtree(SubtreeID{1ul, 8ul}, /* query_count */ 3ul);
+    cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 4ul);
+    BOOST_TEST((*subtree_state).n_loaded[0ul] == 2ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexBytesReadQueriedOnce) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t k = 0; k < 2; ++k) {
+        subtree_state->n_elements[k] = 8ul;
+    }
+
+    auto params = UsageRateCacheParams(8ul);
+    auto cache = UsageRateCache(params, MockStorage(subtree_state));
+
+    // Only one subtree fits, hence each load evicts the other.
+    cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{1ul, 8ul}, /* query_count */ 1ul);
+    cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 2ul);
+    BOOST_TEST((*subtree_state).n_loaded[0ul] == 2ul);
+
+    BOOST_TEST(cache.stats().n_bytes_read == 300ul);
+    BOOST_TEST((*subtree_state).n_bytes_on_disk_queries[0ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_bytes_on_disk_queries[1ul] == 1ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexLoadLatencyHistogram) {
+    auto counters = MultiIndexCounters{};
+    counters.on_load(std::chrono::microseconds(0), 0ul);
+    counters.on_load(std::chrono::microseconds(1), 0ul);
+    counters.on_load(std::chrono::microseconds(3), 0ul);
+    counters.on_load(std::chrono::microseconds(4), 10ul);
+    counters.on_load(std::chrono::hours(24), 20ul);
+
+    auto stats = counters.snapshot();
+    BOOST_TEST(stats.load_latency_histogram[0] == 1ul);
+    BOOST_TEST(stats.load_latency_histogram[1] == 1ul);
+    BOOST_TEST(stats.load_latency_histogram[2] == 1ul);
+    BOOST_TEST(stats.load_latency_histogram[3] == 1ul);
+    BOOST_TEST(stats.load_latency_histogram.back() == 1ul);
+    BOOST_TEST(stats.n_bytes_read == 30ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexPinnedSubtrees) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t k = 0; k < 4; ++k) {
+        subtree_state->n_elements[k] = 8ul;
+    }
+
+    auto params = UsageRateCacheParams(20ul, EvictionPolicy::lru);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    // Subtree 0 is the least recently used, but it's pinned. It's loaded
+    // first, such that no I/O thread refers to it.
+    cache.load_subtree(SubtreeID{0ul, 8ul}, /* query_count */ 0ul);
+    cache.pin(SubtreeID{0ul, 8ul}, /* query_count */ 0ul).wait();
+    for(size_t k = 1; k < 4; ++k) {
+        cache.load_subtree(SubtreeID{k, 8ul}, /* query_count */ k);
+    }
+    BOOST_TEST((*subtree_state).n_loaded[0ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[0ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_evicted[1ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[2ul] == 1ul);
+
+    cache.unpin_all();
+    cache.load_subtree(SubtreeID{1ul, 8ul}, /* query_count */ 4ul);
+    BOOST_TEST((*subtree_state).n_evicted[0ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[3ul] == 0ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexNoEvictionWhileInUse) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->n_elements[42ul] = 4ul;
+    subtree_state->n_elements[24ul] = 7ul;
+    subtree_state->n_elements[30ul] = 9ul;
+    subtree_state->n_elements[0ul] = 1ul;
+
+    auto params = UsageRateCacheParams(20ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    // Subtree 42 has the lowest usage rate, but it's still in use.
+    auto in_use = cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{24ul, 7ul}, /* query_count */ 10ul);
+    cache.load_subtree(SubtreeID{30ul, 9ul}, /* query_count */ 20ul);
+
+    cache.load_subtree(SubtreeID{0ul, 1ul}, /* query_count */ 21ul);
+    BOOST_TEST((*subtree_state).n_evicted[42ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_evicted[24ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[30ul] == 0ul);
+    BOOST_TEST(in_use->subtree_id == 42ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexByteBudget) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t k = 0; k < 4; ++k) {
+        subtree_state->n_elements[k] = 4ul;
+        subtree_state->n_bytes[k] = 40ul;
+    }
+
+    auto params = UsageRateCacheParams(100ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    // By number of elements all four subtrees would fit, but only two of them
+    // fit into 100 bytes.
+    for(size_t k = 0; k < 4; ++k) {
+        cache.load_subtree(SubtreeID{k, 4ul}, /* query_count */ k);
+    }
+
+    size_t n_cached = 0;
+    for(size_t k = 0; k < 4; ++k) {
+        BOOST_TEST((*subtree_state).n_loaded[k] == 1ul);
+        n_cached += (*subtree_state).n_loaded[k] - (*subtree_state).n_evicted[k];
+    }
+    BOOST_TEST(n_cached == 2ul);
+    BOOST_TEST((*subtree_state).n_evicted[3ul] == 0ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexByteBudgetAllPolicies) {
+    auto policies = std::vector<EvictionPolicy>{
+        EvictionPolicy::usage_rate,
+        EvictionPolicy::lru,
+        EvictionPolicy::lfu,
+        EvictionPolicy::clock,
+        EvictionPolicy::arc
+    };
+
+    for(auto policy : policies) {
+        auto subtree_state = std::make_shared<SubtreeState>();
+        for(size_t k = 0; k < 8; ++k) {
+            subtree_state->n_elements[k] = 10ul;
+        }
+
+        auto params = UsageRateCacheParams(30ul, policy);
+        auto storage = MockStorage(subtree_state);
+        auto cache = UsageRateCache(params, storage);
+
+        for(size_t k = 0; k < 32; ++k) {
+            auto subtree_id = (k * 5) % 8;
+            auto subtree = cache.load_subtree(SubtreeID{subtree_id, 10ul}, k);
+            BOOST_TEST(subtree->subtree_id == subtree_id);
+        }
+
+        size_t n_cached = 0;
+        for(size_t k = 0; k < 8; ++k) {
+            n_cached += (*subtree_state).n_loaded[k] - (*subtree_state).n_evicted[k];
+        }
+        BOOST_TEST(n_cached == 3ul);
+    }
+}
+
+
+template <class Policy>
+std::vector<size_t> pop_all_victims(Policy& policy,
+                                    const std::function<bool(size_t)>& is_evictable) {
+    auto victims = std::vector<size_t>{};
+    while(auto victim = policy.pop_victim(/* query_count */ 0ul, is_evictable)) {
+        victims.push_back(*victim);
+    }
+
+    return victims;
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyLRU) {
+    auto policy = LRUPolicy{};
+    for(size_t k : {1ul, 2ul, 3ul}) {
+        policy.on_load(k, 0ul);
+    }
+    policy.on_access(1ul, 0ul);
+    policy.on_access(42ul, 0ul);
+
+    auto all = [](size_t) { return true; };
+    auto not_two = [](size_t id) { return id != 2ul; };
+
+    BOOST_TEST(pop_all_victims(policy, not_two) == (std::vector<size_t>{3ul, 1ul}));
+    BOOST_TEST(policy.size() == 1ul);
+    BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{2ul}));
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyLFU) {
+    auto policy = LFUPolicy{};
+    for(size_t k : {1ul, 2ul, 3ul, 4ul}) {
+        policy.on_load(k, 0ul);
+    }
+    policy.on_access(1ul, 0ul);
+    policy.on_access(1ul, 0ul);
+    policy.on_access(3ul, 0ul);
+
+    auto all = [](size_t) { return true; };
+    auto not_four = [](size_t id) { return id != 4ul; };
+
+    // Ties are broken by recency.
+    BOOST_TEST(pop_all_victims(policy, not_four) == (std::vector<size_t>{2ul, 3ul, 1ul}));
+    BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{4ul}));
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyClock) {
+    auto policy = ClockPolicy{};
+    for(size_t k : {1ul, 2ul, 3ul}) {
+        policy.on_load(k, 0ul);
+    }
+
+    auto all = [](size_t) { return true; };
+
+    // All reference bits are set, after clearing them the hand is back at `1`.
+    BOOST_TEST(policy.pop_victim(0ul, all).value() == 1ul);
+
+    // The hand is at `2` which gets a second chance.
+    policy.on_access(2ul, 0ul);
+    BOOST_TEST(policy.pop_victim(0ul, all).value() == 3ul);
+
+    auto none = [](size_t) { return false; };
+    BOOST_TEST(!policy.pop_victim(0ul, none).has_value());
+    BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{2ul}));
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyARC) {
+    auto policy = ARCPolicy{};
+    policy.on_load(1ul, 0ul);
+    policy.on_load(2ul, 0ul);
+    policy.on_access(1ul, 0ul);
+
+    auto all = [](size_t) { return true; };
+
+    // `2` has only been used once.
+    BOOST_TEST(policy.pop_victim(0ul, all).value() == 2ul);
+
+    // Reloading `2` is a hit in the ghosts of `T1`, i.e. `2` was evicted too
+    // early. Now, both have been used repeatedly and LRU order applies.
+    policy.on_load(2ul, 0ul);
+    BOOST_TEST(policy.size() == 2ul);
+    BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{1ul, 2ul}));
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyAbortedEviction) {
+    auto all = [](size_t) { return true; };
+    auto only_one = [](size_t id) { return id == 1ul; };
+    auto only_two = [](size_t id) { return id == 2ul; };
+
+    {
+        // `2` goes back between `3` and `1`, rather than to the front.
+        auto policy = LRUPolicy{};
+        for(size_t k : {1ul, 2ul, 3ul}) {
+            policy.on_load(k, 0ul);
+        }
+
+        BOOST_TEST(policy.pop_victim(0ul, only_two).value() == 2ul);
+        policy.on_evict_aborted(2ul);
+        BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{1ul, 2ul, 3ul}));
+    }
+
+    {
+        // The most frequently used `1` keeps its frequency.
+        auto policy = LFUPolicy{};
+        for(size_t k : {1ul, 2ul, 3ul}) {
+            policy.on_load(k, 0ul);
+            policy.on_access(k, 0ul);
+        }
+        policy.on_access(1ul, 0ul);
+
+        BOOST_TEST(policy.pop_victim(0ul, only_one).value() == 1ul);
+        policy.on_evict_aborted(1ul);
+        BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{2ul, 3ul, 1ul}));
+    }
+
+    {
+        // The hand points at `1` again, which no longer has a second chance.
+        auto policy = ClockPolicy{};
+        for(size_t k : {1ul, 2ul, 3ul}) {
+            policy.on_load(k, 0ul);
+        }
+
+        BOOST_TEST(policy.pop_victim(0ul, all).value() == 1ul);
+        policy.on_evict_aborted(1ul);
+        BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{1ul, 2ul, 3ul}));
+    }
+
+    {
+        // `2` stays in `T1`; it's not a hit in the ghosts of `T1`.
+        auto policy = ARCPolicy{};
+        policy.on_load(1ul, 0ul);
+        policy.on_load(2ul, 0ul);
+        policy.on_access(1ul, 0ul);
+
+        BOOST_TEST(policy.pop_victim(0ul, all).value() == 2ul);
+        policy.on_evict_aborted(2ul);
+        BOOST_TEST(policy.size() == 2ul);
+        BOOST_TEST(pop_all_victims(policy, all) == (std::vector<size_t>{2ul, 1ul}));
+    }
+
+    {
+        auto policy = UsageRatePolicy{};
+        policy.on_load(1ul, 0ul);
+        policy.on_load(2ul, 0ul);
+        for(size_t k = 0; k < 3; ++k) {
+            policy.on_access(1ul, 0ul);
+        }
+
+        BOOST_TEST(policy.pop_victim(5ul, only_one).value() == 1ul);
+        policy.on_evict_aborted(1ul);
+        BOOST_TEST(policy.size() == 2ul);
+        BOOST_TEST(policy.pop_victim(5ul, all).value() == 2ul);
+        BOOST_TEST(policy.pop_victim(5ul, all).value() == 1ul);
+    }
+
+    {
+        // Only the last victim can be put back.
+        auto policy = LRUPolicy{};
+        policy.on_load(1ul, 0ul);
+        policy.on_load(2ul, 0ul);
+
+        BOOST_TEST(policy.pop_victim(0ul, all).value() == 1ul);
+        BOOST_CHECK_THROW(policy.on_evict_aborted(2ul), std::invalid_argument);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyFromString) {
+    BOOST_CHECK(eviction_policy_from_string("lru") == EvictionPolicy::lru);
+    BOOST_CHECK(eviction_policy_from_string("arc") == EvictionPolicy::arc);
+    BOOST_CHECK_THROW(eviction_policy_from_string("fifo"), std::invalid_argument);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexSingleFlightLoad) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->n_elements[42ul] = 4ul;
+    subtree_state->load_delay = std::chrono::milliseconds(50);
+
+    auto params = UsageRateCacheParams(20ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    size_t n_threads = 8;
+    auto subtree_ids = std::vector<size_t>(n_threads);
+    auto threads = std::vector<std::thread>{};
+    for(size_t k = 0; k < n_threads; ++k) {
+        threads.emplace_back([&cache, &subtree_ids, k]() {
+            auto subtree = cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ k);
+            subtree_ids[k] = subtree->subtree_id;
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    BOOST_TEST((*subtree_state).n_loaded[42ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[42ul] == 0ul);
+    for(size_t k = 0; k < n_threads; ++k) {
+        BOOST_TEST(subtree_ids[k] == 42ul);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexAsyncLoad) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+
+    size_t n_subtrees = 8;
+    auto params = UsageRateCacheParams(100ul);
+    params.n_io_threads = 4;
+    auto storage = MockStorage(subtree_state);
+
+    // Every load waits until four subtrees are being loaded concurrently.
+    subtree_state->n_concurrent_loads = params.n_io_threads;
+
+    auto cache = UsageRateCache(params, storage);
+
+    auto subtrees = std::vector<SubtreeFuture<std::shared_ptr<const MockRTree>>>{};
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        subtrees.push_back(cache.load_subtree_async(SubtreeID{k, 4ul}, /* query_count */ 0ul));
+    }
+
+    // Requesting a pending subtree must not load it a second time.
+    cache.load_subtree(SubtreeID{0ul, 4ul}, /* query_count */ 1ul);
+
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        BOOST_TEST(subtrees[k].get()->subtree_id == k);
+    }
+
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        BOOST_TEST((*subtree_state).n_loaded[k] == 1ul);
+    }
+
+    BOOST_TEST(subtree_state->max_loading == params.n_io_threads);
+
+    auto stats = cache.stats();
+    BOOST_TEST(stats.n_misses == n_subtrees);
+    BOOST_TEST(stats.n_hits == 1ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexDestroyedWhilePrefetching) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->load_delay = std::chrono::milliseconds(50);
+
+    size_t n_subtrees = 8;
+    auto subtree_ids = std::vector<SubtreeID>();
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        subtree_state->n_elements[k] = 1ul;
+        subtree_ids.push_back(SubtreeID{k, 1ul});
+    }
+
+    auto params = UsageRateCacheParams(100ul);
+    params.n_io_threads = 1;
+    auto storage = MockStorage(subtree_state);
+
+    auto subtrees = std::vector<SubtreeFuture<std::shared_ptr<const MockRTree>>>{};
+    {
+        auto cache = UsageRateCache(params, storage);
+        subtrees = cache.prefetch(subtree_ids, /* query_count */ 0ul);
+        BOOST_TEST(subtrees.size() == n_subtrees);
+    }
+
+    // At most the load which had started is finished, the others are cancelled.
+    size_t n_loaded = 0;
+    size_t n_cancelled = 0;
+    for(const auto& subtree : subtrees) {
+        try {
+            subtree.get();
+            ++n_loaded;
+        }
+        catch(const std::runtime_error&) {
+            ++n_cancelled;
+        }
+    }
+
+    BOOST_TEST(n_loaded <= 1ul);
+    BOOST_TEST(n_loaded + n_cancelled == n_subtrees);
+}
+
+
+// Exposes `for_each_subtree` of a multi-index of mock subtrees.
+class MockMultiIndex: public MultiIndexTreeBase<UsageRateCache<MockStorage>> {
+  public:
+    using MultiIndexTreeBase::MultiIndexTreeBase;
+    using MultiIndexTreeBase::for_each_subtree;
+};
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexQueryRequestsBoundedWindow) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+
+    size_t n_subtrees = 8;
+    auto subtree_ids = std::vector<SubtreeID>();
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        subtree_state->n_elements[k] = 8ul;
+        subtree_ids.push_back(SubtreeID{k, 8ul});
+    }
+
+    // Only a single subtree fits into the cache.
+    auto params = UsageRateCacheParams(8ul);
+    params.n_io_threads = 2;
+    auto storage = MockStorage(subtree_state);
+
+    auto index = MockMultiIndex(storage, params);
+
+    size_t max_resident = 0;
+    auto visited = std::vector<size_t>();
+    index.for_each_subtree(subtree_ids, /* query_id */ 0ul, [&](const MockRTree& subtree) {
+        visited.push_back(subtree.subtree_id);
+
+        auto lock = std::lock_guard<std::mutex>(subtree_state->mutex);
+        size_t n_resident = 0;
+        for(size_t k = 0; k < n_subtrees; ++k) {
+            n_resident += subtree_state->n_loaded[k] - subtree_state->n_evicted[k];
+        }
+        max_resident = std::max(max_resident, n_resident);
+    });
+
+    std::sort(visited.begin(), visited.end());
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        BOOST_TEST(visited[k] == k);
+        BOOST_TEST((*subtree_state).n_loaded[k] == 1ul);
+    }
+
+    // The subtree being processed and those requested ahead of it.
+    BOOST_TEST(max_resident <= params.n_io_threads + 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(MultiIndexPrefetchWithinBudget) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+
+    auto params = UsageRateCacheParams(10ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = UsageRateCache(params, storage);
+
+    auto subtree_ids = std::vector<SubtreeID>{
+        SubtreeID{0ul, 4ul}, SubtreeID{1ul, 4ul}, SubtreeID{2ul, 4ul}
+    };
+    cache.prefetch(subtree_ids, /* query_count */ 0ul);
+
+    // Waits for the prefetched subtrees, since loads are single-flight.
+    cache.load_subtree(SubtreeID{0ul, 4ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{1ul, 4ul}, /* query_count */ 0ul);
+
+    BOOST_TEST((*subtree_state).n_loaded[0ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_loaded[1ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_loaded[2ul] == 0ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedSubtreeCacheAcrossProcesses) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto name = std::string("brain_indexer_test_fjqwe");
+    SharedSubtreeCache::remove(name);
+
+    auto segment_bytes = size_t(1) << 16;
+    auto n_loaded = std::unordered_map<size_t, size_t>{};
+    auto load = [&n_loaded, segment_bytes](size_t subtree_id) {
+        return [&n_loaded, segment_bytes, subtree_id](const std::string& segment_name) {
+            ++n_loaded[subtree_id];
+            bip::managed_shared_memory(bip::create_only, segment_name.c_str(), segment_bytes);
+        };
+    };
+
+    {
+        auto params = SharedSubtreeCacheParams(2 * segment_bytes);
+        auto cache = std::make_shared<SharedSubtreeCache>(name, params);
+
+        // Attaches to the same cache, as another process would. The budget is
+        // decided by the first one to attach.
+        auto other = std::make_shared<SharedSubtreeCache>(name, SharedSubtreeCacheParams(1ul));
+
+        auto subtree0 = cache->acquire(0ul, load(0ul));
+        auto other_subtree0 = other->acquire(0ul, load(0ul));
+        BOOST_TEST(n_loaded[0ul] == 1ul);
+
+        // Subtree 1 isn't in use, and is evicted to make room for subtree 2.
+        cache->acquire(1ul, load(1ul));
+        other->acquire(2ul, load(2ul));
+        BOOST_TEST(cache->n_shared_subtrees() == 2ul);
+        BOOST_TEST(cache->shared_bytes() <= 2 * segment_bytes);
+
+        cache->acquire(1ul, load(1ul));
+        BOOST_TEST(n_loaded[0ul] == 1ul);
+        BOOST_TEST(n_loaded[1ul] == 2ul);
+        BOOST_TEST(other->n_loads() == 4ul);
+
+        // Subtree 0 is still in use.
+        subtree0 = nullptr;
+        cache->acquire(3ul, load(3ul));
+        BOOST_TEST(n_loaded[0ul] == 1ul);
+        other->acquire(0ul, load(0ul));
+        BOOST_TEST(n_loaded[0ul] == 1ul);
+    }
+
+    // The last one to detach removes the cache.
+    BOOST_CHECK_THROW(bip::managed_shared_memory(bip::open_only, name.c_str()),
+                      bip::interprocess_exception);
+
+    SharedSubtreeCache::remove(name);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedSubtreeCacheTakesOverFromDeadLoader) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto name = std::string("brain_indexer_test_vkzpa");
+    SharedSubtreeCache::remove(name);
+
+    auto segment_bytes = size_t(1) << 16;
+    auto params = SharedSubtreeCacheParams(2 * segment_bytes);
+
+    // The child dies while loading the subtree, without releasing anything.
+    auto pid = ::fork();
+    BOOST_REQUIRE(pid >= 0);
+    if(pid == 0) {
+        auto cache = std::make_shared<SharedSubtreeCache>(name, params);
+        cache->acquire(0ul, [](const std::string&) { ::_exit(0); });
+        ::_exit(1);
+    }
+
+    int status = 0;
+    BOOST_REQUIRE(::waitpid(pid, &status, 0) == pid);
+    BOOST_TEST(WEXITSTATUS(status) == 0);
+
+    {
+        auto cache = std::make_shared<SharedSubtreeCache>(name, params);
+
+        size_t n_loaded = 0;
+        auto subtree = cache->acquire(0ul, [&](const std::string& segment_name) {
+            ++n_loaded;
+            bip::managed_shared_memory(bip::create_only, segment_name.c_str(), segment_bytes);
+        });
+
+        BOOST_TEST(n_loaded == 1ul);
+        BOOST_TEST(cache->n_loads() == 1ul);
+        BOOST_TEST(cache->n_shared_subtrees() == 1ul);
+    }
+
+    SharedSubtreeCache::remove(name);
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedSubtreeCacheNameChangesWithIndex) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = std::string("tmp-shared-name");
+    std::filesystem::create_directories(output_dir);
+    auto index_file = output_dir + "/index.rtree";
+
+    auto write = [&index_file](const std::string& content) {
+        std::ofstream(index_file) << content;
+    };
+
+    write("abc");
+    auto name = SharedSubtreeCache::default_name(output_dir, index_file);
+    BOOST_TEST(SharedSubtreeCache::default_name(output_dir, index_file) == name);
+
+    // Rebuilt in place, with a different size.
+    write("abcd");
+    BOOST_TEST(SharedSubtreeCache::default_name(output_dir, index_file) != name);
+
+    std::filesystem::remove_all(output_dir);
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedContainerRoundTrip) {
+    auto filename = std::string("tmp-pkc-serial.pack");
+    auto mpi_rank = mpi::rank(MPI_COMM_WORLD);
+    auto comm_size = mpi::size(MPI_COMM_WORLD);
+
+    // Blobs of various sizes, including empty ones and ones larger than the
+    // alignment.
+    auto make_blob = [](size_t id) {
+        return std::string((id * 1531) % 9000, char('a' + id % 26));
+    };
+
+    if(mpi_rank == 0) {
+        auto blobs = PackedBlobs{};
+        for(size_t id : {3ul, 0ul, 7ul, 12ul}) {
+            blobs.emplace_back(id, make_blob(id));
+        }
+        write_packed_container(filename, blobs);
+
+        auto reader = PackedContainerReader(filename);
+        BOOST_TEST(reader.size() == blobs.size());
+        for(const auto& [id, blob] : blobs) {
+            BOOST_TEST(reader.read(id) == blob);
+        }
+        BOOST_CHECK_THROW(reader.read(1ul), std::runtime_error);
+
+        // A writer which isn't closed leaves nothing behind.
+        {
+            auto writer = PackedContainerWriter("tmp-pkc-aborted.pack");
+            writer.write(0ul, make_blob(0ul));
+        }
+    }
+
+    auto collective_filename = std::string("tmp-pkc-collective.pack");
+    auto n_local = size_t(mpi_rank) + 1;
+    auto local_blobs = PackedBlobs{};
+    for(size_t k = 0; k < n_local; ++k) {
+        auto id = size_t(mpi_rank) + k * size_t(comm_size);
+        local_blobs.emplace_back(id, make_blob(id));
+    }
+    write_packed_container(collective_filename, local_blobs, MPI_COMM_WORLD);
+
+    // Every rank sees the blobs of all ranks.
+    auto reader = PackedContainerReader(collective_filename);
+    BOOST_TEST(reader.size() == size_t(comm_size * (comm_size + 1) / 2));
+    for(int rank = 0; rank < comm_size; ++rank) {
+        for(int k = 0; k <= rank; ++k) {
+            auto id = size_t(rank) + size_t(k) * size_t(comm_size);
+            BOOST_TEST(reader.read(id) == make_blob(id));
+        }
+    }
+
+    // The part files have been removed.
+    MPI_Barrier(MPI_COMM_WORLD);
+    for(const auto& entry : std::filesystem::directory_iterator(".")) {
+        auto filename = entry.path().filename().string();
+        if(filename.rfind("tmp-pkc-", 0) == 0) {
+            BOOST_TEST(filename.find(".part-") == std::string::npos);
+            BOOST_TEST(filename != "tmp-pkc-aborted.pack");
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(BinarySerializeMatchesStringStream) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto spheres = std::vector<IndexedSphere>();
+    for(size_t i = 0; i < 1000; ++i) {
+        auto x = CoordType(i);
+        spheres.emplace_back(identifier_t(i), Point3D{x, -x, 0.5f * x}, CoordType(1.0));
+    }
+    auto tree = IndexTree<IndexedSphere>(spheres);
+
+    std::ostringstream oss(std::ios::binary);
+    {
+        boost::archive::binary_oarchive oa(oss);
+        oa << tree;
+    }
+
+    BOOST_TEST(detail::binary_serialize(tree) == oss.str());
+}
+
+
 BOOST_AUTO_TEST_CASE(MultiIndexCompiles) {
     auto synapse_index = MultiIndexTree<Synapse>{};
     auto morpho_index = MultiIndexTree<MorphoEntry>{};
+    auto shared_index = MultiIndexTree<MorphoEntry, SharedMemoryStorage<MorphoEntry>>{};
+    auto packed_index = MultiIndexTree<MorphoEntry, PackedStorage<MorphoEntry>>{};
 }
 
 BOOST_AUTO_TEST_CASE(TwoLevelParamsCutoff) {
@@ -7,6 +7,7 @@ namespace bt = boost::unit_test;
 #include <vector>
 
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/morph_block_index.hpp>
 #include <brain_indexer/multi_index.hpp>
 #include <brain_indexer/util.hpp>
 
@@ -191,6 +192,31 @@ random_elements<Soma>(size_t n_elements,
 }
 
 
+template<>
+std::vector<MorphoEntry>
+random_elements<MorphoEntry>(size_t n_elements,
+                             const std::array<CoordType, 2> &domain,
+                             size_t id_offset,
+                             std::default_random_engine& gen) {
+
+    auto elements = std::vector<MorphoEntry>{};
+    elements.reserve(2*n_elements);
+
+    auto somas = random_elements<Soma>(n_elements, domain, 2*id_offset, gen);
+    auto segments = random_elements<Segment>(n_elements, domain, 2*id_offset + n_elements, gen);
+
+    for(const auto& v : somas) {
+        elements.push_back(v);
+    }
+
+    for(const auto& v : segments) {
+        elements.push_back(v);
+    }
+
+    return elements;
+}
+
+
 template<>
 std::vector<EveryEntry>
 random_elements<EveryEntry>(size_t n_elements,
@@ -270,6 +296,31 @@ static void check_queries_against_geometric_primitives(
         );
     }
 
+    {
+        // Every chunk, except the last, is full.
+        auto chunk_size = size_t(7);
+        auto cursor = index.template query_cursor<GeometryMode>(query_shape);
+
+        std::vector<Element> chunked;
+        while(cursor.next(chunk_size, std::back_inserter(chunked)) == chunk_size) {
+        }
+
+        auto actual = std::vector<identifier_t>{};
+        for(const auto& element : chunked) {
+            actual.push_back(get_id(element));
+        }
+
+        auto expected = std::vector<identifier_t>{};
+        for(const auto& element : found) {
+            expected.push_back(get_id(element));
+        }
+
+        std::sort(actual.begin(), actual.end());
+        std::sort(expected.begin(), expected.end());
+        BOOST_CHECK_MESSAGE(actual == expected,
+                            "query_cursor: query_shape = " << query_shape);
+    }
+
     auto intersecting = std::unordered_map<identifier_t, bool>{};
 
     for(const auto &element : elements) {
@@ -304,6 +355,183 @@ static void check_queries_against_geometric_primitives(
 }
 
 
+template<class GeometryMode, class Element, class Index, class QueryShape>
+static void check_batched_queries(const Index &index,
+                                  const std::vector<QueryShape> &query_shapes) {
+
+    std::vector<Element> found;
+    auto offsets = index.template find_intersecting_batch<GeometryMode>(
+        query_shapes, std::back_inserter(found)
+    );
+    auto counts = index.template count_intersecting_batch<GeometryMode>(query_shapes);
+    auto parallel_counts = index.template count_intersecting_batch<GeometryMode>(
+        query_shapes, /* n_threads = */ 4
+    );
+
+    BOOST_REQUIRE(offsets.size() == query_shapes.size() + 1);
+    BOOST_REQUIRE(counts.size() == query_shapes.size());
+    BOOST_CHECK(parallel_counts == counts);
+    BOOST_CHECK(offsets.front() == 0 && offsets.back() == found.size());
+
+    for(size_t i = 0; i < query_shapes.size(); ++i) {
+        std::vector<Element> expected;
+        index.template find_intersecting<GeometryMode>(
+            query_shapes[i], std::back_inserter(expected)
+        );
+
+        auto actual = std::vector<identifier_t>{};
+        for(size_t k = offsets[i]; k < offsets[i+1]; ++k) {
+            actual.push_back(get_id(found[k]));
+        }
+
+        auto expected_ids = std::vector<identifier_t>{};
+        for(const auto& element : expected) {
+            expected_ids.push_back(get_id(element));
+        }
+
+        std::sort(actual.begin(), actual.end());
+        std::sort(expected_ids.begin(), expected_ids.end());
+
+        BOOST_CHECK_MESSAGE(
+            actual == expected_ids,
+            "find_intersecting_batch: query_shape = " << query_shapes[i]
+        );
+
+        BOOST_CHECK_MESSAGE(
+            counts[i] == expected.size(),
+            "count_intersecting_batch: query_shape = " << query_shapes[i]
+        );
+    }
+}
+
+
+template<class Element, class Index>
+void check_find_nearest(
+        const std::vector<Element>& all_elements,
+        const Index& index,
+        const std::array<CoordType, 2>& domain,
+        std::default_random_engine& gen) {
+
+    auto reference = IndexTree<Element>(all_elements);
+
+    auto pos_dist = std::uniform_real_distribution<CoordType>(domain[0], domain[1]);
+    for(unsigned k_neighbors : {1u, 10u, 100u}) {
+        for(size_t i = 0; i < 10; ++i) {
+            auto x = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+
+            auto actual = std::vector<identifier_t>{};
+            for(const auto& ids : index.find_nearest(x, k_neighbors)) {
+                actual.push_back(ids.gid);
+            }
+
+            auto expected = std::vector<identifier_t>{};
+            for(const auto& ids : reference.find_nearest(x, k_neighbors)) {
+                expected.push_back(ids.gid);
+            }
+
+            std::sort(actual.begin(), actual.end());
+            std::sort(expected.begin(), expected.end());
+            BOOST_CHECK_MESSAGE(
+                actual == expected,
+                "find_nearest: x = " << x << ", k = " << k_neighbors
+            );
+        }
+    }
+}
+
+
+template<class Element, class Index>
+void check_find_nearest_exact(
+        const std::vector<Element>& all_elements,
+        const Index& index,
+        const std::array<CoordType, 2>& domain,
+        std::default_random_engine& gen) {
+
+    auto pos_dist = std::uniform_real_distribution<CoordType>(domain[0], domain[1]);
+    for(unsigned k_neighbors : {1u, 10u, 100u}) {
+        for(size_t i = 0; i < 10; ++i) {
+            auto x = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+
+            // Brute force, using the distance to the exact shape.
+            auto expected = std::vector<std::pair<CoordType, identifier_t>>{};
+            for(const auto& element : all_elements) {
+                expected.emplace_back(geometry_distance(x, element), get_id(element));
+            }
+            std::sort(expected.begin(), expected.end());
+            expected.resize(std::min<size_t>(k_neighbors, expected.size()));
+
+            auto [ids, distances] = index.find_nearest_exact(x, k_neighbors);
+            BOOST_REQUIRE_EQUAL(ids.size(), expected.size());
+            BOOST_REQUIRE_EQUAL(distances.size(), expected.size());
+
+            for(size_t j = 0; j < expected.size(); ++j) {
+                BOOST_CHECK_MESSAGE(
+                    ids[j].gid == expected[j].second && distances[j] == expected[j].first,
+                    "find_nearest_exact: x = " << x << ", k = " << k_neighbors << ", j = " << j
+                );
+            }
+        }
+    }
+}
+
+
+/// Counts with query shapes which cover entire nodes, compared to brute force.
+template<class GeometryMode, class Element, class Index>
+void check_counts_of_covering_shapes(
+        const std::vector<Element>& all_elements,
+        const Index& index,
+        const std::array<CoordType, 2>& domain) {
+
+    auto brute_force_count = [&all_elements](const auto& query_shape) {
+        using QueryShape = std::decay_t<decltype(query_shape)>;
+
+        size_t count = 0;
+        for(const auto& element : all_elements) {
+            count += bg::intersects(bgi::indexable<QueryShape>{}(query_shape),
+                                    bgi::indexable<Element>{}(element))
+                     && geometry_intersects(query_shape, element, GeometryMode{});
+        }
+        return count;
+    };
+
+    auto low = domain[0];
+    auto high = domain[1];
+    auto mid = CoordType(0.5) * (low + high);
+    auto margin = CoordType(0.5) * (high - low);
+
+    auto query_boxes = std::vector<Box3D>{
+        // Everything, every node is covered.
+        Box3D{Point3D{low - margin, low - margin, low - margin},
+              Point3D{high + margin, high + margin, high + margin}},
+        // Halves and an octant, most nodes are covered.
+        Box3D{Point3D{low - margin, low - margin, low - margin},
+              Point3D{mid, high + margin, high + margin}},
+        Box3D{Point3D{low - margin, mid, low - margin},
+              Point3D{high + margin, high + margin, high + margin}},
+        Box3D{Point3D{mid, mid, mid},
+              Point3D{high + margin, high + margin, high + margin}},
+    };
+
+    for(const auto& query_box : query_boxes) {
+        auto actual = index.template count_intersecting<GeometryMode>(query_box);
+        BOOST_CHECK_MESSAGE(actual == brute_force_count(query_box),
+                            "count_intersecting: query_box = " << query_box);
+    }
+
+    auto query_spheres = std::vector<Sphere>{
+        Sphere{Point3D{mid, mid, mid}, CoordType(2.0) * (high - low)},
+        Sphere{Point3D{mid, mid, mid}, CoordType(0.4) * (high - low)},
+        Sphere{Point3D{low, low, low}, CoordType(0.8) * (high - low)},
+    };
+
+    for(const auto& query_sphere : query_spheres) {
+        auto actual = index.template count_intersecting<GeometryMode>(query_sphere);
+        BOOST_CHECK_MESSAGE(actual == brute_force_count(query_sphere),
+                            "count_intersecting: query_sphere = " << query_sphere);
+    }
+}
+
+
 template<class Element, class Index>
 void check_with_all_query_shapes(
         const std::vector<Element>& all_elements,
@@ -335,6 +563,21 @@ void check_with_all_query_shapes(
         }
     }
 
+    {
+        auto query_shapes = random_shapes<Box3D>(20, domain, {-2.0, 1.0}, gen);
+        check_batched_queries<BoundingBoxGeometry, Element>(index, query_shapes);
+        check_batched_queries<BestEffortGeometry, Element>(index, query_shapes);
+    }
+
+    {
+        auto query_shapes = random_shapes<Sphere>(20, domain, {-2.0, 1.0}, gen);
+        check_batched_queries<BoundingBoxGeometry, Element>(index, query_shapes);
+        check_batched_queries<BestEffortGeometry, Element>(index, query_shapes);
+    }
+
+    check_counts_of_covering_shapes<BoundingBoxGeometry>(all_elements, index, domain);
+    check_counts_of_covering_shapes<BestEffortGeometry>(all_elements, index, domain);
+
     // In order to check for non-intersection we need a few small shapes as well.
 }
 
@@ -355,6 +598,46 @@ BOOST_AUTO_TEST_CASE(MorphIndexQueries) {
 }
 
 
+BOOST_AUTO_TEST_CASE(MorphBlockIndexQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto gen = std::default_random_engine{};
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto elements = random_elements<MorphoEntry>(n_elements, domain, 0, gen);
+    auto index = MorphBlockIndexTree(elements);
+    BOOST_CHECK_EQUAL(index.size(), elements.size());
+
+    check_with_all_query_shapes(elements, index, domain, gen);
+
+    auto reference = IndexTree<MorphoEntry>(elements);
+    auto pos_dist = std::uniform_real_distribution<CoordType>(domain[0], domain[1]);
+    for(size_t i = 0; i < 20; ++i) {
+        auto x = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+
+        auto actual = std::vector<identifier_t>{};
+        for(const auto& ids : index.find_nearest(x, 10)) {
+            actual.push_back(ids.gid);
+        }
+
+        auto expected = std::vector<identifier_t>{};
+        for(const auto& ids : reference.find_nearest(x, 10)) {
+            expected.push_back(ids.gid);
+        }
+
+        std::sort(actual.begin(), actual.end());
+        std::sort(expected.begin(), expected.end());
+        BOOST_CHECK(actual == expected);
+    }
+
+    check_find_nearest_exact(elements, index, domain, gen);
+    check_find_nearest_exact(elements, reference, domain, gen);
+}
+
+
 BOOST_AUTO_TEST_CASE(MultiIndexQueries) {
     auto output_dir = "tmp-ndwiu";
 
@@ -383,6 +666,293 @@ BOOST_AUTO_TEST_CASE(MultiIndexQueries) {
     if(mpi_rank == 0) {
         auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
         check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        // Batches are scheduled by subtree, the results must be unaffected even
+        // if only a single subtree fits into the cache.
+        auto tiny_cache_index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ 1ul);
+        auto query_shapes = random_shapes<Box3D>(50, domain, {-2.0, 1.0}, gen);
+        check_batched_queries<BoundingBoxGeometry, EveryEntry>(tiny_cache_index, query_shapes);
+        check_batched_queries<BestEffortGeometry, EveryEntry>(tiny_cache_index, query_shapes);
+
+        // Two indexes sharing the subtrees in shared memory, as two processes
+        // on the same node would. Each subtree is loaded only once.
+        using SharedIndex = MultiIndexTree<EveryEntry, SharedMemoryStorage<EveryEntry>>;
+        auto index_path = resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key);
+        {
+            auto shared_params = SharedSubtreeCacheParams(size_t(1e9));
+            auto storage = SharedMemoryStorage<EveryEntry>(index_path, shared_params);
+
+            auto shared_index = SharedIndex(storage, UsageRateCacheParams(size_t(1e6)));
+            auto other_shared_index = SharedIndex(
+                SharedMemoryStorage<EveryEntry>(index_path, shared_params),
+                UsageRateCacheParams(size_t(1e6))
+            );
+
+            check_with_all_query_shapes(all_elements, shared_index, domain, gen);
+            check_with_all_query_shapes(all_elements, other_shared_index, domain, gen);
+
+            const auto& shared_cache = storage.shared_cache();
+            BOOST_CHECK(shared_cache.n_loads() > 0);
+            BOOST_CHECK_EQUAL(shared_cache.n_loads(), shared_cache.n_shared_subtrees());
+        }
+
+        // Subtrees are evicted from shared memory once no index uses them.
+        auto tiny_shared_index = SharedIndex(
+            SharedMemoryStorage<EveryEntry>(index_path, SharedSubtreeCacheParams(1ul)),
+            UsageRateCacheParams(1ul)
+        );
+        check_batched_queries<BoundingBoxGeometry, EveryEntry>(tiny_shared_index, query_shapes);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexThreadedQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = "tmp-thmiq";
+
+    auto n_elements = identifier_t(2000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto gen = std::default_random_engine{};
+    auto elements = random_elements<EveryEntry>(n_elements, domain, 0, gen);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry>(output_dir, /* n_threads = */ 3);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize_threaded();
+    BOOST_CHECK_EQUAL(builder.size(), elements.size());
+
+    auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+    BOOST_CHECK_EQUAL(index.size(), elements.size());
+    check_with_all_query_shapes(elements, index, domain, gen);
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexOutOfCoreQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = "tmp-oocmq";
+    auto scratch_dir = "tmp-oocmq-scratch";
+
+    auto n_elements = identifier_t(3000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto gen = std::default_random_engine{};
+    auto elements = random_elements<EveryEntry>(n_elements, domain, 0, gen);
+
+    {
+        // Room for a few hundred elements, hence the elements are spilled
+        // and partitioned out-of-core.
+        auto max_memory_bytes = 400 * sizeof(EveryEntry);
+        auto builder = OutOfCoreMultiIndexBulkBuilder<EveryEntry>(
+            output_dir, scratch_dir, max_memory_bytes, /* n_threads = */ 2
+        );
+        builder.insert(elements.begin(), elements.end());
+        builder.finalize();
+        BOOST_CHECK_EQUAL(builder.size(), elements.size());
+    }
+    BOOST_CHECK(std::filesystem::is_empty(scratch_dir));
+
+    auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+    BOOST_CHECK_EQUAL(index.size(), elements.size());
+    check_with_all_query_shapes(elements, index, domain, gen);
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexOutOfCoreTooLittleMemory) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto output_dir = "tmp-ooctlm";
+    auto scratch_dir = "tmp-ooctlm-scratch";
+
+    // Enough for the eight elements, but not for sorting them.
+    auto max_memory_bytes = 8 * sizeof(EveryEntry);
+    BOOST_CHECK_THROW(
+        OutOfCoreMultiIndexBulkBuilder<EveryEntry>(output_dir, scratch_dir, max_memory_bytes),
+        std::invalid_argument
+    );
+
+    // No spill directory is left behind.
+    BOOST_CHECK(!std::filesystem::exists(scratch_dir) || std::filesystem::is_empty(scratch_dir));
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexNearestNeighbours) {
+    auto output_dir = "tmp-nnmiq";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    // The seeds `0` and `1` generate the same elements, which would tie.
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank + 1)
+    };
+    auto elements = random_elements<MorphoEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        // The nearest neighbours are searched across subtrees, not per subtree.
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ size_t(1e6));
+        check_find_nearest(all_elements, index, domain, gen);
+
+        auto tiny_cache_index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ 1ul);
+        check_find_nearest(all_elements, tiny_cache_index, domain, gen);
+
+        check_find_nearest_exact(all_elements, index, domain, gen);
+        check_find_nearest_exact(all_elements, tiny_cache_index, domain, gen);
+
+        // Distant subtrees aren't loaded.
+        index.reset_stats();
+        index.find_nearest(Point3D{0.0, 0.0, 0.0}, 1);
+        BOOST_CHECK(index.stats().n_elements_scanned < index.size());
+        BOOST_CHECK_EQUAL(index.stats().n_elements_returned, 1);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(MemoryMappedIndexQueries) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto index_path = "tmp-mmkwq";
+
+    auto gen = std::default_random_engine{};
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto elements = random_elements<EveryEntry>(n_elements, domain, 0, gen);
+    IndexTree<EveryEntry>(elements).dump(index_path, IndexFormat::memory_mapped);
+
+    auto index = MemoryMappedIndexTree<EveryEntry>(index_path);
+    BOOST_CHECK_EQUAL(index.size(), elements.size());
+
+    check_with_all_query_shapes(elements, index, domain, gen);
+}
+
+
+BOOST_AUTO_TEST_CASE(MemoryMappedIndexFormatMismatch) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto index_path = "tmp-mmfmm";
+
+    auto gen = std::default_random_engine{};
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+    auto elements = random_elements<EveryEntry>(100, domain, 0, gen);
+    IndexTree<EveryEntry>(elements).dump(index_path, IndexFormat::memory_mapped);
+
+    auto filename = resolve_heavy_data_path(index_path, MetaDataConstants::memory_mapped_key);
+    BOOST_CHECK_NO_THROW(MemoryMappedIndexTree<EveryEntry>::open_file(filename));
+
+    // Pretend the file was written by another version of Boost.
+    {
+        auto file = bip::managed_mapped_file(bip::open_only, filename.c_str());
+        auto format = file.find<detail::MemoryMappedFormat>(
+            detail::memory_mapped_format_name
+        ).first;
+        BOOST_REQUIRE(format != nullptr);
+        format->boost_version += 1;
+        file.flush();
+    }
+
+    BOOST_CHECK_THROW(MemoryMappedIndexTree<EveryEntry>{index_path}, std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(MemoryMappedMultiIndexQueries) {
+    auto output_dir = "tmp-mmdwq";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    using Storage = MemoryMappedStorage<EveryEntry>;
+    auto builder = MultiIndexBulkBuilder<EveryEntry, Storage>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        auto index = MultiIndexTree<EveryEntry, Storage>(output_dir, /* mem = */ size_t(1e6));
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PackedMultiIndexQueries) {
+    auto output_dir = "tmp-pkdwq";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    using Storage = PackedStorage<EveryEntry>;
+    auto builder = MultiIndexBulkBuilder<EveryEntry, Storage>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        auto index = MultiIndexTree<EveryEntry, Storage>(output_dir, /* mem = */ size_t(1e6));
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        auto stats = index.stats();
+        BOOST_TEST(stats.n_queries > 0ul);
+        BOOST_TEST(stats.n_misses > 0ul);
+        BOOST_TEST(stats.n_bytes_read > 0ul);
+        BOOST_TEST(stats.n_elements_returned <= stats.n_elements_scanned);
+
+        index.reset_stats();
+        BOOST_TEST(index.stats().n_queries == 0ul);
+
+        // After preloading, the query doesn't need to load any subtree.
+        auto box = Box3D{Point3D{-2.0, -2.0, -2.0}, Point3D{2.0, 2.0, 2.0}};
+        BOOST_TEST(index.preload(box, /* wait = */ true) > 0ul);
+        auto n_misses = index.stats().n_misses;
+        index.find_intersecting_objs(box);
+        BOOST_TEST(index.stats().n_misses == n_misses);
     }
 }
 
@@ -7,6 +7,7 @@ namespace bt = boost::unit_test;
 #include <random>
 
 #include <brain_indexer/distributed_sorting.hpp>
+#include <brain_indexer/external_sort_tile_recursion.hpp>
 #include <brain_indexer/multi_index.hpp>
 #include <brain_indexer/sort_tile_recursion.hpp>
 #include <brain_indexer/util.hpp>
@@ -179,6 +180,99 @@ BOOST_AUTO_TEST_CASE(SerialSTRTests) {
     check_bounding_boxes(values, partition_boundaries, str_params, domain);
 }
 
+BOOST_AUTO_TEST_CASE(ParallelSTRTests) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    size_t n_values = 1000ul;
+    auto domain = std::array<float, 2>{-1.0, 1.0};
+    auto gen = std::default_random_engine{};
+    auto dist = std::uniform_real_distribution<float>(domain[0], domain[1]);
+
+    std::vector<Value> values;
+    values.reserve(n_values);
+    for(size_t i = 0; i < n_values; ++i) {
+        values.push_back(Value{{dist(gen), dist(gen), dist(gen)}, {0ul, i}});
+    }
+
+    auto str_params = SerialSTRParams{n_values, {3ul, 2ul, 2ul}};
+
+    auto expected = values;
+    serial_sort_tile_recursion<Value, GetCoordFromValue>(expected, str_params);
+
+    for(size_t n_threads : {1ul, 2ul, 5ul}) {
+        auto actual = values;
+        parallel_sort_tile_recursion<Value, GetCoordFromValue>(actual, str_params, n_threads);
+
+        for(size_t i = 0; i < n_values; ++i) {
+            BOOST_REQUIRE(actual[i].payload == expected[i].payload);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ExternalSTRTests) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    size_t n_values = 2000ul;
+    auto domain = std::array<float, 2>{-1.0, 1.0};
+    auto gen = std::default_random_engine{};
+    auto dist = std::uniform_real_distribution<float>(domain[0], domain[1]);
+
+    std::vector<Value> values;
+    values.reserve(n_values);
+    for(size_t i = 0; i < n_values; ++i) {
+        values.push_back(Value{{dist(gen), dist(gen), dist(gen)}, {0ul, i}});
+    }
+
+    auto str_params = SerialSTRParams{n_values, {3ul, 2ul, 4ul}};
+
+    auto expected = values;
+    serial_sort_tile_recursion<Value, GetCoordFromValue>(expected, str_params);
+    auto expected_boundaries = str_params.partition_boundaries();
+
+    std::string scratch_dir = "tmp-xstrt";
+    util::ensure_valid_output_directory(scratch_dir);
+
+    // Slices and columns don't fit into memory; and the first axis needs
+    // several passes to merge the runs.
+    auto external_params = ExternalSTRParams{scratch_dir, 200ul, 10ul};
+    auto str = ExternalSortTileRecursion<Value, GetCoordFromValue>(external_params);
+
+    for(size_t i = 0; i < n_values; i += 70) {
+        auto run = std::vector<Value>(
+            values.begin() + std::ptrdiff_t(i),
+            values.begin() + std::ptrdiff_t(std::min(i + 70, n_values))
+        );
+        str.spill(run);
+    }
+    BOOST_CHECK_EQUAL(str.size(), n_values);
+
+    size_t n_parts = 0;
+    str.for_each_bucket(str_params, [&](const std::vector<Value>& bucket,
+                                        const std::vector<size_t>& boundaries,
+                                        size_t first_part) {
+        BOOST_REQUIRE_EQUAL(first_part, n_parts);
+
+        for(size_t k = 0; k + 1 < boundaries.size(); ++k) {
+            auto offset = expected_boundaries[first_part + k];
+            auto n_part = expected_boundaries[first_part + k + 1] - offset;
+            BOOST_REQUIRE_EQUAL(boundaries[k+1] - boundaries[k], n_part);
+
+            for(size_t i = 0; i < n_part; ++i) {
+                BOOST_REQUIRE(bucket[boundaries[k] + i].payload == expected[offset + i].payload);
+            }
+        }
+
+        n_parts += boundaries.size() - 1;
+    });
+
+    BOOST_CHECK_EQUAL(n_parts, str_params.n_parts());
+    BOOST_CHECK(std::filesystem::is_empty(scratch_dir));
+}
+
 std::vector<Value> random_values(size_t n_values,
                                  const std::array<float, 2> &domain,
                                  int comm_rank) {
@@ -279,7 +373,77 @@ BOOST_AUTO_TEST_CASE(DistributedPartitionTests) {
     auto values = std::vector<Value>(n_values);
     auto str_params = two_level_str_heuristic(n_total_values, size_t(1e6), comm_size);
 
-    distributed_partition<GetCenterCoordinate<Value>>(storage, values, str_params, *comm);
+    for(size_t n_threads : {1ul, 3ul}) {
+        auto local_values = values;
+        distributed_partition<GetCenterCoordinate<Value>>(
+            storage, local_values, str_params, *comm, n_threads
+        );
+    }
+}
+
+
+/// Saves subtrees like `NativeStorage`, but fails to write `failing_id`.
+class FailingStorage : public NativeStorageT<MorphoEntry> {
+  public:
+    FailingStorage(std::string output_dir, size_t failing_id)
+        : NativeStorageT<MorphoEntry>(std::move(output_dir)), failing_id_(failing_id) {}
+
+    void write_subtree(const std::string& buffer, size_t subtree_id) const {
+        if(subtree_id == failing_id_) {
+            throw std::runtime_error("Failed to write the subtree.");
+        }
+
+        NativeStorageT<MorphoEntry>::write_subtree(buffer, subtree_id);
+    }
+
+  private:
+    size_t failing_id_;
+};
+
+BOOST_AUTO_TEST_CASE(SaveSubtreesTests) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    using Value = MorphoEntry;
+    using Storage = NativeStorageT<Value>;
+    static_assert(detail::has_serialized_subtrees<Storage>::value);
+
+    std::string output_dir = "tmp-dhwqp";
+    util::ensure_valid_output_directory(output_dir);
+
+    size_t n_values = 200ul;
+    auto values = std::vector<Value>();
+    values.reserve(n_values);
+    for(size_t i = 0; i < n_values; ++i) {
+        auto x = CoordType(i);
+        values.push_back(Soma(identifier_t(i), Point3D{x, x, x}, 0.1f));
+    }
+
+    // The part `[20, 20)` is empty and must be skipped.
+    auto boundaries = std::vector<size_t>{0, 7, 20, 20, 90, 92, 200};
+    size_t first_part = 10;
+
+    for(size_t n_threads : {1ul, 2ul, 5ul}) {
+        auto storage = Storage(output_dir);
+        auto boxes = detail::save_subtrees(storage, values, boundaries, first_part, n_threads);
+
+        BOOST_REQUIRE_EQUAL(boxes.size(), 5ul);
+        for(const auto& box : boxes) {
+            auto k = box.id - first_part;
+            BOOST_REQUIRE(boundaries[k] != boundaries[k+1]);
+
+            auto subtree = storage.load_subtree(box.id);
+            BOOST_CHECK_EQUAL(subtree.size(), boundaries[k+1] - boundaries[k]);
+            BOOST_CHECK_EQUAL(box.n_elements, subtree.size());
+        }
+    }
+
+    auto failing_storage = FailingStorage(output_dir, first_part + 3);
+    BOOST_CHECK_THROW(
+        detail::save_subtrees(failing_storage, values, boundaries, first_part, 2),
+        std::runtime_error
+    );
 }
 
 int main(int argc, char *argv[]) {
@@ -2,10 +2,20 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <limits>
 #include <memory>
 #include <random>
+#include <thread>
+#include <vector>
 
+#include <brain_indexer/radix_sort.hpp>
+#include <brain_indexer/thread_pool.hpp>
 #include <brain_indexer/util.hpp>
+#include <brain_indexer/work_stealing.hpp>
 
 using namespace brain_indexer;
 
@@ -24,3 +34,134 @@ BOOST_AUTO_TEST_CASE(CheckThrowNoSuchFile) {
         }
     }, std::runtime_error);
 }
+
+
+BOOST_AUTO_TEST_CASE(WorkStealingExecutorRunsEachTaskOnce) {
+    size_t n_tasks = 1000;
+
+    for(size_t n_threads : {1ul, 2ul, 3ul, 8ul}) {
+        auto executor = WorkStealingExecutor(n_threads);
+        auto calls = std::vector<std::atomic<size_t>>(n_tasks);
+
+        executor.for_each(n_tasks, [&calls](size_t k) {
+            // All the expensive tasks are in the first thread's range.
+            if(k < 10) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            ++calls[k];
+        });
+
+        for(size_t k = 0; k < n_tasks; ++k) {
+            BOOST_CHECK(calls[k] == 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(WorkStealingExecutorRethrows) {
+    auto executor = WorkStealingExecutor(4);
+    BOOST_CHECK_THROW(
+        executor.for_each(100, [](size_t k) {
+            if(k == 42) {
+                throw std::runtime_error("failed task");
+            }
+        }),
+        std::runtime_error
+    );
+}
+
+
+BOOST_AUTO_TEST_CASE(ThreadPoolCancelsPendingTasks) {
+    std::atomic<size_t> n_run{0};
+    std::atomic<size_t> n_cancelled{0};
+
+    {
+        auto pool = ThreadPool(1);
+
+        // Keeps the only thread busy, until the pool is being destroyed.
+        auto started = std::promise<void>();
+        pool.submit([&started, &n_run]() {
+            started.set_value();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ++n_run;
+        });
+        started.get_future().wait();
+
+        for(size_t k = 0; k < 5; ++k) {
+            pool.submit([&n_run]() { ++n_run; }, [&n_cancelled]() { ++n_cancelled; });
+        }
+    }
+
+    // The running task is finished, the others are cancelled.
+    BOOST_CHECK(n_run == 1);
+    BOOST_CHECK(n_cancelled == 5);
+}
+
+
+BOOST_AUTO_TEST_CASE(RadixKeyPreservesOrder) {
+    auto xs = std::vector<float>{
+        -std::numeric_limits<float>::infinity(), -1e30f, -2.5f, -1.0f, -1e-30f,
+        -0.0f, 0.0f, 1e-30f, 1.0f, 2.5f, 1e30f, std::numeric_limits<float>::infinity()
+    };
+
+    for(size_t i = 0; i + 1 < xs.size(); ++i) {
+        if(xs[i] < xs[i+1]) {
+            BOOST_CHECK(detail::radix_key(xs[i]) < detail::radix_key(xs[i+1]));
+        } else {
+            BOOST_CHECK(detail::radix_key(xs[i]) == detail::radix_key(xs[i+1]));
+        }
+    }
+
+    BOOST_CHECK(detail::radix_key(-0.5) < detail::radix_key(0.25));
+}
+
+
+struct RadixSortable {
+    float x;
+    double y;
+    size_t payload;
+};
+
+struct RadixSortableKey {
+    static constexpr size_t n_components = 2;
+
+    template <size_t k>
+    static auto component(const RadixSortable& a) {
+        if constexpr (k == 0) {
+            return a.x;
+        } else {
+            return a.y;
+        }
+    }
+
+    static bool compare(const RadixSortable& a, const RadixSortable& b) {
+        return a.x == b.x ? a.y < b.y : a.x < b.x;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(RadixSortIsStable) {
+    static_assert(is_radix_sortable<RadixSortableKey>::value);
+
+    auto gen = std::default_random_engine{};
+    // Few distinct values, such that there are many ties.
+    auto dist = std::uniform_int_distribution<int>(-20, 20);
+
+    for(size_t n_values : {0ul, 10ul, 5000ul, 100000ul}) {
+        auto values = std::vector<RadixSortable>();
+        values.reserve(n_values);
+        for(size_t i = 0; i < n_values; ++i) {
+            values.push_back({0.25f * float(dist(gen)), 1e-3 * dist(gen), i});
+        }
+
+        auto expected = values;
+        std::stable_sort(expected.begin(), expected.end(), RadixSortableKey::compare);
+
+        for(size_t n_threads : {1ul, 3ul}) {
+            auto actual = values;
+            radix_sort<RadixSortableKey>(actual.data(), actual.data() + actual.size(), n_threads);
+
+            for(size_t i = 0; i < n_values; ++i) {
+                BOOST_REQUIRE_EQUAL(actual[i].payload, expected[i].payload);
+            }
+        }
+    }
+}
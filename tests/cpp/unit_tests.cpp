@@ -3,8 +3,11 @@
 
 #include <filesystem>
 #include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/parallel_bulk_loading.hpp>
 #include <brain_indexer/util.hpp>
 
 // We need unit tests for each kind of tree
@@ -157,6 +160,174 @@ BOOST_AUTO_TEST_CASE(VariantNeuronPieces) {
 }
 
 
+BOOST_AUTO_TEST_CASE(BatchedNeuronPiecesNumpy) {
+    auto somas = util::make_vec<Soma>(N_ITEMS, util::identity<>(), centers, radius);
+
+    IndexTree<MorphoEntry> rtree(somas);
+    rtree.insert(Segment{10ul, 0u, 0u, centers[0], centers2[0], radius[0], SectionType::undefined});
+
+    auto spheres = std::vector<Sphere>{
+        {tcenter0, tradius}, {tcenter1, tradius}, {tcenter2, tradius}, {tcenter3, tradius}
+    };
+
+    auto result = rtree.find_intersecting_batch_np<BestEffortGeometry>(spheres);
+    BOOST_TEST(result.offsets == std::vector<size_t>({0, 1, 1, 2, 3}));
+    BOOST_TEST(result.values.gid == std::vector<identifier_t>({2, 0, 10}));
+
+    auto counts = rtree.count_intersecting_batch<BestEffortGeometry>(spheres);
+    BOOST_TEST(counts == std::vector<size_t>({1, 0, 1, 1}));
+}
+
+
+BOOST_AUTO_TEST_CASE(ParallelBatchedQueries) {
+    auto gen = std::default_random_engine{};
+    auto pos = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto rad = std::uniform_real_distribution<CoordType>(0.01, 1.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(identifier_t i = 0; i < 10000; ++i) {
+        spheres.emplace_back(i, Point3D{pos(gen), pos(gen), pos(gen)}, rad(gen));
+    }
+    IndexTree<IndexedSphere> rtree(spheres);
+
+    auto query_spheres = std::vector<Sphere>{};
+    for(size_t i = 0; i < 500; ++i) {
+        query_spheres.push_back(Sphere{Point3D{pos(gen), pos(gen), pos(gen)}, rad(gen)});
+    }
+
+    auto expected = rtree.find_intersecting_batch_np<BestEffortGeometry>(query_spheres);
+    auto expected_counts = rtree.count_intersecting_batch<BestEffortGeometry>(query_spheres);
+
+    for(size_t n_threads : {2ul, 3ul, 8ul}) {
+        auto result = rtree.find_intersecting_batch_np<BestEffortGeometry>(
+            query_spheres, n_threads
+        );
+        BOOST_TEST(result.offsets == expected.offsets);
+        BOOST_TEST(result.values.id == expected.values.id);
+        BOOST_TEST(result.values.radius == expected.values.radius);
+
+        auto counts = rtree.count_intersecting_batch<BestEffortGeometry>(
+            query_spheres, n_threads
+        );
+        BOOST_TEST(counts == expected_counts);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(ConcurrentReaders) {
+    static_assert(supports_concurrent_queries<IndexTree<MorphoEntry>>::value);
+
+    auto gen = std::default_random_engine{};
+    auto pos = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto rad = std::uniform_real_distribution<CoordType>(0.01, 1.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(identifier_t i = 0; i < 10000; ++i) {
+        spheres.emplace_back(i, Point3D{pos(gen), pos(gen), pos(gen)}, rad(gen));
+    }
+    IndexTree<IndexedSphere> rtree(spheres);
+
+    auto query_spheres = std::vector<Sphere>{};
+    for(size_t i = 0; i < 200; ++i) {
+        query_spheres.push_back(Sphere{Point3D{pos(gen), pos(gen), pos(gen)}, 2.0f});
+    }
+    auto expected = rtree.count_intersecting_batch<BestEffortGeometry>(query_spheres);
+
+    size_t n_threads = 4;
+    auto counts = std::vector<std::vector<size_t>>(n_threads);
+    auto threads = std::vector<std::thread>{};
+    for(size_t k = 0; k < n_threads; ++k) {
+        threads.emplace_back([&rtree, &query_spheres, &counts, k]() {
+            for(const auto& query_sphere : query_spheres) {
+                counts[k].push_back(rtree.count_intersecting<BestEffortGeometry>(query_sphere));
+            }
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    for(size_t k = 0; k < n_threads; ++k) {
+        BOOST_TEST(counts[k] == expected);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(UnpermuteBatchResults) {
+    // Query `order[j]` was performed as the `j`-th query.
+    auto order = std::vector<size_t>{2, 0, 3, 1};
+
+    auto scheduled = detail::batch_query_result<IndexedSphere>{};
+    scheduled.offsets = {0, 1, 3, 3, 6};
+    scheduled.values.id = {20, 0, 1, 10, 11, 12};
+    scheduled.values.radius = {2.0f, 0.0f, 0.5f, 1.0f, 1.5f, 1.5f};
+    scheduled.values.centroid.resize(6);
+
+    auto executor = WorkStealingExecutor(2);
+    auto result = detail::unpermute_batch_results(scheduled, order, executor);
+
+    BOOST_TEST(result.offsets == (std::vector<size_t>{0, 2, 5, 6, 6}));
+    BOOST_TEST(result.values.id == (std::vector<identifier_t>{0, 1, 10, 11, 12, 20}));
+    BOOST_TEST(result.values.radius
+               == (std::vector<CoordType>{0.0f, 0.5f, 1.0f, 1.5f, 1.5f, 2.0f}));
+}
+
+
+BOOST_AUTO_TEST_CASE(MemoryFootprint) {
+    auto empty = IndexTree<IndexedSphere>{};
+    BOOST_TEST(detail::memory_footprint(empty) == sizeof(empty));
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(identifier_t i = 0; i < 10000; ++i) {
+        spheres.emplace_back(i, Point3D{CoordType(i), 0.0f, 0.0f}, 0.5f);
+    }
+    IndexTree<IndexedSphere> rtree(spheres);
+
+    // The nodes have unused slots, and there are internal nodes.
+    auto n_bytes = detail::memory_footprint(rtree);
+    BOOST_TEST(n_bytes > spheres.size() * sizeof(IndexedSphere));
+    BOOST_TEST(n_bytes < 4 * spheres.size() * sizeof(IndexedSphere));
+}
+
+
+template <class Index>
+std::string serialize_to_string(const Index& index) {
+    std::ostringstream oss;
+    boost::archive::binary_oarchive oa(oss);
+    oa << index;
+
+    return oss.str();
+}
+
+#if SI_PARALLEL_BULK_LOAD == 1
+BOOST_AUTO_TEST_CASE(ParallelBulkLoadIsIdentical) {
+    auto gen = std::default_random_engine{1};
+    auto coord = std::uniform_real_distribution<CoordType>(-100.0f, 100.0f);
+    // Few distinct radii, and hence many equal centroids along some axis.
+    auto radius = std::uniform_int_distribution<int>(1, 3);
+
+    for(size_t n_spheres : {0ul, 1ul, 16ul, 17ul, 300ul, 20000ul}) {
+        auto spheres = std::vector<IndexedSphere>{};
+        for(identifier_t i = 0; i < n_spheres; ++i) {
+            auto center = Point3D{coord(gen), coord(gen), CoordType(radius(gen))};
+            spheres.emplace_back(i, center, CoordType(radius(gen)));
+        }
+
+        auto expected = serialize_to_string(IndexTree<IndexedSphere>(spheres));
+        for(size_t n_threads : {0ul, 2ul, 3ul, 7ul, 16ul}) {
+            auto rtree = parallel_bulk_load<IndexTree<IndexedSphere>>(spheres.begin(),
+                                                                      spheres.end(),
+                                                                      n_threads);
+
+            BOOST_TEST(rtree.size() == n_spheres);
+            BOOST_TEST(serialize_to_string(rtree) == expected);
+        }
+    }
+}
+#endif
+
+
 //////////////////////////////////////////////////////////////////
 // Advanced features
 //////////////////////////////////////////////////////////////////
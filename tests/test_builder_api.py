@@ -95,6 +95,21 @@ def from_sonata_file_target_gids_callback(element_type, index_variant, output_di
     return Builder.from_sonata_file(*args, target_gids=[0, 1], output_dir=output_dir)
 
 
+def threaded_from_sonata_file_callback(element_type, index_variant, output_dir=None):
+    args = small_sonata_conf(element_type)
+
+    Builder = IndexResolver.builder_class(element_type, index_variant)
+    return Builder.from_sonata_file(*args, output_dir=output_dir, n_threads=2)
+
+
+def out_of_core_from_sonata_file_callback(element_type, index_variant, output_dir=None):
+    args = small_sonata_conf(element_type)
+
+    # Small enough that the elements are spilled to disk.
+    Builder = IndexResolver.builder_class(element_type, index_variant)
+    return Builder.from_sonata_file(*args, output_dir=output_dir, max_memory_mb=0.05)
+
+
 def check_builder_from_sonata_file(element_type, index_variant, mpi_comm=None):
     check_builder_from_sonata(
         element_type, index_variant, from_sonata_file_callback, mpi_comm=mpi_comm
@@ -146,6 +161,17 @@ def test_morphology_multi_index_from_sonata():
     check_morphology_from_sonata("multi_index", mpi_comm=mpi_comm)
 
 
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR), reason="Missing data file.")
+@pytest.mark.parametrize("element_type", ["synapse", "morphology"])
+@pytest.mark.parametrize(
+    "build_callback",
+    [threaded_from_sonata_file_callback, out_of_core_from_sonata_file_callback]
+)
+def test_multi_index_from_sonata_file_threaded(element_type, build_callback):
+    # Built by a single process, without MPI.
+    check_builder_from_sonata(element_type, "multi_index", build_callback)
+
+
 def test_sphere_index_builder_add_sphere():
     Builder = IndexResolver.builder_class("sphere", "in_memory")
     builder = Builder()
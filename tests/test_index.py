@@ -1,6 +1,10 @@
 # This file covers correctness of indexes contained in `index.py`.
 
+from concurrent.futures import ThreadPoolExecutor
+
 import numpy as np
+import pytest
+
 import brain_indexer
 
 
@@ -85,3 +89,124 @@ def test_point_index():
 
     check_point_index_boxes(index, centroids)
     check_point_index_spheres(index, centroids)
+
+
+def test_point_index_batched_queries():
+    n_elements = 1000
+    n_queries = 20
+
+    centroids = np.random.uniform(size=(n_elements, 3))
+    ids = np.arange(centroids.shape[0])
+
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, ids)
+
+    corners = np.random.uniform(size=(n_queries, 3))
+    opposite_corners = np.random.uniform(size=(n_queries, 3))
+
+    found, offsets = index.box_query_batch(corners, opposite_corners, fields="id")
+    counts = index.box_counts_batch(corners, opposite_corners)
+
+    assert offsets.shape == (n_queries + 1,)
+    assert offsets[-1] == found.shape[0]
+
+    for i in range(n_queries):
+        expected = index.box_query(corners[i], opposite_corners[i], fields="id")
+        actual = found[offsets[i]:offsets[i + 1]]
+
+        assert np.all(np.sort(actual) == np.sort(expected))
+        assert counts[i] == expected.shape[0]
+
+    centers = np.random.uniform(size=(n_queries, 3))
+    radii = np.random.uniform(0.0, 0.3, size=n_queries)
+
+    found, offsets = index.sphere_query_batch(centers, radii, fields=["id", "position"])
+    counts = index.sphere_counts_batch(centers, radii)
+
+    for i in range(n_queries):
+        expected = index.sphere_query(centers[i], radii[i], fields="id")
+        actual = found["id"][offsets[i]:offsets[i + 1]]
+
+        assert np.all(np.sort(actual) == np.sort(expected))
+        assert counts[i] == expected.shape[0]
+
+
+@pytest.mark.parametrize("n_threads", [2, 5])
+def test_point_index_parallel_batched_queries(n_threads):
+    n_elements = 1000
+    n_queries = 100
+
+    centroids = np.random.uniform(size=(n_elements, 3))
+    ids = np.arange(centroids.shape[0])
+
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, ids)
+
+    centers = np.random.uniform(size=(n_queries, 3))
+    radii = np.random.uniform(0.0, 0.3, size=n_queries)
+
+    expected, expected_offsets = index.sphere_query_batch(centers, radii, fields="id")
+    found, offsets = index.sphere_query_batch(
+        centers, radii, fields="id", n_threads=n_threads
+    )
+
+    assert np.all(offsets == expected_offsets)
+    assert np.all(found == expected)
+
+    expected_counts = index.sphere_counts_batch(centers, radii)
+    counts = index.sphere_counts_batch(centers, radii, n_threads=n_threads)
+    assert np.all(counts == expected_counts)
+
+
+@pytest.mark.parametrize("chunk_size", [1, 7, 1000, 10000])
+def test_point_index_query_chunks(chunk_size):
+    n_elements = 1000
+
+    centroids = np.random.uniform(size=(n_elements, 3))
+    ids = np.arange(centroids.shape[0])
+
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, ids)
+
+    corner, opposite_corner = [0.1, 0.2, 0.0], [0.9, 0.7, 1.0]
+    chunks = list(index.box_query_chunks(
+        corner, opposite_corner, fields=["id", "position"], chunk_size=chunk_size
+    ))
+
+    assert all(chunk["id"].shape[0] == chunk_size for chunk in chunks[:-1])
+    assert all(0 < chunk["id"].shape[0] <= chunk_size for chunk in chunks)
+
+    expected = index.box_query(corner, opposite_corner, fields="id")
+    actual = np.concatenate([chunk["id"] for chunk in chunks])
+    assert np.all(np.sort(actual) == np.sort(expected))
+
+    center, radius = [0.5, 0.5, 0.5], 0.3
+    expected = index.sphere_query(center, radius, fields="id")
+    chunks = index.sphere_query_chunks(center, radius, fields="id", chunk_size=chunk_size)
+    actual = np.concatenate(list(chunks))
+    assert np.all(np.sort(actual) == np.sort(expected))
+
+    chunks = index.box_query_chunks(3 * [2.0], 3 * [3.0], chunk_size=chunk_size)
+    assert list(chunks) == []
+
+
+def test_concurrent_readers():
+    n_elements = 10000
+    n_queries = 200
+
+    centroids = np.random.uniform(size=(n_elements, 3))
+    radii = np.random.uniform(0.0, 0.01, size=n_elements)
+    ids = np.arange(n_elements)
+
+    index = brain_indexer.SphereIndexBuilder.from_numpy(centroids, radii, ids)
+
+    corners = np.random.uniform(size=(n_queries, 3))
+    opposite_corners = np.random.uniform(size=(n_queries, 3))
+
+    def query(i):
+        return index.box_query(corners[i], opposite_corners[i], fields="id")
+
+    expected = [query(i) for i in range(n_queries)]
+
+    with ThreadPoolExecutor(max_workers=4) as executor:
+        actual = list(executor.map(query, 4 * list(range(n_queries))))
+
+    for i, found in enumerate(actual):
+        assert np.all(np.sort(found) == np.sort(expected[i % n_queries]))
@@ -447,6 +447,99 @@ def test_index_api(element_type, index_variant, accuracy, population_mode):
     check_all_index_api(index, window, sphere, accuracy, population_mode)
 
 
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+@pytest.mark.long
+@pytest.mark.parametrize(
+    "element_type,eviction_policy",
+    itertools.product(
+        ["synapse", "morphology"],
+        ["usage_rate", "lru", "lfu", "clock", "arc"],
+    )
+)
+def test_multi_index_eviction_policy(element_type, eviction_policy):
+    _, window, sphere = circuit_10_config("multi_index", element_type)
+
+    data_dir = CIRCUIT_1K_DIR if element_type == "synapse" else CIRCUIT_10_DIR
+    index_path = os.path.join(data_dir, f"indexes/{element_type}/multi_index")
+    index = open_index(index_path, max_cache_size_mb=1, eviction_policy=eviction_policy)
+
+    check_all_index_api(index, window, sphere, accuracy=None, population_mode=None)
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+@pytest.mark.parametrize("element_type", ["synapse", "morphology"])
+def test_multi_index_shared_cache(element_type):
+    _, window, sphere = circuit_10_config("multi_index", element_type)
+
+    data_dir = CIRCUIT_1K_DIR if element_type == "synapse" else CIRCUIT_10_DIR
+    index_path = os.path.join(data_dir, f"indexes/{element_type}/multi_index")
+
+    # The second index maps the subtrees loaded by the first one.
+    index = open_index(index_path, max_cache_size_mb=1, shared_cache_size_mb=16)
+    other_index = open_index(index_path, max_cache_size_mb=1, shared_cache_size_mb=16)
+
+    check_all_index_api(index, window, sphere, accuracy=None, population_mode=None)
+    check_all_index_api(other_index, window, sphere, accuracy=None, population_mode=None)
+
+    # Both are wrapped like private multi-indexes, e.g. they provide statistics
+    # and preloading.
+    Index = brain_indexer.IndexResolver.index_class(
+        element_type, "shared_memory_multi_index"
+    )
+    assert isinstance(index, Index)
+    assert isinstance(other_index, Index)
+
+    index.box_preload(*window, wait=True)
+    index.reset_stats()
+    index.box_query(*window)
+    assert index.stats()["n_queries"] == 1
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+def test_multi_index_stats():
+    index_path = os.path.join(CIRCUIT_10_DIR, "indexes/morphology/multi_index")
+    index = open_index(index_path, max_cache_size_mb=1)
+
+    index.box_query([-1e6, -1e6, -1e6], [1e6, 1e6, 1e6])
+    stats = index.stats()
+    assert stats["n_queries"] == 1
+    assert stats["n_misses"] > 0
+    assert stats["n_elements_returned"] == len(index)
+    assert sum(stats["load_latency_histogram"]) == stats["n_misses"]
+
+    index.reset_stats()
+    assert index.stats()["n_queries"] == 0
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+def test_multi_index_preload():
+    index_path = os.path.join(CIRCUIT_10_DIR, "indexes/morphology/multi_index")
+    index = open_index(index_path, max_cache_size_mb=1000)
+
+    min_corner, max_corner = index.bounds()
+    assert index.box_preload(min_corner, max_corner, pin=True, wait=True) > 0
+
+    # All subtrees are in cache.
+    index.reset_stats()
+    index.box_query(min_corner, max_corner)
+    assert index.stats()["n_misses"] == 0
+
+    index.unpin_all()
+    assert index.warm_up(wait=True) > 0
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+def test_multi_index_invalid_eviction_policy():
+    index_path = os.path.join(CIRCUIT_10_DIR, "indexes/morphology/multi_index")
+    with pytest.raises(ValueError):
+        open_index(index_path, eviction_policy="fifo")
+
+
 @pytest.mark.parametrize(
     "element_type,index_variant,accuracy,population_mode",
     itertools.product(
@@ -533,6 +626,26 @@ def test_index_write_sonata_api(element_type, index_variant):
         assert fake_population in extended_conf.value("population")
 
 
+def test_index_write_memory_mapped_api():
+    centroids = np.random.uniform(-10.0, 10.0, size=(100, 3)).astype(np.float32)
+    radii = np.random.uniform(0.1, 1.0, size=100).astype(np.float32)
+    index = brain_indexer.SphereIndexBuilder.from_numpy(centroids, radii)
+
+    with tempfile.TemporaryDirectory(prefix="api_write_test") as d:
+        index_path = os.path.join(d, "foo")
+
+        index.write(index_path, memory_mapped=True)
+        loaded_index = brain_indexer.open_index(index_path)
+
+        assert isinstance(loaded_index, brain_indexer.SphereMemoryMappedIndex)
+        assert len(loaded_index) == len(index)
+
+        window = np.array([[-5.0, -5.0, -5.0], [5.0, 5.0, 5.0]], dtype=np.float32)
+        expected = np.sort(index.box_query(*window, fields="id"))
+        actual = np.sort(loaded_index.box_query(*window, fields="id"))
+        np.testing.assert_array_equal(actual, expected)
+
+
 def test_index_insert():
     radius_cases = [1.0, [0.2, 0.4]]
     centroid_cases = [[1.0, 2.0, 3.0], [[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]]]
@@ -9,7 +9,7 @@ import sys
 import pytest
 
 from brain_indexer import core
-from brain_indexer import MorphIndex, SectionType
+from brain_indexer import MorphIndex, MorphBlockIndex, SectionType
 
 # Add this dir to path so we can import the other tests
 sys.path.append(os.path.abspath(os.path.dirname(__file__)))
@@ -32,6 +32,19 @@ def test_morphos_insert():
         assert idx[0] == (i // 4) and idx[1] == (i % 4), "i={}, idx={} ".format(i, idx)
 
 
+def test_find_nearest_exact():
+    """The bounding box of a long oblique segment contains points far from it."""
+    t = core.MorphIndex()
+    t._insert(0, 1, 0, [0, 0, 0], [10, 10, 0], 0.1, SectionType.undefined)
+    t._insert(1, 1, 0, [8, 4, 0], [9, 4, 0], 0.1, SectionType.undefined)
+
+    assert t._find_nearest([8, 2, 0], 1)[0][0] == 0
+
+    ids, distances = t._find_nearest_exact([8, 2, 0], 2)
+    assert [idx[0] for idx in ids] == [1, 0]
+    np.testing.assert_allclose(distances, [1.9, 6.0 / np.sqrt(2.0) - 0.1], rtol=1e-5)
+
+
 def test_bulk_single_segments_no_soma():
     """
     Adding a neuron with one segment per section
@@ -215,6 +228,38 @@ def test_endpoints_retrieval():
     np.testing.assert_allclose(idx[1].endpoints, array_expect)
 
 
+def test_numpy_fields_retrieval():
+    points = [
+        [1, 3, 5],
+        [2, 4, 6],
+        [2, 4, 6],
+        [10, 10, 10]
+    ]
+    radius = [3, 2, 2, 1]
+    offsets = [0, 2]
+    n_points = len(points)
+    types = np.full(n_points, SectionType.undefined)
+    rtree = core.MorphIndex()
+    rtree._add_neuron(1, points, radius, offsets, types)
+
+    index = MorphIndex(rtree)
+    results = index.box_query([-50, -50, -50], [50, 50, 50])
+
+    i = np.argsort(results["section_id"])
+    np.testing.assert_allclose(
+        results["centroid"][i], [[1, 3, 5], [1.5, 3.5, 5.5], [6, 7, 8]]
+    )
+    np.testing.assert_allclose(results["endpoints"][0][i[1:]], [[1, 3, 5], [2, 4, 6]])
+    np.testing.assert_allclose(
+        results["endpoints"][1][i[1:]], [[2, 4, 6], [10, 10, 10]]
+    )
+    np.testing.assert_array_equal(results["is_soma"][i], [True, False, False])
+
+    ids = results["ids"]
+    for field in ["gid", "section_id", "segment_id"]:
+        np.testing.assert_array_equal(ids[field], results[field])
+
+
 def test_section_type_retrieval():
     # This test creates a small artificial circuit
     # with one soma and three sections with
@@ -262,6 +307,32 @@ def test_section_type_retrieval():
         assert np.all(expected == actual)
 
 
+def test_block_index_matches_morph_index():
+    n_neurons, n_points = 20, 50
+    rtree = core.MorphIndex()
+    for gid in range(n_neurons):
+        points = np.cumsum(np.random.uniform(-1.0, 1.0, size=(n_points, 3)), axis=0)
+        radii = np.random.uniform(0.1, 0.5, size=n_points)
+        offsets = [1, 20]
+        types = [SectionType.axon, SectionType.basal_dendrite]
+        rtree._add_neuron(gid, points.astype(np.float32), radii.astype(np.float32),
+                          offsets, types)
+
+    index = MorphIndex(rtree)
+    block_index = MorphBlockIndex.from_morph_index(index)
+    assert len(block_index) == len(index)
+
+    min_corner, max_corner = [-3.0, -3.0, -3.0], [3.0, 3.0, 3.0]
+    for accuracy in ["bounding_box", "best_effort"]:
+        expected = index.box_query(min_corner, max_corner, accuracy=accuracy)
+        actual = block_index.box_query(min_corner, max_corner, accuracy=accuracy)
+
+        i = np.lexsort((expected["segment_id"], expected["section_id"], expected["gid"]))
+        j = np.lexsort((actual["segment_id"], actual["section_id"], actual["gid"]))
+        for field in ["gid", "section_id", "segment_id", "section_type", "radius"]:
+            np.testing.assert_array_equal(actual[field][j], expected[field][i])
+
+
 @pytest.mark.parametrize(
     "points, radius, offsets",
     [
@@ -283,3 +283,18 @@ def test_nearest_random():
             pass
 
     assert n_success >= 2
+
+
+def test_parallel_bulk_loading():
+    n_spheres = 5000
+    centroids = np.random.uniform(-100.0, 100.0, size=(n_spheres, 3)).astype(np.float32)
+    radii = np.random.uniform(0.1, 2.0, size=n_spheres).astype(np.float32)
+    ids = np.arange(n_spheres, dtype=np.int64)
+
+    expected = SphereIndexBuilder.from_numpy(centroids, radii, ids)
+    for n_threads in [0, 2, 5]:
+        index = SphereIndexBuilder.from_numpy(centroids, radii, ids, n_threads=n_threads)
+
+        # Same tree, hence the same elements in the same order.
+        assert np.all(index.box_query(*expected.bounds(), fields="id")
+                      == expected.box_query(*expected.bounds(), fields="id"))